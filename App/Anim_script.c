@@ -0,0 +1,149 @@
+#include <string.h>
+#include "Anim_script.h"
+
+// Operand bytes of every opcode, indexed by the opcode
+static const uint8_t anim_operands[] = {
+  0,  // END
+  1,  // GLYPH
+  1,  // COLOR
+  2,  // POS
+  2,  // MOVE
+  2,  // WAIT
+  1,  // LOOP
+  0,  // NEXT
+  3,  // FADE
+  3,  // BLINK
+};
+
+//------------------------------------------------------------------------------
+// Begin a script at now_ms: red, visible, top-left corner, no glyph shown yet
+//------------------------------------------------------------------------------
+void Anim_script_start(T_anim_player *pl, uint32_t now_ms)
+{
+  memset(pl, 0, sizeof(*pl));
+  pl->state   = ANIM_RUNNING;
+  pl->colors  = 0x01;
+  pl->visible = 1;
+  pl->glyph   = 0xFF;
+  pl->wake_ms = now_ms;
+}
+
+//------------------------------------------------------------------------------
+// Stop the player, with ANIM_ERROR on a malformed script
+//------------------------------------------------------------------------------
+static uint32_t Anim_stop(T_anim_player *pl, uint32_t state, uint32_t evt)
+{
+  pl->state = (uint8_t)state;
+  return evt | ANIM_EVT_END;
+}
+
+//------------------------------------------------------------------------------
+// Execute the script of size bytes from the current position until it must wait
+// Returns ANIM_EVT_xxx flags of what changed
+//------------------------------------------------------------------------------
+uint32_t Anim_script_run(T_anim_player *pl, const uint8_t *code, uint32_t size, uint32_t now_ms)
+{
+  const uint8_t *op;
+  uint32_t       evt    = 0;
+  uint32_t       budget = ANIM_RUN_BUDGET;
+  uint32_t       n;
+
+  while ((pl->state == ANIM_RUNNING) && ((int32_t)(now_ms - pl->wake_ms) >= 0))
+  {
+    // An unfinished BLINK toggles the sprite before the script goes on
+    if (pl->blink_cnt != 0)
+    {
+      pl->blink_cnt--;
+      pl->visible ^= 1;
+      pl->wake_ms += pl->blink_ms;
+      evt         |= ANIM_EVT_SPRITE;
+      continue;
+    }
+
+    if (budget-- == 0)
+    {
+      break;
+    }
+    if (pl->pc >= size)
+    {
+      return Anim_stop(pl, ANIM_ERROR, evt);
+    }
+    op = &code[pl->pc];
+    if ((op[0] >= sizeof(anim_operands)) || ((pl->pc + 1U + anim_operands[op[0]]) > size))
+    {
+      return Anim_stop(pl, ANIM_ERROR, evt);
+    }
+    pl->pc += 1 + anim_operands[op[0]];
+
+    switch (op[0])
+    {
+      case ANIM_OP_END:
+        pl->pc--;
+        return Anim_stop(pl, ANIM_IDLE, evt);
+
+      case ANIM_OP_GLYPH:
+        pl->glyph = op[1];
+        evt      |= ANIM_EVT_SPRITE;
+        break;
+
+      case ANIM_OP_COLOR:
+        pl->colors = op[1] & 0x03;
+        evt       |= ANIM_EVT_SPRITE;
+        break;
+
+      case ANIM_OP_POS:
+        pl->x  = (int8_t)op[1];
+        pl->y  = (int8_t)op[2];
+        evt   |= ANIM_EVT_SPRITE;
+        break;
+
+      case ANIM_OP_MOVE:
+        pl->x  = (int8_t)(pl->x + (int8_t)op[1]);
+        pl->y  = (int8_t)(pl->y + (int8_t)op[2]);
+        evt   |= ANIM_EVT_SPRITE;
+        break;
+
+      case ANIM_OP_WAIT:
+        pl->wake_ms += op[1] | ((uint32_t)op[2] << 8);
+        break;
+
+      case ANIM_OP_LOOP:
+        if (pl->sp >= ANIM_LOOP_DEPTH)
+        {
+          return Anim_stop(pl, ANIM_ERROR, evt);
+        }
+        pl->loop_pc[pl->sp]  = pl->pc;
+        pl->loop_cnt[pl->sp] = op[1];
+        pl->sp++;
+        break;
+
+      case ANIM_OP_NEXT:
+        if (pl->sp == 0)
+        {
+          return Anim_stop(pl, ANIM_ERROR, evt);
+        }
+        n = pl->loop_cnt[pl->sp - 1];
+        if ((n == 0) || (--pl->loop_cnt[pl->sp - 1] != 0))
+        {
+          pl->pc = pl->loop_pc[pl->sp - 1];
+        }
+        else
+        {
+          pl->sp--;
+        }
+        break;
+
+      case ANIM_OP_FADE:
+        pl->fade_level = op[1];
+        pl->fade_ms    = (uint16_t)(op[2] | (op[3] << 8));
+        evt           |= ANIM_EVT_FADE;
+        break;
+
+      case ANIM_OP_BLINK:
+        pl->blink_cnt = (uint16_t)(2U * op[1]);
+        pl->blink_ms  = (uint16_t)(op[2] | (op[3] << 8));
+        break;
+    }
+  }
+  return evt;
+}
@@ -0,0 +1,85 @@
+#ifndef __ANIM_SCRIPT_H
+#define __ANIM_SCRIPT_H
+
+#include <stdint.h>
+
+// Keyframe animation bytecode played on the node, free of HAL and OS calls.
+// A player drives one sprite: each call of Anim_script_run() executes instructions until a wait,
+// the end of the script or ANIM_RUN_BUDGET instructions, and reports what the driver must apply.
+// Waits accumulate from the start time, so players started at the same display time stay in step.
+//
+// Instruction set, operands follow the opcode byte, 16-bit operands low byte first:
+//   END                 stop, the sprite keeps its last picture
+//   GLYPH  sym          show symbol sym
+//   COLOR  c            colours: bit 0 red, bit 1 green
+//   POS    x y          place the top-left corner, signed
+//   MOVE   dx dy        move by dx, dy, signed
+//   WAIT   ms16         pause
+//   LOOP   n            repeat the block up to NEXT n times, 0 - forever; loops nest ANIM_LOOP_DEPTH deep
+//   NEXT                end of a LOOP block
+//   FADE   level ms16   ramp the display brightness to level 0..255 within ms16, does not wait
+//   BLINK  n ms16       hide and show the sprite n times, ms16 per half period
+//
+// The ANIM_xxx macros below assemble scripts in C source, e.g.
+//   static const uint8_t s[] = { ANIM_GLYPH(5), ANIM_LOOP(0), ANIM_MOVE(1, 0), ANIM_WAIT(100), ANIM_NEXT(), ANIM_END() };
+
+#define ANIM_OP_END   0x00
+#define ANIM_OP_GLYPH 0x01
+#define ANIM_OP_COLOR 0x02
+#define ANIM_OP_POS   0x03
+#define ANIM_OP_MOVE  0x04
+#define ANIM_OP_WAIT  0x05
+#define ANIM_OP_LOOP  0x06
+#define ANIM_OP_NEXT  0x07
+#define ANIM_OP_FADE  0x08
+#define ANIM_OP_BLINK 0x09
+
+#define ANIM_END()              ANIM_OP_END
+#define ANIM_GLYPH(sym)         ANIM_OP_GLYPH, (uint8_t)(sym)
+#define ANIM_COLOR(c)           ANIM_OP_COLOR, (uint8_t)(c)
+#define ANIM_POS(x, y)          ANIM_OP_POS, (uint8_t)(x), (uint8_t)(y)
+#define ANIM_MOVE(dx, dy)       ANIM_OP_MOVE, (uint8_t)(dx), (uint8_t)(dy)
+#define ANIM_WAIT(ms)           ANIM_OP_WAIT, (uint8_t)(ms), (uint8_t)((ms) >> 8)
+#define ANIM_LOOP(n)            ANIM_OP_LOOP, (uint8_t)(n)
+#define ANIM_NEXT()             ANIM_OP_NEXT
+#define ANIM_FADE(level, ms)    ANIM_OP_FADE, (uint8_t)(level), (uint8_t)(ms), (uint8_t)((ms) >> 8)
+#define ANIM_BLINK(n, half_ms)  ANIM_OP_BLINK, (uint8_t)(n), (uint8_t)(half_ms), (uint8_t)((half_ms) >> 8)
+
+#define ANIM_LOOP_DEPTH 2
+#define ANIM_RUN_BUDGET 32  // Instructions per call, a loop without WAIT cannot hang the caller
+
+// Results of Anim_script_run()
+#define ANIM_EVT_SPRITE 0x01u  // glyph, colors, x, y or visible changed
+#define ANIM_EVT_FADE   0x02u  // fade_level and fade_ms hold a new brightness ramp
+#define ANIM_EVT_END    0x04u  // Script finished or stopped on an error
+
+typedef enum
+{
+  ANIM_IDLE = 0,
+  ANIM_RUNNING,
+  ANIM_ERROR  // Unknown opcode, truncated operand, loop nesting or NEXT without LOOP
+} T_anim_state;
+
+typedef struct
+{
+  uint8_t  state;                      // T_anim_state
+  uint8_t  pc;                         // Offset of the next instruction
+  uint8_t  sp;                         // Open loops
+  uint8_t  loop_pc[ANIM_LOOP_DEPTH];   // First instruction of each open loop
+  uint8_t  loop_cnt[ANIM_LOOP_DEPTH];  // Passes left, 0 - forever
+  uint8_t  glyph;
+  uint8_t  colors;
+  uint8_t  visible;
+  int8_t   x;
+  int8_t   y;
+  uint16_t blink_cnt;                  // Visibility toggles left of the current BLINK
+  uint16_t blink_ms;
+  uint8_t  fade_level;
+  uint16_t fade_ms;
+  uint32_t wake_ms;                    // Time the script continues
+} T_anim_player;
+
+void     Anim_script_start(T_anim_player *pl, uint32_t now_ms);
+uint32_t Anim_script_run(T_anim_player *pl, const uint8_t *code, uint32_t size, uint32_t now_ms);
+
+#endif
@@ -5,8 +5,31 @@ T_app_vars app_vars;
 
 /* Флаг для отладки - включение отправки цифр */
 volatile uint32_t can_debug_send_digits = 0;
+volatile uint32_t time_sync_master      = 0;
 static void       SendDigitViaCAN(uint32_t tick_counter);
+static void       SendTimeSyncBeacon(uint32_t tick_counter);
+static void       PollNodeAddr(uint32_t tick_counter);
+static void       RunAnimScripts(void);
+static void       StageSymbolRows(const uint8_t *data, uint32_t row);
+static void       WriteSymbolUploads(uint32_t tick_counter);
+static void       WriteGlyphUpload(void);
+static void       SendGlyphAnswer(T_can_msg *can_msg, uint8_t cmd, uint8_t id, uint32_t status, uint32_t flags);
 static void       AddCANStatusIndicator(uint8_t *green_data, uint8_t *red_data);
+
+static T_time_sync       time_sync;          // Display clock, disciplined by PDISPLx_TIME_SYNC
+static volatile uint32_t time_sync_tx_cyc;   // DWT->CYCCNT when our last beacon left the mailbox
+static volatile uint8_t  time_sync_tx_seq;   // Number of that beacon
+static volatile uint8_t  time_sync_tx_done;  // time_sync_tx_cyc is valid
+
+static uint8_t       anim_scripts[ANIM_SCRIPT_SLOTS][ANIM_SCRIPT_SIZE];  // Loaded by PDISPLx_SCRIPT_LOAD
+static T_anim_player anim_players[ANIM_SCRIPT_SLOTS];
+static uint8_t       anim_sprite[ANIM_SCRIPT_SLOTS];  // Sprite driven by the player of each slot
+static uint8_t       anim_mode[ANIM_SCRIPT_SLOTS];    // Blend mode in bits 2-3 and z-order in bits 4-7
+
+// Uploaded glyphs waiting to be written to flash; the CANRx stack is too small for flash programming
+static T_symbol_upload symbol_uploads[SYMBOL_UPLOAD_QUEUE];
+static uint8_t         symbol_upload_cnt;
+static T_glyph_upload  glyph_upload;  // Transaction of PDISPLx_GLYPH_BEGIN/DATA/COMMIT
 /*-----------------------------------------------------------------------------------------------------
   Function for drawing horizontal line in symbol_data buffer
 -----------------------------------------------------------------------------------------------------*/
@@ -34,9 +57,13 @@ static void HandleDisplayIdleMode(uint32_t tick_counter)
   uint32_t erase_time    = configTICK_RATE_HZ / 2;            // 0.5 sec for erasing
   // Get current symbol data
   uint32_t symbol_code   = remap_array[symbol_index].to_sym;
-  uint32_t remapped_code = Remap_sym_code(symbol_code);
+  const uint8_t *symbol  = Symbol_get(Remap_sym_code(symbol_code));
   uint8_t  green_data[8];  // Buffer for green color
   uint8_t  red_data[8];    // Buffer for red color
+  if (symbol == NULL)
+  {
+    return;
+  }
   if (cycle_pos < draw_time)
   {
     // Phase 1 (first 0.5 seconds): green line draws symbol
@@ -50,7 +77,7 @@ static void HandleDisplayIdleMode(uint32_t tick_counter)
       if (pos >= 8 || i >= (7 - pos))
       {
         // On line and below - show already drawn part of symbol in green
-        green_data[i] = Symbols[remapped_code][i];
+        green_data[i] = symbol[i];
       }
       else
       {
@@ -81,7 +108,7 @@ static void HandleDisplayIdleMode(uint32_t tick_counter)
   {  // Phase 2 (next 1 second): symbol is fully displayed in green
     for (uint32_t i = 0; i < 8; i++)
     {
-      green_data[i] = Symbols[remapped_code][i];
+      green_data[i] = symbol[i];
       red_data[i]   = 0;  // Red buffer empty
     }
 
@@ -110,7 +137,7 @@ static void HandleDisplayIdleMode(uint32_t tick_counter)
       if (i < line_row)
       {
         // Above line - show remaining part of symbol in green
-        green_data[i] = Symbols[remapped_code][i];
+        green_data[i] = symbol[i];
       }
       else
       {
@@ -186,7 +213,15 @@ static void AddCANStatusIndicator(uint8_t *green_data, uint8_t *red_data)
  ------------------------------------------------------------------------------*/
 void Main_cycle(void)
 {
-  uint32_t tick_counter;  // Counter for timing calculations
+  uint32_t tick_counter;  // OS tick of the last pass of the per-tick work
+  uint32_t now;
+
+  // Display clock runs on the local clock until the first time beacons arrive
+  Local_clock_init();
+  Time_sync_init(&time_sync);
+
+  // Пользовательские символы из flash, до запуска задачи приема CAN
+  Symbols_init();
 
   app_vars.node_addr = GPIOA->IDR & 0x03;
   if (app_vars.node_addr == 3) can_debug_send_digits = 1;
@@ -215,26 +250,54 @@ void Main_cycle(void)
   vTaskDelay(pdMS_TO_TICKS(10));
 
   Display_set_symbol(12, 2);  // Display initial symbol
+  Display_init();             // Start timer/DMA driven row scan
 
-  tick_counter      = 0;
+  tick_counter      = xTaskGetTickCount() - 1;
   display_idle_mode = 1;
 
   while (1)
   {
-    IWDG->KR = 0xAAAA;  // Reset IWDG watchdog
+    // Работа раз в тик ОС; между тиками цикл проходит еще и после каждой смены страницы развертки
+    now = xTaskGetTickCount();
+    if (now != tick_counter)
+    {
+      tick_counter = now;
 
-    tick_counter++;
+      IWDG->KR = 0xAAAA;  // Reset IWDG watchdog
 
-    if (display_idle_mode)
-    {
-      HandleDisplayIdleMode(tick_counter);
-    }
+      if (display_idle_mode)
+      {
+        // Demo runs on the display clock so that all boards show the same phase
+        HandleDisplayIdleMode(App_display_clock_us() / (1000000 / configTICK_RATE_HZ));
+      }
+
+      // Вызов функции отправки цифр по CAN (работает только если установлен флаг через отладчик)
+      SendDigitViaCAN(tick_counter);
+
+      // Рассылка меток времени, если плата назначена мастером времени
+      SendTimeSyncBeacon(tick_counter);
 
-    // Вызов функции отправки цифр по CAN (работает только если установлен флаг через отладчик)
-    SendDigitViaCAN(tick_counter);
+      // Отслеживание адресных перемычек для смены адреса узла без перезапуска
+      PollNodeAddr(tick_counter);
 
+      // Проигрывание сценариев анимации
+      RunAnimScripts();
+
+      // Запись загруженных символов во flash
+      WriteSymbolUploads(tick_counter);
+      WriteGlyphUpload();
+
+      // Скорости потоков CAN и занятость шины пересчитываются раз в секунду
+      CAN_update_load_stats();
+
+      Display_tick();
+    }
+
+    // Кадровый этап: анимация, наложение спрайтов и сборка заднего буфера
     Display_state_machine();
-    vTaskDelay(1);  // Execute every OS tick instead of every 10ms
+
+    // Ждем следующего тика или уведомления Display_event_isr об освобождении заднего буфера
+    ulTaskNotifyTake(pdTRUE, 1);
   }
 }
 
@@ -243,6 +306,9 @@ void Main_cycle(void)
 /* Temporary storage for multi-part dynamic symbol configuration */
 T_din_symbol tmp_dsym;
 
+/* Staging of two-colour frames sent as a transaction */
+T_frame_stage frame_stage;
+
 /*-----------------------------------------------------------------------------------------------------
  * Function: Handle_CAN_SetSymbol
  *
@@ -271,7 +337,7 @@ void Handle_CAN_SetSymbol(const uint8_t *data)
  * Function: Handle_CAN_SetSymbolPattern1
  *
  * Description: Обрабатывает команду PDISPLx_SET_SYMBOL_PTRN1 - загрузка первой части паттерна символа
- *              Копирует первые 4 байта растрового изображения символа
+ *              Ставит первые 4 строки растрового изображения символа в очередь записи во flash
  *
  * Input:       data - массив данных CAN сообщения
  *              data[1] - номер символа для редактирования (0-255)
@@ -283,17 +349,18 @@ void Handle_CAN_SetSymbol(const uint8_t *data)
  *
  * Note:        Символ состоит из 8 байт (8x8 пикселей), эта функция загружает строки 0-3
  *              Для полной загрузки символа требуется также вызов Handle_CAN_SetSymbolPattern2
+ *              Загруженный символ сохраняется после сброса и заменяет встроенный символ с тем же номером
  *-----------------------------------------------------------------------------------------------------*/
 void Handle_CAN_SetSymbolPattern1(const uint8_t *data)
 {
-  memcpy(&Symbols[data[1]][0], &data[4], 4);
+  StageSymbolRows(data, 0);
 }
 
 /*-----------------------------------------------------------------------------------------------------
  * Function: Handle_CAN_SetSymbolPattern2
  *
  * Description: Обрабатывает команду PDISPLx_SET_SYMBOL_PTRН2 - загрузка второй части паттерна символа
- *              Копирует последние 4 байта растрового изображения символа
+ *              Ставит последние 4 строки растрового изображения символа в очередь записи во flash
  *
  * Input:       data - массив данных CAN сообщения
  *              data[1] - номер символа для редактирования (0-255)
@@ -308,7 +375,282 @@ void Handle_CAN_SetSymbolPattern1(const uint8_t *data)
  *-----------------------------------------------------------------------------------------------------*/
 void Handle_CAN_SetSymbolPattern2(const uint8_t *data)
 {
-  memcpy(&Symbols[data[1]][4], &data[4], 4);
+  StageSymbolRows(data, 4);
+}
+
+/*-----------------------------------------------------------------------------------------------------
+ * Function: StageSymbolRows
+ *
+ * Description: Добавляет 4 строки загружаемого символа в очередь записи во flash
+ *
+ * Input:       data - массив данных CAN сообщения
+ *              data[1] - номер символа (0-255)
+ *              data[4-7] - 4 строки растрового изображения
+ *              row - первая строка, 0 или 4
+ *
+ * Output:      Нет
+ *
+ * Called by:   - Handle_CAN_SetSymbolPattern1(), Handle_CAN_SetSymbolPattern2()
+ *
+ * Note:        Половины одного символа объединяются в одну запись очереди, недостающие строки
+ *              берутся из текущего изображения символа. При заполненной очереди загрузка отбрасывается
+ *              Запись ждет второй половины не дольше SYMBOL_UPLOAD_TIMEOUT_MS от прихода первой
+ *-----------------------------------------------------------------------------------------------------*/
+static void StageSymbolRows(const uint8_t *data, uint32_t row)
+{
+  const uint8_t *cur;
+  uint32_t       i;
+
+  taskENTER_CRITICAL();
+  for (i = 0; (i < symbol_upload_cnt) && (symbol_uploads[i].code != data[1]); i++)
+  {
+  }
+  if (i == symbol_upload_cnt)
+  {
+    if (i == SYMBOL_UPLOAD_QUEUE)
+    {
+      taskEXIT_CRITICAL();
+      return;
+    }
+    cur = Symbol_get(data[1]);
+    if (cur != NULL)
+    {
+      memcpy(symbol_uploads[i].rows, cur, 8);
+    }
+    else
+    {
+      memset(symbol_uploads[i].rows, 0, 8);
+    }
+    symbol_uploads[i].code   = data[1];
+    symbol_uploads[i].halves = 0;
+    symbol_uploads[i].tick   = xTaskGetTickCount();
+    symbol_upload_cnt++;
+  }
+  memcpy(&symbol_uploads[i].rows[row], &data[4], 4);
+  symbol_uploads[i].halves |= (row == 0) ? BIT(0) : BIT(1);
+  taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------------------------------------------------
+ * Function: WriteSymbolUploads
+ *
+ * Description: Записывает во flash первый готовый символ из очереди загрузки
+ *
+ * Input:       tick_counter - текущий тик Main_cycle()
+ *
+ * Output:      Нет
+ *
+ * Called by:   - Main_cycle() на каждом тике
+ *
+ * Note:        Символ готов, когда пришли обе половины или истекло SYMBOL_UPLOAD_TIMEOUT_MS.
+ *              Так каждая загрузка стоит одной записи во flash, а не двух, и пока обе половины
+ *              приходят вовремя, на экране не появляется символ из новой и старой половин
+ *              Если вторая половина не пришла за SYMBOL_UPLOAD_TIMEOUT_MS (100 мс), записывается
+ *              пришедшая половина, а недостающие строки берутся из прежнего изображения символа
+ *              Если за время записи пришла еще одна половина того же символа, запись очереди
+ *              остается и записывается повторно на следующем тике
+ *-----------------------------------------------------------------------------------------------------*/
+static void WriteSymbolUploads(uint32_t tick_counter)
+{
+  T_symbol_upload up;
+  uint32_t        i;
+
+  if (symbol_upload_cnt == 0)
+  {
+    return;
+  }
+  taskENTER_CRITICAL();
+  for (i = 0; i < symbol_upload_cnt; i++)
+  {
+    // Signed: a half stamped after tick_counter was read looks one tick early, not 49 days late
+    if ((symbol_uploads[i].halves == (BIT(0) | BIT(1))) || ((int32_t)(tick_counter - symbol_uploads[i].tick) >= (int32_t)pdMS_TO_TICKS(SYMBOL_UPLOAD_TIMEOUT_MS)))
+    {
+      break;
+    }
+  }
+  if (i < symbol_upload_cnt)
+  {
+    up = symbol_uploads[i];
+  }
+  taskEXIT_CRITICAL();
+  if (i == symbol_upload_cnt)
+  {
+    return;
+  }
+
+  Symbol_store(up.code, up.rows, 1);
+
+  // Entries only leave the queue here, so entry i still holds the same code
+  taskENTER_CRITICAL();
+  if (memcmp(symbol_uploads[i].rows, up.rows, 8) == 0)
+  {
+    symbol_upload_cnt--;
+    memmove(&symbol_uploads[i], &symbol_uploads[i + 1], (symbol_upload_cnt - i) * sizeof(T_symbol_upload));
+  }
+  taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------------------------------------------------
+ * Function: Handle_CAN_GlyphBegin
+ *
+ * Description: Обрабатывает команду PDISPLx_GLYPH_BEGIN - открытие транзакции загрузки символов
+ *
+ * Input:       data - массив данных CAN сообщения
+ *              data[1] - номер транзакции
+ *              data[2] - код первого символа
+ *              data[3] - количество символов 1..GLYPH_UPLOAD_MAX, коды идут подряд
+ *
+ * Output:      Нет
+ *
+ * Called by:   - Task_can_receiver() при получении команды PDISPLx_GLYPH_BEGIN
+ *
+ * Note:        Незавершенная транзакция отбрасывается. При ошибке посылается NACK
+ *-----------------------------------------------------------------------------------------------------*/
+void Handle_CAN_GlyphBegin(const uint8_t *data)
+{
+  static T_can_msg can_msg;  // Off the small CANRx task stack
+  uint32_t         res = Glyph_upload_begin(&glyph_upload, data[1], data[2], data[3]);
+
+  if (res != GLYPH_UPLOAD_OK)
+  {
+    SendGlyphAnswer(&can_msg, PDISPLx_GLYPH_BEGIN, data[1], res, 0);
+  }
+}
+
+/*-----------------------------------------------------------------------------------------------------
+ * Function: Handle_CAN_GlyphData
+ *
+ * Description: Обрабатывает команду PDISPLx_GLYPH_DATA - часть растровых данных транзакции
+ *
+ * Input:       data - массив данных CAN сообщения
+ *              data[1] - номер части, данные ложатся со смещения data[1] * GLYPH_UPLOAD_CHUNK
+ *              data[2-7] - 6 байт строк символов подряд, по 8 байт на символ
+ *
+ * Output:      Нет
+ *
+ * Called by:   - Task_can_receiver() при получении команды PDISPLx_GLYPH_DATA
+ *
+ * Note:        Ответ не посылается, мастер передает части подряд без ожидания
+ *              Ошибки сообщаются ответом на PDISPLx_GLYPH_COMMIT
+ *-----------------------------------------------------------------------------------------------------*/
+void Handle_CAN_GlyphData(const uint8_t *data)
+{
+  Glyph_upload_data(&glyph_upload, data[1], &data[2]);
+}
+
+/*-----------------------------------------------------------------------------------------------------
+ * Function: Handle_CAN_GlyphCommit
+ *
+ * Description: Обрабатывает команду PDISPLx_GLYPH_COMMIT - проверка и фиксация транзакции
+ *
+ * Input:       data - массив данных CAN сообщения
+ *              data[1] - номер транзакции
+ *              data[2-3] - CRC-16/CCITT-FALSE всех байт символов, младшим байтом вперед
+ *
+ * Output:      Нет
+ *
+ * Called by:   - Task_can_receiver() при получении команды PDISPLx_GLYPH_COMMIT
+ *
+ * Note:        Проверенная транзакция записывается во flash в Main_cycle(), после записи
+ *              посылается ACK. При ошибке транзакция отбрасывается и сразу посылается NACK
+ *-----------------------------------------------------------------------------------------------------*/
+void Handle_CAN_GlyphCommit(const uint8_t *data)
+{
+  static T_can_msg can_msg;  // Off the small CANRx task stack
+  uint32_t         res = Glyph_upload_commit(&glyph_upload, data[1], (uint16_t)(data[2] | (data[3] << 8)));
+
+  if (res != GLYPH_UPLOAD_OK)
+  {
+    SendGlyphAnswer(&can_msg, PDISPLx_GLYPH_COMMIT, data[1], res, 0);
+  }
+}
+
+/*-----------------------------------------------------------------------------------------------------
+ * Function: WriteGlyphUpload
+ *
+ * Description: Записывает во flash проверенную транзакцию загрузки символов и посылает ACK
+ *
+ * Input:       Нет
+ *
+ * Output:      Нет
+ *
+ * Called by:   - Main_cycle() на каждом тике
+ *
+ * Note:        Все символы транзакции становятся видны одновременно. Если новые коды не
+ *              помещаются в хранилище, не записывается ни один символ
+ *              При ошибке flash символы перед сбойным уже записаны - NACK GLYPH_UPLOAD_FLASH_ERROR
+ *              означает частично записанную транзакцию
+ *              Флаги ACK сообщают мастеру, что на время записи узел не принимал CAN:
+ *              было стирание страницы (около 20 мс) или кадры потерялись при переполнении FIFO
+ *-----------------------------------------------------------------------------------------------------*/
+static void WriteGlyphUpload(void)
+{
+  static T_can_msg            can_msg;
+  const T_symbol_flash_stats *fs = Symbol_get_flash_stats();
+  uint32_t                    erases;
+  uint32_t                    overruns;
+  uint32_t                    flags = 0;
+  uint32_t                    res;
+
+  if (glyph_upload.state != GLYPH_UPLOAD_COMMITTED)
+  {
+    return;
+  }
+  erases   = fs->erases;
+  overruns = fs->rx_overruns;
+  switch (Symbol_store(glyph_upload.first, glyph_upload.rows, glyph_upload.count))
+  {
+    case GLYPH_STORE_OK:
+      res = GLYPH_UPLOAD_OK;
+      break;
+    case GLYPH_STORE_FULL:
+      res = GLYPH_UPLOAD_STORE_FULL;
+      break;
+    default:
+      res = GLYPH_UPLOAD_FLASH_ERROR;
+      break;
+  }
+  if (fs->erases != erases)
+  {
+    flags |= PDISPLx_GLYPH_ANS_ERASED;
+  }
+  if (fs->rx_overruns != overruns)
+  {
+    flags |= PDISPLx_GLYPH_ANS_RX_LOST;
+  }
+  SendGlyphAnswer(&can_msg, PDISPLx_GLYPH_COMMIT, glyph_upload.id, res, flags);
+  Glyph_upload_done(&glyph_upload);
+}
+
+/*-----------------------------------------------------------------------------------------------------
+ * Function: SendGlyphAnswer
+ *
+ * Description: Посылает ответ на команду транзакции загрузки символов в PDISPLx_ANS
+ *
+ * Input:       can_msg - буфер посылки вызывающей задачи
+ *              cmd - команда, на которую дается ответ
+ *              id - номер транзакции из команды
+ *              status - 0 (ACK) или код ошибки GLYPH_UPLOAD_xxx (NACK)
+ *              flags - флаги PDISPLx_GLYPH_ANS_xxx записи во flash
+ *
+ * Output:      Нет
+ *
+ * Called by:   - Handle_CAN_GlyphBegin(), Handle_CAN_GlyphCommit(), WriteGlyphUpload()
+ *
+ * Note:        Формат ответа описан в CAN_IDs.h. Ответ передается с высшим приоритетом
+ *-----------------------------------------------------------------------------------------------------*/
+static void SendGlyphAnswer(T_can_msg *can_msg, uint8_t cmd, uint8_t id, uint32_t status, uint32_t flags)
+{
+  can_msg->format  = EXTENDED_FORMAT;
+  can_msg->type    = DATA_FRAME;
+  can_msg->id      = PDISPLx_ANS | (app_vars.node_addr << 20);
+  can_msg->len     = 8;
+  memset(can_msg->data, 0, 8);
+  can_msg->data[0] = cmd;
+  can_msg->data[1] = id;
+  can_msg->data[2] = (uint8_t)status;
+  can_msg->data[3] = (uint8_t)flags;
+  CAN_send_msg_prio(can_msg, CAN_TX_PRIO_HIGH, 10);
 }
 
 /*-----------------------------------------------------------------------------------------------------
@@ -424,10 +766,18 @@ void Handle_CAN_DynamicSymbolSet4(const uint8_t *data)
  * Note:        Функция отключает демо-режим дисплея (display_idle_mode = 0)
  *              Вызывает Display_copy_to_red_screen() для копирования данных
  *              Команда имеет отдельный CAN ID, отличный от PDISPLx_REQ
+ *              В режиме транзакций (после PDISPLx_FRAME_BEGIN) данные только сохраняются
+ *              в frame_stage и выводятся вместе с другим цветом по PDISPLx_FRAME_COMMIT
  *-----------------------------------------------------------------------------------------------------*/
 void Handle_CAN_SetRedScreen(const uint8_t *data)
 {
   extern uint32_t display_idle_mode;
+  if (frame_stage.active)
+  {
+    memcpy(frame_stage.red, data, 8);
+    frame_stage.received_mask |= FRAME_PLANE_RED;
+    return;
+  }
   display_idle_mode = 0;
   Display_copy_to_red_screen((uint8_t *)data);
 }
@@ -448,14 +798,705 @@ void Handle_CAN_SetRedScreen(const uint8_t *data)
  * Note:        Функция отключает демо-режим дисплея (display_idle_mode = 0)
  *              Вызывает Display_copy_to_green_screen() для копирования данных
  *              Команда имеет отдельный CAN ID, отличный от PDISPLx_REQ
+ *              В режиме транзакций (после PDISPLx_FRAME_BEGIN) данные только сохраняются
+ *              в frame_stage и выводятся вместе с другим цветом по PDISPLx_FRAME_COMMIT
  *-----------------------------------------------------------------------------------------------------*/
 void Handle_CAN_SetGreenScreen(const uint8_t *data)
 {
   extern uint32_t display_idle_mode;
+  if (frame_stage.active)
+  {
+    memcpy(frame_stage.green, data, 8);
+    frame_stage.received_mask |= FRAME_PLANE_GREEN;
+    return;
+  }
   display_idle_mode = 0;
   Display_copy_to_green_screen((uint8_t *)data);
 }
 
+/*-----------------------------------------------------------------------------------------------------
+ * Function: Handle_CAN_SetBrightness
+ *
+ * Description: Обрабатывает команду PDISPLx_SET_BRIGHTNESS - установка общей яркости дисплея
+ *              Яркость меняется плавно за указанное время
+ *
+ * Input:       data - массив данных CAN сообщения
+ *              data[1] - уровень яркости 0..255 (0 - погашен, 255 - полная яркость)
+ *              data[2-3] - время перехода в мс (16-бит, младший байт первый), 0 - сразу
+ *
+ * Output:      Нет
+ *
+ * Called by:   - Task_can_receiver() при получении команды PDISPLx_SET_BRIGHTNESS
+ *
+ * Note:        Режим idle дисплея не меняется - яркость действует и на демо-режим
+ *              Яркость задается длительностью низкого уровня BLANK в каждом слоте строки,
+ *              который формирует канал 4 таймера TIM2 без участия процессора
+ *-----------------------------------------------------------------------------------------------------*/
+void Handle_CAN_SetBrightness(const uint8_t *data)
+{
+  Display_set_brightness(data[1], data[2] | ((uint32_t)data[3] << 8));
+}
+
+/*-----------------------------------------------------------------------------------------------------
+ * Function: Handle_CAN_FrameBegin
+ *
+ * Description: Обрабатывает команду PDISPLx_FRAME_BEGIN - начало транзакции двухцветного кадра
+ *              Открывает новый кадр и сбрасывает принятые цвета
+ *
+ * Input:       data - массив данных CAN сообщения
+ *              data[1] - номер кадра
+ *              data[2] - маска ожидаемых цветов (FRAME_PLANE_RED | FRAME_PLANE_GREEN),
+ *                        0 - выход из режима транзакций
+ *
+ * Output:      Нет
+ *
+ * Called by:   - Task_can_receiver() при получении команды PDISPLx_FRAME_BEGIN
+ *
+ * Note:        Режим транзакций остается включенным и после PDISPLx_FRAME_COMMIT, поэтому
+ *              цвета, пришедшие после потерянного PDISPLx_FRAME_BEGIN, не попадут на дисплей
+ *              Незавершенный предыдущий кадр отбрасывается
+ *              Буферы кадра заполняются текущим изображением - к ним применяются посылки XOR дельт
+ *-----------------------------------------------------------------------------------------------------*/
+void Handle_CAN_FrameBegin(const uint8_t *data)
+{
+  if (frame_stage.open)
+  {
+    frame_stage.rejected_cnt++;
+  }
+  frame_stage.expected_mask = data[2] & (FRAME_PLANE_RED | FRAME_PLANE_GREEN);
+  frame_stage.active        = (frame_stage.expected_mask != 0);
+  frame_stage.open          = frame_stage.active;
+  frame_stage.seq           = data[1];
+  frame_stage.received_mask = 0;
+  // XOR deltas inside the transaction apply to the picture shown now
+  Display_get_screens(frame_stage.red, frame_stage.green);
+}
+
+/*-----------------------------------------------------------------------------------------------------
+ * Function: Handle_CAN_FrameCommit
+ *
+ * Description: Обрабатывает команду PDISPLx_FRAME_COMMIT - вывод накопленного двухцветного кадра
+ *              Оба цвета и яркость применяются вместе и появляются с начала следующего кадра развертки
+ *
+ * Input:       data - массив данных CAN сообщения
+ *              data[1] - номер кадра, должен совпадать с номером из PDISPLx_FRAME_BEGIN
+ *              data[2] - флаги (FRAME_FLAG_BRIGHT - в кадре есть яркость)
+ *              data[3] - уровень яркости 0..255
+ *              data[4-5] - время перехода яркости в мс (16-бит, младший байт первый)
+ *              data[6-7] - момент вывода при FRAME_FLAG_PRESENT_AT: младшие 16 бит
+ *                          времени отображения в единицах 64 мкс
+ *
+ * Output:      Нет
+ *
+ * Called by:   - Task_can_receiver() при получении команды PDISPLx_FRAME_COMMIT
+ *
+ * Note:        Если номер не совпал или пришли не все цвета из маски, кадр отбрасывается
+ *              и на дисплее остается предыдущий кадр
+ *              Не объявленный в маске цвет не меняется
+ *              Момент вывода берется ближайшим к текущему времени (+-2.1 с), прошедший момент
+ *              означает вывод сразу, а момент дальше FRAME_PRESENT_AHEAD_MAX_MS приближается к нему.
+ *              Кадр, пришедший до вывода предыдущего, заменяет его. Все платы с синхронными
+ *              часами меняют кадр вместе
+ *-----------------------------------------------------------------------------------------------------*/
+void Handle_CAN_FrameCommit(const uint8_t *data)
+{
+  extern uint32_t display_idle_mode;
+  uint32_t        now;
+  int32_t         ahead;
+  uint32_t        local_us;
+
+  if (!frame_stage.open || (frame_stage.seq != data[1]) || ((frame_stage.received_mask & frame_stage.expected_mask) != frame_stage.expected_mask))
+  {
+    frame_stage.open = 0;
+    frame_stage.rejected_cnt++;
+    return;
+  }
+  frame_stage.open  = 0;
+  display_idle_mode = 0;
+
+  // Planes, moment and brightness in one critical section: the frame stage builds them into
+  // one page, so the page flip of the scan engine shows all of them at once
+  taskENTER_CRITICAL();
+  if (frame_stage.expected_mask == (FRAME_PLANE_RED | FRAME_PLANE_GREEN))
+  {
+    Display_copy_frame(frame_stage.red, frame_stage.green);
+  }
+  else if (frame_stage.expected_mask & FRAME_PLANE_RED)
+  {
+    Display_copy_to_red_screen(frame_stage.red);
+  }
+  else
+  {
+    Display_copy_to_green_screen(frame_stage.green);
+  }
+  if (data[2] & FRAME_FLAG_PRESENT_AT)
+  {
+    now   = App_display_clock_us();
+    ahead = (int16_t)((data[6] | ((uint32_t)data[7] << 8)) - (now >> 6));
+    // A stale or garbled moment must not hold the frame stage for seconds
+    if (ahead > (FRAME_PRESENT_AHEAD_MAX_MS * 1000) / 64)
+    {
+      ahead = (FRAME_PRESENT_AHEAD_MAX_MS * 1000) / 64;
+    }
+    if (ahead > 0)
+    {
+      local_us = Time_sync_local_time(&time_sync, ((now >> 6) + ahead) << 6);
+      Display_present_at(Local_clock_us_to_cyc(local_us));
+    }
+  }
+  if (data[2] & FRAME_FLAG_BRIGHT)
+  {
+    Display_set_brightness(data[3], data[4] | ((uint32_t)data[5] << 8));
+  }
+  taskEXIT_CRITICAL();
+  frame_stage.committed_cnt++;
+}
+
+/*-----------------------------------------------------------------------------------------------------
+ * Function: Handle_CAN_XorRedScreen
+ *
+ * Description: Обрабатывает команду PDISPLx_XOR_RED - изменение красного экрана XOR дельтой
+ *              Меняются только строки, отмеченные в маске
+ *
+ * Input:       data - массив данных CAN сообщения
+ *              data[1] - маска измененных строк (бит r - строка r)
+ *              data[2..] - байты XOR для отмеченных строк по возрастанию номера строки (не более 6)
+ *
+ * Output:      Нет
+ *
+ * Called by:   - Task_can_receiver() при получении команды PDISPLx_XOR_RED
+ *
+ * Note:        Формат дельты и кодировщик для мастера - в Frame_delta.c
+ *              В режиме транзакций дельта применяется к кадру в frame_stage
+ *              Посылка с маской более чем из 6 строк или короче 2 + число строк маски
+ *              отбрасывается в Can_dispatch_msg()
+ *-----------------------------------------------------------------------------------------------------*/
+void Handle_CAN_XorRedScreen(const uint8_t *data)
+{
+  extern uint32_t display_idle_mode;
+  if (frame_stage.active)
+  {
+    if (Frame_delta_apply(frame_stage.red, &data[1]) > 0)
+    {
+      frame_stage.received_mask |= FRAME_PLANE_RED;
+    }
+    return;
+  }
+  if (Display_xor_red_screen(&data[1]) > 0)
+  {
+    display_idle_mode = 0;
+  }
+}
+
+/*-----------------------------------------------------------------------------------------------------
+ * Function: Handle_CAN_XorGreenScreen
+ *
+ * Description: Обрабатывает команду PDISPLx_XOR_GREEN - изменение зеленого экрана XOR дельтой
+ *              Меняются только строки, отмеченные в маске
+ *
+ * Input:       data - массив данных CAN сообщения
+ *              data[1] - маска измененных строк (бит r - строка r)
+ *              data[2..] - байты XOR для отмеченных строк по возрастанию номера строки (не более 6)
+ *
+ * Output:      Нет
+ *
+ * Called by:   - Task_can_receiver() при получении команды PDISPLx_XOR_GREEN
+ *
+ * Note:        Формат дельты и кодировщик для мастера - в Frame_delta.c
+ *              В режиме транзакций дельта применяется к кадру в frame_stage
+ *              Посылка с маской более чем из 6 строк или короче 2 + число строк маски
+ *              отбрасывается в Can_dispatch_msg()
+ *-----------------------------------------------------------------------------------------------------*/
+void Handle_CAN_XorGreenScreen(const uint8_t *data)
+{
+  extern uint32_t display_idle_mode;
+  if (frame_stage.active)
+  {
+    if (Frame_delta_apply(frame_stage.green, &data[1]) > 0)
+    {
+      frame_stage.received_mask |= FRAME_PLANE_GREEN;
+    }
+    return;
+  }
+  if (Display_xor_green_screen(&data[1]) > 0)
+  {
+    display_idle_mode = 0;
+  }
+}
+
+/*-----------------------------------------------------------------------------------------------------
+ * Function: Handle_CAN_SetGroups
+ *
+ * Description: Обрабатывает команду PDISPLx_SET_GROUPS - назначение групп рассылки платы
+ *
+ * Input:       data - массив данных CAN сообщения
+ *              data[1] - маска групп (бит g - группа с адресом PDISPLx_ADDR_GROUP0 + g)
+ *
+ * Output:      Нет
+ *
+ * Called by:   - Task_can_receiver() при получении команды PDISPLx_SET_GROUPS по адресу платы
+ *
+ * Note:        Фильтры приема перестраивает задача Task_can_transmiter
+ *-----------------------------------------------------------------------------------------------------*/
+void Handle_CAN_SetGroups(const uint8_t *data)
+{
+  CAN_set_node_groups(data[1] & ((1u << PDISPLx_GROUPS_NUM) - 1));
+}
+
+/*-----------------------------------------------------------------------------------------------------
+ * Function: App_display_clock_us
+ *
+ * Description: Возвращает время отображения - общее для всех плат на шине
+ *
+ * Input:       Нет
+ *
+ * Output:      Время отображения в мкс
+ *
+ * Called by:   - Main_cycle() для демонстрационного режима
+ *              - Display_state_machine() для шага анимации
+ *              - Handle_CAN_FrameCommit() для момента вывода кадра
+ *
+ * Note:        До первых меток PDISPLx_TIME_SYNC и на мастере времени совпадает с локальным временем
+ *-----------------------------------------------------------------------------------------------------*/
+uint32_t App_display_clock_us(void)
+{
+  uint32_t local_us = Local_clock_us();
+  uint32_t disp_us;
+
+  taskENTER_CRITICAL();
+  disp_us = Time_sync_display_time(&time_sync, local_us);
+  taskEXIT_CRITICAL();
+  return disp_us;
+}
+
+/*-----------------------------------------------------------------------------------------------------
+ * Function: Handle_CAN_TimeSync
+ *
+ * Description: Обрабатывает метку времени мастера PDISPLx_TIME_SYNC
+ *
+ * Input:       data - массив данных CAN сообщения
+ *              data[1] - номер метки
+ *              data[2-5] - время мастера в мкс в момент передачи метки с номером data[6]
+ *              data[6] - номер метки, к которой относится время
+ *              data[7] - флаги, бит 0 - время действительно
+ *              rx_cyc - значение DWT->CYCCNT в прерывании приема метки
+ *
+ * Output:      Нет
+ *
+ * Called by:   - Task_can_receiver() при получении команды PDISPLx_TIME_SYNC
+ *
+ * Note:        Синхронизация в два шага: мастер узнает момент передачи метки только после ее
+ *              отправки и сообщает его в следующей метке. Плата хранит момент приема последней
+ *              метки и подстраивает часы, когда номера совпали. Задержка очереди передачи мастера
+ *              и повторы после ошибок на точность не влияют
+ *-----------------------------------------------------------------------------------------------------*/
+void Handle_CAN_TimeSync(const uint8_t *data, uint32_t rx_cyc)
+{
+  static uint32_t last_rx_us;
+  static uint8_t  last_seq;
+  static uint8_t  last_valid;
+  uint32_t        master_us;
+
+  if (time_sync_master)
+  {
+    return;
+  }
+
+  master_us = data[2] | ((uint32_t)data[3] << 8) | ((uint32_t)data[4] << 16) | ((uint32_t)data[5] << 24);
+  if (last_valid && (data[7] & BIT(0)) && (data[6] == last_seq))
+  {
+    taskENTER_CRITICAL();
+    Time_sync_beacon(&time_sync, master_us, last_rx_us);
+    taskEXIT_CRITICAL();
+  }
+  last_rx_us = Local_clock_cyc_to_us(rx_cyc);
+  last_seq   = data[1];
+  last_valid = 1;
+}
+
+/*-----------------------------------------------------------------------------------------------------
+ * Function: Handle_CAN_TimeSyncSent
+ *
+ * Description: Запоминает момент окончания передачи собственной метки PDISPLx_TIME_SYNC
+ *
+ * Input:       seq - номер метки
+ *              tx_cyc - значение DWT->CYCCNT в прерывании завершения передачи
+ *
+ * Output:      Нет
+ *
+ * Called by:   - CAN_tx_mbox_complete() в прерывании CAN
+ *-----------------------------------------------------------------------------------------------------*/
+void Handle_CAN_TimeSyncSent(uint8_t seq, uint32_t tx_cyc)
+{
+  time_sync_tx_cyc  = tx_cyc;
+  time_sync_tx_seq  = seq;
+  time_sync_tx_done = 1;
+}
+
+/*-----------------------------------------------------------------------------------------------------
+ * Function: SendTimeSyncBeacon
+ *
+ * Description: Рассылает метку времени PDISPLx_TIME_SYNC каждые TIME_SYNC_PERIOD_MS
+ *              Функция работает только если через отладчик установлен флаг time_sync_master = 1
+ *
+ * Input:       tick_counter - счетчик тиков для отслеживания времени
+ *
+ * Output:      Нет
+ *
+ * Called by:   - Main_cycle() на каждом тике
+ *
+ * Note:        Метка несет момент передачи предыдущей отправленной метки
+ *              Передается с высшим приоритетом, чтобы поток кадров не задерживал синхронизацию
+ *-----------------------------------------------------------------------------------------------------*/
+static void SendTimeSyncBeacon(uint32_t tick_counter)
+{
+  static uint32_t last_send_time = 0;
+  static uint8_t  seq            = 0;
+  T_can_msg       can_msg;
+  uint32_t        tx_cyc;
+  uint32_t        master_us;
+
+  if (time_sync_master == 0)
+  {
+    return;
+  }
+  if ((tick_counter - last_send_time) < pdMS_TO_TICKS(TIME_SYNC_PERIOD_MS))
+  {
+    return;
+  }
+  last_send_time  = tick_counter;
+
+  can_msg.format  = EXTENDED_FORMAT;
+  can_msg.type    = DATA_FRAME;
+  can_msg.id      = PDISPLx_REQ | (PDISPLx_ADDR_BROADCAST << 20);
+  can_msg.len     = 8;
+  memset(can_msg.data, 0, 8);
+  can_msg.data[0] = PDISPLx_TIME_SYNC;
+  can_msg.data[1] = ++seq;
+
+  taskENTER_CRITICAL();
+  tx_cyc            = time_sync_tx_cyc;
+  can_msg.data[6]   = time_sync_tx_seq;
+  can_msg.data[7]   = time_sync_tx_done;
+  time_sync_tx_done = 0;  // Each transmission moment is reported once
+  taskEXIT_CRITICAL();
+  if (can_msg.data[7])
+  {
+    master_us       = Local_clock_cyc_to_us(tx_cyc);
+    master_us       = Time_sync_display_time(&time_sync, master_us);
+    can_msg.data[2] = (uint8_t)master_us;
+    can_msg.data[3] = (uint8_t)(master_us >> 8);
+    can_msg.data[4] = (uint8_t)(master_us >> 16);
+    can_msg.data[5] = (uint8_t)(master_us >> 24);
+  }
+
+  CAN_send_msg_prio(&can_msg, CAN_TX_PRIO_HIGH, 10);
+}
+
+/*-----------------------------------------------------------------------------------------------------
+ * Function: Put_u16_sat
+ *
+ * Description: Записывает значение в 2 байта (младший первый) с ограничением 0xFFFF
+ *-----------------------------------------------------------------------------------------------------*/
+static void Put_u16_sat(uint8_t *p, uint32_t v)
+{
+  if (v > 0xFFFF)
+  {
+    v = 0xFFFF;
+  }
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+}
+
+/*-----------------------------------------------------------------------------------------------------
+ * Function: Handle_CAN_ReadStats
+ *
+ * Description: Обрабатывает команду PDISPLx_READ_STATS - отвечает страницей статистики
+ *              загрузки шины и задержек посылкой PDISPLx_ANS
+ *
+ * Input:       data - массив данных CAN сообщения
+ *              data[1] - номер страницы (формат страниц описан в CAN_IDs.h)
+ *              data[2] - бит 0: после ответа сбросить гистограммы и максимумы
+ *
+ * Output:      Нет
+ *
+ * Called by:   - Task_can_receiver() при получении команды PDISPLx_READ_STATS
+ *
+ * Note:        На несуществующую страницу ответ не посылается
+ *              Ответ передается с высшим приоритетом
+ *-----------------------------------------------------------------------------------------------------*/
+void Handle_CAN_ReadStats(const uint8_t *data)
+{
+  extern osThreadId          defaultTaskHandle;
+  const T_can_load_stats    *ld = CAN_get_load_stats();
+  const T_can_tx_prio_stats *tx = CAN_get_tx_stats();
+  const T_can_bus_recovery  *br = CAN_get_bus_recovery();
+  const T_display_timing    *dt = Display_get_timing();
+  const uint32_t            *hist;
+  uint32_t                   max_us;
+  uint32_t                   page = data[1];
+  uint32_t                   drops;
+  uint32_t                   i;
+  uint32_t                   b;
+  static T_can_msg           can_msg;  // Off the small CANRx task stack
+
+  if (page >= PDISPLx_STATS_PAGES_NUM)
+  {
+    return;
+  }
+
+  can_msg.format  = EXTENDED_FORMAT;
+  can_msg.type    = DATA_FRAME;
+  can_msg.id      = PDISPLx_ANS | (app_vars.node_addr << 20);
+  can_msg.len     = 8;
+  memset(can_msg.data, 0, 8);
+  can_msg.data[0] = PDISPLx_READ_STATS;
+  can_msg.data[1] = (uint8_t)page;
+
+  switch (page)
+  {
+    case 0:
+      Put_u16_sat(&can_msg.data[2], ld->rx_fps);
+      Put_u16_sat(&can_msg.data[4], ld->tx_fps);
+      Put_u16_sat(&can_msg.data[6], ld->bus_load_pm);
+      break;
+
+    case 1:
+      Put_u16_sat(&can_msg.data[2], ld->rx_bps);
+      Put_u16_sat(&can_msg.data[4], ld->tx_bps);
+      can_msg.data[6] = (uint8_t)ld->rx_ring_high_water;
+      can_msg.data[7] = (uint8_t)CAN_get_pool_stats()->high_water;
+      break;
+
+    case 2:
+      memcpy(&can_msg.data[2], &ld->rx_frames, 4);
+      Put_u16_sat(&can_msg.data[6], CAN_get_error_stats()->rx_overflow_count);
+      break;
+
+    case 3:
+      drops = 0;
+      for (i = 0; i < CAN_TX_PRIO_NUM; i++)
+      {
+        drops += tx[i].drop_count;
+      }
+      memcpy(&can_msg.data[2], &ld->tx_frames, 4);
+      Put_u16_sat(&can_msg.data[6], drops);
+      break;
+
+    case 10:
+      can_msg.data[2] = br->state;
+      can_msg.data[3] = (uint8_t)((br->recover_count > 0xFF) ? 0xFF : br->recover_count);
+      Put_u16_sat(&can_msg.data[4], br->recover_last_ms);
+      Put_u16_sat(&can_msg.data[6], br->recover_max_ms);
+      break;
+
+    case 11:
+      if (dt->ticks_per_us != 0)  // Zero until Display_init() reads the TIM2 clock - times stay 0
+      {
+        Put_u16_sat(&can_msg.data[2], dt->latch_max * 1000U / dt->ticks_per_us);
+        Put_u16_sat(&can_msg.data[4], dt->isr_max * 1000U / dt->ticks_per_us);
+      }
+      Put_u16_sat(&can_msg.data[6], dt->latch_late);
+      break;
+
+    case 12:
+      Put_u16_sat(&can_msg.data[2], dt->compile_max_us);
+      memcpy(&can_msg.data[4], &dt->frames_compiled, 4);
+      break;
+
+    case 13:
+      // Least free stack seen since start, in words
+      Put_u16_sat(&can_msg.data[2], uxTaskGetStackHighWaterMark(xCanRxTaskHandle));
+      Put_u16_sat(&can_msg.data[4], uxTaskGetStackHighWaterMark(xCanTxTaskHandle));
+      Put_u16_sat(&can_msg.data[6], uxTaskGetStackHighWaterMark((TaskHandle_t)defaultTaskHandle));
+      break;
+
+    case 14:
+      Put_u16_sat(&can_msg.data[2], Symbol_get_flash_stats()->erases);
+      Put_u16_sat(&can_msg.data[4], Symbol_get_flash_stats()->stall_max_us);
+      Put_u16_sat(&can_msg.data[6], Symbol_get_flash_stats()->rx_overruns);
+      break;
+
+    default:
+      // Pages 4..6 and 7..9: 8 buckets and the maximum, three values per page
+      hist   = (page < 7) ? ld->rx_dispatch_hist : ld->cmd_display_hist;
+      max_us = (page < 7) ? ld->rx_dispatch_max_us : ld->cmd_display_max_us;
+      for (i = 0; i < 3; i++)
+      {
+        b = ((page - 4) % 3) * 3 + i;
+        Put_u16_sat(&can_msg.data[2 + 2 * i], (b < CAN_LAT_HIST_SIZE) ? hist[b] : max_us);
+      }
+      break;
+  }
+
+  CAN_send_msg_prio(&can_msg, CAN_TX_PRIO_HIGH, 10);
+
+  if (data[2] & BIT(0))
+  {
+    CAN_reset_load_stats();
+    Display_reset_timing();
+    Symbol_reset_stall_max();
+  }
+}
+
+/*-----------------------------------------------------------------------------------------------------
+ * Function: Handle_CAN_SetSprite
+ *
+ * Description: Обрабатывает команду PDISPLx_SET_SPRITE - установка или удаление спрайта
+ *
+ * Input:       data - массив данных CAN сообщения
+ *              data[1] - номер спрайта 0..SPRITE_POOL_SIZE-1
+ *              data[2] - код символа, несуществующий код удаляет спрайт
+ *              data[3] - биты 0-1 цвета, биты 2-3 режим наложения, биты 4-7 порядок по z
+ *              data[4], data[5] - координаты x, y левого верхнего угла со знаком
+ *              data[6] - биты 0-3 приращение x, биты 4-7 приращение y со знаком за один сдвиг
+ *              data[7] - шагов анимации на один сдвиг, 0 - спрайт неподвижен
+ *
+ * Output:      Нет
+ *
+ * Called by:   - Task_can_receiver() при получении команды PDISPLx_SET_SPRITE
+ *
+ * Note:        Спрайт накладывается на изображение экранов и не стирает его
+ *-----------------------------------------------------------------------------------------------------*/
+void Handle_CAN_SetSprite(const uint8_t *data)
+{
+  extern uint32_t display_idle_mode;
+  display_idle_mode = 0;
+  Display_set_sprite(data[1], data[2], (int8_t)data[4], (int8_t)data[5],
+                     data[3] & 0x03, (data[3] >> 2) & 0x03, data[3] >> 4,
+                     (int8_t)(data[6] << 4) >> 4, (int8_t)data[6] >> 4, data[7]);
+}
+
+/*-----------------------------------------------------------------------------------------------------
+ * Function: Handle_CAN_ScriptLoad
+ *
+ * Description: Обрабатывает команду PDISPLx_SCRIPT_LOAD - запись части сценария анимации в слот
+ *
+ * Input:       data - массив данных CAN сообщения
+ *              data[1] - номер слота 0..ANIM_SCRIPT_SLOTS-1
+ *              data[2] - смещение в слоте
+ *              data[3..7] - 5 байт сценария
+ *
+ * Output:      Нет
+ *
+ * Called by:   - Task_can_receiver() при получении команды PDISPLx_SCRIPT_LOAD
+ *
+ * Note:        Запись со смещением 0 останавливает проигрыватель слота, чтобы он не исполнял
+ *              сценарий, загруженный наполовину. Байты за концом слота отбрасываются
+ *-----------------------------------------------------------------------------------------------------*/
+void Handle_CAN_ScriptLoad(const uint8_t *data)
+{
+  uint32_t slot = data[1];
+  uint32_t offs = data[2];
+  uint32_t n    = 5;
+
+  if ((slot >= ANIM_SCRIPT_SLOTS) || (offs >= ANIM_SCRIPT_SIZE))
+  {
+    return;
+  }
+  if (offs == 0)
+  {
+    anim_players[slot].state = ANIM_IDLE;
+  }
+  if (n > ANIM_SCRIPT_SIZE - offs)
+  {
+    n = ANIM_SCRIPT_SIZE - offs;
+  }
+  memcpy(&anim_scripts[slot][offs], &data[3], n);
+}
+
+/*-----------------------------------------------------------------------------------------------------
+ * Function: Handle_CAN_ScriptRun
+ *
+ * Description: Обрабатывает команду PDISPLx_SCRIPT_RUN - запуск или остановка сценария анимации
+ *
+ * Input:       data - массив данных CAN сообщения
+ *              data[1] - номер слота 0..ANIM_SCRIPT_SLOTS-1
+ *              data[2] - номер спрайта, которым управляет сценарий, 0xFF - остановить сценарий
+ *              data[3] - биты 2-3 режим наложения, биты 4-7 порядок по z
+ *
+ * Output:      Нет
+ *
+ * Called by:   - Task_can_receiver() при получении команды PDISPLx_SCRIPT_RUN
+ *
+ * Note:        Отсчет сценария начинается от текущего времени отображения, поэтому платы,
+ *              принявшие команду по групповому адресу, проигрывают его синхронно
+ *              Остановленный сценарий оставляет спрайт в последнем состоянии
+ *-----------------------------------------------------------------------------------------------------*/
+void Handle_CAN_ScriptRun(const uint8_t *data)
+{
+  extern uint32_t display_idle_mode;
+  uint32_t        slot = data[1];
+
+  if (slot >= ANIM_SCRIPT_SLOTS)
+  {
+    return;
+  }
+  if (data[2] >= SPRITE_POOL_SIZE)
+  {
+    anim_players[slot].state = ANIM_IDLE;
+    return;
+  }
+  display_idle_mode = 0;
+  anim_sprite[slot] = data[2];
+  anim_mode[slot]   = data[3];
+  Anim_script_start(&anim_players[slot], App_display_clock_us() / 1000U);
+}
+
+/*-----------------------------------------------------------------------------------------------------
+ * Function: RunAnimScripts
+ *
+ * Description: Исполняет сценарии анимации до очередного ожидания и передает изменения спрайтам и яркости
+ *
+ * Input:       Нет
+ *
+ * Output:      Нет
+ *
+ * Called by:   - Main_cycle() на каждом тике
+ *
+ * Note:        Обработчики команд сценариев работают в задаче приема CAN с более высоким приоритетом,
+ *              поэтому на время исполнения переключение задач запрещается
+ *              Время - миллисекунды времени отображения, накапливаемые по приращениям, чтобы
+ *              переполнение 32-битного счетчика микросекунд не останавливало ожидания
+ *-----------------------------------------------------------------------------------------------------*/
+static void RunAnimScripts(void)
+{
+  static uint32_t last_us;
+  static uint32_t now_ms;
+  static uint32_t rem_us;
+  T_anim_player  *pl;
+  uint32_t        us = App_display_clock_us();
+  uint32_t        d  = us - last_us + rem_us;
+  uint32_t        evt;
+  uint32_t        i;
+
+  // A backward step of the synchronized clock does not run time back
+  if ((int32_t)d < 0)
+  {
+    d = 0;
+  }
+  last_us  = us;
+  now_ms  += d / 1000U;
+  rem_us   = d % 1000U;
+
+  vTaskSuspendAll();
+  for (i = 0; i < ANIM_SCRIPT_SLOTS; i++)
+  {
+    pl  = &anim_players[i];
+    evt = Anim_script_run(pl, anim_scripts[i], ANIM_SCRIPT_SIZE, now_ms);
+    if (evt & ANIM_EVT_SPRITE)
+    {
+      Display_set_sprite(anim_sprite[i], pl->visible ? pl->glyph : -1, pl->x, pl->y, pl->colors,
+                         (anim_mode[i] >> 2) & 0x03, anim_mode[i] >> 4, 0, 0, 0);
+    }
+    if (evt & ANIM_EVT_FADE)
+    {
+      Display_set_brightness(pl->fade_level, pl->fade_ms);
+    }
+  }
+  xTaskResumeAll();
+}
+
 /*-----------------------------------------------------------------------------------------------------
  * Function: SendDigitViaCAN
  *
@@ -502,8 +1543,8 @@ static void SendDigitViaCAN(uint32_t tick_counter)
     can_msg.data[1] = current_digit;       // Код символа (0-9)
     can_msg.data[2] = 1;                   // Цвет символа (1 = зеленый)
 
-    // Отправляем сообщение
-    CAN_send_or_post_msg(&can_msg, 10);
+    // Отправляем сообщение, отладочный поток не должен задерживать ответы
+    CAN_send_msg_prio(&can_msg, CAN_TX_PRIO_LOW, 10);
 
     // Обновляем время последней отправки
     last_send_time = tick_counter;
@@ -512,3 +1553,35 @@ static void SendDigitViaCAN(uint32_t tick_counter)
     current_digit  = (current_digit + 1) % 10;
   }
 }
+
+/*-----------------------------------------------------------------------------------------------------
+ * Function: PollNodeAddr
+ *
+ * Description: Опрашивает адресные перемычки и передает новый адрес узла CAN менеджеру
+ *
+ * Input:       tick_counter - счетчик тиков для отслеживания времени
+ *
+ * Output:      Нет
+ *
+ * Called by:   - Main_cycle() на каждом тике
+ *
+ * Note:        Перемычки читаются раз в 100 мс, новый адрес принимается после двух
+ *              одинаковых чтений подряд, чтобы дребезг контакта не перестраивал фильтры
+ *-----------------------------------------------------------------------------------------------------*/
+static void PollNodeAddr(uint32_t tick_counter)
+{
+  static uint32_t last_addr = 0xFFFFFFFF;
+  uint32_t        addr;
+
+  if ((tick_counter % (configTICK_RATE_HZ / 10)) != 0)
+  {
+    return;
+  }
+
+  addr = GPIOA->IDR & 0x03;
+  if (addr != app_vars.node_addr && addr == last_addr)
+  {
+    CAN_set_node_addr(addr);
+  }
+  last_addr = addr;
+}
@@ -26,8 +26,21 @@
 
 /* Заголовочные файлы приложения */
 #include "BitMasks.h"
+#include "Bit_matrix.h"
+#include "Sprite.h"
+#include "Anim_script.h"
+#include "Frame_delta.h"
+#include "Can_filter_plan.h"
+#include "Can_pool.h"
+#include "Display_scan.h"
+#include "Time_sync.h"
+#include "Can_bus_recovery.h"
+#include "Glyph_store.h"
+#include "Glyph_upload.h"
 #include "CAN_IDs.h"
 #include "CAN_manager.h"
+#include "Can_rx_ring.h"
+#include "Can_dispatch.h"
 #include "IO_funcs.h"
 #include "LED_display.h"
 #include "Symbols.h"
@@ -49,27 +62,12 @@
 typedef struct
 {
   uint32_t node_addr;
+  uint32_t node_groups;  // Бит g - плата входит в группу рассылки PDISPLx_ADDR_GROUP0 + g
   uint32_t rotated;
   uint32_t req_temperature;
 
 } T_app_vars;
 
-enum T_led_states
-{
-  SIG_off    = 0,
-  SIG_on     = 1,
-  SIG_ret    = 2,
-  SIG_repeat = 3,
-  SIG_stop   = 4,
-};
-
-typedef struct
-{
-  enum T_led_states state;
-  uint32_t          duration;
-  uint32_t          value;
-} T_sig_pattern;
-
 typedef struct
 {
   uint32_t from_sym;
@@ -77,26 +75,65 @@ typedef struct
 
 } T_remap_sym;
 
+// Staging of a two-colour frame between PDISPLx_FRAME_BEGIN and PDISPLx_FRAME_COMMIT
+#define FRAME_PLANE_RED       BIT(0)
+#define FRAME_PLANE_GREEN     BIT(1)
+#define FRAME_FLAG_BRIGHT     BIT(0)
+#define FRAME_FLAG_PRESENT_AT BIT(1)
+
+#define FRAME_PRESENT_AHEAD_MAX_MS 100  // Furthest present moment, later ones are brought closer
+
+typedef struct
+{
+  uint8_t  active;          // Transaction mode: colour frames are staged, not shown at once
+  uint8_t  open;            // PDISPLx_FRAME_BEGIN received, commit not yet done
+  uint8_t  seq;             // Frame number from PDISPLx_FRAME_BEGIN
+  uint8_t  expected_mask;   // Colours the master announced
+  uint8_t  received_mask;   // Colours received since PDISPLx_FRAME_BEGIN
+  uint8_t  red[8];
+  uint8_t  green[8];
+  uint32_t committed_cnt;   // Frames shown
+  uint32_t rejected_cnt;    // Frames dropped: wrong number, missing colour or no begin
+
+} T_frame_stage;
+
 extern T_app_vars  app_vars;
 extern T_remap_sym remap_array[];
 
-/* CAN Display Protocol Command Handlers */
-void Handle_CAN_SetSymbol(const uint8_t *data);
-void Handle_CAN_SetSymbolPattern1(const uint8_t *data);
-void Handle_CAN_SetSymbolPattern2(const uint8_t *data);
-void Handle_CAN_DynamicSymbolSet1(const uint8_t *data);
-void Handle_CAN_DynamicSymbolSet2(const uint8_t *data);
-void Handle_CAN_DynamicSymbolSet3(const uint8_t *data);
-void Handle_CAN_DynamicSymbolSet4(const uint8_t *data);
-void Handle_CAN_SetRedScreen(const uint8_t *data);
-void Handle_CAN_SetGreenScreen(const uint8_t *data);
+/* Completion of the own PDISPLx_TIME_SYNC transmission; command handlers are declared in Can_dispatch.h */
+void Handle_CAN_TimeSyncSent(uint8_t seq, uint32_t tx_cyc);
+
+/* Display clock shared by all boards on the bus, us */
+uint32_t App_display_clock_us(void);
 
 /* Dynamic symbol temporary storage */
 extern T_din_symbol tmp_dsym;
 
+/* Two-colour frame transaction state */
+extern T_frame_stage frame_stage;
+
 extern void Main_cycle(void);
 
 /* Флаг для отладки - отправка цифр по CAN */
 extern volatile uint32_t can_debug_send_digits;
 
+/* Флаг для отладки - плата рассылает метки PDISPLx_TIME_SYNC как мастер времени */
+extern volatile uint32_t time_sync_master;
+
+#define TIME_SYNC_PERIOD_MS 100  // Период меток времени мастера
+
+#define ANIM_SCRIPT_SLOTS 2   // Слоты сценариев анимации в RAM, у каждого свой проигрыватель
+#define ANIM_SCRIPT_SIZE  64  // Байт в слоте
+
+#define SYMBOL_UPLOAD_QUEUE      4    // Загруженные символы, ожидающие записи во flash
+#define SYMBOL_UPLOAD_TIMEOUT_MS 100  // Ожидание второй половины символа, затем пишется то, что пришло
+
+typedef struct
+{
+  uint8_t  code;
+  uint8_t  halves;  // Пришедшие половины: бит 0 - строки 0-3, бит 1 - строки 4-7
+  uint8_t  rows[8];
+  uint32_t tick;    // Тик прихода первой половины
+} T_symbol_upload;
+
 #endif
@@ -0,0 +1,166 @@
+#include <string.h>
+#include "Bit_matrix.h"
+
+// Cortex-M3 has single-cycle RBIT/REV; other targets (host builds) use shift/mask fallbacks
+#if defined(__ARM_ARCH_7M__)
+  #include "cmsis_compiler.h"
+  #define BM_RBIT32(x) __RBIT(x)
+  #define BM_REV32(x)  __REV(x)
+#else
+static uint32_t BM_RBIT32(uint32_t x)
+{
+  x = ((x >> 1) & 0x55555555U) | ((x & 0x55555555U) << 1);
+  x = ((x >> 2) & 0x33333333U) | ((x & 0x33333333U) << 2);
+  x = ((x >> 4) & 0x0F0F0F0FU) | ((x & 0x0F0F0F0FU) << 4);
+  x = ((x >> 8) & 0x00FF00FFU) | ((x & 0x00FF00FFU) << 8);
+  return (x >> 16) | (x << 16);
+}
+
+static uint32_t BM_REV32(uint32_t x)
+{
+  x = ((x >> 8) & 0x00FF00FFU) | ((x & 0x00FF00FFU) << 8);
+  return (x >> 16) | (x << 16);
+}
+#endif
+
+#define BM_LO(m)     ((uint32_t)(m))
+#define BM_HI(m)     ((uint32_t)((m) >> 32))
+#define BM_MAKE(h, l) (((uint64_t)(h) << 32) | (uint64_t)(l))
+
+//------------------------------------------------------------------------------
+// Load 8 screen rows into a 64-bit plane
+//------------------------------------------------------------------------------
+uint64_t Bit_matrix_load(const uint8_t *rows)
+{
+  uint64_t m;
+  memcpy(&m, rows, sizeof(m));
+  return m;
+}
+
+//------------------------------------------------------------------------------
+// Store a 64-bit plane into 8 screen rows
+//------------------------------------------------------------------------------
+void Bit_matrix_store(uint64_t m, uint8_t *rows)
+{
+  memcpy(rows, &m, sizeof(m));
+}
+
+//------------------------------------------------------------------------------
+// Reverse bit order of one byte
+//------------------------------------------------------------------------------
+uint8_t Bit_matrix_reverse8(uint32_t b)
+{
+  return (uint8_t)(BM_RBIT32(b) >> 24);
+}
+
+//------------------------------------------------------------------------------
+// Transpose about the main diagonal: out(r, c) = in(c, r)
+// Three delta swaps exchange 1x1, 2x2 and 4x4 blocks
+//------------------------------------------------------------------------------
+uint64_t Bit_matrix_transpose(uint64_t m)
+{
+  uint32_t lo = BM_LO(m);  // Rows 0..3
+  uint32_t hi = BM_HI(m);  // Rows 4..7
+  uint32_t t;
+
+  t  = (lo ^ (lo >> 7)) & 0x00AA00AAU;
+  lo = lo ^ t ^ (t << 7);
+  t  = (hi ^ (hi >> 7)) & 0x00AA00AAU;
+  hi = hi ^ t ^ (t << 7);
+
+  t  = (lo ^ (lo >> 14)) & 0x0000CCCCU;
+  lo = lo ^ t ^ (t << 14);
+  t  = (hi ^ (hi >> 14)) & 0x0000CCCCU;
+  hi = hi ^ t ^ (t << 14);
+
+  t  = ((lo >> 4) ^ hi) & 0x0F0F0F0FU;
+  hi = hi ^ t;
+  lo = lo ^ (t << 4);
+
+  return BM_MAKE(hi, lo);
+}
+
+//------------------------------------------------------------------------------
+// Mirror columns: out(r, c) = in(r, 7 - c)
+//------------------------------------------------------------------------------
+uint64_t Bit_matrix_flip_h(uint64_t m)
+{
+  // RBIT reverses the whole word, REV restores the byte order -> bits reversed inside each byte
+  return BM_MAKE(BM_REV32(BM_RBIT32(BM_HI(m))), BM_REV32(BM_RBIT32(BM_LO(m))));
+}
+
+//------------------------------------------------------------------------------
+// Mirror rows: out(r, c) = in(7 - r, c)
+//------------------------------------------------------------------------------
+uint64_t Bit_matrix_flip_v(uint64_t m)
+{
+  return BM_MAKE(BM_REV32(BM_LO(m)), BM_REV32(BM_HI(m)));
+}
+
+//------------------------------------------------------------------------------
+// Rotate by quarter_turns * 90 degrees in the display orientation convention:
+//   1 - out(r, c) = in(7 - c, r), 2 - out(r, c) = in(7 - r, 7 - c), 3 - out(r, c) = in(c, 7 - r)
+//------------------------------------------------------------------------------
+uint64_t Bit_matrix_rotate(uint64_t m, uint32_t quarter_turns)
+{
+  switch (quarter_turns & 3)
+  {
+    case 1:
+      return Bit_matrix_flip_h(Bit_matrix_transpose(m));
+    case 2:
+      return Bit_matrix_flip_h(Bit_matrix_flip_v(m));
+    case 3:
+      return Bit_matrix_flip_v(Bit_matrix_transpose(m));
+    default:
+      return m;
+  }
+}
+
+//------------------------------------------------------------------------------
+// Move the picture by dx columns and dy rows, pixels shifted out are lost:
+//   out(r, c) = in(r - dy, c - dx)
+//------------------------------------------------------------------------------
+uint64_t Bit_matrix_shift(uint64_t m, int32_t dx, int32_t dy)
+{
+  uint32_t cols;
+
+  if ((dx <= -8) || (dx >= 8) || (dy <= -8) || (dy >= 8))
+  {
+    return 0;
+  }
+
+  if (dy >= 0)
+  {
+    m <<= 8 * dy;
+  }
+  else
+  {
+    m >>= 8 * -dy;
+  }
+
+  if (dx >= 0)
+  {
+    cols = (0xFFU << dx) & 0xFFU;
+    m  <<= dx;
+  }
+  else
+  {
+    cols = 0xFFU >> -dx;
+    m  >>= -dx;
+  }
+  return m & (cols * 0x0101010101010101ULL);
+}
+
+//------------------------------------------------------------------------------
+// Interleave two bytes (Morton encode): bit i of odd goes to bit 2i + 1, bit i of even to bit 2i
+// Both bytes are spread in one 32-bit word with three magic-mask steps
+//------------------------------------------------------------------------------
+uint16_t Bit_matrix_interleave(uint32_t odd, uint32_t even)
+{
+  uint32_t x = ((odd & 0xFFU) << 16) | (even & 0xFFU);
+
+  x = (x | (x << 4)) & 0x0F0F0F0FU;
+  x = (x | (x << 2)) & 0x33333333U;
+  x = (x | (x << 1)) & 0x55555555U;
+  return (uint16_t)((x >> 15) | x);
+}
@@ -0,0 +1,20 @@
+#ifndef __BIT_MATRIX_H
+#define __BIT_MATRIX_H
+
+#include <stdint.h>
+
+// 8x8 one-bit pixel plane packed into 64 bits: row r occupies byte r, column c is bit c of that byte.
+// This is the layout of an 8-byte screen buffer loaded on a little-endian CPU.
+
+uint64_t Bit_matrix_load(const uint8_t *rows);
+void     Bit_matrix_store(uint64_t m, uint8_t *rows);
+
+uint8_t  Bit_matrix_reverse8(uint32_t b);
+uint64_t Bit_matrix_transpose(uint64_t m);
+uint64_t Bit_matrix_flip_h(uint64_t m);
+uint64_t Bit_matrix_flip_v(uint64_t m);
+uint64_t Bit_matrix_rotate(uint64_t m, uint32_t quarter_turns);
+uint64_t Bit_matrix_shift(uint64_t m, int32_t dx, int32_t dy);
+uint16_t Bit_matrix_interleave(uint32_t odd, uint32_t even);
+
+#endif
@@ -14,10 +14,18 @@
 #define PDISPLx_SET_RED_SYMB             0x1E06FFFFU   //    8-   
 #define PDISPLx_SET_GREEN_SYMB           0x1E07FFFFU   //    8-   
 
+//     20...23.      0..7
+//      PDISPLx_REQ, PDISPLx_SET_RED_SYMB  PDISPLx_SET_GREEN_SYMB
+#define PDISPLx_ADDR_GROUP0              0x08          //   0,  0..6   0x08..0x0E
+#define PDISPLx_GROUPS_NUM               7             //   
+#define PDISPLx_ADDR_BROADCAST           0x0F          //  ,   
+
 //  PDISPLx_REQ    (   0  )
 #define PDISPLx_SET_SYMBOL                0x01 //        1     2 (0 - red, 1 - green, 2 - red+green)
 #define PDISPLx_SET_SYMBOL_PTRN1          0x02 //  1-         1 ,     4..7
 #define PDISPLx_SET_SYMBOL_PTRN2          0x03 //  2-         1 ,     4..7
+                                               //     flash       
+                                               //       ,   - PDISPLx_GLYPH_BEGIN
 #define PDISPLx_DIN_SYMBOL_SET1           0x04 //  1   .
                                                //    1 -  
                                                //   2..3 -    
@@ -30,6 +38,89 @@
                                                //   4..5 -   y
 #define PDISPLx_DIN_SYMBOL_SET4           0x07 //  2   .
                                                //    1 -   (0 - , 1 - )
+#define PDISPLx_SET_BRIGHTNESS            0x08 //    .
+                                               //    1 -   0..255
+                                               //   2..3 -      (0 - )
+#define PDISPLx_FRAME_BEGIN               0x09 //   .  PDISPLx_SET_RED_SYMB  PDISPLx_SET_GREEN_SYMB
+                                               //     ,    PDISPLx_FRAME_COMMIT
+                                               //    1 -  
+                                               //    2 -    ( 0 - ,  1 - )
+                                               //              0 -    ,    
+#define PDISPLx_FRAME_COMMIT              0x0A //       .
+                                               //    1 -   (   PDISPLx_FRAME_BEGIN)
+                                               //    2 -  ( 0 -    ,  1 -       6..7)
+                                               //    3 -   0..255
+                                               //   4..5 -      
+                                               //   6..7 -  :  16      64  (  100  )
+                                               //           ,  
+#define PDISPLx_XOR_RED                   0x0B //    XOR  (  Frame_delta.h)
+                                               //    1 -    ( r -  r)
+                                               //   2..7 -  XOR      (  6)
+#define PDISPLx_XOR_GREEN                 0x0C //    XOR ,    PDISPLx_XOR_RED
+#define PDISPLx_SET_GROUPS                0x0D //    .      
+                                               //    1 -   ( g -       PDISPLx_ADDR_GROUP0 + g)
+                                               //    RAM        PDISPLx_ONBUS_MSG
+#define PDISPLx_TIME_SYNC                 0x0E //       .   PDISPLx_ADDR_BROADCAST
+                                               //    1 -   
+                                               //   2..5 -     (  )          6
+                                               //    6 -  ,    
+                                               //    7 - :  0 -    2..5 
+#define PDISPLx_READ_STATS                0x0F //       .   PDISPLx_ANS
+                                               //    1 -   0..PDISPLx_STATS_PAGES_NUM-1
+                                               //    2 -  0:      
+                                               // :  0 - PDISPLx_READ_STATS,  1 -  ,  2..7 -  
+                                               // (   , 16-   0xFFFF):
+                                               //   0 -  / (16),  / (16),     (16)
+                                               //   1 -  / (16),  / (16),    (8),    (8)
+                                               //   2 -    (32),  -   (16)
+                                               //   3 -    (32),    (16)
+                                               //   4..6 -     ->  (16 x 3  ):
+                                               //           < 32, < 64, ... < 2048, >= 2048 ,    
+                                               //   7..9 -     ->    ,   4..6
+                                               //   10 -   T_can_bus_state (8),   Bus-Off (8),
+                                               //             (16),    (16)
+                                               //   11 - :          (16),
+                                               //             (16),    BLANK (16)
+                                               //   12 -  :      (16),    (32)
+                                               //   13 -     :  CANRx (16), CANTx (16), Main_cycle (16)
+                                               //   14 -    flash:   (16),      (16),
+                                               //         FIFO    (16)
+#define PDISPLx_STATS_PAGES_NUM           15
+#define PDISPLx_SET_SPRITE                0x10 //     
+                                               //    1 -   0..SPRITE_POOL_SIZE-1
+                                               //    2 -  ,   ( 0xFF)  
+                                               //    3 -  0-1  ( 0 - ,  1 - ),
+                                               //               2-3  (0 - OR, 1 - XOR, 2 - MASK),  4-7   z
+                                               //   4..5 -  x, y   ,  
+                                               //    6 -   :  0-3  x,  4-7  y,   -8..7
+                                               //    7 -     , 0 -  
+                                               //  ,    ,    
+                                               //  0  1   PDISPLx_DIN_SYMBOL_SET4 (  )
+#define PDISPLx_SCRIPT_LOAD               0x11 //     (. Anim_script.h)
+                                               //    1 -   0..ANIM_SCRIPT_SLOTS-1
+                                               //    2 -   ,    0   
+                                               //   3..7 - 5  ,     
+#define PDISPLx_SCRIPT_RUN                0x12 //   
+                                               //    1 -   0..ANIM_SCRIPT_SLOTS-1
+                                               //    2 -  ,   , 0xFF -  
+                                               //    3 -  2-3 ,  4-7   z (  PDISPLx_SET_SPRITE)
+#define PDISPLx_GLYPH_BEGIN               0x13 //     (. Glyph_upload.h)
+                                               //    1 -  
+                                               //    2 -   
+                                               //    3 -   1..GLYPH_UPLOAD_MAX,   
+                                               //   .  PDISPLx_ANS   
+#define PDISPLx_GLYPH_DATA                0x14 //    ,  
+                                               //    1 -   n,     6 * n
+                                               //   2..7 -   ,  8   
+#define PDISPLx_GLYPH_COMMIT              0x15 //    
+                                               //    1 -  
+                                               //   2..3 - CRC-16/CCITT-FALSE   ,   
+                                               //           flash
+                                               // NACK GLYPH_UPLOAD_FLASH_ERROR:    ,   
+                                               //   BEGIN  COMMIT  PDISPLx_ANS:  0 - ,  1 -  ,
+                                               //  2 - 0 (ACK)    GLYPH_UPLOAD_xxx (NACK),  3 -  PDISPLx_GLYPH_ANS_xxx
+#define PDISPLx_GLYPH_ANS_ERASED          0x01 //     flash,  20     CAN
+#define PDISPLx_GLYPH_ANS_RX_LOST         0x02 //     FIFO ,     
 
 
 #endif
@@ -56,34 +56,227 @@ extern CAN_HandleTypeDef hcan;
 
 static CAN_Error_Stats_t can_error_stats    = {0};
 
+/* Загрузка шины и задержки обработки */
+static T_can_load_stats  can_load_stats;
+
+/* Состояние шины и восстановление после Bus-Off */
+static T_can_bus_recovery can_bus_rec;
+
 /* Глобальная переменная для отслеживания статуса ONBUS сообщений */
 static ONBUS_Status_t onbus_status          = {0};
 
 /*--------------------------- CAN Filters Configuration -------------------*/
 
-/* Массив базовых ID для CAN фильтров - экономит Flash память */
-static const uint32_t can_filter_base_ids[] = {
- PDISPLx_ONBUS_MSG,       // Filter 0
- PDISPLx_REQ,             // Filter 1
- PDISPLx_ANS,             // Filter 2
- PDISPLx_UPGRADE_RX_ID,   // Filter 3
- PDISPLx_SET_RED_SYMB,    // Filter 4
- PDISPLx_SET_GREEN_SYMB,  // Filter 5
- PDISPLx_UPGRADE_TX_ID    // Filter 6
-};
+/* Банки, занятые последним планом фильтров. Начальное значение заставляет при первой
+   настройке выключить все банки, не вошедшие в план */
+static uint32_t can_filter_banks_used = CAN_FILTER_PLAN_MAX_BANKS;
+
+/* Новый адрес узла и новые группы, ожидающие применения задачей Task_can_transmiter (-1 - нет запроса) */
+static volatile int32_t can_node_addr_req      = -1;
+static volatile int32_t can_node_groups_req    = -1;
+
+/* Прерывания CAN: переполнение FIFO не включается - флаг FOVR обрабатывается при выборке FIFO.
+   Прерывание SCE (смена состояния шины и код последней ошибки) будит задачу Task_can_transmiter */
+#define CAN_NOTIFICATIONS (CAN_IT_TX_MAILBOX_EMPTY | CAN_IT_RX_FIFO0_MSG_PENDING | CAN_IT_RX_FIFO1_MSG_PENDING | \
+                           CAN_IT_ERROR_WARNING | CAN_IT_ERROR_PASSIVE | CAN_IT_BUSOFF | CAN_IT_LAST_ERROR_CODE | CAN_IT_ERROR)
+
+/* События Task_can_transmiter - биты прямого уведомления задачи */
+#define CAN_EVT_ERROR   BIT(0)  // HAL_CAN_ErrorCallback: ошибка протокола, передачи или смена состояния шины
+#define CAN_EVT_ONBUS   BIT(1)  // Кадр ONBUS подтвержден шиной
+#define CAN_EVT_REQUEST BIT(2)  // Запрошена смена адреса узла или групп рассылки
+
+#define CAN_ONBUS_RETRY_MS 1000  // Таймаут подтверждения ONBUS до повторной отправки
 
-#define CAN_FILTERS_COUNT (sizeof(can_filter_base_ids) / sizeof(can_filter_base_ids[0]))
+#define CAN_INAK_WAIT_LOOPS 1000  // Опросов MSR.INAK при входе в режим инициализации, ~28 мкс на 72 МГц
 
-/* Memory pool for CAN messages, both transmit and receive*/
-static T_can_msg can_memory_pool[CAN_CTRL_MAX_NUM * (CAN_NO_SEND_OBJECTS + CAN_NO_RECV_OBJECTS + CAN_NO_LOG_OBJECTS)];
-static uint8_t   can_memory_pool_used[CAN_CTRL_MAX_NUM * (CAN_NO_SEND_OBJECTS + CAN_NO_RECV_OBJECTS + CAN_NO_LOG_OBJECTS)];
+#define CAN_POOL_SIZE (CAN_CTRL_MAX_NUM * (CAN_NO_SEND_OBJECTS + CAN_NO_LOG_OBJECTS))
+#if CAN_POOL_SIZE > CAN_POOL_MAX_BLOCKS
+  #error "Can_pool holds one bit of used_map per block"
+#endif
 
-/* FreeRTOS queues for CAN mailbox functionality */
-QueueHandle_t can_tx_queue;
-QueueHandle_t can_rx_queue;
+/* Transmit item: message plus scheduler bookkeeping.
+   msg is the first member, so alloc_can_msg() hands out a pointer to the whole item */
+typedef struct T_can_tx_item
+{
+  T_can_msg             msg;
+  struct T_can_tx_item *link;     // Next waiting item of the same priority
+  uint32_t              seq;      // Enqueue order, kept when the item is requeued
+  uint32_t              t_enq;    // Tick of the enqueue, for latency statistics
+  uint8_t               prio;     // T_can_tx_prio
+  uint8_t               retries;  // Failed transmissions so far
+} T_can_tx_item;
+
+/* Memory pool for CAN messages.
+   A free block stores the link to the next free block in place of the message */
+static T_can_tx_item can_memory_pool[CAN_POOL_SIZE];
+static T_can_pool    can_pool;
+
+/* Transmit scheduler: waiting items are kept in one list per priority sorted by seq,
+   loaded items are remembered per mailbox until completion, abort or failure */
+#define CAN_TX_MBOX_NUM 3
+
+static T_can_tx_item      *can_tx_wait[CAN_TX_PRIO_NUM];  // Heads of the waiting lists
+static T_can_tx_item      *can_tx_mbox[CAN_TX_MBOX_NUM];  // Item loaded into mailbox n or NULL
+static uint32_t            can_tx_abort_map;              // Bit n set - abort of mailbox n requested
+static uint32_t            can_tx_seq;
+static T_can_tx_prio_stats can_tx_stats[CAN_TX_PRIO_NUM];
+static volatile uint32_t   can_tx_hold;                   // Bus-off: mailboxes stay empty, only HIGH items wait
+
+/* Receive ring: filled from FIFO registers by the RX interrupt, read in place by Task_can_receiver.
+   Stamps are DWT->CYCCNT at the RX interrupt that stored the frame */
+static T_can_rx_ring can_rx_ring;
+
+/*--------------------------- Load statistics functions -------------------*/
+
+/*-----------------------------------------------------------------------------------------------------
+ * Function: CAN_frame_bits
+ *
+ * Description: Оценивает время занятия шины кадром данных в битовых интервалах
+ *
+ * Input:       format - STANDARD_FORMAT или EXTENDED_FORMAT
+ *              len - длина поля данных в байтах
+ *
+ * Output:      Число бит кадра вместе с межкадровым интервалом
+ *
+ * Note:        Биты стаффинга не учитываются, они добавляют до 20% в худшем случае
+ *-----------------------------------------------------------------------------------------------------*/
+static uint32_t CAN_frame_bits(uint8_t format, uint8_t len)
+{
+  // SOF, арбитраж, управление, CRC, ACK, EOF и 3 бита межкадрового интервала
+  return ((format == EXTENDED_FORMAT) ? 67U : 47U) + 8U * len;
+}
+
+/*-----------------------------------------------------------------------------------------------------
+ * Function: CAN_lat_hist_add
+ *
+ * Description: Добавляет задержку в гистограмму с корзинами по степеням двойки
+ *
+ * Input:       hist - гистограмма из CAN_LAT_HIST_SIZE корзин
+ *              max_us - максимум задержки
+ *              cyc - задержка в тактах DWT->CYCCNT
+ *
+ * Output:      Нет
+ *
+ * Note:        У каждой гистограммы один писатель, поэтому блокировка не нужна
+ *-----------------------------------------------------------------------------------------------------*/
+static void CAN_lat_hist_add(uint32_t *hist, uint32_t *max_us, uint32_t cyc)
+{
+  uint32_t us  = cyc / (SystemCoreClock / 1000000U);
+  uint32_t lim = 32;
+  uint32_t b   = 0;
+
+  while (us >= lim && b < (CAN_LAT_HIST_SIZE - 1))
+  {
+    lim <<= 1;
+    b++;
+  }
+  hist[b]++;
+  if (us > *max_us)
+  {
+    *max_us = us;
+  }
+}
+
+/*-----------------------------------------------------------------------------------------------------
+ * Function: CAN_update_load_stats
+ *
+ * Description: Раз в секунду пересчитывает скорости потоков и занятость шины
+ *
+ * Input:       Нет
+ *
+ * Output:      Нет
+ *
+ * Called by:   - Main_cycle() на каждом тике
+ *
+ * Note:        Скорость шины берется из регистра CAN_BTR, поэтому оценка остается верной
+ *              при смене настроек в can.c. Чужие кадры, отсеянные фильтрами, узлу не видны
+ *-----------------------------------------------------------------------------------------------------*/
+void CAN_update_load_stats(void)
+{
+  static uint32_t last_time;
+  static uint32_t last_rx_frames;
+  static uint32_t last_tx_frames;
+  static uint32_t last_rx_bytes;
+  static uint32_t last_tx_bytes;
+  static uint32_t last_bits;
+  uint32_t        now = xTaskGetTickCount();
+  uint32_t        btr;
+  uint32_t        bitrate;
+  uint32_t        bits;
+
+  if ((now - last_time) < configTICK_RATE_HZ)
+  {
+    return;
+  }
+  last_time                  = now;
+
+  btr                        = hcan.Instance->BTR;
+  bitrate                    = HAL_RCC_GetPCLK1Freq() / (((btr & CAN_BTR_BRP) + 1) * (3 + ((btr & CAN_BTR_TS1) >> CAN_BTR_TS1_Pos) + ((btr & CAN_BTR_TS2) >> CAN_BTR_TS2_Pos)));
+  bits                       = can_load_stats.rx_bits + can_load_stats.tx_bits;
+
+  can_load_stats.rx_fps      = can_load_stats.rx_frames - last_rx_frames;
+  can_load_stats.tx_fps      = can_load_stats.tx_frames - last_tx_frames;
+  can_load_stats.rx_bps      = can_load_stats.rx_bytes - last_rx_bytes;
+  can_load_stats.tx_bps      = can_load_stats.tx_bytes - last_tx_bytes;
+  can_load_stats.bus_load_pm = (uint32_t)(((uint64_t)(bits - last_bits) * 1000U) / bitrate);
+
+  last_rx_frames             = can_load_stats.rx_frames;
+  last_tx_frames             = can_load_stats.tx_frames;
+  last_rx_bytes              = can_load_stats.rx_bytes;
+  last_tx_bytes              = can_load_stats.tx_bytes;
+  last_bits                  = bits;
+}
 
 /*--------------------------- Memory management functions -------------------*/
 
+/*-----------------------------------------------------------------------------------------------------
+ * Function: CAN_pool_init
+ *
+ * Description: Связывает все блоки пула в список свободных блоков
+ *
+ * Input:       Нет
+ *
+ * Output:      Нет
+ *
+ * Called by:   - CAN_init()
+ *
+ * Note:        Статистика пула (high-water, ошибки) сохраняется
+ *-----------------------------------------------------------------------------------------------------*/
+static void CAN_pool_init(void)
+{
+  UBaseType_t saved = taskENTER_CRITICAL_FROM_ISR();
+
+  Can_pool_init(&can_pool, can_memory_pool, sizeof(can_memory_pool[0]), CAN_POOL_SIZE);
+  taskEXIT_CRITICAL_FROM_ISR(saved);
+}
+
+/*-----------------------------------------------------------------------------------------------------
+ * Function: CAN_pool_take
+ *
+ * Description: Снимает блок с головы списка свободных блоков
+ *
+ * Input:       reserve - число блоков, которые должны остаться свободными после выделения
+ *
+ * Output:      Указатель на блок или NULL если свободных блоков не больше reserve
+ *
+ * Called by:   - alloc_can_msg()
+ *              - CAN_send_msg_prio() с резервом CAN_TX_HIGH_RESERVE для приоритетов ниже HIGH
+ *
+ * Note:        Блок снимается за постоянное время
+ *              Вызывается из задач и прерываний: список меняется при поднятом BASEPRI
+ *              (taskENTER_CRITICAL_FROM_ISR допустим в обоих контекстах), что маскирует
+ *              прерывания CAN на несколько тактов
+ *-----------------------------------------------------------------------------------------------------*/
+static T_can_tx_item *CAN_pool_take(uint32_t reserve)
+{
+  T_can_tx_item *item;
+  UBaseType_t    saved = taskENTER_CRITICAL_FROM_ISR();
+
+  item = (T_can_tx_item *)Can_pool_take(&can_pool, reserve);
+  taskEXIT_CRITICAL_FROM_ISR(saved);
+  return item;
+}
+
 /*-----------------------------------------------------------------------------------------------------
  * Function: alloc_can_msg
  *
@@ -93,23 +286,19 @@ QueueHandle_t can_rx_queue;
  *
  * Output:      Указатель на выделенный блок памяти или NULL если пул переполнен
  *
- * Called by:   - CAN_send_or_post_msg() при добавлении сообщения в очередь передачи
- *              - HAL_CAN_RxFifo0MsgPendingCallback() при приеме CAN сообщения
+ * Called by:   - Пользовательские функции, которым нужен временный буфер сообщения
  *
- * Note:        Использует простой линейный поиск по массиву флагов использования
- *              Thread-safe за счет использования в контексте прерываний и задач
+ * Note:        Резерв приоритета HIGH не учитывается, блок может быть последним свободным
  *-----------------------------------------------------------------------------------------------------*/
 T_can_msg *alloc_can_msg(void)
 {
-  for (unsigned int i = 0; i < sizeof(can_memory_pool_used); i++)
+  T_can_tx_item *item = CAN_pool_take(0);
+
+  if (item == NULL)
   {
-    if (can_memory_pool_used[i] == 0)
-    {
-      can_memory_pool_used[i] = 1;
-      return &can_memory_pool[i];
-    }
+    can_pool.stats.alloc_fail_count++;  // Pool is full
   }
-  return NULL;  // Pool is full
+  return (T_can_msg *)item;
 }
 
 /*-----------------------------------------------------------------------------------------------------
@@ -121,89 +310,216 @@ T_can_msg *alloc_can_msg(void)
  *
  * Output:      Нет
  *
- * Called by:   - CAN_pull_msg_from_mbox() после копирования сообщения в пользовательский буфер
- *              - CAN_send_or_post_msg() при ошибке добавления в очередь
- *              - HAL_CAN_TxMailbox0CompleteCallback() после отправки сообщения из очереди
- *              - HAL_CAN_RxFifo0MsgPendingCallback() при ошибке чтения или переполнении очереди
+ * Called by:   - CAN_tx_mbox_complete() после подтвержденной передачи
+ *              - CAN_tx_retry() при отбрасывании кадра
+ *              - CAN_tx_flush() при очистке очередей передачи
  *
  * Note:        Проверяет принадлежность указателя к пулу памяти перед освобождением
+ *              Чужой указатель и повторное освобождение не меняют список, а только
+ *              увеличивают счетчик bad_free_count
  *-----------------------------------------------------------------------------------------------------*/
 void free_can_msg(T_can_msg *msg)
 {
-  if (msg >= can_memory_pool && msg < &can_memory_pool[sizeof(can_memory_pool_used)])
+  UBaseType_t saved = taskENTER_CRITICAL_FROM_ISR();
+
+  Can_pool_give(&can_pool, msg);
+  taskEXIT_CRITICAL_FROM_ISR(saved);
+}
+
+/*-----------------------------------------------------------------------------------------------------
+ * Function: CAN_get_pool_stats
+ *
+ * Description: Возвращает статистику пула CAN сообщений
+ *
+ * Input:       Нет
+ *
+ * Output:      Указатель на структуру статистики
+ *
+ * Called by:   - Пользовательские функции диагностики
+ *-----------------------------------------------------------------------------------------------------*/
+const T_can_pool_stats *CAN_get_pool_stats(void)
+{
+  return &can_pool.stats;
+}
+
+/*-----------------------------------------------------------------------------------------------------
+ * Function: CAN_set_filter_bank
+ *
+ * Description: Записывает в банк фильтра образ, построенный планировщиком фильтров
+ *
+ * Input:       bank - номер банка фильтра (0-13 для STM32F103)
+ *              plan - образ банка или NULL для выключения банка
+ *
+ * Output:      Нет
+ *
+ * Called by:   - CAN_setup_all_filters()
+ *
+ * Note:        Образ уже содержит регистры CAN_FxR1/CAN_FxR2, поля HAL заполняются их половинами
+ *-----------------------------------------------------------------------------------------------------*/
+static void CAN_set_filter_bank(uint32_t bank, const T_can_filter_bank *plan)
+{
+  CAN_FilterTypeDef canFilterConfig = {0};
+
+  canFilterConfig.FilterBank           = bank;
+  canFilterConfig.FilterMode           = CAN_FILTERMODE_IDMASK;
+  canFilterConfig.FilterScale          = CAN_FILTERSCALE_32BIT;
+  canFilterConfig.FilterFIFOAssignment = CAN_FILTER_FIFO0;
+  canFilterConfig.FilterActivation     = DISABLE;
+  canFilterConfig.SlaveStartFilterBank = 14;
+
+  if (plan != NULL)
   {
-    int index                   = msg - can_memory_pool;
-    can_memory_pool_used[index] = 0;
+    canFilterConfig.FilterIdHigh         = plan->r1 >> 16;
+    canFilterConfig.FilterIdLow          = plan->r1 & 0xFFFF;
+    canFilterConfig.FilterMaskIdHigh     = plan->r2 >> 16;
+    canFilterConfig.FilterMaskIdLow      = plan->r2 & 0xFFFF;
+    canFilterConfig.FilterFIFOAssignment = plan->fifo;
+    canFilterConfig.FilterActivation     = ENABLE;
+    if (plan->kind == CAN_FILTER_LIST32)
+    {
+      canFilterConfig.FilterMode = CAN_FILTERMODE_IDLIST;
+    }
   }
+
+  HAL_CAN_ConfigFilter(&hcan, &canFilterConfig);
 }
 
 /*-----------------------------------------------------------------------------------------------------
  * Function: CAN_setup_all_filters
  *
- * Description: Настраивает все CAN фильтры из массива - экономит Flash память
+ * Description: Строит план фильтров для адреса узла и его групп и программирует банки
  *
  * Input:       Нет
  *
  * Output:      Нет
  *
- * Called by:   - Task_can_transmiter() при инициализации
- *              - CAN_process_errors() при восстановлении
+ * Called by:   - Task_can_transmiter() при инициализации и при смене адреса узла или групп
  *
- * Note:        Использует массив can_filter_base_ids для экономии Flash памяти
- *              Все фильтры настраиваются с одинаковой маской 0x1FFFFFFF
+ * Note:        Can_filter_plan_node() берет ID из таблицы базовых ID с адресом app_vars.node_addr,
+ *              а для команд изображения - также с широковещательным адресом и адресами групп
+ *              из app_vars.node_groups (до 31 ID), без промежуточного списка ID
+ *              ID объединяются в точные пары ID/маска и списки из двух ID, поэтому набор занимает
+ *              не более CAN_FILTER_PLAN_NODE_BANKS (11) банков из 14 и чужие кадры не вызывают прерываний
+ *              План статический: стек задачи Task_can_transmiter его не вмещает
+ *              Банки, которые были заняты прежним планом и не вошли в новый, выключаются
+ *              Кадры изображения направляются в FIFO0, служебные - в FIFO1
  *-----------------------------------------------------------------------------------------------------*/
 static void CAN_setup_all_filters(void)
 {
-  for (uint8_t i = 0; i < CAN_FILTERS_COUNT; i++)
+  static T_can_filter_bank plan[CAN_FILTER_PLAN_NODE_BANKS];
+  int32_t                  nb;
+  uint32_t                 i;
+
+  nb = Can_filter_plan_node(app_vars.node_addr, app_vars.node_groups, plan, CAN_FILTER_PLAN_NODE_BANKS);
+  if (nb < 0)
+  {
+    return;  // Набор не помещается в банки - прежние фильтры остаются
+  }
+
+  for (i = 0; i < (uint32_t)nb; i++)
+  {
+    CAN_set_filter_bank(i, &plan[i]);
+  }
+  for (; i < can_filter_banks_used; i++)
   {
-    CAN_set_32bit_filter_mask(i,
-                              can_filter_base_ids[i] | (app_vars.node_addr << 20),
-                              0x1FFFFFFF);
+    CAN_set_filter_bank(i, NULL);
   }
+  can_filter_banks_used = nb;
 }
 
 /*-----------------------------------------------------------------------------------------------------
- * Function: CAN_release_init_mode
+ * Function: CAN_notify_supervisor
  *
- * Description: Освобождает режим инициализации CAN контроллера (заглушка для совместимости)
+ * Description: Будит Task_can_transmiter событием из задачи
  *
- * Input:       Нет
+ * Input:       evt - биты CAN_EVT_xxx
  *
- * Output:      CAN_OK - всегда успешно
+ * Output:      Нет
+ *-----------------------------------------------------------------------------------------------------*/
+static void CAN_notify_supervisor(uint32_t evt)
+{
+  if (xCanTxTaskHandle != NULL)
+  {
+    xTaskNotify(xCanTxTaskHandle, evt, eSetBits);
+  }
+}
+
+/*-----------------------------------------------------------------------------------------------------
+ * Function: CAN_notify_supervisor_from_isr
  *
- * Called by:   - Task_can_transmiter() после настройки фильтров
- * * Note:        В HAL STM32 эта операция не требуется, так как CAN уже запущен в CAN_init()
- *              Функция оставлена для совместимости с существующим API
+ * Description: Будит Task_can_transmiter событием из прерывания CAN
+ *
+ * Input:       evt - биты CAN_EVT_xxx
+ *
+ * Output:      Нет
  *-----------------------------------------------------------------------------------------------------*/
-T_can_err CAN_release_init_mode(void)
+static void CAN_notify_supervisor_from_isr(uint32_t evt)
 {
-  // В HAL это не требуется, CAN уже запущен в CAN_init
-  return CAN_OK;
+  BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
+  if (xCanTxTaskHandle != NULL)
+  {
+    xTaskNotifyFromISR(xCanTxTaskHandle, evt, eSetBits, &xHigherPriorityTaskWoken);
+    portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+  }
 }
 
 /*-----------------------------------------------------------------------------------------------------
- * Function: CAN_is_txmbox0_empty
+ * Function: CAN_set_node_addr
  *
- * Description: Проверяет доступность передающих mailbox
+ * Description: Запрашивает смену адреса узла во время работы
  *
- * Input:       Нет
+ * Input:       addr - новый адрес узла (0-7, старшие адреса заняты группами)
  *
- * Output:      CAN_OK - mailbox свободен
- *              CAN_TX_BUSY_ERROR - все mailbox заняты
+ * Output:      Нет
  *
- * Called by:   - CAN_send_or_post_msg() для проверки возможности немедленной отправки
+ * Called by:   - Main_cycle() при изменении адресных перемычек
  *
- * Note:        STM32 HAL автоматически выбирает свободный mailbox (0, 1 или 2)
- *              HAL_CAN_AddTxMessage() является thread-safe операцией
+ * Note:        Фильтры перепрограммирует задача Task_can_transmiter, разбуженная уведомлением,
+ *              после чего узел заново сообщает о себе посылкой ONBUS
  *-----------------------------------------------------------------------------------------------------*/
-static T_can_err CAN_is_txmbox0_empty(void)
+void CAN_set_node_addr(uint32_t addr)
 {
-  if (HAL_CAN_GetTxMailboxesFreeLevel(&hcan) > 0)
-  {
-    return CAN_OK;
-  }
+  can_node_addr_req = (int32_t)(addr & 0x07);
+  CAN_notify_supervisor(CAN_EVT_REQUEST);
+}
+
+/*-----------------------------------------------------------------------------------------------------
+ * Function: CAN_set_node_groups
+ *
+ * Description: Запрашивает смену групп рассылки, в которые входит узел
+ *
+ * Input:       groups - маска групп (бит g - группа с адресом PDISPLx_ADDR_GROUP0 + g)
+ *
+ * Output:      Нет
+ *
+ * Called by:   - Handle_CAN_SetGroups() по команде PDISPLx_SET_GROUPS
+ *
+ * Note:        Фильтры перепрограммирует задача Task_can_transmiter, разбуженная уведомлением
+ *-----------------------------------------------------------------------------------------------------*/
+void CAN_set_node_groups(uint32_t groups)
+{
+  can_node_groups_req = (int32_t)(groups & ((1u << PDISPLx_GROUPS_NUM) - 1));
+  CAN_notify_supervisor(CAN_EVT_REQUEST);
+}
 
-  return CAN_TX_BUSY_ERROR;
+/*-----------------------------------------------------------------------------------------------------
+ * Function: CAN_release_init_mode
+ *
+ * Description: Освобождает режим инициализации CAN контроллера (заглушка для совместимости)
+ *
+ * Input:       Нет
+ *
+ * Output:      CAN_OK - всегда успешно
+ *
+ * Called by:   - Task_can_transmiter() после настройки фильтров
+ * * Note:        В HAL STM32 эта операция не требуется, так как CAN уже запущен в CAN_init()
+ *              Функция оставлена для совместимости с существующим API
+ *-----------------------------------------------------------------------------------------------------*/
+T_can_err CAN_release_init_mode(void)
+{
+  // В HAL это не требуется, CAN уже запущен в CAN_init
+  return CAN_OK;
 }
 
 /*-----------------------------------------------------------------------------------------------------
@@ -212,17 +528,17 @@ static T_can_err CAN_is_txmbox0_empty(void)
  * Description: Заполняет заголовок CAN сообщения и отправляет через HAL
  *
  * Input:       msg - указатель на структуру CAN сообщения для отправки
+ *              mbox - куда записать номер занятого mailbox (0-2)
  *
  * Output:      CAN_OK - сообщение успешно отправлено
  *              CAN_TX_BUSY_ERROR - ошибка отправки (mailbox заняты)
  *
- * Called by:   - CAN_send_or_post_msg() для немедленной отправки
- *              - HAL_CAN_TxMailbox0CompleteCallback() для отправки из очереди
+ * Called by:   - CAN_tx_service() при загрузке свободного mailbox
  * * Note:        Преобразует внутренний формат сообщения в формат HAL
  *              Поддерживает стандартные и расширенные идентификаторы
  *              Использует аппаратную очередь CAN контроллера
  *-----------------------------------------------------------------------------------------------------*/
-static T_can_err CAN_fill_and_send_mbox(T_can_msg *msg)
+static T_can_err CAN_fill_and_send_mbox(const T_can_msg *msg, uint32_t *mbox)
 {
   CAN_TxHeaderTypeDef txHeader;
   uint32_t            txMailbox;
@@ -244,14 +560,305 @@ static T_can_err CAN_fill_and_send_mbox(T_can_msg *msg)
   txHeader.TransmitGlobalTime = DISABLE;
 
   // Отправка сообщения
-  if (HAL_CAN_AddTxMessage(&hcan, &txHeader, msg->data, &txMailbox) != HAL_OK)
+  if (HAL_CAN_AddTxMessage(&hcan, &txHeader, (uint8_t *)msg->data, &txMailbox) != HAL_OK)
   {
     return CAN_TX_BUSY_ERROR;
   }
 
+  *mbox = txMailbox >> 1;  // CAN_TX_MAILBOX0/1/2 = 1/2/4 -> 0/1/2
   return CAN_OK;
 }
 
+/*--------------------------- Transmit scheduler -------------------*/
+
+/*-----------------------------------------------------------------------------------------------------
+ * Function: CAN_tx_insert
+ *
+ * Description: Вставляет элемент в список ожидания своего приоритета по порядку seq
+ *
+ * Input:       item - элемент передачи
+ *
+ * Output:      Нет
+ *
+ * Called by:   - CAN_send_msg_prio() для нового кадра (в конец списка)
+ *              - CAN_tx_retry() и CAN_tx_mbox_abort() для возврата кадра на его место
+ *
+ * Note:        Вызывается при поднятом BASEPRI
+ *-----------------------------------------------------------------------------------------------------*/
+static void CAN_tx_insert(T_can_tx_item *item)
+{
+  T_can_tx_item **pp = &can_tx_wait[item->prio];
+
+  while (*pp != NULL && (int32_t)((*pp)->seq - item->seq) < 0)
+  {
+    pp = &(*pp)->link;
+  }
+  item->link = *pp;
+  *pp        = item;
+}
+
+/*-----------------------------------------------------------------------------------------------------
+ * Function: CAN_tx_retry
+ *
+ * Description: Возвращает в очередь кадр, передача которого завершилась ошибкой
+ *
+ * Input:       item - элемент передачи
+ *
+ * Output:      Нет
+ *
+ * Called by:   - CAN_tx_service() при обнаружении mailbox, освобожденного без подтверждения
+ *
+ * Note:        Кадр сохраняет свой seq и уходит раньше более новых кадров того же приоритета
+ *              После CAN_TX_RETRY_MAX неудач кадр отбрасывается
+ *-----------------------------------------------------------------------------------------------------*/
+static void CAN_tx_retry(T_can_tx_item *item)
+{
+  if (++item->retries > CAN_TX_RETRY_MAX)
+  {
+    can_tx_stats[item->prio].drop_count++;
+    free_can_msg(&item->msg);
+  }
+  else
+  {
+    can_tx_stats[item->prio].retry_count++;
+    CAN_tx_insert(item);
+  }
+}
+
+/*-----------------------------------------------------------------------------------------------------
+ * Function: CAN_tx_service
+ *
+ * Description: Планировщик передачи: разбирает неудачные передачи, вытесняет менее срочные
+ *              кадры из mailbox и загружает свободные mailbox из списков ожидания
+ *
+ * Input:       Нет
+ *
+ * Output:      Нет
+ *
+ * Called by:   - CAN_send_msg_prio() после постановки кадра в очередь
+ *              - Callback функциями завершения, отмены передачи и ошибок CAN
+ *
+ * Note:        Вызывается из задач и прерываний, работает при поднятом BASEPRI
+ *              Автоматический повтор передачи выключен, поэтому mailbox, освобожденный без
+ *              вызова complete или abort callback (флаг RQCP уже сброшен прерыванием),
+ *              означает проигрыш арбитража или ошибку - кадр возвращается в очередь
+ *              TransmitFifoPriority включен: mailbox уходят на шину в порядке загрузки.
+ *              Поэтому ожидающий кадр, который должен уйти раньше загруженного (выше
+ *              приоритет или тот же приоритет и меньший seq после ошибки), снимает
+ *              загруженный кадр с передачи через HAL_CAN_AbortTxRequest()
+ *              Mailbox с необработанным RQCP не загружается: HAL выбирает mailbox сам,
+ *              и новый кадр занял бы место, завершение которого еще не учтено
+ *              Во время Bus-Off (can_tx_hold) загруженные кадры снимаются, а mailbox не загружаются
+ *-----------------------------------------------------------------------------------------------------*/
+static void CAN_tx_service(void)
+{
+  T_can_tx_item *item;
+  uint32_t       tsr;
+  uint32_t       mbox;
+  uint32_t       p;
+  uint32_t       completion_pending = 0;
+  UBaseType_t    saved              = taskENTER_CRITICAL_FROM_ISR();
+
+  tsr                               = hcan.Instance->TSR;
+
+  for (mbox = 0; mbox < CAN_TX_MBOX_NUM; mbox++)
+  {
+    item = can_tx_mbox[mbox];
+    if (item == NULL || (tsr & (CAN_TSR_TME0 << mbox)) == 0)
+    {
+      continue;
+    }
+    if ((tsr & (CAN_TSR_RQCP0 << (8 * mbox))) != 0)
+    {
+      completion_pending = 1;  // Interrupt is masked by BASEPRI and will call us again
+      continue;
+    }
+    can_tx_mbox[mbox]  = NULL;
+    can_tx_abort_map  &= ~(1UL << mbox);
+    CAN_tx_retry(item);
+  }
+
+  // Evict loaded items that a waiting item must precede
+  for (mbox = 0; mbox < CAN_TX_MBOX_NUM; mbox++)
+  {
+    item = can_tx_mbox[mbox];
+    if (item == NULL || (can_tx_abort_map & (1UL << mbox)) != 0)
+    {
+      continue;
+    }
+    if (can_tx_hold)
+    {
+      // Bus-off: the frame goes back to its list and waits for the end of recovery
+      can_tx_abort_map |= 1UL << mbox;
+      HAL_CAN_AbortTxRequest(&hcan, CAN_TX_MAILBOX0 << mbox);
+      continue;
+    }
+    for (p = 0; p <= item->prio; p++)
+    {
+      if (can_tx_wait[p] != NULL && (p < item->prio || (int32_t)(can_tx_wait[p]->seq - item->seq) < 0))
+      {
+        can_tx_abort_map |= 1UL << mbox;
+        HAL_CAN_AbortTxRequest(&hcan, CAN_TX_MAILBOX0 << mbox);
+        break;
+      }
+    }
+  }
+
+  // Load free mailboxes, highest priority and oldest item first
+  for (p = 0; p < CAN_TX_PRIO_NUM && completion_pending == 0 && can_tx_hold == 0; p++)
+  {
+    while ((item = can_tx_wait[p]) != NULL && HAL_CAN_GetTxMailboxesFreeLevel(&hcan) > 0)
+    {
+      if (CAN_fill_and_send_mbox(&item->msg, &mbox) != CAN_OK)
+      {
+        break;
+      }
+      can_tx_wait[p]    = item->link;
+      can_tx_mbox[mbox] = item;
+    }
+  }
+  taskEXIT_CRITICAL_FROM_ISR(saved);
+}
+
+/*-----------------------------------------------------------------------------------------------------
+ * Function: CAN_tx_mbox_complete
+ *
+ * Description: Учитывает подтвержденную передачу кадра из mailbox и освобождает его блок
+ *
+ * Input:       mbox - номер mailbox (0-2)
+ *
+ * Output:      Нет
+ *
+ * Called by:   - HAL_CAN_TxMailbox0/1/2CompleteCallback()
+ *
+ * Note:        Подтверждение ONBUS сообщения отмечается только по его собственному кадру
+ *              Для меток PDISPLx_TIME_SYNC запоминается момент окончания передачи
+ *-----------------------------------------------------------------------------------------------------*/
+static void CAN_tx_mbox_complete(uint32_t mbox)
+{
+  T_can_tx_item       *item = can_tx_mbox[mbox];
+  T_can_tx_prio_stats *st;
+  uint32_t             latency;
+
+  can_tx_mbox[mbox]         = NULL;
+  can_tx_abort_map         &= ~(1UL << mbox);
+  if (item != NULL)
+  {
+    st                      = &can_tx_stats[item->prio];
+    latency                 = xTaskGetTickCountFromISR() - item->t_enq;
+    st->sent_count++;
+    st->latency_sum        += latency;
+    can_load_stats.tx_frames++;
+    can_load_stats.tx_bytes += item->msg.len;
+    can_load_stats.tx_bits  += CAN_frame_bits(item->msg.format, item->msg.len);
+    if (latency > st->latency_max)
+    {
+      st->latency_max = latency;
+    }
+
+    if ((item->msg.id & 0x1E0FFFFF) == PDISPLx_ONBUS_MSG && onbus_status.pending)
+    {
+      onbus_status.ack_received = 1;
+      onbus_status.pending      = 0;
+      CAN_notify_supervisor_from_isr(CAN_EVT_ONBUS);
+    }
+    // Two-step time sync: the moment the beacon left goes out in the next beacon
+    if ((item->msg.id & 0x1E0FFFFF) == PDISPLx_REQ && item->msg.data[0] == PDISPLx_TIME_SYNC)
+    {
+      Handle_CAN_TimeSyncSent(item->msg.data[1], DWT->CYCCNT);
+    }
+    free_can_msg(&item->msg);
+  }
+  CAN_tx_service();
+}
+
+/*-----------------------------------------------------------------------------------------------------
+ * Function: CAN_tx_mbox_abort
+ *
+ * Description: Возвращает в очередь кадр, снятый с передачи планировщиком
+ *
+ * Input:       mbox - номер mailbox (0-2)
+ *
+ * Output:      Нет
+ *
+ * Called by:   - HAL_CAN_TxMailbox0/1/2AbortCallback()
+ *
+ * Note:        Вытеснение не считается неудачной попыткой, счетчик повторов не меняется
+ *-----------------------------------------------------------------------------------------------------*/
+static void CAN_tx_mbox_abort(uint32_t mbox)
+{
+  T_can_tx_item *item = can_tx_mbox[mbox];
+
+  can_tx_mbox[mbox]   = NULL;
+  can_tx_abort_map   &= ~(1UL << mbox);
+  if (item != NULL)
+  {
+    can_tx_stats[item->prio].preempt_count++;
+    CAN_tx_insert(item);
+  }
+  CAN_tx_service();
+}
+
+/*-----------------------------------------------------------------------------------------------------
+ * Function: CAN_tx_flush
+ *
+ * Description: Снимает с передачи кадры заданного и более низких приоритетов и возвращает их блоки в пул
+ *
+ * Input:       from_prio - самый срочный из снимаемых приоритетов, CAN_TX_PRIO_HIGH - снять все кадры
+ *
+ * Output:      Нет
+ *
+ * Called by:   - CAN_bus_supervise() при входе в Bus-Off с from_prio = CAN_TX_PRIO_NORMAL
+ *
+ * Note:        Снятые кадры учитываются как отброшенные
+ *              Callback функции для уже освобожденных mailbox ничего не делают
+ *-----------------------------------------------------------------------------------------------------*/
+static void CAN_tx_flush(T_can_tx_prio from_prio)
+{
+  T_can_tx_item *item;
+  uint32_t       i;
+  UBaseType_t    saved = taskENTER_CRITICAL_FROM_ISR();
+
+  for (i = 0; i < CAN_TX_MBOX_NUM; i++)
+  {
+    if ((item = can_tx_mbox[i]) != NULL && item->prio >= from_prio)
+    {
+      HAL_CAN_AbortTxRequest(&hcan, CAN_TX_MAILBOX0 << i);
+      can_tx_mbox[i]    = NULL;
+      can_tx_abort_map &= ~(1UL << i);
+      can_tx_stats[item->prio].drop_count++;
+      free_can_msg(&item->msg);
+    }
+  }
+
+  for (i = from_prio; i < CAN_TX_PRIO_NUM; i++)
+  {
+    while ((item = can_tx_wait[i]) != NULL)
+    {
+      can_tx_wait[i] = item->link;
+      can_tx_stats[i].drop_count++;
+      free_can_msg(&item->msg);
+    }
+  }
+  taskEXIT_CRITICAL_FROM_ISR(saved);
+}
+
+/*-----------------------------------------------------------------------------------------------------
+ * Function: CAN_get_tx_stats
+ *
+ * Description: Возвращает статистику передачи по приоритетам
+ *
+ * Input:       Нет
+ *
+ * Output:      Массив из CAN_TX_PRIO_NUM структур, индекс - T_can_tx_prio
+ *
+ * Called by:   - Пользовательские функции диагностики
+ *-----------------------------------------------------------------------------------------------------*/
+const T_can_tx_prio_stats *CAN_get_tx_stats(void)
+{
+  return can_tx_stats;
+}
+
 /*-----------------------------------------------------------------------------------------------------
  * Function: CAN_set_32bit_filter_mask
  *
@@ -260,22 +867,22 @@ static T_can_err CAN_fill_and_send_mbox(T_can_msg *msg)
  * Input:       bank - номер банка фильтра (0-13 для STM32F103)
  *              filter - значение фильтра (29-битный идентификатор)
  *              mask - маска фильтра (биты 1 - проверяются, биты 0 - игнорируются)
+ *              fifo - приемный FIFO (CAN_RX_FIFO0 или CAN_RX_FIFO1)
  *
  * Output:      Нет
  *
- * Called by:   - Task_can_transmiter() для настройки приема сообщений с определенным ID
+ * Called by:   - Пользовательские функции для отдельного фильтра вне плана CAN_setup_all_filters()
  *
  * Note:        Фильтр настраивается для расширенных идентификаторов (29 бит)
- *              Сообщения направляются в FIFO0
  *              Преобразование битов выполняется согласно формату регистров STM32
  *-----------------------------------------------------------------------------------------------------*/
-void CAN_set_32bit_filter_mask(uint16_t bank, uint32_t filter, uint32_t mask)
+void CAN_set_32bit_filter_mask(uint16_t bank, uint32_t filter, uint32_t mask, uint32_t fifo)
 {
   CAN_FilterTypeDef canFilterConfig;
 
   canFilterConfig.FilterActivation     = ENABLE;
   canFilterConfig.FilterBank           = bank;
-  canFilterConfig.FilterFIFOAssignment = CAN_RX_FIFO0;
+  canFilterConfig.FilterFIFOAssignment = fifo;
   canFilterConfig.FilterIdHigh         = (filter >> 13) & 0xFFFF;
   canFilterConfig.FilterIdLow          = (filter << 3) & 0xFFFF;
   canFilterConfig.FilterMaskIdHigh     = (mask >> 13) & 0xFFFF;
@@ -290,162 +897,224 @@ void CAN_set_32bit_filter_mask(uint16_t bank, uint32_t filter, uint32_t mask)
 /*-----------------------------------------------------------------------------------------------------
  * Function: CAN_get_errors
  *
- * Description: Получает текущие ошибки CAN контроллера через HAL
+ * Description: Забирает накопленные ошибки CAN контроллера из HAL и сбрасывает их
  *
  * Input:       chanel - номер канала CAN (не используется в текущей реализации)
  *
- * Output:      Битовая маска ошибок CAN контроллера
+ * Output:      Битовая маска ошибок HAL_CAN_ERROR_xxx
  *
- * Called by:   - Task_can_transmiter() для периодической проверки ошибок CAN
+ * Called by:   - Task_can_transmiter() по событию из прерывания ошибок CAN
  *
- * Note:        Возвращает значение регистра ошибок HAL CAN
- *              Биты 0-2 указывают на критические ошибки (bus-off, error warning, error passive)
+ * Note:        Чтение и сброс выполняются в критической секции: ошибка, пришедшая
+ *              из прерывания между ними, не теряется
+ *              Биты 0-2 указывают на состояние шины (error warning, error passive, bus-off)
  *-----------------------------------------------------------------------------------------------------*/
 unsigned int CAN_get_errors(uint32_t chanel)
 {
-  return HAL_CAN_GetError(&hcan);
+  unsigned int err;
+
+  taskENTER_CRITICAL();
+  err            = hcan.ErrorCode;
+  hcan.ErrorCode = HAL_CAN_ERROR_NONE;
+  taskEXIT_CRITICAL();
+  return err;
 }
 
 /*-----------------------------------------------------------------------------------------------------
  * Function: CAN_init
  *
  * Description: Инициализация CAN менеджера и аппаратной части контроллера
- *              Инициализирует пул памяти для CAN сообщений, создает семафоры и очереди FreeRTOS,
+ *              Инициализирует пул памяти для CAN сообщений,
  *              запускает HAL CAN и активирует прерывания
  *
  * Input:       Нет
  *
  * Output:      CAN_OK - успешная инициализация
- *              CAN_MEM_POOL_INIT_ERROR - ошибка создания семафоров или очередей
  *              CAN_BAUDRATE_ERROR - ошибка запуска CAN или активации прерываний
  *
- * Called by:   - Task_can_transmiter() при запуске задачи передачи CAN
- * * Note:        Использует статическое выделение памяти для FreeRTOS объектов
- *              Очереди can_tx_queue и can_rx_queue буферизуют сообщения
+ * Called by:   - Task_can_transmiter() один раз при запуске задачи передачи CAN
+ * * Note:        FreeRTOS объекты не создаются: кадры на передачу ждут в списках
+ *              планировщика по приоритетам, принятые - в кольце can_rx_ring
  *              HAL уже инициализирует CAN через MX_CAN_Init() в main.c
  *              STM32 HAL CAN функции уже thread-safe и не требуют дополнительной защиты
  *              Скорость передачи настраивается в CubeMX, не передается как параметр
  *-----------------------------------------------------------------------------------------------------*/
 T_can_err CAN_init(void)
 {
-  static uint8_t first_run_flag = 0;
+  /* Initialize memory pool */
+  CAN_pool_init();
 
-  /* When function is called for the first time it will initialize and setup
-     all of the resources that are common to CAN functionality               */
-  if (first_run_flag == 0)
+#if CAN_AUTO_BUS_OFF
+  /* Контроллер еще в режиме инициализации после MX_CAN_Init(), ABOM можно менять */
+  SET_BIT(hcan.Instance->MCR, CAN_MCR_ABOM);
+#endif
+
+  /* Start CAN hardware - HAL уже инициализирует CAN через MX_CAN_Init() в main.c */
+  if (HAL_CAN_Start(&hcan) != HAL_OK)
   {
-    first_run_flag = 1;
+    return CAN_BAUDRATE_ERROR;
+  }
 
-    /* Initialize memory pool */
-    memset(can_memory_pool_used, 0, sizeof(can_memory_pool_used));
+  /* Активация уведомлений о приеме и передаче */
+  if (HAL_CAN_ActivateNotification(&hcan, CAN_NOTIFICATIONS) != HAL_OK)
+  {
+    return CAN_BAUDRATE_ERROR;
   }
 
-  /* Create FreeRTOS queues using static allocation for mailbox functionality */
-  can_tx_queue = xQueueCreateStatic(
-  CAN_NO_SEND_OBJECTS,      // Queue length
-  sizeof(T_can_msg *),      // Item size
-  ucCanTxQueueStorageArea,  // Queue storage buffer
-  &xCanTxQueueBuffer        // Queue buffer
-  );
-
-  can_rx_queue = xQueueCreateStatic(
-  CAN_NO_RECV_OBJECTS,      // Queue length
-  sizeof(T_can_msg *),      // Item size
-  ucCanRxQueueStorageArea,  // Queue storage buffer
-  &xCanRxQueueBuffer        // Queue buffer
-  );
-
-  if (can_tx_queue == NULL || can_rx_queue == NULL)
+  return CAN_OK;
+}
+
+/*-----------------------------------------------------------------------------------------------------
+ * Function: CAN_send_msg_prio
+ *
+ * Description: Ставит CAN сообщение в очередь передачи с заданным приоритетом
+ *              Свободный mailbox загружается сразу, иначе кадр ждет в списке своего приоритета
+ *
+ * Input:       msg - указатель на структуру CAN сообщения для отправки
+ *              prio - приоритет передачи (T_can_tx_prio)
+ *              timeout - время ожидания свободного блока пула (в миллисекундах)
+ *
+ * Output:      CAN_OK - сообщение поставлено в очередь
+ *              CAN_TIMEOUT_ERROR - за время ожидания не освободился блок пула
+ *              CAN_TX_BUSY_ERROR - узел в Bus-Off, принимаются только кадры CAN_TX_PRIO_HIGH
+ *
+ * Called by:   - CAN_send_or_post_msg() с приоритетом CAN_TX_PRIO_NORMAL
+ *              - Пользовательские функции для отправки CAN сообщений
+ *
+ * Note:        Вызывается только из задач
+ *              Последние CAN_TX_HIGH_RESERVE блоков пула доступны только приоритету HIGH,
+ *              поэтому поток статусных кадров не может заблокировать срочный ответ
+ *              Кадры одного приоритета уходят на шину в порядке постановки в очередь
+ *-----------------------------------------------------------------------------------------------------*/
+T_can_err CAN_send_msg_prio(const T_can_msg *msg, T_can_tx_prio prio, uint16_t timeout)
+{
+  T_can_tx_item *item;
+  TickType_t     start = xTaskGetTickCount();
+  UBaseType_t    saved;
+
+  if (prio >= CAN_TX_PRIO_NUM)
   {
-    return CAN_MEM_POOL_INIT_ERROR;
+    prio = CAN_TX_PRIO_LOW;
   }
 
-  /* Start CAN hardware - HAL уже инициализирует CAN через MX_CAN_Init() в main.c */
-  if (HAL_CAN_Start(&hcan) != HAL_OK)
+  if (can_tx_hold && prio != CAN_TX_PRIO_HIGH)
   {
-    return CAN_BAUDRATE_ERROR;
+    can_tx_stats[prio].drop_count++;
+    return CAN_TX_BUSY_ERROR;
   }
 
-  /* Активация уведомлений о приеме и передаче */
-  if (HAL_CAN_ActivateNotification(&hcan,
-                                   CAN_IT_TX_MAILBOX_EMPTY |
-                                   CAN_IT_RX_FIFO0_MSG_PENDING |
-                                   CAN_IT_RX_FIFO0_OVERRUN) != HAL_OK)
+  while ((item = CAN_pool_take(prio == CAN_TX_PRIO_HIGH ? 0 : CAN_TX_HIGH_RESERVE)) == NULL)
   {
-    return CAN_BAUDRATE_ERROR;
+    if ((xTaskGetTickCount() - start) >= pdMS_TO_TICKS(timeout))
+    {
+      can_tx_stats[prio].drop_count++;
+      return CAN_TIMEOUT_ERROR;
+    }
+    vTaskDelay(1);
   }
 
+  item->msg     = *msg;
+  item->prio    = prio;
+  item->retries = 0;
+  item->t_enq   = xTaskGetTickCount();
+
+  saved         = taskENTER_CRITICAL_FROM_ISR();
+  item->seq     = can_tx_seq++;
+  CAN_tx_insert(item);
+  taskEXIT_CRITICAL_FROM_ISR(saved);
+
+  CAN_tx_service();
   return CAN_OK;
 }
 
 /*-----------------------------------------------------------------------------------------------------
- * Function: CAN_send_or_post_msg
+ * Function: CAN_send_or_post_msg
+ *
+ * Description: Отправляет CAN сообщение с обычным приоритетом
+ *
+ * Input:       msg - указатель на структуру CAN сообщения для отправки
+ *              timeout - время ожидания свободного блока пула (в миллисекундах)
+ *
+ * Output:      Результат CAN_send_msg_prio()
+ *
+ * Called by:   - Send_ONBUS_MSG() для отправки сообщения о подключении к шине
+ *              - Пользовательские функции для отправки CAN сообщений
+ *-----------------------------------------------------------------------------------------------------*/
+T_can_err CAN_send_or_post_msg(T_can_msg *msg, uint16_t timeout)
+{
+  return CAN_send_msg_prio(msg, CAN_TX_PRIO_NORMAL, timeout);
+}
+
+/*-----------------------------------------------------------------------------------------------------
+ * Function: CAN_rx_get_msg
  *
- * Description: Отправляет CAN сообщение немедленно или помещает в очередь отправки
- *              Если передающий mailbox свободен - отправляет сразу,
- *              иначе помещает в очередь для отправки при освобождении mailbox
+ * Description: Возвращает указатель на самый старый принятый кадр в кольце приема
+ *              Ожидает поступления кадра в течение заданного таймаута
  *
- * Input:       msg - указатель на структуру CAN сообщения для отправки
- *              timeout - таймаут добавления в очередь (в миллисекундах)
+ * Input:       timeout - таймаут ожидания сообщения (в миллисекундах)
  *
- * Output:      CAN_OK - сообщение отправлено или добавлено в очередь
- *              CAN_TIMEOUT_ERROR - таймаут добавления в очередь
- *              CAN_ALLOC_MEM_ERROR - нет свободной памяти для сообщения
+ * Output:      Указатель на кадр в кольце или NULL по таймауту
  *
- * Called by:   - Send_ONBUS_MSG() для отправки сообщения о подключении к шине
- *              - Пользовательские функции для отправки CAN сообщений
- * * Note:        STM32 HAL CAN функции уже thread-safe и не требуют дополнительной защиты
- *              При неудаче добавления в очередь освобождает выделенную память
+ * Called by:   - Task_can_receiver() для обработки принятых кадров на месте
+ *              - CAN_pull_msg_from_mbox()
+ *
+ * Note:        Вызывается только из задачи CANRx: прерывание приема будит ее прямым уведомлением
+ *              Кадр остается в кольце до вызова CAN_rx_release_msg()
  *-----------------------------------------------------------------------------------------------------*/
-T_can_err CAN_send_or_post_msg(T_can_msg *msg, uint16_t timeout)
+T_can_msg *CAN_rx_get_msg(uint16_t timeout)
 {
-  T_can_msg *ptrmsg;
-
-  if (CAN_is_txmbox0_empty() == CAN_OK)
+  if (can_rx_ring.head == can_rx_ring.tail)
   {
-    if (CAN_fill_and_send_mbox(msg) != CAN_OK)
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeout));
+    if (can_rx_ring.head == can_rx_ring.tail)
     {
-      return CAN_TX_BUSY_ERROR;
+      return NULL;
     }
   }
-  else
-  {
-    ptrmsg = alloc_can_msg();
-    if (ptrmsg != NULL)
-    {
-      *ptrmsg = *msg;
+  __DMB();  // Slot contents are read only after the index that published them
+  return Can_rx_ring_front(&can_rx_ring);
+}
 
-      if (xQueueSend(can_tx_queue, &ptrmsg, pdMS_TO_TICKS(timeout)) != pdTRUE)
-      {
-        free_can_msg(ptrmsg);
-        return CAN_TIMEOUT_ERROR;
-      }
-      else
-      {        /* Check once again if transmit hardware is ready for transmission   */
-        if (CAN_is_txmbox0_empty() == CAN_OK)
-        {          if (xQueueReceive(can_tx_queue, &ptrmsg, 0) == pdTRUE)
-          {
-            free_can_msg(ptrmsg);
-            if (CAN_fill_and_send_mbox(msg) != CAN_OK)
-            {
-              return CAN_TX_BUSY_ERROR;
-            }
-          }
-        }
-      }
-    }
-    else
-      return CAN_ALLOC_MEM_ERROR;
-  }
-  return CAN_OK;
+/*-----------------------------------------------------------------------------------------------------
+ * Function: CAN_rx_msg_stamp
+ *
+ * Description: Возвращает момент приема кадра, полученного от CAN_rx_get_msg()
+ *
+ * Input:       Нет
+ *
+ * Output:      Значение DWT->CYCCNT в прерывании, выбравшем кадр из FIFO
+ *
+ * Called by:   - Task_can_receiver() для метки PDISPLx_TIME_SYNC и статистики задержек
+ *-----------------------------------------------------------------------------------------------------*/
+uint32_t CAN_rx_msg_stamp(void)
+{
+  return Can_rx_ring_front_stamp(&can_rx_ring);
+}
+
+/*-----------------------------------------------------------------------------------------------------
+ * Function: CAN_rx_release_msg
+ *
+ * Description: Освобождает слот кольца приема, полученный от CAN_rx_get_msg()
+ *
+ * Input:       Нет
+ *
+ * Output:      Нет
+ *
+ * Called by:   - Task_can_receiver() после обработки кадра
+ *              - CAN_pull_msg_from_mbox()
+ *-----------------------------------------------------------------------------------------------------*/
+void CAN_rx_release_msg(void)
+{
+  __DMB();  // Slot is read out before it is handed back to the interrupt
+  Can_rx_ring_release(&can_rx_ring);
 }
 
 /*-----------------------------------------------------------------------------------------------------
  * Function: CAN_pull_msg_from_mbox
  *
- * Description: Извлекает принятое CAN сообщение из очереди приема
+ * Description: Извлекает принятое CAN сообщение из кольца приема с копированием
  *              Ожидает поступления сообщения в течение заданного таймаута,
- *              копирует сообщение в пользовательский буфер и освобождает память
+ *              копирует сообщение в пользовательский буфер и освобождает слот
  *
  * Input:       msg - указатель на структуру для сохранения принятого сообщения
  *              timeout - таймаут ожидания сообщения (в миллисекундах)
@@ -453,26 +1122,20 @@ T_can_err CAN_send_or_post_msg(T_can_msg *msg, uint16_t timeout)
  * Output:      CAN_OK - сообщение успешно получено и скопировано
  *              CAN_TIMEOUT_ERROR - таймаут ожидания сообщения
  *
- * Called by:   - Task_can_receiver() для получения принятых CAN сообщений
- *              - Пользовательские функции для чтения входящих сообщений
+ * Called by:   - Пользовательские функции для чтения входящих сообщений
  *
- * Note:        Функция блокирующая - ожидает сообщения в течение timeout
- *              Автоматически освобождает память после копирования сообщения
- *              Использует очередь can_rx_queue для буферизации принятых сообщений
+ * Note:        Оставлена для совместимости; Task_can_receiver обрабатывает кадры на месте
+ *              через CAN_rx_get_msg()/CAN_rx_release_msg() без копирования
  *-----------------------------------------------------------------------------------------------------*/
 T_can_err CAN_pull_msg_from_mbox(T_can_msg *msg, uint16_t timeout)
 {
-  T_can_msg *ptrmsg;
+  T_can_msg *ptrmsg = CAN_rx_get_msg(timeout);
 
-  /* Wait for received message in queue                                    */
-  if (xQueueReceive(can_rx_queue, &ptrmsg, pdMS_TO_TICKS(timeout)) != pdTRUE)
+  if (ptrmsg == NULL)
     return CAN_TIMEOUT_ERROR;
 
-  /* Copy received message from queue to address given in function parameter msg */
   *msg = *ptrmsg;
-
-  /* Free memory where message was kept                                         */
-  free_can_msg(ptrmsg);
+  CAN_rx_release_msg();
 
   return CAN_OK;
 }
@@ -537,7 +1200,7 @@ uint8_t Check_ONBUS_ACK_timeout(void)
 
   // Если ожидаем подтверждения и прошла секунда без ACK
   if (onbus_status.pending &&
-      (current_time - onbus_status.last_send_time) > pdMS_TO_TICKS(1000))
+      (current_time - onbus_status.last_send_time) > pdMS_TO_TICKS(CAN_ONBUS_RETRY_MS))
   {
     return 1;  // Нужна повторная отправка
   }
@@ -587,7 +1250,7 @@ uint8_t Is_CAN_bus_active(uint32_t can_err)
 /*-----------------------------------------------------------------------------------------------------
  * Function: CAN_process_errors
  *
- * Description: Обрабатывает ошибки CAN и выполняет необходимые действия по восстановлению
+ * Description: Обрабатывает ошибки CAN и ведет статистику ошибок
  *
  * Input:       can_err - битовая маска ошибок CAN
  *
@@ -595,18 +1258,17 @@ uint8_t Is_CAN_bus_active(uint32_t can_err)
  *
  * Called by:   - Task_can_transmiter() для обработки ошибок CAN
  *
- * Note:        Реализует различные стратегии восстановления в зависимости от типа ошибки
- *              Ведет статистику ошибок для диагностики проблем
+ * Note:        Ведет статистику ошибок для диагностики проблем
+ *              Восстановление после Bus-Off выполняет CAN_bus_supervise() без остановки задачи
  *-----------------------------------------------------------------------------------------------------*/
 static void CAN_process_errors(uint32_t can_err)
 {
   uint32_t        current_time     = xTaskGetTickCount();
   static uint32_t last_stable_time = 0;
 
-  // Сначала сбрасываем обработанные ошибки в HAL для предотвращения накопления
+  // Ошибки уже сброшены в HAL функцией CAN_get_errors()
   if (can_err != 0)
   {
-    HAL_CAN_ResetError(&hcan);
     can_error_stats.last_error_time = current_time;
   }
 
@@ -619,7 +1281,6 @@ static void CAN_process_errors(uint32_t can_err)
     {
       can_error_stats.consecutive_errors--;
     }
-    can_error_stats.recovery_in_progress = 0;
     return;
   }
 
@@ -634,57 +1295,30 @@ static void CAN_process_errors(uint32_t can_err)
 
   /* Критические ошибки состояния шины */
 
-  // Bus-Off ошибка - самая критичная (bit 2)
-  if (can_err & 0x04)
+  // Bus-Off ошибка - самая критичная, восстановление ведет CAN_bus_supervise()
+  if (can_err & HAL_CAN_ERROR_BOF)
   {
     can_error_stats.bus_off_count++;
-    can_error_stats.recovery_in_progress = 1;
-    can_error_stats.recovery_attempts++;
-
-    // Автоматическое восстановление при Bus-Off
-    HAL_CAN_Stop(&hcan);
-    vTaskDelay(pdMS_TO_TICKS(200));  // Увеличенная пауза для стабилизации
-    HAL_CAN_Start(&hcan);
-
-    // Повторная активация прерываний
-    HAL_CAN_ActivateNotification(&hcan,
-                                 CAN_IT_TX_MAILBOX_EMPTY |
-                                 CAN_IT_RX_FIFO0_MSG_PENDING |
-                                 CAN_IT_RX_FIFO0_OVERRUN);
-
-    // Очищаем очереди и сбрасываем счетчик
-    xQueueReset(can_tx_queue);
-    xQueueReset(can_rx_queue);
     can_error_stats.consecutive_errors = 0;
-    return;  // Не обрабатываем другие ошибки после Bus-Off восстановления
+    return;  // Остальные ошибки относятся к кадрам, приведшим к Bus-Off
   }
 
-  // Error Passive состояние - менее агрессивная реакция (bit 1)
-  if (can_err & 0x02)
+  // Error Passive состояние - контроллер продолжает работу сам
+  if (can_err & HAL_CAN_ERROR_EPV)
   {
     can_error_stats.error_passive_count++;
-
-    // Восстановление только при критическом количестве ошибок
-    if (can_error_stats.consecutive_errors > 30)
-    {
-      can_error_stats.recovery_attempts++;
-      HAL_CAN_Stop(&hcan);
-      vTaskDelay(pdMS_TO_TICKS(100));
-      HAL_CAN_Start(&hcan);
-      can_error_stats.consecutive_errors = 0;
-    }
   }
 
-  // Error Warning состояние (bit 0)
-  if (can_err & 0x01)
+  // Error Warning состояние
+  if (can_err & HAL_CAN_ERROR_EWG)
   {
     can_error_stats.error_warning_count++;
   }
 
   /* Ошибки протокола CAN - менее критичные */
 
-  // ACK ошибки - могут быть временными при подаче питания (bit 5)
-  if (can_err & 0x20)
+  // ACK ошибки - могут быть временными при подаче питания
+  if (can_err & HAL_CAN_ERROR_ACK)
   {
     can_error_stats.ack_error_count++;
 
@@ -696,58 +1330,153 @@ static void CAN_process_errors(uint32_t can_err)
     }
   }
 
-  // Stuff ошибки (bit 4)
-  if (can_err & 0x10)
+  // Stuff ошибки
+  if (can_err & HAL_CAN_ERROR_STF)
   {
     can_error_stats.stuff_error_count++;
   }
 
-  // Form ошибки (bit 3)
-  if (can_err & 0x08)
+  // Form ошибки
+  if (can_err & HAL_CAN_ERROR_FOR)
   {
     can_error_stats.form_error_count++;
   }
 
-  // CRC ошибки (bit 6)
-  if (can_err & 0x40)
+  // CRC ошибки
+  if (can_err & HAL_CAN_ERROR_CRC)
   {
     can_error_stats.crc_error_count++;
   }
 
   /* Ошибки передачи TX_TERR - обычно временные */
 
-  // TX_TERR0 - ошибка передачи в Mailbox 0 (bit 26)
-  if (can_err & (1UL << 26))
+  // TX_TERR0 - ошибка передачи в Mailbox 0
+  if (can_err & HAL_CAN_ERROR_TX_TERR0)
   {
     can_error_stats.tx_terr0_count++;
   }
 
-  // TX_TERR1 - ошибка передачи в Mailbox 1 (bit 27)
-  if (can_err & (1UL << 27))
+  // TX_TERR1 - ошибка передачи в Mailbox 1
+  if (can_err & HAL_CAN_ERROR_TX_TERR1)
   {
     can_error_stats.tx_terr1_count++;
   }
 
-  // TX_TERR2 - ошибка передачи в Mailbox 2 (bit 28)
-  if (can_err & (1UL << 28))
+  // TX_TERR2 - ошибка передачи в Mailbox 2
+  if (can_err & HAL_CAN_ERROR_TX_TERR2)
   {
     can_error_stats.tx_terr2_count++;
   }
+}
+
+/*-----------------------------------------------------------------------------------------------------
+ * Function: CAN_bus_restart
+ *
+ * Description: Проводит контроллер через режим инициализации, что запускает отсчет
+ *              128 последовательностей из 11 рецессивных бит для выхода из Bus-Off
+ *
+ * Input:       Нет
+ *
+ * Output:      Нет
+ *
+ * Called by:   - CAN_bus_supervise() по действию CAN_BUS_ACT_RESTART
+ *
+ * Note:        Фильтры, скорость и разрешения прерываний при этом сохраняются
+ *              Если контроллер не подтвердил вход в режим инициализации, попытка
+ *              завершится по таймауту CAN_BUS_RECOVER_TIMEOUT_MS и будет повторена
+ *-----------------------------------------------------------------------------------------------------*/
+static void CAN_bus_restart(void)
+{
+  uint32_t i;
+
+  SET_BIT(hcan.Instance->MCR, CAN_MCR_INRQ);
+  for (i = 0; i < CAN_INAK_WAIT_LOOPS && (hcan.Instance->MSR & CAN_MSR_INAK) == 0; i++)
+  {
+  }
+  CLEAR_BIT(hcan.Instance->MCR, CAN_MCR_INRQ);
+}
+
+/*-----------------------------------------------------------------------------------------------------
+ * Function: CAN_bus_supervise
+ *
+ * Description: Передает состояние шины из регистра ESR автомату Can_bus_recovery
+ *              и выполняет его действия
+ *
+ * Input:       Нет
+ *
+ * Output:      Нет
+ *
+ * Called by:   - Task_can_transmiter() по каждому событию и таймауту
+ *
+ * Note:        При входе в Bus-Off кадры приоритетов ниже HIGH отбрасываются, кадры HIGH
+ *              снимаются из mailbox и ждут в очереди до конца восстановления
+ *              Время автомата - тики FreeRTOS, равные миллисекундам при configTICK_RATE_HZ = 1000
+ *-----------------------------------------------------------------------------------------------------*/
+static void CAN_bus_supervise(void)
+{
+  uint32_t esr    = hcan.Instance->ESR;
+  uint32_t status = 0;
+  uint32_t act;
+
+  if (esr & CAN_ESR_BOFF)
+  {
+    status |= CAN_BUS_IN_BOFF;
+  }
+  if (esr & CAN_ESR_EPVF)
+  {
+    status |= CAN_BUS_IN_EPV;
+  }
+
+  act = Can_bus_recovery_step(&can_bus_rec, status, xTaskGetTickCount());
 
-  /* Критическая диагностика - только для персистентных ошибок */
-  // Полная переинициализация только при критическом состоянии
-  if (can_error_stats.consecutive_errors > 100 &&
-      !can_error_stats.recovery_in_progress)
+  if (act & CAN_BUS_ACT_HOLD_TX)
+  {
+    can_tx_hold = 1;
+    CAN_tx_flush(CAN_TX_PRIO_NORMAL);
+    CAN_tx_service();
+  }
+  if (act & CAN_BUS_ACT_RESTART)
   {
     can_error_stats.recovery_attempts++;
-    can_error_stats.consecutive_errors   = 0;
-    can_error_stats.recovery_in_progress = 1;  // Полная переинициализация CAN с увеличенной паузой
-    vTaskDelay(pdMS_TO_TICKS(500));            // Пауза перед переинициализацией
-    CAN_init();
-    // Повторная настройка всех фильтров после восстановления
-    CAN_setup_all_filters();
-    CAN_release_init_mode();
+    CAN_bus_restart();
+  }
+  if (act & CAN_BUS_ACT_RESUME_TX)
+  {
+    can_tx_hold = 0;
+    CAN_tx_service();
+  }
+  can_error_stats.recovery_in_progress = (can_bus_rec.state >= CAN_BUS_OFF);
+}
+
+/*-----------------------------------------------------------------------------------------------------
+ * Function: CAN_supervisor_timeout
+ *
+ * Description: Время ожидания событий задачей Task_can_transmiter
+ *
+ * Input:       Нет
+ *
+ * Output:      Тиков до ближайшего из сроков: повторной отправки ONBUS и шага автомата восстановления шины
+ *              portMAX_DELAY, если ONBUS не ожидает ACK и шина в состоянии Error Active
+ *-----------------------------------------------------------------------------------------------------*/
+static TickType_t CAN_supervisor_timeout(void)
+{
+  TickType_t elapsed;
+  TickType_t timeout = portMAX_DELAY;
+  TickType_t onbus;
+  uint32_t   rec_ms  = Can_bus_recovery_timeout(&can_bus_rec, xTaskGetTickCount());
+
+  if (rec_ms != CAN_BUS_NO_TIMEOUT)
+  {
+    timeout = pdMS_TO_TICKS(rec_ms);
   }
+
+  if (!onbus_status.pending)
+  {
+    return timeout;
+  }
+  elapsed = xTaskGetTickCount() - onbus_status.last_send_time;
+  onbus   = (elapsed > pdMS_TO_TICKS(CAN_ONBUS_RETRY_MS)) ? 0 : (pdMS_TO_TICKS(CAN_ONBUS_RETRY_MS) + 1 - elapsed);
+  return (onbus < timeout) ? onbus : timeout;
 }
 
 /*-----------------------------------------------------------------------------------------------------
@@ -755,7 +1484,7 @@ static void CAN_process_errors(uint32_t can_err)
  *
  * Description: Задача FreeRTOS для инициализации CAN и мониторинга ошибок
  *              Выполняет начальную настройку CAN контроллера, фильтров,
- *              отправляет сообщение ONBUS и периодически проверяет состояние шины
+ *              отправляет сообщение ONBUS и обрабатывает события шины
  *
  * Input:       pvParameters - параметры задачи FreeRTOS (не используются)
  *
@@ -765,14 +1494,18 @@ static void CAN_process_errors(uint32_t can_err)
  *
  * Note:        Приоритет задачи должен обеспечивать своевременное обслуживание CAN
  *              Фильтр настраивается на прием сообщений с ID узла (PDISPLx_REQ)
- *              Проверка ошибок каждые 10 мс для раннего обнаружения проблем шины
- *              Реализует автоматическое восстановление при критических ошибках
+ *              Задача спит до уведомления из прерываний ошибок CAN, подтверждения ONBUS
+ *              или запроса смены адреса. Таймаут ставится только на срок повтора ONBUS
+ *              и на шаг автомата восстановления шины, поэтому на исправной шине без событий
+ *              задача не просыпается
+ *              Восстановление после Bus-Off не блокирует задачу: паузы выдерживаются таймаутом ожидания
  *-----------------------------------------------------------------------------------------------------*/
 void Task_can_transmiter(void *pvParameters)
 {
   unsigned int can_err;
 
   // Инициализация CAN контроллера
+  Can_bus_recovery_init(&can_bus_rec, CAN_AUTO_BUS_OFF, xTaskGetTickCount());
   CAN_init();
   // Настройка всех фильтров для приема сообщений с адресом узла
   CAN_setup_all_filters();
@@ -788,8 +1521,9 @@ void Task_can_transmiter(void *pvParameters)
     // Получение текущих ошибок CAN контроллера
     can_err = CAN_get_errors(CAN_CHANL);
 
-    // Обработка ошибок с автоматическим восстановлением
+    // Учет ошибок и шаг автомата восстановления после Bus-Off
     CAN_process_errors(can_err);
+    CAN_bus_supervise();
     // Проверка необходимости повторной отправки ONBUS сообщения
     if (Check_ONBUS_ACK_timeout())
     {
@@ -805,7 +1539,25 @@ void Task_can_transmiter(void *pvParameters)
       }
     }
 
-    vTaskDelay(pdMS_TO_TICKS(10));
+    // Смена адреса узла: новый план фильтров и повторное сообщение о подключении
+    if (can_node_addr_req >= 0)
+    {
+      app_vars.node_addr       = (uint32_t)can_node_addr_req;
+      can_node_addr_req        = -1;
+      onbus_status.retry_count = 0;
+      CAN_setup_all_filters();
+      Send_ONBUS_MSG();
+    }
+
+    // Смена групп рассылки: новый план фильтров
+    if (can_node_groups_req >= 0)
+    {
+      app_vars.node_groups = (uint32_t)can_node_groups_req;
+      can_node_groups_req  = -1;
+      CAN_setup_all_filters();
+    }
+
+    xTaskNotifyWait(0, 0xFFFFFFFF, NULL, CAN_supervisor_timeout());
   }
 }
 
@@ -813,8 +1565,7 @@ void Task_can_transmiter(void *pvParameters)
  * Function: Task_can_receiver
  *
  * Description: Задача FreeRTOS для приема и обработки CAN сообщений дисплейного протокола
- *              Использует switch-case для эффективной маршрутизации команд по базовому ID
- *              Извлекает базовый ID (без адреса узла) и направляет сообщения к соответствующим обработчикам
+ *              Обрабатывает кадры прямо в слотах кольца приема без копирования
  *
  * Input:       pvParameters - параметры задачи FreeRTOS (не используются)
  *
@@ -822,81 +1573,27 @@ void Task_can_transmiter(void *pvParameters)
  *
  * Called by:   - FreeRTOS scheduler при создании задачи
  *
- * Note:        Таймаут приема 255 мс обеспечивает отзывчивость системы
- *              Использует вложенные switch-case для двухуровневой маршрутизации:
- *              1. По базовому ID (PDISPLx_REQ, PDISPLx_SET_RED_SYMB, PDISPLx_SET_GREEN_SYMB)
- *              2. По подкоманде в data[0] для PDISPLx_REQ
- *              Обработчики команд вынесены в отдельные функции в Application.c
- *              Поддерживаемые команды определяются в CAN_IDs.h
+ * Note:        Задача спит до прямого уведомления от прерывания приема
+ *              Таймаут ожидания 255 мс обеспечивает отзывчивость системы
  *-----------------------------------------------------------------------------------------------------*/
 void Task_can_receiver(void *pvParameters)
 {
-  T_can_msg msg_rcv;
-  uint32_t  base_id;
+  T_can_msg *msg;
+  uint32_t   stamp;
+  uint32_t   gen;
 
   for (;;)
   {
-    // When message arrives store received value to global variable Rx_val
-    if (CAN_pull_msg_from_mbox(&msg_rcv, 0x00FF) == CAN_OK)
+    msg = CAN_rx_get_msg(0x00FF);
+    if (msg != NULL)
     {
-      // Extract base ID (without node address)
-      base_id = msg_rcv.id & 0x1E0FFFFF;  // Mask out node address (bits 20-23)
-
-      // Process messages from display protocol using switch case
-      switch (base_id)
-      {
-        case PDISPLx_REQ:
-          // Handle commands sent to PDISPLx_REQ ID - sub-command in data[0]
-          switch (msg_rcv.data[0])
-          {
-            case PDISPLx_SET_SYMBOL:
-              Handle_CAN_SetSymbol(msg_rcv.data);
-              break;
-
-            case PDISPLx_SET_SYMBOL_PTRN1:
-              Handle_CAN_SetSymbolPattern1(msg_rcv.data);
-              break;
-
-            case PDISPLx_SET_SYMBOL_PTRN2:
-              Handle_CAN_SetSymbolPattern2(msg_rcv.data);
-              break;
-
-            case PDISPLx_DIN_SYMBOL_SET1:
-              Handle_CAN_DynamicSymbolSet1(msg_rcv.data);
-              break;
-
-            case PDISPLx_DIN_SYMBOL_SET2:
-              Handle_CAN_DynamicSymbolSet2(msg_rcv.data);
-              break;
-
-            case PDISPLx_DIN_SYMBOL_SET3:
-              Handle_CAN_DynamicSymbolSet3(msg_rcv.data);
-              break;
-
-            case PDISPLx_DIN_SYMBOL_SET4:
-              Handle_CAN_DynamicSymbolSet4(msg_rcv.data);
-              break;
-
-            default:
-              // Unknown command - ignore
-              break;
-          }
-          break;
-
-        case PDISPLx_SET_RED_SYMB:
-          // Handle red screen command
-          Handle_CAN_SetRedScreen(msg_rcv.data);
-          break;
-
-        case PDISPLx_SET_GREEN_SYMB:
-          // Handle green screen command
-          Handle_CAN_SetGreenScreen(msg_rcv.data);
-          break;
-
-        default:
-          // Unknown message ID - ignore
-          break;
-      }
+      stamp = CAN_rx_msg_stamp();
+      CAN_lat_hist_add(can_load_stats.rx_dispatch_hist, &can_load_stats.rx_dispatch_max_us, DWT->CYCCNT - stamp);
+      gen   = Display_screen_gen();
+      Can_dispatch_msg(msg, app_vars.node_addr, stamp);
+      // A command that changed the picture is timed until the frame flip that shows it
+      Display_mark_command(gen, stamp);
+      CAN_rx_release_msg();
     }
   }
 }
@@ -907,7 +1604,6 @@ void Task_can_receiver(void *pvParameters)
  * Function: HAL_CAN_TxMailbox0CompleteCallback
  * * Description: Callback функция HAL для обработки завершения передачи из Mailbox 0
  *              Вызывается аппаратным прерыванием при успешной отправке CAN сообщения
- *              Проверяет очередь передачи и отправляет следующее сообщение если есть
  *
  * Input:       hcan - указатель на дескриптор CAN контроллера HAL
  *
@@ -915,41 +1611,19 @@ void Task_can_receiver(void *pvParameters)
  *
  * Called by:   - HAL_CAN interrupt handler при завершении передачи
  *
- * Note:        Выполняется в контексте прерывания - использует ISR-безопасные функции FreeRTOS
- *              Если очередь передачи не пуста - отправляет следующее сообщение
- *              Автоматически обрабатывает цепочку сообщений в очереди
- *              Вызывает portYIELD_FROM_ISR для переключения контекста при необходимости
+ * Note:        Выполняется в контексте прерывания
+ *              Учитывает задержку кадра и загружает освободившийся mailbox через
+ *              CAN_tx_mbox_complete()
  *-----------------------------------------------------------------------------------------------------*/
 void HAL_CAN_TxMailbox0CompleteCallback(CAN_HandleTypeDef *hcan)
 {
-  T_can_msg *ptrmsg;
-  BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-
-  // Проверяем, получили ли ACK (успешная передача без ошибок)
-  uint32_t can_error                  = HAL_CAN_GetError(hcan);
-  if ((can_error & (HAL_CAN_ERROR_TX_ALST0 | HAL_CAN_ERROR_TX_TERR0)) == HAL_CAN_ERROR_NONE)
-  {
-    // ACK получен - отмечаем успешную передачу для ONBUS сообщений
-    if (onbus_status.pending)
-    {
-      onbus_status.ack_received = 1;
-      onbus_status.pending      = 0;
-    }
-  }  // If there is a message in the queue ready for send, read the message from the queue and send it
-  if (xQueueReceiveFromISR(can_tx_queue, &ptrmsg, &xHigherPriorityTaskWoken) == pdTRUE)
-  {
-    CAN_fill_and_send_mbox(ptrmsg);
-    free_can_msg(ptrmsg);
-    xHigherPriorityTaskWoken = pdTRUE;
-  }
-  portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+  CAN_tx_mbox_complete(0);
 }
 
 /*-----------------------------------------------------------------------------------------------------
  * Function: HAL_CAN_TxMailbox1CompleteCallback
  *
  * Description: Callback функция HAL для обработки завершения передачи из Mailbox 1
- *              Перенаправляет обработку на общую функцию HAL_CAN_TxMailbox0CompleteCallback
  *
  * Input:       hcan - указатель на дескриптор CAN контроллера HAL
  *
@@ -963,14 +1637,13 @@ void HAL_CAN_TxMailbox0CompleteCallback(CAN_HandleTypeDef *hcan)
  *-----------------------------------------------------------------------------------------------------*/
 void HAL_CAN_TxMailbox1CompleteCallback(CAN_HandleTypeDef *hcan)
 {
-  HAL_CAN_TxMailbox0CompleteCallback(hcan);
+  CAN_tx_mbox_complete(1);
 }
 
 /*-----------------------------------------------------------------------------------------------------
  * Function: HAL_CAN_TxMailbox2CompleteCallback
  *
  * Description: Callback функция HAL для обработки завершения передачи из Mailbox 2
- *              Перенаправляет обработку на общую функцию HAL_CAN_TxMailbox0CompleteCallback
  *
  * Input:       hcan - указатель на дескриптор CAN контроллера HAL
  *
@@ -984,77 +1657,182 @@ void HAL_CAN_TxMailbox1CompleteCallback(CAN_HandleTypeDef *hcan)
  *-----------------------------------------------------------------------------------------------------*/
 void HAL_CAN_TxMailbox2CompleteCallback(CAN_HandleTypeDef *hcan)
 {
-  HAL_CAN_TxMailbox0CompleteCallback(hcan);
+  CAN_tx_mbox_complete(2);
 }
 
 /*-----------------------------------------------------------------------------------------------------
- * Function: HAL_CAN_RxFifo0MsgPendingCallback
+ * Function: HAL_CAN_TxMailbox0AbortCallback
  *
- * Description: Callback функция HAL для обработки поступления CAN сообщения в FIFO0
- *              Вызывается аппаратным прерыванием при получении нового CAN сообщения
- *              Читает сообщение из FIFO, преобразует в внутренний формат и помещает в очередь приема
+ * Description: Callback функция HAL при снятии кадра с передачи из Mailbox 0
  *
  * Input:       hcan - указатель на дескриптор CAN контроллера HAL
  *
  * Output:      Нет
  *
- * Called by:   - HAL_CAN interrupt handler при поступлении сообщения в RX FIFO0
+ * Called by:   - HAL_CAN interrupt handler после HAL_CAN_AbortTxRequest()
  *
- * Note:        Выполняется в контексте прерывания - использует ISR-безопасные функции FreeRTOS
- *              Поддерживает стандартные и расширенные идентификаторы CAN
- *              Поддерживает Data Frame и Remote Frame типы сообщений
- *              При переполнении очереди приема сообщение отбрасывается
- *              Автоматически освобождает память при ошибках чтения или очереди
- *              Вызывает portYIELD_FROM_ISR для переключения контекста при необходимости
+ * Note:        Выполняется в контексте прерывания
+ *              Кадр возвращается в очередь через CAN_tx_mbox_abort()
  *-----------------------------------------------------------------------------------------------------*/
-void HAL_CAN_RxFifo0MsgPendingCallback(CAN_HandleTypeDef *hcan)
+void HAL_CAN_TxMailbox0AbortCallback(CAN_HandleTypeDef *hcan)
 {
-  CAN_RxHeaderTypeDef rxHeader;
-  T_can_msg          *ptrmsg;
-  BaseType_t          xHigherPriorityTaskWoken = pdFALSE;
+  CAN_tx_mbox_abort(0);
+}
 
-  // Allocate memory for CAN message
-  ptrmsg                                       = alloc_can_msg();
-  if (ptrmsg)
-  {
-    // Read received message
-    if (HAL_CAN_GetRxMessage(hcan, CAN_RX_FIFO0, &rxHeader, ptrmsg->data) == HAL_OK)
-    {
-      // Fill message structure
-      if (rxHeader.IDE == CAN_ID_EXT)
-      {
-        ptrmsg->format = EXTENDED_FORMAT;
-        ptrmsg->id     = rxHeader.ExtId;
-      }
-      else
-      {
-        ptrmsg->format = STANDARD_FORMAT;
-        ptrmsg->id     = rxHeader.StdId;
-      }
+/*-----------------------------------------------------------------------------------------------------
+ * Function: HAL_CAN_TxMailbox1AbortCallback
+ *
+ * Description: Callback функция HAL при снятии кадра с передачи из Mailbox 1
+ *
+ * Input:       hcan - указатель на дескриптор CAN контроллера HAL
+ *
+ * Output:      Нет
+ *
+ * Called by:   - HAL_CAN interrupt handler после HAL_CAN_AbortTxRequest()
+ *-----------------------------------------------------------------------------------------------------*/
+void HAL_CAN_TxMailbox1AbortCallback(CAN_HandleTypeDef *hcan)
+{
+  CAN_tx_mbox_abort(1);
+}
 
-      ptrmsg->type = (rxHeader.RTR == CAN_RTR_REMOTE) ? REMOTE_FRAME : DATA_FRAME;
-      ptrmsg->len  = rxHeader.DLC;
+/*-----------------------------------------------------------------------------------------------------
+ * Function: HAL_CAN_TxMailbox2AbortCallback
+ *
+ * Description: Callback функция HAL при снятии кадра с передачи из Mailbox 2
+ *
+ * Input:       hcan - указатель на дескриптор CAN контроллера HAL
+ *
+ * Output:      Нет
+ *
+ * Called by:   - HAL_CAN interrupt handler после HAL_CAN_AbortTxRequest()
+ *-----------------------------------------------------------------------------------------------------*/
+void HAL_CAN_TxMailbox2AbortCallback(CAN_HandleTypeDef *hcan)
+{
+  CAN_tx_mbox_abort(2);
+}
 
-      // Try to send message to queue
-      if (xQueueSendFromISR(can_rx_queue, &ptrmsg, &xHigherPriorityTaskWoken) == pdPASS)
-      {
-        xHigherPriorityTaskWoken = pdTRUE;
-      }
-      else
-      {
-        // Queue is full, free the allocated message
-        free_can_msg(ptrmsg);
-      }
+/*-----------------------------------------------------------------------------------------------------
+ * Function: CAN_rx_drain_fifo
+ *
+ * Description: Переносит все кадры приемного FIFO в кольцо приема
+ *              Читает кадры прямо из регистров FIFO в свободные слоты кольца
+ *
+ * Input:       hcan - указатель на дескриптор CAN контроллера HAL
+ *              fifo - номер FIFO (CAN_RX_FIFO0 или CAN_RX_FIFO1)
+ *
+ * Output:      Нет
+ *
+ * Called by:   - HAL_CAN_RxFifo0MsgPendingCallback()
+ *              - HAL_CAN_RxFifo1MsgPendingCallback()
+ *
+ * Note:        Выполняется в контексте прерывания
+ *              Оба прерывания приема имеют одинаковый приоритет и не вытесняют друг друга,
+ *              поэтому у кольца остается один производитель
+ *              При заполненном кольце кадр отбрасывается (счетчик rx_overflow_count)
+ *              Задача CANRx будится одним прямым уведомлением на всю пачку кадров
+ *              Ведет счетчики кадров и переполнений по FIFO и гистограмму глубины выборки
+ *-----------------------------------------------------------------------------------------------------*/
+static void CAN_rx_drain_fifo(CAN_HandleTypeDef *hcan, uint32_t fifo)
+{
+  CAN_FIFOMailBox_TypeDef *mbox                     = &hcan->Instance->sFIFOMailBox[fifo];
+  volatile uint32_t       *rfr                      = (fifo == CAN_RX_FIFO0) ? &hcan->Instance->RF0R : &hcan->Instance->RF1R;
+  T_can_msg               *slot;
+  uint32_t                 head                     = can_rx_ring.head;
+  uint32_t                 depth                    = 0;
+  uint32_t                 regs[4];
+  uint32_t                 stamp                    = DWT->CYCCNT;
+  BaseType_t               xHigherPriorityTaskWoken = pdFALSE;
+
+  // FIFO overrun: a frame was lost in hardware before this interrupt was served
+  if (*rfr & CAN_RF0R_FOVR0)
+  {
+    *rfr = CAN_RF0R_FOVR0;
+    can_error_stats.rx_fifo_overrun_count[fifo]++;
+  }
+
+  // FMP bits and RFOM have the same positions in RF0R and RF1R
+  while ((*rfr & CAN_RF0R_FMP0) != 0)
+  {
+    depth++;
+    regs[0] = mbox->RIR;
+    regs[1] = mbox->RDTR;
+    regs[2] = mbox->RDLR;
+    regs[3] = mbox->RDHR;
+    if (Can_rx_ring_store(&can_rx_ring, head, regs, stamp))
+    {
+      slot = &can_rx_ring.msg[head & (CAN_RX_RING_SIZE - 1)];
+      head++;
+      can_load_stats.rx_frames++;
+      can_load_stats.rx_bytes += slot->len;
+      can_load_stats.rx_bits  += CAN_frame_bits(slot->format, slot->len);
     }
     else
     {
-      free_can_msg(ptrmsg);
+      can_error_stats.rx_overflow_count++;
+    }
+
+    // Release the output mailbox, the next frame of the FIFO moves into it
+    *rfr = CAN_RF0R_RFOM0;
+  }
+
+  can_error_stats.rx_fifo_frames_count[fifo] += depth;
+  if ((head - can_rx_ring.tail) > can_load_stats.rx_ring_high_water)
+  {
+    can_load_stats.rx_ring_high_water = head - can_rx_ring.tail;
+  }
+  can_error_stats.rx_drain_depth_hist[(depth < CAN_RX_DRAIN_HIST_SIZE) ? depth : (CAN_RX_DRAIN_HIST_SIZE - 1)]++;
+
+  if (head != can_rx_ring.head)
+  {
+    __DMB();  // Slots are complete before the task can see them
+    can_rx_ring.head = head;
+    if (xCanRxTaskHandle != NULL)
+    {
+      vTaskNotifyGiveFromISR(xCanRxTaskHandle, &xHigherPriorityTaskWoken);
     }
   }
 
   portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
 }
 
+/*-----------------------------------------------------------------------------------------------------
+ * Function: HAL_CAN_RxFifo0MsgPendingCallback
+ *
+ * Description: Callback функция HAL для обработки поступления CAN сообщений в FIFO0
+ *              Вызывается аппаратным прерыванием при получении нового CAN сообщения
+ *
+ * Input:       hcan - указатель на дескриптор CAN контроллера HAL
+ *
+ * Output:      Нет
+ *
+ * Called by:   - HAL_CAN interrupt handler при поступлении сообщения в RX FIFO0
+ *
+ * Note:        FIFO0 принимает обновления изображения, выбирается полностью за одно прерывание
+ *-----------------------------------------------------------------------------------------------------*/
+void HAL_CAN_RxFifo0MsgPendingCallback(CAN_HandleTypeDef *hcan)
+{
+  CAN_rx_drain_fifo(hcan, CAN_RX_FIFO0);
+}
+
+/*-----------------------------------------------------------------------------------------------------
+ * Function: HAL_CAN_RxFifo1MsgPendingCallback
+ *
+ * Description: Callback функция HAL для обработки поступления CAN сообщений в FIFO1
+ *              Вызывается аппаратным прерыванием CAN1_RX1 при получении нового CAN сообщения
+ *
+ * Input:       hcan - указатель на дескриптор CAN контроллера HAL
+ *
+ * Output:      Нет
+ *
+ * Called by:   - HAL_CAN interrupt handler при поступлении сообщения в RX FIFO1
+ *
+ * Note:        FIFO1 принимает служебные посылки и обновление ПО, выбирается полностью за одно прерывание
+ *-----------------------------------------------------------------------------------------------------*/
+void HAL_CAN_RxFifo1MsgPendingCallback(CAN_HandleTypeDef *hcan)
+{
+  CAN_rx_drain_fifo(hcan, CAN_RX_FIFO1);
+}
+
 /*-----------------------------------------------------------------------------------------------------
  * Function: HAL_CAN_ErrorCallback
  *
@@ -1068,24 +1846,18 @@ void HAL_CAN_RxFifo0MsgPendingCallback(CAN_HandleTypeDef *hcan)
  * Called by:   - HAL_CAN interrupt handler при критических ошибках
  *
  * Note:        Выполняется в контексте прерывания
- *              Обрабатывает только критические ошибки Bus-Off
- *              Основная обработка ошибок выполняется в Task_can_transmiter
+ *              Вызывается из прерывания SCE (Error Warning, Error Passive, Bus-Off, код ошибки)
+ *              и из прерывания передачи. Обработка ошибок выполняется в Task_can_transmiter
+ *              Неудачная передача (ALST/TERR) сообщается только этим callback,
+ *              поэтому здесь вызывается планировщик для повтора кадра
  *-----------------------------------------------------------------------------------------------------*/
 void HAL_CAN_ErrorCallback(CAN_HandleTypeDef *hcan)
 {
-  // Обработка критической ошибки Bus-Off
-  if ((hcan->ErrorCode & HAL_CAN_ERROR_BOF) != 0)
-  {
-    // Увеличиваем счетчик Bus-Off ошибок
-    can_error_stats.bus_off_count++;
-    can_error_stats.consecutive_errors++;
+  CAN_tx_service();
 
-    // Основное восстановление будет выполнено в задаче Task_can_transmiter
-    // В прерывании только отмечаем факт ошибки
-  }
-
-  // Остальные ошибки обрабатываются в Task_can_transmiter
-  // для избежания блокировки прерывания
+  // Ошибки учитываются и Bus-Off восстанавливается в Task_can_transmiter
+  // по коду hcan->ErrorCode, здесь задача только пробуждается
+  CAN_notify_supervisor_from_isr(CAN_EVT_ERROR);
 }
 
 /*-----------------------------------------------------------------------------------------------------
@@ -1129,6 +1901,81 @@ void CAN_reset_error_stats(void)
   can_error_stats.recovery_in_progress = recovery_state;
 }
 
+/*-----------------------------------------------------------------------------------------------------
+ * Function: CAN_get_load_stats
+ *
+ * Description: Возвращает статистику загрузки шины и задержек обработки
+ *
+ * Input:       Нет
+ *
+ * Output:      Указатель на структуру T_can_load_stats
+ *
+ * Called by:   - Handle_CAN_ReadStats() по команде PDISPLx_READ_STATS
+ *-----------------------------------------------------------------------------------------------------*/
+const T_can_load_stats *CAN_get_load_stats(void)
+{
+  return &can_load_stats;
+}
+
+/*-----------------------------------------------------------------------------------------------------
+ * Function: CAN_get_bus_recovery
+ *
+ * Description: Возвращает состояние шины, переходы между состояниями и время восстановления после Bus-Off
+ *
+ * Input:       Нет
+ *
+ * Output:      Указатель на структуру T_can_bus_recovery
+ *
+ * Called by:   - Handle_CAN_ReadStats() по команде PDISPLx_READ_STATS
+ *-----------------------------------------------------------------------------------------------------*/
+const T_can_bus_recovery *CAN_get_bus_recovery(void)
+{
+  return &can_bus_rec;
+}
+
+/*-----------------------------------------------------------------------------------------------------
+ * Function: CAN_reset_load_stats
+ *
+ * Description: Сбрасывает гистограммы задержек и максимумы заполнения очередей
+ *
+ * Input:       Нет
+ *
+ * Output:      Нет
+ *
+ * Called by:   - Handle_CAN_ReadStats() по запросу со сбросом
+ *
+ * Note:        Счетчики кадров и байт не сбрасываются: по ним считаются скорости
+ *              Гистограммы пишутся из задачи приема и прерывания TIM2, поэтому сброс
+ *              выполняется в критической секции
+ *-----------------------------------------------------------------------------------------------------*/
+void CAN_reset_load_stats(void)
+{
+  taskENTER_CRITICAL();
+  memset(can_load_stats.rx_dispatch_hist, 0, sizeof(can_load_stats.rx_dispatch_hist));
+  memset(can_load_stats.cmd_display_hist, 0, sizeof(can_load_stats.cmd_display_hist));
+  can_load_stats.rx_dispatch_max_us = 0;
+  can_load_stats.cmd_display_max_us = 0;
+  can_load_stats.rx_ring_high_water = 0;
+  can_pool.stats.high_water         = can_pool.stats.used;
+  taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------------------------------------------------
+ * Function: CAN_note_display_latency
+ *
+ * Description: Учитывает задержку от приема команды до смены кадра на дисплее
+ *
+ * Input:       cyc - задержка в тактах DWT->CYCCNT
+ *
+ * Output:      Нет
+ *
+ * Called by:   - Display_event_isr() при смене страницы с отмеченной командой
+ *-----------------------------------------------------------------------------------------------------*/
+void CAN_note_display_latency(uint32_t cyc)
+{
+  CAN_lat_hist_add(can_load_stats.cmd_display_hist, &can_load_stats.cmd_display_max_us, cyc);
+}
+
 /*-----------------------------------------------------------------------------------------------------
  * Function: Get_ONBUS_status
  *
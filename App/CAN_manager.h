@@ -1,6 +1,10 @@
 #ifndef __CAN_MANAGER_H
 #define __CAN_MANAGER_H
 
+#include <stdint.h>
+#include "Can_pool.h"
+#include "Can_bus_recovery.h"
+
 typedef enum
 {
   CAN_OK = 0,                 // No error
@@ -20,39 +24,39 @@ typedef enum
 /*
  * ОБЩЕЕ ИСПОЛЬЗОВАНИЕ ПАМЯТИ CAN:
  *
- * Статический пул: CAN_CTRL_MAX_NUM * (SEND + RECV + LOG) = 1 * (2 + 8 + 2) = 12 сообщений
- * Размер сообщения: sizeof(T_can_msg) = 16 байт
- * Общий расход RAM: 12 * 16 = 192 байта для пула сообщений
- *                 + 2 * 4 = 8 байт для TX очереди указателей
- *                 + 8 * 4 = 32 байта для RX очереди указателей
- *                 + размер статических буферов FreeRTOS
- * ИТОГО: ~240 байт RAM для CAN подсистемы
+ * Статический пул передачи: CAN_CTRL_MAX_NUM * (SEND + LOG) = 1 * (6 + 0) = 6 блоков
+ * Кольцо приема: RECV = 8 слотов, заполняется прерыванием прямо из регистров FIFO
+ * Размер блока пула: сообщение 16 байт + служебные поля планировщика = 32 байта
+ * Общий расход RAM: 6 * 32 = 192 байта для пула сообщений
+ *                 + 8 * 16 = 128 байт для кольца приема
+ *                 + ~100 байт статистики и состояния планировщика передачи
+ * ИТОГО: ~500 байт RAM для CAN подсистемы, FreeRTOS очереди не используются
  */
 
 /**
  * @brief Размер очереди передачи CAN сообщений
  *
  * Определяет максимальное количество сообщений, которые могут ожидать
- * отправки в программном буфере. Небольшое значение (2) обусловлено тем,
- * что LED дисплей редко отправляет сообщения (в основном ONBUS).
+ * отправки в программном буфере сверх трех аппаратных mailbox.
+ * Сообщения ждут в списках по приоритетам, последний свободный блок
+ * пула резервируется для приоритета CAN_TX_PRIO_HIGH.
  *
  * Используется для:
- * - Создания FreeRTOS очереди can_tx_queue
  * - Расчета размера общего пула памяти для CAN сообщений
  */
-#define CAN_NO_SEND_OBJECTS 2
+#define CAN_NO_SEND_OBJECTS 6
 
 /**
  * @brief Размер очереди приема CAN сообщений
  *
  * Определяет максимальное количество принятых сообщений, которые могут
- * храниться в программном буфере до их обработки пользовательским кодом.
+ * храниться в кольце приема до их обработки пользовательским кодом.
+ * Должно быть степенью 2.
  * Значение 8 обеспечивает буферизацию команд управления дисплеем при
  * пиковых нагрузках CAN шины.
  *
  * Используется для:
- * - Создания FreeRTOS очереди can_rx_queue
- * - Расчета размера общего пула памяти для CAN сообщений
+ * - Создания кольца приема can_rx_ring
  */
 #define CAN_NO_RECV_OBJECTS 8
 
@@ -61,12 +65,13 @@ typedef enum
  *
  * В текущей реализации активно НЕ используется, но резервирует память
  * в общем пуле для возможного добавления функций логирования/диагностики.
- * Можно установить в 0 для экономии RAM, если логирование не планируется.
+ * Установлено в 0: каждый блок пула стоит 32 байта RAM, а 6 КБ RAM
+ * контроллера едва хватает на стеки задач.
  *
  * Используется только для:
  * - Расчета размера общего пула памяти для CAN сообщений
  */
-#define CAN_NO_LOG_OBJECTS  2
+#define CAN_NO_LOG_OBJECTS  0
 
 /*--------------------------- CAN Controller Configuration ---------------*/
 
@@ -114,6 +119,8 @@ typedef enum
   REMOTE_FRAME
 } T_can_frame_type;
 
+#define CAN_RX_DRAIN_HIST_SIZE 4  // Глубина аппаратного FIFO (3) + 1
+
 /* Статистика ошибок CAN */
 typedef struct {
   uint32_t bus_off_count;        // Счетчик Bus-Off состояний
@@ -128,10 +135,68 @@ typedef struct {
   uint32_t tx_terr2_count;       // Счетчик ошибок передачи MailBox 2
   uint32_t recovery_attempts;    // Счетчик попыток восстановления
   uint32_t last_error_time;      // Время последней ошибки (в тиках)
+  uint32_t rx_overflow_count;    // Счетчик кадров, потерянных из-за заполненного кольца приема
+  uint32_t rx_fifo_frames_count[2];   // Счетчики принятых кадров по FIFO0 и FIFO1
+  uint32_t rx_fifo_overrun_count[2];  // Счетчики аппаратных переполнений FIFO0 и FIFO1
+  uint32_t rx_drain_depth_hist[CAN_RX_DRAIN_HIST_SIZE];  // Число прерываний, выбравших 0, 1, 2, 3 кадра
   uint8_t  consecutive_errors;   // Счетчик последовательных ошибок
   uint8_t  recovery_in_progress; // Флаг процесса восстановления
 } CAN_Error_Stats_t;
 
+/*--------------------------- CAN Load Statistics -------------------*/
+
+#define CAN_LAT_HIST_SIZE 8  // Корзины гистограмм задержек: < 32, < 64, ... < 2048 мкс и >= 2048 мкс
+
+/* Загрузка шины и задержки обработки, скорости обновляются раз в секунду */
+typedef struct {
+  uint32_t rx_frames;           // Принято кадров (прошедших фильтры) с запуска
+  uint32_t tx_frames;           // Передано кадров с подтверждением с запуска
+  uint32_t rx_bytes;            // Байт данных в принятых кадрах
+  uint32_t tx_bytes;            // Байт данных в переданных кадрах
+  uint32_t rx_bits;             // Битовых интервалов, занятых принятыми кадрами (без бит-стаффинга)
+  uint32_t tx_bits;             // Битовых интервалов, занятых переданными кадрами (без бит-стаффинга)
+  uint32_t rx_fps;              // Принято кадров за последнюю секунду
+  uint32_t tx_fps;              // Передано кадров за последнюю секунду
+  uint32_t rx_bps;              // Принято байт данных за последнюю секунду
+  uint32_t tx_bps;              // Передано байт данных за последнюю секунду
+  uint32_t bus_load_pm;         // Занятость шины видимыми узлу кадрами за последнюю секунду, промилле
+  uint32_t rx_ring_high_water;  // Максимум кадров, ожидавших обработки в кольце приема
+  uint32_t rx_dispatch_hist[CAN_LAT_HIST_SIZE];  // Задержка от прерывания приема до обработчика команды
+  uint32_t rx_dispatch_max_us;
+  uint32_t cmd_display_hist[CAN_LAT_HIST_SIZE];  // Задержка от прерывания приема команды до смены кадра
+  uint32_t cmd_display_max_us;
+} T_can_load_stats;
+
+/*--------------------------- CAN Transmit Scheduler -------------------*/
+
+/* Приоритеты передачи: меньшее значение обслуживается раньше */
+typedef enum
+{
+  CAN_TX_PRIO_HIGH = 0,  // Срочные ответы, вытесняет из mailbox менее срочные кадры
+  CAN_TX_PRIO_NORMAL,    // Обычные сообщения (CAN_send_or_post_msg)
+  CAN_TX_PRIO_LOW,       // Периодический статус и отладка
+  CAN_TX_PRIO_NUM
+} T_can_tx_prio;
+
+#define CAN_TX_RETRY_MAX    8  // Повторов после ошибки передачи до отбрасывания кадра
+#define CAN_TX_HIGH_RESERVE 1  // Блоков пула, недоступных приоритетам ниже CAN_TX_PRIO_HIGH
+
+/* Статистика передачи по одному приоритету, задержки в тиках FreeRTOS */
+typedef struct {
+  uint32_t sent_count;     // Передано с подтверждением
+  uint32_t drop_count;     // Не принято в очередь за таймаут или отброшено после CAN_TX_RETRY_MAX
+  uint32_t preempt_count;  // Снято из mailbox ради более срочного кадра
+  uint32_t retry_count;    // Повторов после ошибки передачи или проигрыша арбитража
+  uint32_t latency_max;    // Максимальная задержка от постановки в очередь до подтверждения
+  uint32_t latency_sum;    // Сумма задержек (среднее = latency_sum / sent_count)
+} T_can_tx_prio_stats;
+
+/*--------------------------- Bus-Off Recovery -------------------*/
+
+/* 1 - Bus-Off покидается аппаратно (MCR.ABOM) сразу после 128 x 11 рецессивных бит,
+   0 - Task_can_transmiter выдерживает паузу с удвоением при повторных отказах и запускает восстановление сама */
+#define CAN_AUTO_BUS_OFF 0
+
 /*--------------------------- ONBUS Status Tracking -------------------*/
 
 /**
@@ -150,9 +215,15 @@ typedef struct {
 T_can_err    CAN_init(void);
 T_can_err    CAN_release_init_mode(void);
 T_can_err    CAN_send_or_post_msg(T_can_msg *msg, uint16_t timeout);
+T_can_err    CAN_send_msg_prio(const T_can_msg *msg, T_can_tx_prio prio, uint16_t timeout);
 T_can_err    CAN_pull_msg_from_mbox(T_can_msg *msg, uint16_t timeout);
+T_can_msg   *CAN_rx_get_msg(uint16_t timeout);
+uint32_t     CAN_rx_msg_stamp(void);
+void         CAN_rx_release_msg(void);
 unsigned int CAN_get_errors(uint32_t chanel);
-void         CAN_set_32bit_filter_mask(uint16_t bank, uint32_t filter, uint32_t mask);
+void         CAN_set_32bit_filter_mask(uint16_t bank, uint32_t filter, uint32_t mask, uint32_t fifo);
+void         CAN_set_node_addr(uint32_t addr);
+void         CAN_set_node_groups(uint32_t groups);
 
 /* FreeRTOS task functions - take void pointer parameter */
 void Task_can_transmiter(void *pvParameters);
@@ -162,6 +233,14 @@ void Task_can_receiver(void *pvParameters);
 T_can_msg *alloc_can_msg(void);
 void       free_can_msg(T_can_msg *msg);
 
+const T_can_pool_stats    *CAN_get_pool_stats(void);
+const T_can_tx_prio_stats *CAN_get_tx_stats(void);
+const T_can_load_stats    *CAN_get_load_stats(void);
+void                       CAN_reset_load_stats(void);
+void                       CAN_update_load_stats(void);
+void                       CAN_note_display_latency(uint32_t cyc);
+const T_can_bus_recovery  *CAN_get_bus_recovery(void);
+
 /* Error statistics functions */
 const CAN_Error_Stats_t* CAN_get_error_stats(void);
 void                     CAN_reset_error_stats(void);
@@ -0,0 +1,139 @@
+#include <string.h>
+#include "Can_bus_recovery.h"
+
+//------------------------------------------------------------------------------
+// Change state and count the transition
+//------------------------------------------------------------------------------
+static void Bus_enter(T_can_bus_recovery *r, uint32_t state, uint32_t now_ms)
+{
+  r->state   = (uint8_t)state;
+  r->t_enter = now_ms;
+  r->enter_count[state]++;
+}
+
+//------------------------------------------------------------------------------
+// Start in error active state
+//------------------------------------------------------------------------------
+void Can_bus_recovery_init(T_can_bus_recovery *r, uint32_t auto_bus_off, uint32_t now_ms)
+{
+  memset(r, 0, sizeof(*r));
+  r->auto_bus_off = (uint8_t)(auto_bus_off != 0);
+  r->holdoff_ms   = CAN_BUS_HOLDOFF_MIN_MS;
+  r->t_enter      = now_ms;
+  r->t_recovered  = now_ms - CAN_BUS_STABLE_MS;
+}
+
+//------------------------------------------------------------------------------
+// Advance on new status flags or on a timeout
+// Returns CAN_BUS_ACT_xxx actions the driver must execute
+//------------------------------------------------------------------------------
+uint32_t Can_bus_recovery_step(T_can_bus_recovery *r, uint32_t status, uint32_t now_ms)
+{
+  uint32_t on_bus_state = (status & CAN_BUS_IN_EPV) ? CAN_BUS_ERROR_PASSIVE : CAN_BUS_ERROR_ACTIVE;
+  uint32_t elapsed      = now_ms - r->t_enter;
+
+  switch (r->state)
+  {
+    case CAN_BUS_ERROR_ACTIVE:
+    case CAN_BUS_ERROR_PASSIVE:
+      if (status & CAN_BUS_IN_BOFF)
+      {
+        // A node that falls off again soon after a recovery waits longer each time
+        if ((now_ms - r->t_recovered) < CAN_BUS_STABLE_MS)
+        {
+          r->holdoff_ms *= 2;
+          if (r->holdoff_ms > CAN_BUS_HOLDOFF_MAX_MS)
+          {
+            r->holdoff_ms = CAN_BUS_HOLDOFF_MAX_MS;
+          }
+        }
+        else
+        {
+          r->holdoff_ms = CAN_BUS_HOLDOFF_MIN_MS;
+        }
+        r->t_bus_off = now_ms;
+        Bus_enter(r, CAN_BUS_OFF, now_ms);
+        return CAN_BUS_ACT_HOLD_TX;
+      }
+      if (on_bus_state != r->state)
+      {
+        Bus_enter(r, on_bus_state, now_ms);
+      }
+      return 0;
+
+    case CAN_BUS_OFF:
+      if (r->auto_bus_off)
+      {
+        // Hardware counts the recessive bits itself, only its completion is awaited
+        break;
+      }
+      if (elapsed >= r->holdoff_ms)
+      {
+        Bus_enter(r, CAN_BUS_RECOVERING, now_ms);
+        return CAN_BUS_ACT_RESTART;
+      }
+      return 0;
+
+    case CAN_BUS_RECOVERING:
+      if ((status & CAN_BUS_IN_BOFF) && elapsed >= CAN_BUS_RECOVER_TIMEOUT_MS)
+      {
+        // No 128 x 11 recessive bits in sight: the bus is stuck, back off and retry
+        r->recover_fail_count++;
+        r->holdoff_ms *= 2;
+        if (r->holdoff_ms > CAN_BUS_HOLDOFF_MAX_MS)
+        {
+          r->holdoff_ms = CAN_BUS_HOLDOFF_MAX_MS;
+        }
+        Bus_enter(r, CAN_BUS_OFF, now_ms);
+        return 0;
+      }
+      break;
+
+    default:
+      Bus_enter(r, on_bus_state, now_ms);
+      return 0;
+  }
+
+  // Bus-off or recovering: done once the controller has cleared BOFF
+  if (status & CAN_BUS_IN_BOFF)
+  {
+    return 0;
+  }
+  r->recover_count++;
+  r->recover_last_ms = now_ms - r->t_bus_off;
+  if (r->recover_last_ms > r->recover_max_ms)
+  {
+    r->recover_max_ms = r->recover_last_ms;
+  }
+  r->t_recovered = now_ms;
+  Bus_enter(r, on_bus_state, now_ms);
+  return CAN_BUS_ACT_RESUME_TX;
+}
+
+//------------------------------------------------------------------------------
+// Time after which Can_bus_recovery_step() must run again without a status change
+// Returns ms, or CAN_BUS_NO_TIMEOUT if only status interrupts can advance the state
+//------------------------------------------------------------------------------
+uint32_t Can_bus_recovery_timeout(const T_can_bus_recovery *r, uint32_t now_ms)
+{
+  uint32_t elapsed = now_ms - r->t_enter;
+
+  switch (r->state)
+  {
+    case CAN_BUS_ERROR_PASSIVE:
+      return CAN_BUS_PASSIVE_POLL_MS;
+
+    case CAN_BUS_OFF:
+      if (r->auto_bus_off)
+      {
+        return CAN_BUS_POLL_MS;
+      }
+      return (elapsed >= r->holdoff_ms) ? 0 : (r->holdoff_ms - elapsed);
+
+    case CAN_BUS_RECOVERING:
+      return CAN_BUS_POLL_MS;
+
+    default:
+      return CAN_BUS_NO_TIMEOUT;
+  }
+}
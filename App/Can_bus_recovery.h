@@ -0,0 +1,59 @@
+#ifndef __CAN_BUS_RECOVERY_H
+#define __CAN_BUS_RECOVERY_H
+
+#include <stdint.h>
+
+// Fault confinement state machine of the bxCAN node, free of HAL and OS calls.
+// The driver feeds it status flags and a millisecond time and executes the returned actions.
+// After bus-off the controller may rejoin only after 128 occurrences of 11 recessive bits
+// (ISO 11898-1). With automatic bus-off management the hardware starts that sequence itself;
+// otherwise the state machine holds the node off the bus for holdoff_ms, then asks the driver
+// to pass through initialization mode, which starts the sequence. Until the controller reports
+// BOFF clear, transmission is held. A bus-off shortly after a recovery doubles the holdoff.
+
+#define CAN_BUS_HOLDOFF_MIN_MS     100   // Pause before the first recovery attempt
+#define CAN_BUS_HOLDOFF_MAX_MS     1600  // Backoff limit for a bus that keeps failing
+#define CAN_BUS_STABLE_MS          1000  // Bus-off later than this after recovery resets the backoff
+#define CAN_BUS_RECOVER_TIMEOUT_MS 100   // 128 x 11 bits take 2.5 ms at 562.5 kbit/s; longer means a stuck bus
+#define CAN_BUS_POLL_MS            1     // Status poll while waiting for BOFF to clear
+#define CAN_BUS_PASSIVE_POLL_MS    100   // Error passive has no exit interrupt, poll for the return to active
+#define CAN_BUS_NO_TIMEOUT         0xFFFFFFFFu
+
+// Status inputs
+#define CAN_BUS_IN_BOFF 0x01u  // ESR.BOFF
+#define CAN_BUS_IN_EPV  0x02u  // ESR.EPVF
+
+// Actions for the driver
+#define CAN_BUS_ACT_HOLD_TX   0x01u  // Entered bus-off: stop loading mailboxes, drop non-urgent frames
+#define CAN_BUS_ACT_RESTART   0x02u  // Enter and leave initialization mode to start the recovery sequence
+#define CAN_BUS_ACT_RESUME_TX 0x04u  // Back on the bus: resume transmission
+
+typedef enum
+{
+  CAN_BUS_ERROR_ACTIVE = 0,
+  CAN_BUS_ERROR_PASSIVE,
+  CAN_BUS_OFF,         // Holdoff before a recovery attempt, or hardware recovery with automatic bus-off
+  CAN_BUS_RECOVERING,  // Initialization mode left, waiting for 128 x 11 recessive bits
+  CAN_BUS_STATE_NUM
+} T_can_bus_state;
+
+typedef struct
+{
+  uint8_t  state;                           // T_can_bus_state
+  uint8_t  auto_bus_off;                    // Hardware leaves bus-off by itself (MCR.ABOM)
+  uint32_t t_enter;                         // Time the current state was entered, ms
+  uint32_t t_bus_off;                       // Time the last bus-off began, ms
+  uint32_t t_recovered;                     // Time of the last successful recovery, ms
+  uint32_t holdoff_ms;                      // Current pause before a recovery attempt
+  uint32_t enter_count[CAN_BUS_STATE_NUM];  // Transitions into each state
+  uint32_t recover_count;                   // Successful recoveries
+  uint32_t recover_fail_count;              // Attempts that timed out with BOFF still set
+  uint32_t recover_last_ms;                 // Bus-off to back-on-bus time of the last recovery
+  uint32_t recover_max_ms;
+} T_can_bus_recovery;
+
+void     Can_bus_recovery_init(T_can_bus_recovery *r, uint32_t auto_bus_off, uint32_t now_ms);
+uint32_t Can_bus_recovery_step(T_can_bus_recovery *r, uint32_t status, uint32_t now_ms);
+uint32_t Can_bus_recovery_timeout(const T_can_bus_recovery *r, uint32_t now_ms);
+
+#endif
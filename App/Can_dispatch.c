@@ -0,0 +1,152 @@
+#include "CAN_IDs.h"
+#include "Can_dispatch.h"
+#include "Frame_delta.h"
+
+//------------------------------------------------------------------------------
+// XOR delta after the sub-command byte is complete: a frame shorter than its mask
+// announces would apply stale bytes of the receive buffer as row changes
+//------------------------------------------------------------------------------
+static uint32_t Can_dispatch_delta_fits(const T_can_msg *msg)
+{
+  int32_t size = Frame_delta_size(&msg->data[1]);
+
+  return (size != FRAME_DELTA_FULL) && ((1U + (uint32_t)size) <= msg->len);
+}
+
+//------------------------------------------------------------------------------
+// Route one received frame to its command handler; unknown commands are ignored
+// node_addr - own address of the board, rx_cyc - reception time for PDISPLx_TIME_SYNC
+//------------------------------------------------------------------------------
+void Can_dispatch_msg(const T_can_msg *msg, uint32_t node_addr, uint32_t rx_cyc)
+{
+  uint32_t base_id;
+
+  // Extract base ID (without node address)
+  base_id = msg->id & CAN_DISPATCH_ADDR_MASK;  // Mask out node address (bits 20-23)
+
+  // Process messages from display protocol using switch case
+  switch (base_id)
+  {
+    case PDISPLx_REQ:
+      // Handle commands sent to PDISPLx_REQ ID - sub-command in data[0]
+      switch (msg->data[0])
+      {
+        case PDISPLx_SET_SYMBOL:
+          Handle_CAN_SetSymbol(msg->data);
+          break;
+
+        case PDISPLx_SET_SYMBOL_PTRN1:
+          Handle_CAN_SetSymbolPattern1(msg->data);
+          break;
+
+        case PDISPLx_SET_SYMBOL_PTRN2:
+          Handle_CAN_SetSymbolPattern2(msg->data);
+          break;
+
+        case PDISPLx_DIN_SYMBOL_SET1:
+          Handle_CAN_DynamicSymbolSet1(msg->data);
+          break;
+
+        case PDISPLx_DIN_SYMBOL_SET2:
+          Handle_CAN_DynamicSymbolSet2(msg->data);
+          break;
+
+        case PDISPLx_DIN_SYMBOL_SET3:
+          Handle_CAN_DynamicSymbolSet3(msg->data);
+          break;
+
+        case PDISPLx_DIN_SYMBOL_SET4:
+          Handle_CAN_DynamicSymbolSet4(msg->data);
+          break;
+
+        case PDISPLx_SET_BRIGHTNESS:
+          Handle_CAN_SetBrightness(msg->data);
+          break;
+
+        case PDISPLx_FRAME_BEGIN:
+          Handle_CAN_FrameBegin(msg->data);
+          break;
+
+        case PDISPLx_FRAME_COMMIT:
+          Handle_CAN_FrameCommit(msg->data);
+          break;
+
+        case PDISPLx_XOR_RED:
+          if (Can_dispatch_delta_fits(msg))
+          {
+            Handle_CAN_XorRedScreen(msg->data);
+          }
+          break;
+
+        case PDISPLx_XOR_GREEN:
+          if (Can_dispatch_delta_fits(msg))
+          {
+            Handle_CAN_XorGreenScreen(msg->data);
+          }
+          break;
+
+        case PDISPLx_SET_GROUPS:
+          // Membership is assigned per node, group and broadcast copies are ignored
+          if (((msg->id >> 20) & 0x0F) == node_addr)
+          {
+            Handle_CAN_SetGroups(msg->data);
+          }
+          break;
+
+        case PDISPLx_TIME_SYNC:
+          Handle_CAN_TimeSync(msg->data, rx_cyc);
+          break;
+
+        case PDISPLx_READ_STATS:
+          Handle_CAN_ReadStats(msg->data);
+          break;
+
+        case PDISPLx_SET_SPRITE:
+          Handle_CAN_SetSprite(msg->data);
+          break;
+
+        case PDISPLx_SCRIPT_LOAD:
+          Handle_CAN_ScriptLoad(msg->data);
+          break;
+
+        case PDISPLx_SCRIPT_RUN:
+          Handle_CAN_ScriptRun(msg->data);
+          break;
+
+        case PDISPLx_GLYPH_BEGIN:
+          Handle_CAN_GlyphBegin(msg->data);
+          break;
+
+        case PDISPLx_GLYPH_DATA:
+          // A short chunk would store stale bytes of the receive buffer as glyph rows
+          if (msg->len >= 8)
+          {
+            Handle_CAN_GlyphData(msg->data);
+          }
+          break;
+
+        case PDISPLx_GLYPH_COMMIT:
+          Handle_CAN_GlyphCommit(msg->data);
+          break;
+
+        default:
+          // Unknown command - ignore
+          break;
+      }
+      break;
+
+    case PDISPLx_SET_RED_SYMB:
+      // Handle red screen command
+      Handle_CAN_SetRedScreen(msg->data);
+      break;
+
+    case PDISPLx_SET_GREEN_SYMB:
+      // Handle green screen command
+      Handle_CAN_SetGreenScreen(msg->data);
+      break;
+
+    default:
+      // Unknown message ID - ignore
+      break;
+  }
+}
@@ -0,0 +1,40 @@
+#ifndef __CAN_DISPATCH_H
+#define __CAN_DISPATCH_H
+
+#include <stdint.h>
+#include "CAN_manager.h"
+
+// Routing of received display protocol frames to the command handlers, free of HAL and OS calls.
+// The base ID (node address bits 20..23 masked out) selects the command, PDISPLx_REQ carries the
+// sub-command in data[0]. The handlers are implemented by the application (Application.c).
+
+#define CAN_DISPATCH_ADDR_MASK 0x1E0FFFFFu  // Identifier without the node address
+
+void Can_dispatch_msg(const T_can_msg *msg, uint32_t node_addr, uint32_t rx_cyc);
+
+/* CAN Display Protocol Command Handlers */
+void Handle_CAN_SetSymbol(const uint8_t *data);
+void Handle_CAN_SetSymbolPattern1(const uint8_t *data);
+void Handle_CAN_SetSymbolPattern2(const uint8_t *data);
+void Handle_CAN_DynamicSymbolSet1(const uint8_t *data);
+void Handle_CAN_DynamicSymbolSet2(const uint8_t *data);
+void Handle_CAN_DynamicSymbolSet3(const uint8_t *data);
+void Handle_CAN_DynamicSymbolSet4(const uint8_t *data);
+void Handle_CAN_SetRedScreen(const uint8_t *data);
+void Handle_CAN_SetGreenScreen(const uint8_t *data);
+void Handle_CAN_SetBrightness(const uint8_t *data);
+void Handle_CAN_FrameBegin(const uint8_t *data);
+void Handle_CAN_FrameCommit(const uint8_t *data);
+void Handle_CAN_XorRedScreen(const uint8_t *data);
+void Handle_CAN_XorGreenScreen(const uint8_t *data);
+void Handle_CAN_SetGroups(const uint8_t *data);
+void Handle_CAN_TimeSync(const uint8_t *data, uint32_t rx_cyc);
+void Handle_CAN_ReadStats(const uint8_t *data);
+void Handle_CAN_SetSprite(const uint8_t *data);
+void Handle_CAN_ScriptLoad(const uint8_t *data);
+void Handle_CAN_ScriptRun(const uint8_t *data);
+void Handle_CAN_GlyphBegin(const uint8_t *data);
+void Handle_CAN_GlyphData(const uint8_t *data);
+void Handle_CAN_GlyphCommit(const uint8_t *data);
+
+#endif
@@ -0,0 +1,298 @@
+#include <stddef.h>
+#include "CAN_IDs.h"
+#include "Can_filter_plan.h"
+
+#define EXT_ID_BITS 0x1FFFFFFFu
+
+#define REG32_RTR   0x02u
+#define REG32_IDE   0x04u
+
+// Base ID, FIFO of the frames it accepts, and acceptance at the broadcast and group addresses
+typedef struct
+{
+  uint32_t base_id;
+  uint32_t fifo;
+  uint32_t group;
+} T_can_filter_cfg;
+
+// FIFO0 - picture updates (time critical), FIFO1 - service frames and firmware upgrade.
+// Answers and firmware upgrade are accepted at the own address of the board only
+static const T_can_filter_cfg can_filters[] = {
+ {PDISPLx_ONBUS_MSG,      1, 0},
+ {PDISPLx_REQ,            0, 1},
+ {PDISPLx_ANS,            1, 0},
+ {PDISPLx_UPGRADE_RX_ID,  1, 0},
+ {PDISPLx_SET_RED_SYMB,   0, 1},
+ {PDISPLx_SET_GREEN_SYMB, 0, 1},
+ {PDISPLx_UPGRADE_TX_ID,  1, 0}
+};
+
+#define CAN_FILTERS_COUNT (sizeof(can_filters) / sizeof(can_filters[0]))
+
+// Set of IDs: all IDs equal to val on the bits set in care
+typedef struct
+{
+  uint32_t val;
+  uint32_t care;
+} T_id_cube;
+
+//------------------------------------------------------------------------------
+// 32-bit scale image of an extended data frame ID: ID in bits 31..3, IDE set, RTR clear
+//------------------------------------------------------------------------------
+static uint32_t Filter_reg32(uint32_t id)
+{
+  return ((id & EXT_ID_BITS) << 3) | REG32_IDE;
+}
+
+//------------------------------------------------------------------------------
+// Merge cubes that differ in exactly one cared bit until no such pair is left.
+// Both halves of a merged cube come from the set, so the cover stays exact.
+// Bits are tried from the lowest up, so IDs of one node merge over the command
+// field before address bits join cubes of different nodes
+// Returns the new number of cubes
+//------------------------------------------------------------------------------
+static uint32_t Filter_merge_cubes(T_id_cube *c, uint32_t n)
+{
+  uint32_t i;
+  uint32_t j;
+  uint32_t d;
+  uint32_t bit;
+  uint32_t merged = 1;
+
+  // Drop duplicate IDs first
+  for (i = 0; i < n; i++)
+  {
+    for (j = i + 1; j < n; j++)
+    {
+      if (c[i].val == c[j].val)
+      {
+        c[j--] = c[--n];
+      }
+    }
+  }
+
+  while (merged)
+  {
+    merged = 0;
+    for (bit = 1; bit & EXT_ID_BITS; bit <<= 1)
+    {
+      for (i = 0; i < n; i++)
+      {
+        for (j = i + 1; j < n; j++)
+        {
+          d = c[i].val ^ c[j].val;
+          if (d == bit && c[i].care == c[j].care)
+          {
+            c[i].care &= ~d;
+            c[i].val  &= ~d;
+            c[j]       = c[--n];
+            merged     = 1;
+            break;
+          }
+        }
+      }
+    }
+  }
+  return n;
+}
+
+//------------------------------------------------------------------------------
+// Accept set of the display protocol: every base ID at the node address, picture commands also
+// at the broadcast address and at the addresses of the groups set in the groups mask
+// ids must hold CAN_FILTER_PLAN_MAX_IDS entries
+// Returns number of IDs
+//------------------------------------------------------------------------------
+uint32_t Can_filter_plan_ids(uint32_t node_addr, uint32_t groups, T_can_accept_id *ids)
+{
+  uint32_t n = 0;
+  uint32_t i;
+  uint32_t g;
+
+  for (i = 0; i < CAN_FILTERS_COUNT; i++)
+  {
+    ids[n].id     = can_filters[i].base_id | (node_addr << 20);
+    ids[n++].fifo = can_filters[i].fifo;
+    if (can_filters[i].group)
+    {
+      ids[n].id     = can_filters[i].base_id | (PDISPLx_ADDR_BROADCAST << 20);
+      ids[n++].fifo = can_filters[i].fifo;
+      for (g = 0; g < PDISPLx_GROUPS_NUM; g++)
+      {
+        if (groups & (1u << g))
+        {
+          ids[n].id     = can_filters[i].base_id | ((PDISPLx_ADDR_GROUP0 + g) << 20);
+          ids[n++].fifo = can_filters[i].fifo;
+        }
+      }
+    }
+  }
+  return n;
+}
+
+// Cube workspace of one FIFO, static to keep it off small task stacks
+static T_id_cube cube[CAN_FILTER_PLAN_FIFO_IDS];
+
+//------------------------------------------------------------------------------
+// Add an ID to the cube workspace; past the end only the count grows
+//------------------------------------------------------------------------------
+static void Filter_add_id(uint32_t *cnt, uint32_t id)
+{
+  if (*cnt < CAN_FILTER_PLAN_FIFO_IDS)
+  {
+    cube[*cnt].val  = id & EXT_ID_BITS;
+    cube[*cnt].care = EXT_ID_BITS;
+  }
+  (*cnt)++;
+}
+
+//------------------------------------------------------------------------------
+// Merge the cnt IDs of the workspace and pack them into banks of the FIFO from *nb on
+// Returns 0, or -1 if the IDs overflowed the workspace or the banks run out
+//------------------------------------------------------------------------------
+static int32_t Filter_pack_fifo(uint32_t cnt, uint32_t fifo, T_can_filter_bank *banks, uint32_t *nb, uint32_t max_banks)
+{
+  T_can_filter_bank *list = NULL;  // List bank with a free second entry
+  T_can_filter_bank *b;
+  uint32_t           i;
+
+  if (cnt > CAN_FILTER_PLAN_FIFO_IDS)
+  {
+    return -1;
+  }
+  cnt = Filter_merge_cubes(cube, cnt);
+
+  for (i = 0; i < cnt; i++)
+  {
+    if (cube[i].care == EXT_ID_BITS && list != NULL)
+    {
+      list->r2 = Filter_reg32(cube[i].val);
+      list     = NULL;
+      continue;
+    }
+
+    if (*nb >= max_banks)
+    {
+      return -1;
+    }
+    b       = &banks[(*nb)++];
+    b->fifo = (uint8_t)fifo;
+    if (cube[i].care == EXT_ID_BITS)
+    {
+      b->kind = CAN_FILTER_LIST32;
+      b->r1   = Filter_reg32(cube[i].val);
+      b->r2   = b->r1;  // Duplicate until a second ID comes
+      list    = b;
+    }
+    else
+    {
+      b->kind = CAN_FILTER_MASK32;
+      b->r1   = Filter_reg32(cube[i].val);
+      b->r2   = Filter_reg32(cube[i].care) | REG32_RTR;
+    }
+  }
+  return 0;
+}
+
+//------------------------------------------------------------------------------
+// Plan filter banks that accept exactly the given IDs, each into its FIFO
+// Returns number of banks used, or -1 if the set does not fit into max_banks
+// or one FIFO gets more than CAN_FILTER_PLAN_FIFO_IDS IDs
+// Not reentrant: shares the static cube workspace with Can_filter_plan_node()
+//------------------------------------------------------------------------------
+int32_t Can_filter_plan_build(const T_can_accept_id *ids, uint32_t n, T_can_filter_bank *banks, uint32_t max_banks)
+{
+  uint32_t fifo;
+  uint32_t cnt;
+  uint32_t i;
+  uint32_t nb = 0;
+
+  for (fifo = 0; fifo < 2; fifo++)
+  {
+    cnt = 0;
+    for (i = 0; i < n; i++)
+    {
+      if (ids[i].fifo == fifo)
+      {
+        Filter_add_id(&cnt, ids[i].id);
+      }
+    }
+    if (Filter_pack_fifo(cnt, fifo, banks, &nb, max_banks) < 0)
+    {
+      return -1;
+    }
+  }
+  return (int32_t)nb;
+}
+
+//------------------------------------------------------------------------------
+// Plan filter banks for the accept set of Can_filter_plan_ids() without building the ID list:
+// IDs go from the filter table straight into the cube workspace, one FIFO at a time,
+// in the same order, so the banks equal those of Can_filter_plan_build()
+// Returns number of banks used, or -1 if the set does not fit into max_banks
+// Not reentrant: shares the static cube workspace with Can_filter_plan_build()
+//------------------------------------------------------------------------------
+int32_t Can_filter_plan_node(uint32_t node_addr, uint32_t groups, T_can_filter_bank *banks, uint32_t max_banks)
+{
+  uint32_t fifo;
+  uint32_t cnt;
+  uint32_t i;
+  uint32_t g;
+  uint32_t nb = 0;
+
+  for (fifo = 0; fifo < 2; fifo++)
+  {
+    cnt = 0;
+    for (i = 0; i < CAN_FILTERS_COUNT; i++)
+    {
+      if (can_filters[i].fifo != fifo)
+      {
+        continue;
+      }
+      Filter_add_id(&cnt, can_filters[i].base_id | (node_addr << 20));
+      if (can_filters[i].group)
+      {
+        Filter_add_id(&cnt, can_filters[i].base_id | (PDISPLx_ADDR_BROADCAST << 20));
+        for (g = 0; g < PDISPLx_GROUPS_NUM; g++)
+        {
+          if (groups & (1u << g))
+          {
+            Filter_add_id(&cnt, can_filters[i].base_id | ((PDISPLx_ADDR_GROUP0 + g) << 20));
+          }
+        }
+      }
+    }
+    if (Filter_pack_fifo(cnt, fifo, banks, &nb, max_banks) < 0)
+    {
+      return -1;
+    }
+  }
+  return (int32_t)nb;
+}
+
+//------------------------------------------------------------------------------
+// Software model of the hardware acceptance of an extended data frame
+// Returns FIFO the frame is stored in, or -1 if the frame is rejected
+//------------------------------------------------------------------------------
+int32_t Can_filter_plan_match(const T_can_filter_bank *banks, uint32_t n, uint32_t id)
+{
+  uint32_t reg = Filter_reg32(id);
+  uint32_t i;
+  int32_t  hit;
+
+  for (i = 0; i < n; i++)
+  {
+    if (banks[i].kind == CAN_FILTER_MASK32)
+    {
+      hit = ((reg ^ banks[i].r1) & banks[i].r2) == 0;
+    }
+    else
+    {
+      hit = reg == banks[i].r1 || reg == banks[i].r2;
+    }
+    if (hit)
+    {
+      return banks[i].fifo;
+    }
+  }
+  return -1;
+}
@@ -0,0 +1,46 @@
+#ifndef __CAN_FILTER_PLAN_H
+#define __CAN_FILTER_PLAN_H
+
+#include <stdint.h>
+
+// Packing of an exact set of accepted 29-bit extended data-frame IDs into bxCAN filter banks.
+// IDs are merged into id/mask cubes that cover no foreign ID, then packed per FIFO:
+// single IDs two per bank in 32-bit list mode, larger cubes one per bank in 32-bit mask mode.
+// 16-bit scale is not used: it sees only ID bits 28..15, and display IDs differ from foreign
+// traffic in the low bits too, so a 16-bit bank could not keep the accept set exact.
+// Every bank checks IDE = 1 and RTR = 0, so standard and remote frames never pass.
+// Can_filter_plan_ids() builds the accept set of the display protocol for a node,
+// Can_filter_plan_node() plans the same set without the ID list.
+
+#define CAN_FILTER_PLAN_MAX_IDS    32  // Accept set size
+#define CAN_FILTER_PLAN_FIFO_IDS   27  // IDs of one FIFO: 3 picture commands at the own, broadcast and 7 group addresses
+#define CAN_FILTER_PLAN_MAX_BANKS  14  // Filter banks of a single-CAN STM32F1
+#define CAN_FILTER_PLAN_NODE_BANKS 11  // Most banks a node plan takes, checked by Can_filter_plan_test
+
+typedef enum
+{
+  CAN_FILTER_MASK32 = 0,  // r1 - id, r2 - mask
+  CAN_FILTER_LIST32,      // r1, r2 - ids
+} T_can_filter_kind;
+
+// Bank image in the layout of the CAN_FxR1/CAN_FxR2 registers
+typedef struct
+{
+  uint8_t  kind;  // T_can_filter_kind
+  uint8_t  fifo;  // 0 or 1
+  uint32_t r1;
+  uint32_t r2;
+} T_can_filter_bank;
+
+typedef struct
+{
+  uint32_t id;    // 29-bit extended identifier
+  uint32_t fifo;  // 0 or 1
+} T_can_accept_id;
+
+uint32_t Can_filter_plan_ids(uint32_t node_addr, uint32_t groups, T_can_accept_id *ids);
+int32_t  Can_filter_plan_build(const T_can_accept_id *ids, uint32_t n, T_can_filter_bank *banks, uint32_t max_banks);
+int32_t  Can_filter_plan_node(uint32_t node_addr, uint32_t groups, T_can_filter_bank *banks, uint32_t max_banks);
+int32_t  Can_filter_plan_match(const T_can_filter_bank *banks, uint32_t n, uint32_t id);
+
+#endif
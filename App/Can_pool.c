@@ -0,0 +1,81 @@
+#include <string.h>
+#include "Can_pool.h"
+
+//------------------------------------------------------------------------------
+// Link all blocks into the free-list
+// Statistics other than the number of used blocks are kept over a reinit
+//------------------------------------------------------------------------------
+void Can_pool_init(T_can_pool *pool, void *base, uint32_t blk_size, uint32_t num)
+{
+  uint8_t *blk;
+  void    *next = NULL;
+  uint32_t i;
+
+  pool->base     = (uint8_t *)base;
+  pool->blk_size = blk_size;
+  pool->num      = num;
+  // Linked from the end so the list runs in address order
+  for (i = num; i > 0; i--)
+  {
+    blk = pool->base + (i - 1) * blk_size;
+    memcpy(blk, &next, sizeof(next));
+    next = blk;
+  }
+  pool->free_head  = next;
+  pool->used_map   = 0;
+  pool->stats.used = 0;
+}
+
+//------------------------------------------------------------------------------
+// Take the block at the head of the free-list in constant time
+// reserve - blocks that must stay free after the allocation
+// Returns the block or NULL when no more than reserve blocks are free
+//------------------------------------------------------------------------------
+void *Can_pool_take(T_can_pool *pool, uint32_t reserve)
+{
+  uint8_t *blk;
+
+  if (pool->stats.used + reserve >= pool->num)
+  {
+    return NULL;  // Counted in alloc_fail_count by the caller: a waiting sender retries every tick
+  }
+  blk = (uint8_t *)pool->free_head;
+  memcpy(&pool->free_head, blk, sizeof(pool->free_head));
+  pool->used_map |= 1UL << ((uint32_t)(blk - pool->base) / pool->blk_size);
+  if (++pool->stats.used > pool->stats.high_water)
+  {
+    pool->stats.high_water = pool->stats.used;
+  }
+  return blk;
+}
+
+//------------------------------------------------------------------------------
+// Return a block to the head of the free-list
+// A pointer outside the pool, not at a block start or to a free block leaves the list
+// unchanged and is counted in bad_free_count
+// Returns 0 - block freed, 1 - pointer rejected
+//------------------------------------------------------------------------------
+uint32_t Can_pool_give(T_can_pool *pool, void *blk)
+{
+  uint8_t *p = (uint8_t *)blk;
+  uint32_t offs;
+  uint32_t bit;
+
+  if ((p < pool->base) || (p >= pool->base + pool->num * pool->blk_size))
+  {
+    pool->stats.bad_free_count++;
+    return 1;
+  }
+  offs = (uint32_t)(p - pool->base);
+  bit  = 1UL << (offs / pool->blk_size);
+  if (((offs % pool->blk_size) != 0) || ((pool->used_map & bit) == 0))
+  {
+    pool->stats.bad_free_count++;
+    return 1;
+  }
+  pool->used_map &= ~bit;
+  memcpy(p, &pool->free_head, sizeof(pool->free_head));
+  pool->free_head = p;
+  pool->stats.used--;
+  return 0;
+}
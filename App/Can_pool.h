@@ -0,0 +1,35 @@
+#ifndef __CAN_POOL_H
+#define __CAN_POOL_H
+
+#include <stdint.h>
+
+// Fixed-block pool with an intrusive free-list, free of HAL and OS calls.
+// A free block stores the pointer to the next free block in its first bytes, so a block must be
+// at least pointer sized. A bitmap of allocated blocks rejects foreign pointers
+// and double frees without touching the list. The caller serializes access.
+
+#define CAN_POOL_MAX_BLOCKS 32  // One bit of used_map per block
+
+typedef struct
+{
+  uint32_t used;              // Blocks allocated now
+  uint32_t high_water;        // Most blocks allocated at once
+  uint32_t alloc_fail_count;  // Allocations refused, pool empty
+  uint32_t bad_free_count;    // Double frees and foreign pointers
+} T_can_pool_stats;
+
+typedef struct
+{
+  uint8_t         *base;      // First block
+  uint32_t         blk_size;  // Block size in bytes
+  uint32_t         num;       // Number of blocks, up to CAN_POOL_MAX_BLOCKS
+  void            *free_head; // Head of the free-list, NULL - pool empty
+  uint32_t         used_map;  // Bit n set - block n is allocated
+  T_can_pool_stats stats;
+} T_can_pool;
+
+void     Can_pool_init(T_can_pool *pool, void *base, uint32_t blk_size, uint32_t num);
+void    *Can_pool_take(T_can_pool *pool, uint32_t reserve);
+uint32_t Can_pool_give(T_can_pool *pool, void *blk);
+
+#endif
@@ -0,0 +1,70 @@
+#include <string.h>
+#include "Can_rx_ring.h"
+
+// Bits of the bxCAN RIR and RDTR registers
+#define CAN_RX_RIR_RTR      0x00000002u
+#define CAN_RX_RIR_IDE      0x00000004u
+#define CAN_RX_RIR_EXID_POS 3
+#define CAN_RX_RIR_STID_POS 21
+#define CAN_RX_RDTR_DLC     0x0000000Fu
+
+//------------------------------------------------------------------------------
+// Decode one FIFO output mailbox into the slot of the unpublished index head
+// regs - RIR, RDTR, RDLR, RDHR in register order
+// Returns 1 - frame stored, 0 - ring full, frame dropped
+//------------------------------------------------------------------------------
+uint32_t Can_rx_ring_store(T_can_rx_ring *ring, uint32_t head, const uint32_t *regs, uint32_t stamp)
+{
+  T_can_msg *slot;
+  uint32_t   rir = regs[0];
+
+  if ((head - ring->tail) >= CAN_RX_RING_SIZE)
+  {
+    return 0;
+  }
+  slot = &ring->msg[head & (CAN_RX_RING_SIZE - 1)];
+  if (rir & CAN_RX_RIR_IDE)
+  {
+    slot->format = EXTENDED_FORMAT;
+    slot->id     = rir >> CAN_RX_RIR_EXID_POS;
+  }
+  else
+  {
+    slot->format = STANDARD_FORMAT;
+    slot->id     = rir >> CAN_RX_RIR_STID_POS;
+  }
+  slot->type = (rir & CAN_RX_RIR_RTR) ? REMOTE_FRAME : DATA_FRAME;
+  slot->len  = (uint8_t)(regs[1] & CAN_RX_RDTR_DLC);
+  memcpy(&slot->data[0], &regs[2], 4);
+  memcpy(&slot->data[4], &regs[3], 4);
+  ring->stamp[head & (CAN_RX_RING_SIZE - 1)] = stamp;
+  return 1;
+}
+
+//------------------------------------------------------------------------------
+// Oldest published frame, left in the ring, or NULL when the ring is empty
+//------------------------------------------------------------------------------
+T_can_msg *Can_rx_ring_front(T_can_rx_ring *ring)
+{
+  if (ring->head == ring->tail)
+  {
+    return NULL;
+  }
+  return &ring->msg[ring->tail & (CAN_RX_RING_SIZE - 1)];
+}
+
+//------------------------------------------------------------------------------
+// Reception time of the frame returned by Can_rx_ring_front()
+//------------------------------------------------------------------------------
+uint32_t Can_rx_ring_front_stamp(const T_can_rx_ring *ring)
+{
+  return ring->stamp[ring->tail & (CAN_RX_RING_SIZE - 1)];
+}
+
+//------------------------------------------------------------------------------
+// Hand the slot of the front frame back to the producer
+//------------------------------------------------------------------------------
+void Can_rx_ring_release(T_can_rx_ring *ring)
+{
+  ring->tail = ring->tail + 1;
+}
@@ -0,0 +1,31 @@
+#ifndef __CAN_RX_RING_H
+#define __CAN_RX_RING_H
+
+#include <stdint.h>
+#include "CAN_manager.h"
+
+// Receive ring of CAN frames, free of HAL and OS calls.
+// The RX interrupt decodes the FIFO output mailbox registers straight into the slot at its
+// private head and publishes the whole batch at once; the receiver task handles the oldest frame
+// in place and releases the slot afterwards. One producer and one consumer with free-running
+// indexes need no lock; the memory barriers around publishing and releasing stay with the driver.
+
+#define CAN_RX_RING_SIZE CAN_NO_RECV_OBJECTS
+#if (CAN_RX_RING_SIZE & (CAN_RX_RING_SIZE - 1)) != 0
+  #error "CAN_NO_RECV_OBJECTS must be a power of 2"
+#endif
+
+typedef struct
+{
+  T_can_msg         msg[CAN_RX_RING_SIZE];
+  uint32_t          stamp[CAN_RX_RING_SIZE];  // Reception time of each frame, CPU cycles
+  volatile uint32_t head;                     // Frames written, changed by the producer only
+  volatile uint32_t tail;                     // Frames released, changed by the consumer only
+} T_can_rx_ring;
+
+uint32_t   Can_rx_ring_store(T_can_rx_ring *ring, uint32_t head, const uint32_t *regs, uint32_t stamp);
+T_can_msg *Can_rx_ring_front(T_can_rx_ring *ring);
+uint32_t   Can_rx_ring_front_stamp(const T_can_rx_ring *ring);
+void       Can_rx_ring_release(T_can_rx_ring *ring);
+
+#endif
@@ -0,0 +1,172 @@
+#include "Bit_matrix.h"
+#include "Display_scan.h"
+
+//------------------------------------------------------------------------------
+// Build 16-bit TLC5920 shift word from one red (a) and one green (c) line
+// Bit layout is selected by DISPLAY_SWAP_COLORS and DISPLAY_REVERSE_COLUMNS
+//------------------------------------------------------------------------------
+uint16_t Display_interleave_row(uint8_t a, uint8_t c)
+{
+#if DISPLAY_SWAP_COLORS
+  uint32_t odd  = c;
+  uint32_t even = a;
+#else
+  uint32_t odd  = a;
+  uint32_t even = c;
+#endif
+
+#if (DISPLAY_REVERSE_COLUMNS == 0)
+  // Column 0 occupies the two top bits of the word and is shifted out first
+  odd  = Bit_matrix_reverse8(odd);
+  even = Bit_matrix_reverse8(even);
+#endif
+
+  return Bit_matrix_interleave(odd, even);
+}
+
+//------------------------------------------------------------------------------
+// Build the shift words of all slots of a frame from the bit-planes of both colours,
+// rotated by rot quarter turns
+//------------------------------------------------------------------------------
+void Display_compile_words(uint8_t (*red)[8], uint8_t (*green)[8], uint32_t rot, uint16_t *words)
+{
+  uint32_t p, k;
+  uint8_t  r[8];
+  uint8_t  g[8];
+
+  for (p = 0; p < DISPLAY_BCM_BITS; p++)
+  {
+    // If rotation is enabled, rotate display by 90 degree increments (whole plane at once)
+    Bit_matrix_store(Bit_matrix_rotate(Bit_matrix_load(red[p]), rot), r);
+    Bit_matrix_store(Bit_matrix_rotate(Bit_matrix_load(green[p]), rot), g);
+
+    for (k = 0; k < 8; k++)
+    {
+      words[k * DISPLAY_BCM_BITS + p] = Display_interleave_row(r[k], g[k]);
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+// Timer values of the slots of every plane for brightness level 0..255 and a timer
+// running at us_ticks per microsecond: arr[p] is the auto-reload (period - 1) and
+// ccr[p] the compare that ends the blank of a slot of plane p.
+// Every slot starts with DISPLAY_BLANK_LEAD_US of forced blank that covers CSEL switching
+// and latch; the lit window is then scaled by the level and doubled per plane so the
+// binary weights of BCM are kept at any brightness
+//------------------------------------------------------------------------------
+void Display_plane_timing(uint32_t level, uint32_t us_ticks, uint32_t *arr, uint32_t *ccr)
+{
+  uint32_t p;
+  uint32_t period;
+  uint32_t on_ticks;
+
+  on_ticks = ((DISPLAY_BCM_UNIT_US - DISPLAY_BLANK_LEAD_US) * us_ticks * level) / 255U;
+  for (p = 0; p < DISPLAY_BCM_BITS; p++)
+  {
+    period = (DISPLAY_BCM_UNIT_US * us_ticks) << p;
+    arr[p] = period - 1U;
+    ccr[p] = period - (on_ticks << p);
+  }
+}
+
+//------------------------------------------------------------------------------
+// Scan page 0 with no flip pending; the first slot start shows slot 0
+//------------------------------------------------------------------------------
+void Display_scan_init(T_display_scan *sc)
+{
+  sc->slot    = DISPLAY_SLOTS_NUM - 1;
+  sc->front   = 0;
+  sc->pending = 0;
+  sc->timed   = 0;
+  sc->marked  = 0;
+}
+
+//------------------------------------------------------------------------------
+// Slot start: step to the slot whose word was shifted during the previous one
+// Returns the slot to select and latch now
+//------------------------------------------------------------------------------
+uint32_t Display_scan_advance(T_display_scan *sc)
+{
+  uint32_t slot = sc->slot + 1;
+
+  if (slot >= DISPLAY_SLOTS_NUM)
+  {
+    slot = 0;
+  }
+  sc->slot = slot;
+  return slot;
+}
+
+//------------------------------------------------------------------------------
+// After the latch: choose the slot whose word is shifted during the current one,
+// flipping pages when the pending flip is due. now_cyc is the cycle counter for timed flips.
+// Returns the slot in the (possibly new) front page, events get DISPLAY_SCAN_xxx
+//------------------------------------------------------------------------------
+uint32_t Display_scan_next(T_display_scan *sc, uint32_t now_cyc, uint32_t *events)
+{
+  uint32_t next = sc->slot + 1;
+  uint32_t evt  = 0;
+
+  if (next >= DISPLAY_SLOTS_NUM)
+  {
+    next = 0;
+  }
+
+  // Page flip: the last slot of the frame is on, the next word opens a new frame.
+  // A timed flip waits for its moment instead and then restarts the frame from the new page,
+  // so the picture changes within one slot of the requested time
+  if (sc->pending)
+  {
+    if (sc->timed)
+    {
+      if ((int32_t)(now_cyc - sc->flip_cyc) >= 0)
+      {
+        next     = 0;
+        sc->slot = DISPLAY_SLOTS_NUM - 1;
+        evt      = DISPLAY_SCAN_FLIPPED;
+      }
+    }
+    else if (next == 0)
+    {
+      evt = DISPLAY_SCAN_FLIPPED;
+    }
+    if (evt)
+    {
+      sc->front  ^= 1;
+      sc->timed   = 0;
+      sc->pending = 0;
+      if (sc->marked)
+      {
+        sc->marked  = 0;
+        evt        |= DISPLAY_SCAN_MARKED;
+      }
+    }
+  }
+  *events = evt;
+  return next;
+}
+
+//------------------------------------------------------------------------------
+// Frame stage: the back page (front ^ 1) is compiled and its flip fields are set, hand it over
+//------------------------------------------------------------------------------
+void Display_scan_post(T_display_scan *sc)
+{
+  sc->pending = 1;
+}
+
+//------------------------------------------------------------------------------
+// Frame stage: take back a posted timed flip that is still waiting for its moment, so a newer
+// picture can be compiled into the back page. Called with the scan interrupt masked
+// Returns 1 - flip withdrawn, the back page is free again; 0 - nothing was withdrawn
+//------------------------------------------------------------------------------
+uint32_t Display_scan_withdraw(T_display_scan *sc)
+{
+  if (!sc->pending || !sc->timed)
+  {
+    return 0;
+  }
+  sc->pending = 0;
+  sc->timed   = 0;
+  return 1;
+}
@@ -0,0 +1,63 @@
+#ifndef __DISPLAY_SCAN_H
+#define __DISPLAY_SCAN_H
+
+#include <stdint.h>
+
+// Parts of the row scan engine that do not touch HAL, FreeRTOS or registers, so that the
+// slot sequence of the scan interrupt and the TLC5920 shift words can be checked on the host.
+// A shift word carries one line of both colours: two bits per column, red and green interleaved.
+// A compiled frame holds the words of all DISPLAY_SLOTS_NUM slots: slot k * DISPLAY_BCM_BITS + p
+// shows line k of bit-plane p, so the scan interrupt only looks its word up.
+// A slot of plane p lasts 2^p BCM units of the scan timer; BLANK is held high from the slot
+// start up to the compare value, so the lit part of every slot ends with the slot.
+
+#define DISPLAY_BCM_BITS  4                       // Bit-planes per colour (Binary Code Modulation), 2^N brightness levels
+#define DISPLAY_SLOTS_NUM (8 * DISPLAY_BCM_BITS)  // Row slots per frame: every line is shown once per bit-plane
+
+#define DISPLAY_BCM_UNIT_US   8  // Dwell of the least significant plane; frame = 8 * (2^N - 1) units = 960 us
+#define DISPLAY_BLANK_LEAD_US 1  // Forced blank at the start of each slot for CSEL switching and latch
+
+#if (DISPLAY_BCM_BITS < 1) || (DISPLAY_BCM_BITS > 4)
+  #error "DISPLAY_BCM_BITS must be 1..4: grey input carries 4 bits per pixel"
+#endif
+
+// Board variant: layout of the 16-bit TLC5920 shift word
+#ifndef DISPLAY_SWAP_COLORS
+  #define DISPLAY_SWAP_COLORS     0  // 0 - red on odd bits, green on even bits; 1 - colours swapped
+#endif
+#ifndef DISPLAY_REVERSE_COLUMNS
+  #define DISPLAY_REVERSE_COLUMNS 0  // 0 - column 0 in bits 15:14 (shifted first); 1 - column 0 in bits 1:0
+#endif
+
+// Slot sequence and page flips of the scan interrupt over two compiled frames.
+// The interrupt scans the front page only. The frame stage compiles the back page while no flip
+// is pending, then posts it; the interrupt makes it front at the end of a frame, or for a timed
+// flip at the first slot start after flip_cyc, and restarts the frame from slot 0 then.
+// Only the task posts and only the interrupt clears pending, which preempts the task and never
+// the other way round, so the fields need no lock: timed, flip_cyc, marked and mark_cyc are
+// read by the interrupt only while a flip is pending and written by the task only while none is.
+typedef struct
+{
+  volatile uint32_t slot;      // Slot currently displayed: line = slot / DISPLAY_BCM_BITS, plane = slot % DISPLAY_BCM_BITS
+  volatile uint32_t front;     // Page scanned by the interrupt
+  volatile uint32_t pending;   // Back page is complete and waits for its flip
+  volatile uint32_t timed;     // Pending flip waits for the cycle counter to reach flip_cyc
+  volatile uint32_t flip_cyc;
+  volatile uint32_t marked;    // Pending flip shows a command received at mark_cyc
+  volatile uint32_t mark_cyc;
+} T_display_scan;
+
+// Events of Display_scan_next()
+#define DISPLAY_SCAN_FLIPPED 0x01u  // Back page became front, the next word opens its frame
+#define DISPLAY_SCAN_MARKED  0x02u  // The flip showed the marked command
+
+uint16_t Display_interleave_row(uint8_t a, uint8_t c);
+void     Display_plane_timing(uint32_t level, uint32_t us_ticks, uint32_t *arr, uint32_t *ccr);
+void     Display_scan_init(T_display_scan *sc);
+uint32_t Display_scan_advance(T_display_scan *sc);
+uint32_t Display_scan_next(T_display_scan *sc, uint32_t now_cyc, uint32_t *events);
+void     Display_scan_post(T_display_scan *sc);
+uint32_t Display_scan_withdraw(T_display_scan *sc);
+void     Display_compile_words(uint8_t (*red)[8], uint8_t (*green)[8], uint32_t rot, uint16_t *words);
+
+#endif
@@ -0,0 +1,78 @@
+#include "Frame_delta.h"
+
+//------------------------------------------------------------------------------
+// Build the XOR delta that turns prev into next
+// Returns payload length (0 - nothing changed) or FRAME_DELTA_FULL when the full plane must be sent
+//------------------------------------------------------------------------------
+int32_t Frame_delta_encode(const uint8_t *prev, const uint8_t *next, uint8_t *payload)
+{
+  uint32_t r;
+  uint32_t n    = 1;
+  uint8_t  mask = 0;
+  uint8_t  x;
+
+  for (r = 0; r < 8; r++)
+  {
+    x = prev[r] ^ next[r];
+    if (x != 0)
+    {
+      if (n > FRAME_DELTA_MAX_ROWS)
+      {
+        return FRAME_DELTA_FULL;
+      }
+      mask         |= (uint8_t)(1u << r);
+      payload[n++]  = x;
+    }
+  }
+  if (mask == 0)
+  {
+    return 0;
+  }
+  payload[0] = mask;
+  return (int32_t)n;
+}
+
+//------------------------------------------------------------------------------
+// Length of a delta payload from its mask byte, so a receiver can check the frame carries it whole
+// Returns 1 + changed rows, or FRAME_DELTA_FULL for a mask with more rows than a frame can carry
+//------------------------------------------------------------------------------
+int32_t Frame_delta_size(const uint8_t *payload)
+{
+  uint32_t cnt = payload[0];
+
+  // Count set bits of the mask
+  cnt = cnt - ((cnt >> 1) & 0x55);
+  cnt = (cnt & 0x33) + ((cnt >> 2) & 0x33);
+  cnt = (cnt + (cnt >> 4)) & 0x0F;
+  if (cnt > FRAME_DELTA_MAX_ROWS)
+  {
+    return FRAME_DELTA_FULL;
+  }
+  return (int32_t)(1 + cnt);
+}
+
+//------------------------------------------------------------------------------
+// Apply an XOR delta to 8 screen rows in place
+// Returns payload length, or FRAME_DELTA_FULL for a mask with more rows than a frame can carry
+// (rows are left untouched then)
+//------------------------------------------------------------------------------
+int32_t Frame_delta_apply(uint8_t *rows, const uint8_t *payload)
+{
+  uint32_t r;
+  uint32_t n    = 1;
+  uint32_t mask = payload[0];
+
+  if (Frame_delta_size(payload) == FRAME_DELTA_FULL)
+  {
+    return FRAME_DELTA_FULL;
+  }
+
+  for (r = 0; r < 8; r++)
+  {
+    if (mask & (1u << r))
+    {
+      rows[r] ^= payload[n++];
+    }
+  }
+  return (int32_t)n;
+}
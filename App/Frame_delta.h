@@ -0,0 +1,17 @@
+#ifndef __FRAME_DELTA_H
+#define __FRAME_DELTA_H
+
+#include <stdint.h>
+
+// XOR delta of an 8x8 one-bit plane against the picture currently shown.
+// Payload: byte 0 - mask of changed rows (bit r = row r), then one XOR byte per set bit
+// in ascending row order. One changed pixel costs 2 bytes, plus the sub-command byte on the bus.
+
+#define FRAME_DELTA_MAX_ROWS 6     // Rows that fit after sub-command and mask in an 8-byte CAN frame
+#define FRAME_DELTA_FULL     (-1)  // Encoder result: too many rows changed, send the full plane
+
+int32_t Frame_delta_encode(const uint8_t *prev, const uint8_t *next, uint8_t *payload);
+int32_t Frame_delta_size(const uint8_t *payload);
+int32_t Frame_delta_apply(uint8_t *rows, const uint8_t *payload);
+
+#endif
@@ -0,0 +1,298 @@
+#include <string.h>
+#include "Glyph_store.h"
+
+//------------------------------------------------------------------------------
+// Little-endian halfword from flash
+//------------------------------------------------------------------------------
+static uint16_t Glyph_rd16(const uint8_t *p)
+{
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+//------------------------------------------------------------------------------
+// Index position of code, -1 if the code is not stored
+//------------------------------------------------------------------------------
+static int32_t Glyph_find(const T_glyph_store *st, uint32_t code)
+{
+  uint32_t i;
+
+  for (i = 0; i < st->count; i++)
+  {
+    if (st->codes[i] == code)
+    {
+      return (int32_t)i;
+    }
+  }
+  return -1;
+}
+
+//------------------------------------------------------------------------------
+// Non-zero if the record slot was never programmed
+//------------------------------------------------------------------------------
+static uint32_t Glyph_slot_free(const uint8_t *rec)
+{
+  uint32_t i;
+
+  for (i = 0; i < GLYPH_STORE_REC_SIZE; i++)
+  {
+    if (rec[i] != 0xFF)
+    {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+//------------------------------------------------------------------------------
+// Program a record at offs from base, the tag last so a torn record stays invalid
+// Erased halfwords already hold 0xFFFF and are skipped
+//------------------------------------------------------------------------------
+static int32_t Glyph_put(T_glyph_store *st, uint32_t offs, uint32_t code, const uint8_t *glyph)
+{
+  uint8_t *rec = st->base + offs;
+  uint16_t v;
+  uint32_t i;
+
+  for (i = 0; i < 8; i += 2)
+  {
+    v = (uint16_t)(glyph[i] | (glyph[i + 1] << 8));
+    if ((v != 0xFFFF) && (st->flash->program(&rec[i], v) != 0))
+    {
+      return GLYPH_STORE_FLASH_ERROR;
+    }
+  }
+  if (st->flash->program(&rec[8], (uint16_t)((code & 0xFF) | ((~code & 0xFF) << 8))) != 0)
+  {
+    return GLYPH_STORE_FLASH_ERROR;
+  }
+  return GLYPH_STORE_OK;
+}
+
+//------------------------------------------------------------------------------
+// Validate the page with generation gen: header written after its records
+//------------------------------------------------------------------------------
+static int32_t Glyph_seal(T_glyph_store *st, uint32_t page, uint16_t gen)
+{
+  uint8_t *hdr = st->base + page * st->page_size;
+
+  if ((st->flash->program(&hdr[0], gen) != 0) || (st->flash->program(&hdr[2], GLYPH_STORE_PAGE_MAGIC) != 0))
+  {
+    return GLYPH_STORE_FLASH_ERROR;
+  }
+  return GLYPH_STORE_OK;
+}
+
+//------------------------------------------------------------------------------
+// Erase a page before it takes a new generation. A valid page loses its magic first:
+// an interrupted erase could leave the header readable over half-erased records
+//------------------------------------------------------------------------------
+static int32_t Glyph_erase(T_glyph_store *st, uint32_t page)
+{
+  uint8_t *p = st->base + page * st->page_size;
+
+  if ((Glyph_rd16(p + 2) == GLYPH_STORE_PAGE_MAGIC) && (st->flash->program(p + 2, 0) != 0))
+  {
+    return GLYPH_STORE_FLASH_ERROR;
+  }
+  st->erase_count++;
+  if (st->flash->erase(p) != 0)
+  {
+    return GLYPH_STORE_FLASH_ERROR;
+  }
+  return GLYPH_STORE_OK;
+}
+
+//------------------------------------------------------------------------------
+// Move the latest record of every code and the new glyph into the other page
+// and make it active. On failure the old page and the index stay as they were
+//------------------------------------------------------------------------------
+static int32_t Glyph_compact(T_glyph_store *st, uint32_t code, const uint8_t *glyph)
+{
+  uint32_t dst  = st->active ^ 1u;
+  uint32_t base = dst * st->page_size;
+  uint32_t offs = GLYPH_STORE_HDR_SIZE;
+  int32_t  res;
+  int32_t  n;
+  uint32_t i;
+
+  res = Glyph_erase(st, dst);
+  for (i = 0; (res == GLYPH_STORE_OK) && (i < st->count); i++)
+  {
+    if (st->codes[i] != code)
+    {
+      res   = Glyph_put(st, base + offs, st->codes[i], st->base + st->offs[i]);
+      offs += GLYPH_STORE_REC_SIZE;
+    }
+  }
+  if (res == GLYPH_STORE_OK)
+  {
+    res = Glyph_put(st, base + offs, code, glyph);
+  }
+  if (res == GLYPH_STORE_OK)
+  {
+    res = Glyph_seal(st, dst, (uint16_t)(st->gen + 1));
+  }
+  if (res != GLYPH_STORE_OK)
+  {
+    return res;
+  }
+
+  // Records were copied in index order, the rewritten code last
+  offs = GLYPH_STORE_HDR_SIZE;
+  for (i = 0; i < st->count; i++)
+  {
+    if (st->codes[i] != code)
+    {
+      st->offs[i]  = (uint16_t)(base + offs);
+      offs        += GLYPH_STORE_REC_SIZE;
+    }
+  }
+  n = Glyph_find(st, code);
+  if (n < 0)
+  {
+    n              = st->count;
+    st->codes[n]   = (uint8_t)code;
+    st->offs[n]    = (uint16_t)(base + offs);
+    st->count++;
+  }
+  else
+  {
+    st->offs[n] = (uint16_t)(base + offs);
+  }
+  st->active    = (uint8_t)dst;
+  st->gen++;
+  st->free_offs = (uint16_t)(offs + GLYPH_STORE_REC_SIZE);
+  return GLYPH_STORE_OK;
+}
+
+//------------------------------------------------------------------------------
+// Open the store in two pages of page_size bytes at base and build the index
+// A store without a valid page is formatted
+//------------------------------------------------------------------------------
+int32_t Glyph_store_init(T_glyph_store *st, const T_glyph_flash *flash, uint8_t *base, uint32_t page_size)
+{
+  uint32_t valid[2];
+  uint8_t *page;
+  uint8_t *rec;
+  uint32_t offs;
+  int32_t  n;
+  int32_t  res;
+  uint32_t p;
+
+  memset(st, 0, sizeof(*st));
+  st->flash     = flash;
+  st->base      = base;
+  st->page_size = (uint16_t)page_size;
+
+  for (p = 0; p < 2; p++)
+  {
+    valid[p] = (Glyph_rd16(base + p * page_size + 2) == GLYPH_STORE_PAGE_MAGIC);
+  }
+  if (!valid[0] && !valid[1])
+  {
+    res = Glyph_erase(st, 0);
+    if (res == GLYPH_STORE_OK)
+    {
+      res = Glyph_seal(st, 0, 0);
+    }
+    st->free_offs = GLYPH_STORE_HDR_SIZE;
+    return res;
+  }
+  if (valid[0] && valid[1])
+  {
+    // An interrupted compaction is not sealed, so two valid pages differ in generation
+    st->active = ((int16_t)(Glyph_rd16(base + page_size) - Glyph_rd16(base)) > 0) ? 1 : 0;
+  }
+  else
+  {
+    st->active = valid[1] ? 1 : 0;
+  }
+
+  page          = base + st->active * page_size;
+  st->gen       = Glyph_rd16(page);
+  st->free_offs = GLYPH_STORE_HDR_SIZE;
+  for (offs = GLYPH_STORE_HDR_SIZE; offs + GLYPH_STORE_REC_SIZE <= page_size; offs += GLYPH_STORE_REC_SIZE)
+  {
+    rec = page + offs;
+    if (Glyph_slot_free(rec))
+    {
+      continue;
+    }
+    // Torn records are skipped but keep their slot
+    st->free_offs = (uint16_t)(offs + GLYPH_STORE_REC_SIZE);
+    if ((rec[8] ^ rec[9]) != 0xFF)
+    {
+      continue;
+    }
+    n = Glyph_find(st, rec[8]);
+    if (n < 0)
+    {
+      if (st->count >= GLYPH_STORE_MAX)
+      {
+        continue;
+      }
+      n            = st->count++;
+      st->codes[n] = rec[8];
+    }
+    st->offs[n] = (uint16_t)(st->active * page_size + offs);
+  }
+  return GLYPH_STORE_OK;
+}
+
+//------------------------------------------------------------------------------
+// Stored glyph of code, NULL if the code was never written
+//------------------------------------------------------------------------------
+const uint8_t *Glyph_store_get(const T_glyph_store *st, uint32_t code)
+{
+  int32_t n = Glyph_find(st, code);
+
+  return (n < 0) ? NULL : st->base + st->offs[n];
+}
+
+//------------------------------------------------------------------------------
+// Store glyph of 8 rows under code; writing the glyph already stored costs nothing
+//------------------------------------------------------------------------------
+int32_t Glyph_store_write(T_glyph_store *st, uint32_t code, const uint8_t *glyph)
+{
+  uint32_t offs;
+  int32_t  n = Glyph_find(st, code);
+  int32_t  res;
+
+  if (n >= 0)
+  {
+    if (memcmp(st->base + st->offs[n], glyph, 8) == 0)
+    {
+      return GLYPH_STORE_OK;
+    }
+  }
+  else if (st->count >= GLYPH_STORE_MAX)
+  {
+    return GLYPH_STORE_FULL;
+  }
+
+  if (st->free_offs + GLYPH_STORE_REC_SIZE > st->page_size)
+  {
+    return Glyph_compact(st, code, glyph);
+  }
+
+  // A failed record still occupies its slot
+  offs           = st->active * st->page_size + st->free_offs;
+  st->free_offs += GLYPH_STORE_REC_SIZE;
+  res            = Glyph_put(st, offs, code, glyph);
+  if (res != GLYPH_STORE_OK)
+  {
+    return res;
+  }
+  if (n < 0)
+  {
+    n            = st->count;
+    st->codes[n] = (uint8_t)code;
+    st->offs[n]  = (uint16_t)offs;
+    st->count++;
+  }
+  else
+  {
+    st->offs[n] = (uint16_t)offs;
+  }
+  return GLYPH_STORE_OK;
+}
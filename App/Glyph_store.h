@@ -0,0 +1,60 @@
+#ifndef __GLYPH_STORE_H
+#define __GLYPH_STORE_H
+
+#include <stdint.h>
+
+// Log-structured store of user 8x8 glyphs in two flash pages, free of HAL and OS calls.
+// A write appends a record to the active page; the newest record of a code wins. When the
+// active page is full, the latest record of every code is copied into the other page, which
+// then becomes active with a higher generation. Pages are erased in turn, so wear is spread
+// over both, and an erase happens once per page-full of writes rather than once per write.
+// The page header is programmed last, and so is the tag of each record. A power loss while
+// writing therefore leaves the previous state readable: the half-copied page has no valid
+// header, and a torn record has no valid tag. The tag holds the code and its complement: a
+// torn program clears only part of the bits, which breaks the pair. The magic of a page is
+// cleared before the page is erased, so an interrupted erase leaves no valid header behind.
+// The RAM index holds one offset per stored code; glyph data are read from flash in place.
+//
+// Page layout, halfwords low byte first, erased flash reads 0xFF:
+//   0  generation
+//   2  GLYPH_STORE_PAGE_MAGIC
+//   4  records of GLYPH_STORE_REC_SIZE bytes: 8 rows, code, inverted code
+
+#define GLYPH_STORE_MAX        16      // Distinct codes kept, size of the RAM index
+#define GLYPH_STORE_HDR_SIZE   4
+#define GLYPH_STORE_REC_SIZE   10
+#define GLYPH_STORE_PAGE_MAGIC 0x4C47u
+
+// Results
+#define GLYPH_STORE_OK          0
+#define GLYPH_STORE_FULL        -1  // GLYPH_STORE_MAX other codes are already stored
+#define GLYPH_STORE_FLASH_ERROR -2  // Programming or erase failed
+
+// Flash access of the driver, both return 0 on success.
+// program writes one halfword at a halfword aligned address, erased or, for val 0, any;
+// erase clears a whole page to 0xFF
+typedef struct
+{
+  uint32_t (*program)(uint8_t *dst, uint16_t val);
+  uint32_t (*erase)(uint8_t *page);
+} T_glyph_flash;
+
+typedef struct
+{
+  const T_glyph_flash *flash;
+  uint8_t             *base;                     // Two consecutive pages
+  uint16_t             page_size;
+  uint8_t              active;                   // Page holding the current generation
+  uint8_t              count;                    // Codes in the index
+  uint16_t             gen;                      // Generation of the active page
+  uint16_t             free_offs;                // Next record in the active page
+  uint8_t              codes[GLYPH_STORE_MAX];
+  uint16_t             offs[GLYPH_STORE_MAX];    // Record of each code, from base
+  uint32_t             erase_count;
+} T_glyph_store;
+
+int32_t        Glyph_store_init(T_glyph_store *st, const T_glyph_flash *flash, uint8_t *base, uint32_t page_size);
+const uint8_t *Glyph_store_get(const T_glyph_store *st, uint32_t code);
+int32_t        Glyph_store_write(T_glyph_store *st, uint32_t code, const uint8_t *glyph);
+
+#endif
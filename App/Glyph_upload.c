@@ -0,0 +1,119 @@
+#include <string.h>
+#include "Glyph_upload.h"
+
+//------------------------------------------------------------------------------
+// CRC-16/CCITT-FALSE, bitwise: a batch is at most 128 bytes
+//------------------------------------------------------------------------------
+uint16_t Glyph_upload_crc16(const uint8_t *data, uint32_t len)
+{
+  uint16_t crc = 0xFFFF;
+  uint32_t i;
+  uint32_t b;
+
+  for (i = 0; i < len; i++)
+  {
+    crc ^= (uint16_t)(data[i] << 8);
+    for (b = 0; b < 8; b++)
+    {
+      crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+  }
+  return crc;
+}
+
+//------------------------------------------------------------------------------
+// Chunks needed for count glyphs
+//------------------------------------------------------------------------------
+static uint32_t Glyph_upload_chunks(uint32_t count)
+{
+  return (count * 8 + GLYPH_UPLOAD_CHUNK - 1) / GLYPH_UPLOAD_CHUNK;
+}
+
+//------------------------------------------------------------------------------
+// Open a batch of count glyphs starting at code first; an unfinished batch is dropped
+//------------------------------------------------------------------------------
+uint32_t Glyph_upload_begin(T_glyph_upload *u, uint32_t id, uint32_t first, uint32_t count)
+{
+  if (u->state == GLYPH_UPLOAD_COMMITTED)
+  {
+    return GLYPH_UPLOAD_BUSY;
+  }
+  if ((count == 0) || (count > GLYPH_UPLOAD_MAX) || (first + count > 256))
+  {
+    u->state = GLYPH_UPLOAD_IDLE;
+    return GLYPH_UPLOAD_BAD_LENGTH;
+  }
+  u->id        = (uint8_t)id;
+  u->first     = (uint8_t)first;
+  u->count     = (uint8_t)count;
+  u->bad_chunk = 0;
+  u->chunks    = 0;
+  memset(u->rows, 0, sizeof(u->rows));
+  u->state     = GLYPH_UPLOAD_RECEIVING;
+  return GLYPH_UPLOAD_OK;
+}
+
+//------------------------------------------------------------------------------
+// Put GLYPH_UPLOAD_CHUNK bytes at chunk * GLYPH_UPLOAD_CHUNK; the last chunk is cut to the batch
+// An error is remembered and reported by the commit, DATA itself is not answered
+//------------------------------------------------------------------------------
+uint32_t Glyph_upload_data(T_glyph_upload *u, uint32_t chunk, const uint8_t *bytes)
+{
+  uint32_t offs = chunk * GLYPH_UPLOAD_CHUNK;
+  uint32_t size = u->count * 8U;
+
+  if (u->state != GLYPH_UPLOAD_RECEIVING)
+  {
+    return GLYPH_UPLOAD_NO_TRANSACTION;
+  }
+  if (chunk >= Glyph_upload_chunks(u->count))
+  {
+    u->bad_chunk = 1;
+    return GLYPH_UPLOAD_BAD_CHUNK;
+  }
+  memcpy(&u->rows[offs], bytes, (size - offs < GLYPH_UPLOAD_CHUNK) ? size - offs : GLYPH_UPLOAD_CHUNK);
+  u->chunks |= 1UL << chunk;
+  return GLYPH_UPLOAD_OK;
+}
+
+//------------------------------------------------------------------------------
+// Verify the batch. On success it waits in GLYPH_UPLOAD_COMMITTED for the driver,
+// on failure it is dropped and the master has to start again from BEGIN
+//------------------------------------------------------------------------------
+uint32_t Glyph_upload_commit(T_glyph_upload *u, uint32_t id, uint16_t crc)
+{
+  uint32_t res = GLYPH_UPLOAD_OK;
+  uint32_t n;
+
+  if (u->state != GLYPH_UPLOAD_RECEIVING)
+  {
+    return (u->state == GLYPH_UPLOAD_COMMITTED) ? GLYPH_UPLOAD_BUSY : GLYPH_UPLOAD_NO_TRANSACTION;
+  }
+  n = Glyph_upload_chunks(u->count);
+  if (u->id != (uint8_t)id)
+  {
+    res = GLYPH_UPLOAD_BAD_ID;
+  }
+  else if (u->bad_chunk)
+  {
+    res = GLYPH_UPLOAD_BAD_CHUNK;
+  }
+  else if (u->chunks != ((n < 32) ? ((1UL << n) - 1) : 0xFFFFFFFFUL))
+  {
+    res = GLYPH_UPLOAD_INCOMPLETE;
+  }
+  else if (Glyph_upload_crc16(u->rows, u->count * 8U) != crc)
+  {
+    res = GLYPH_UPLOAD_BAD_CRC;
+  }
+  u->state = (res == GLYPH_UPLOAD_OK) ? GLYPH_UPLOAD_COMMITTED : GLYPH_UPLOAD_IDLE;
+  return res;
+}
+
+//------------------------------------------------------------------------------
+// The driver has stored the committed batch, a new one may begin
+//------------------------------------------------------------------------------
+void Glyph_upload_done(T_glyph_upload *u)
+{
+  u->state = GLYPH_UPLOAD_IDLE;
+}
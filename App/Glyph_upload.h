@@ -0,0 +1,54 @@
+#ifndef __GLYPH_UPLOAD_H
+#define __GLYPH_UPLOAD_H
+
+#include <stdint.h>
+
+// Glyph upload transaction, free of HAL and OS calls.
+// BEGIN opens a batch of consecutive symbol codes, DATA chunks carry their rows at an explicit
+// offset, so chunks may be sent back to back, repeated or reordered, and COMMIT checks that every
+// chunk arrived and that the CRC of the batch matches. Only a verified batch is handed to the
+// driver, which stores its glyphs in code order and then calls Glyph_upload_done(). Until then the
+// batch stays in RAM and no glyph of it is visible. A flash error may leave the batch partially stored.
+//
+// CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF, no reflection) over count * 8 glyph bytes.
+
+#define GLYPH_UPLOAD_MAX   16  // Glyphs per batch, the capacity of the user glyph store
+#define GLYPH_UPLOAD_CHUNK 6   // Glyph bytes per DATA frame
+
+// Results, sent back as the status of a NACK; 0 is ACK
+#define GLYPH_UPLOAD_OK             0
+#define GLYPH_UPLOAD_BUSY           1  // Previous batch is still being written to flash
+#define GLYPH_UPLOAD_NO_TRANSACTION 2  // DATA or COMMIT without BEGIN
+#define GLYPH_UPLOAD_BAD_LENGTH     3  // Count 0, above GLYPH_UPLOAD_MAX or past code 255
+#define GLYPH_UPLOAD_BAD_ID         4  // COMMIT of another transaction
+#define GLYPH_UPLOAD_BAD_CHUNK      5  // A DATA chunk lay outside the batch
+#define GLYPH_UPLOAD_INCOMPLETE     6  // Chunks are missing
+#define GLYPH_UPLOAD_BAD_CRC        7
+#define GLYPH_UPLOAD_STORE_FULL     8  // Reported by the driver: no room for a new code
+#define GLYPH_UPLOAD_FLASH_ERROR    9  // Reported by the driver: the batch is partially stored
+
+typedef enum
+{
+  GLYPH_UPLOAD_IDLE = 0,
+  GLYPH_UPLOAD_RECEIVING,
+  GLYPH_UPLOAD_COMMITTED  // Verified, waiting for the driver to store it
+} T_glyph_upload_state;
+
+typedef struct
+{
+  uint8_t  state;     // T_glyph_upload_state
+  uint8_t  id;        // Transaction number chosen by the master
+  uint8_t  first;     // Code of the first glyph
+  uint8_t  count;     // Glyphs in the batch
+  uint8_t  bad_chunk;
+  uint32_t chunks;    // Received chunks, bit n - chunk n
+  uint8_t  rows[GLYPH_UPLOAD_MAX * 8];
+} T_glyph_upload;
+
+uint16_t Glyph_upload_crc16(const uint8_t *data, uint32_t len);
+uint32_t Glyph_upload_begin(T_glyph_upload *u, uint32_t id, uint32_t first, uint32_t count);
+uint32_t Glyph_upload_data(T_glyph_upload *u, uint32_t chunk, const uint8_t *bytes);
+uint32_t Glyph_upload_commit(T_glyph_upload *u, uint32_t id, uint16_t crc);
+void     Glyph_upload_done(T_glyph_upload *u);
+
+#endif
@@ -42,3 +42,77 @@ void TLC5920DLG4_Latch_low(void)
 {
   GPIOA->BSRR = LSHIFT(BIT(4), 16);
 }
+
+static uint32_t g_cyc_per_us;  // DWT->CYCCNT counts per microsecond
+static uint32_t g_clock_cyc;   // CYCCNT at the last update
+static uint32_t g_clock_us;    // Local time at g_clock_cyc - g_clock_rem
+static uint32_t g_clock_rem;   // Cycles of g_clock_cyc not yet counted in g_clock_us
+
+/*------------------------------------------------------------------------------
+  Запуск счетчика тактов DWT для локальных часов
+ ------------------------------------------------------------------------------*/
+void Local_clock_init(void)
+{
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT       = 0;
+  DWT->CTRL        |= DWT_CTRL_CYCCNTENA_Msk;
+  g_cyc_per_us      = SystemCoreClock / 1000000U;
+  g_clock_cyc       = 0;
+  g_clock_us        = 0;
+  g_clock_rem       = 0;
+}
+
+/*------------------------------------------------------------------------------
+  Перенос прошедших тактов в счетчик микросекунд. Вызывается в критической секции
+ ------------------------------------------------------------------------------*/
+static void Local_clock_update(void)
+{
+  uint32_t cyc = DWT->CYCCNT;
+  uint32_t d   = cyc - g_clock_cyc + g_clock_rem;
+
+  g_clock_cyc  = cyc;
+  g_clock_us  += d / g_cyc_per_us;
+  g_clock_rem  = d % g_cyc_per_us;
+}
+
+/*------------------------------------------------------------------------------
+  Текущее локальное время в мкс
+ ------------------------------------------------------------------------------*/
+uint32_t Local_clock_us(void)
+{
+  uint32_t us;
+
+  taskENTER_CRITICAL();
+  Local_clock_update();
+  us = g_clock_us;
+  taskEXIT_CRITICAL();
+  return us;
+}
+
+/*------------------------------------------------------------------------------
+  Локальное время в мкс для значения DWT->CYCCNT в пределах +-29 с от текущего
+ ------------------------------------------------------------------------------*/
+uint32_t Local_clock_cyc_to_us(uint32_t cyc)
+{
+  uint32_t us;
+
+  taskENTER_CRITICAL();
+  Local_clock_update();
+  us = g_clock_us - (uint32_t)((int32_t)(g_clock_cyc - g_clock_rem - cyc) / (int32_t)g_cyc_per_us);
+  taskEXIT_CRITICAL();
+  return us;
+}
+
+/*------------------------------------------------------------------------------
+  Значение DWT->CYCCNT в момент локального времени us (не далее 29 с от текущего)
+ ------------------------------------------------------------------------------*/
+uint32_t Local_clock_us_to_cyc(uint32_t us)
+{
+  uint32_t cyc;
+
+  taskENTER_CRITICAL();
+  Local_clock_update();
+  cyc = g_clock_cyc - g_clock_rem + (uint32_t)((int32_t)(us - g_clock_us) * (int32_t)g_cyc_per_us);
+  taskEXIT_CRITICAL();
+  return cyc;
+}
@@ -7,4 +7,11 @@ void TLC5920DLG4_Blank_low(void);
 void TLC5920DLG4_Latch_high(void);
 void TLC5920DLG4_Latch_low(void);
 
+// Local microsecond clock on the DWT cycle counter, extended to 32-bit microseconds.
+// Local_clock_us() must run more often than the counter wraps (2^32 / SystemCoreClock, 59 s at 72 MHz)
+void     Local_clock_init(void);
+uint32_t Local_clock_us(void);
+uint32_t Local_clock_cyc_to_us(uint32_t cyc);
+uint32_t Local_clock_us_to_cyc(uint32_t us);
+
 #endif
@@ -1,67 +1,142 @@
 #include "Application.h"
 
-static int32_t g_line_cnt;
+// Compiled frames: TLC5920 shift words of all slots, rebuilt only when the content changes
+// The scan ISR reads the front page only; the back page is compiled from a snapshot of
+// red_screen/green_screen and becomes front at the end of a frame, so a frame is never torn
+static uint16_t          g_slot_words[2][DISPLAY_SLOTS_NUM];
+static T_display_scan    g_scan;          // Slot sequence and page flips (Display_scan.h)
+static volatile uint32_t g_screen_gen;    // Incremented by every writer of red_screen/green_screen
+static uint32_t          g_compiled_gen;  // g_screen_gen value the slot words were built from
+static uint32_t          g_compiled_rot;  // Rotation the slot words were built with
+static uint32_t          g_present_req;   // Display_present_at() waits for the frame of g_present_gen
+static uint32_t          g_present_gen;
+static uint32_t          g_present_cyc;
+static uint32_t          g_mark_req;      // Display_mark_command() waits for the frame of g_mark_gen
+static uint32_t          g_mark_gen;
+static uint32_t          g_mark_cyc;
+static volatile uint32_t g_scan_events;   // DISPLAY_SCAN_xxx left by Display_scan_isr for Display_event_isr
+static volatile uint32_t g_scan_latency;  // Cycles from the marked command to the flip showing it
+
+static TIM_HandleTypeDef htim_scan;
+static uint32_t          g_us_ticks;  // TIM2 ticks per microsecond
+
+static T_display_timing  g_timing;    // Written by Display_scan_isr and the frame stage only
+
+extern osThreadId        defaultTaskHandle;  // Runs Main_cycle and with it the frame stage
+
+// Global brightness: per-plane slot period and BLANK compare of each page, built with its words,
+// so a new level is shown from the same page flip as the picture it came with
+static uint32_t          g_page_arr[2][DISPLAY_BCM_BITS];  // ARR of a slot of plane p
+static uint32_t          g_page_ccr[2][DISPLAY_BCM_BITS];  // CCR4 of a slot of plane p: BLANK stays high until CNT reaches it
+static uint32_t          g_brightness;                     // Level of the last page built, 0..255
+static volatile uint32_t g_bright_cur;                     // Ramp position, level << 8
+static volatile uint32_t g_bright_target;                  // Requested level << 8
+static volatile uint32_t g_bright_step;                    // Ramp increment per OS tick, level << 8
+
+// Bit-planes of both colours: plane p holds bit p of every pixel's brightness level
+uint8_t red_screen[DISPLAY_BCM_BITS][8];
+uint8_t green_screen[DISPLAY_BCM_BITS][8];
+
+// Sprites drawn over the screens when a frame is compiled; the zero-initialized pool is all free.
+// Set_dinamic_symbol() animates its red symbol in sprite 0 and its green symbol in sprite 1
+static T_sprite g_sprites[SPRITE_POOL_SIZE];
+static uint32_t g_sprite_legacy;  // SPRITE_RED - sprite 0, SPRITE_GREEN - sprite 1 run a Set_dinamic_symbol() animation
 
-uint8_t red_screen[8];
-uint8_t green_screen[8];
+//------------------------------------------------------------------------------
+// Stop the Set_dinamic_symbol() animation of the given colours, a screen write replaces it
+//------------------------------------------------------------------------------
+static void Display_stop_animation(uint32_t colors)
+{
+  uint32_t i;
 
-T_din_symbol red_dsym;
-T_din_symbol green_dsym;
+  taskENTER_CRITICAL();
+  for (i = 0; i < 2; i++)
+  {
+    if (g_sprite_legacy & colors & (SPRITE_RED << i))
+    {
+      g_sprites[i].colors = 0;
+      g_screen_gen++;
+    }
+  }
+  g_sprite_legacy &= ~colors;
+  taskEXIT_CRITICAL();
+}
 
 //------------------------------------------------------------------------------
-// Copy symbol data to red screen buffer
+// Copy on/off pixel rows into every bit-plane of a screen (full brightness)
 //------------------------------------------------------------------------------
-static void Copy_red_screen(int32_t code)
+static void Display_fill_screen(uint8_t screen[][8], const uint8_t *rows)
 {
-  red_screen[0] = Symbols[Remap_sym_code(code)][0];
-  red_screen[1] = Symbols[Remap_sym_code(code)][1];
-  red_screen[2] = Symbols[Remap_sym_code(code)][2];
-  red_screen[3] = Symbols[Remap_sym_code(code)][3];
-  red_screen[4] = Symbols[Remap_sym_code(code)][4];
-  red_screen[5] = Symbols[Remap_sym_code(code)][5];
-  red_screen[6] = Symbols[Remap_sym_code(code)][6];
-  red_screen[7] = Symbols[Remap_sym_code(code)][7];
+  uint32_t p;
+
+  taskENTER_CRITICAL();
+  for (p = 0; p < DISPLAY_BCM_BITS; p++)
+  {
+    memcpy(screen[p], rows, 8);
+  }
+  g_screen_gen++;
+  taskEXIT_CRITICAL();
 }
 
 //------------------------------------------------------------------------------
-// Copy symbol data to green screen buffer
+// Split 4-bit-per-pixel data into bit-planes of a screen
+// Pixel (row r, column c) is in byte r * 4 + c / 2, low nibble for even columns
 //------------------------------------------------------------------------------
-static void Copy_green_screen(int32_t code)
+static void Display_fill_grey_screen(uint8_t screen[][8], const uint8_t *pix4)
 {
-  green_screen[0] = Symbols[Remap_sym_code(code)][0];
-  green_screen[1] = Symbols[Remap_sym_code(code)][1];
-  green_screen[2] = Symbols[Remap_sym_code(code)][2];
-  green_screen[3] = Symbols[Remap_sym_code(code)][3];
-  green_screen[4] = Symbols[Remap_sym_code(code)][4];
-  green_screen[5] = Symbols[Remap_sym_code(code)][5];
-  green_screen[6] = Symbols[Remap_sym_code(code)][6];
-  green_screen[7] = Symbols[Remap_sym_code(code)][7];
+  uint32_t p, r, c;
+  uint32_t level;
+  uint8_t  plane[DISPLAY_BCM_BITS][8];
+
+  memset(plane, 0, sizeof(plane));
+  for (r = 0; r < 8; r++)
+  {
+    for (c = 0; c < 8; c++)
+    {
+      level = (pix4[r * 4 + c / 2] >> ((c & 1) * 4)) & 0x0F;
+      // Keep the most significant bits when fewer than 4 planes are built
+      level >>= (4 - DISPLAY_BCM_BITS);
+      for (p = 0; p < DISPLAY_BCM_BITS; p++)
+      {
+        plane[p][r] |= ((level >> p) & 1) << c;
+      }
+    }
+  }
+  taskENTER_CRITICAL();
+  memcpy(screen, plane, sizeof(plane));
+  g_screen_gen++;
+  taskEXIT_CRITICAL();
 }
+
 //------------------------------------------------------------------------------
 // Set display symbol with specified color
 //------------------------------------------------------------------------------
 void Display_set_symbol(int32_t code, int32_t color)
 {
-  if (code >= Get_symbols_count())
+  const uint8_t *glyph = Symbol_get(Remap_sym_code(code));
+
+  if (glyph == NULL)
     return;
   switch (color)
   {
     case 0:
 
-      red_dsym.state_period = 0;
-      Copy_red_screen(code);
+      Display_stop_animation(SPRITE_RED);
+      Display_fill_screen(red_screen, glyph);
       // memset(green_screen, 0, sizeof(green_screen));
       break;
     case 1:
-      green_dsym.state_period = 0;
-      Copy_green_screen(code);
+      Display_stop_animation(SPRITE_GREEN);
+      Display_fill_screen(green_screen, glyph);
       // memset(red_screen,  0, sizeof(red_screen));
       break;
     case 2:
-      red_dsym.state_period   = 0;
-      green_dsym.state_period = 0;
-      Copy_red_screen(code);
-      Copy_green_screen(code);
+      Display_stop_animation(SPRITE_RED | SPRITE_GREEN);
+      // Both colours in one critical section so no frame is compiled with only one of them
+      taskENTER_CRITICAL();
+      Display_fill_screen(red_screen, glyph);
+      Display_fill_screen(green_screen, glyph);
+      taskEXIT_CRITICAL();
       break;
   }
 }
@@ -71,347 +146,645 @@ void Display_set_symbol(int32_t code, int32_t color)
 //------------------------------------------------------------------------------
 void Display_copy_to_red_screen(uint8_t *ptr)
 {
-  red_dsym.state_period = 0;
-  red_screen[0]         = ptr[0];
-  red_screen[1]         = ptr[1];
-  red_screen[2]         = ptr[2];
-  red_screen[3]         = ptr[3];
-  red_screen[4]         = ptr[4];
-  red_screen[5]         = ptr[5];
-  red_screen[6]         = ptr[6];
-  red_screen[7]         = ptr[7];
+  Display_stop_animation(SPRITE_RED);
+  Display_fill_screen(red_screen, ptr);
 }
 //------------------------------------------------------------------------------
 // Copy data to green screen buffer
 //------------------------------------------------------------------------------
 void Display_copy_to_green_screen(uint8_t *ptr)
 {
-  green_dsym.state_period = 0;
-  green_screen[0]         = ptr[0];
-  green_screen[1]         = ptr[1];
-  green_screen[2]         = ptr[2];
-  green_screen[3]         = ptr[3];
-  green_screen[4]         = ptr[4];
-  green_screen[5]         = ptr[5];
-  green_screen[6]         = ptr[6];
-  green_screen[7]         = ptr[7];
+  Display_stop_animation(SPRITE_GREEN);
+  Display_fill_screen(green_screen, ptr);
+}
+
+//------------------------------------------------------------------------------
+// Copy both colours at once: no frame is compiled with only one of them updated
+//------------------------------------------------------------------------------
+void Display_copy_frame(const uint8_t *red, const uint8_t *green)
+{
+  taskENTER_CRITICAL();
+  Display_stop_animation(SPRITE_RED | SPRITE_GREEN);
+  Display_fill_screen(red_screen, red);
+  Display_fill_screen(green_screen, green);
+  taskEXIT_CRITICAL();
+}
+
+//------------------------------------------------------------------------------
+// Apply an XOR delta (Frame_delta.h) to the on/off picture of a screen
+// The most significant plane is the on/off picture; changed rows get full brightness
+//------------------------------------------------------------------------------
+static int32_t Display_xor_screen(uint8_t screen[][8], const uint8_t *payload)
+{
+  uint32_t p, r;
+  int32_t  res;
+  uint8_t  rows[8];
+
+  taskENTER_CRITICAL();
+  memcpy(rows, screen[DISPLAY_BCM_BITS - 1], 8);
+  res = Frame_delta_apply(rows, payload);
+  if (res > 0)
+  {
+    for (r = 0; r < 8; r++)
+    {
+      if (payload[0] & (1u << r))
+      {
+        for (p = 0; p < DISPLAY_BCM_BITS; p++)
+        {
+          screen[p][r] = rows[r];
+        }
+      }
+    }
+    g_screen_gen++;
+  }
+  taskEXIT_CRITICAL();
+  return res;
+}
+
+//------------------------------------------------------------------------------
+// Apply an XOR delta to red screen buffer
+//------------------------------------------------------------------------------
+int32_t Display_xor_red_screen(const uint8_t *payload)
+{
+  Display_stop_animation(SPRITE_RED);
+  return Display_xor_screen(red_screen, payload);
+}
+
+//------------------------------------------------------------------------------
+// Apply an XOR delta to green screen buffer
+//------------------------------------------------------------------------------
+int32_t Display_xor_green_screen(const uint8_t *payload)
+{
+  Display_stop_animation(SPRITE_GREEN);
+  return Display_xor_screen(green_screen, payload);
+}
+
+//------------------------------------------------------------------------------
+// Read the on/off picture of both colours (most significant planes)
+//------------------------------------------------------------------------------
+void Display_get_screens(uint8_t *red, uint8_t *green)
+{
+  taskENTER_CRITICAL();
+  memcpy(red, red_screen[DISPLAY_BCM_BITS - 1], 8);
+  memcpy(green, green_screen[DISPLAY_BCM_BITS - 1], 8);
+  taskEXIT_CRITICAL();
 }
 
+//------------------------------------------------------------------------------
+// Copy 4-bit-per-pixel data (32 bytes, 16 brightness levels) to red screen buffer
+//------------------------------------------------------------------------------
+void Display_copy_grey_to_red_screen(const uint8_t *pix4)
+{
+  Display_stop_animation(SPRITE_RED);
+  Display_fill_grey_screen(red_screen, pix4);
+}
 
-/*-----------------------------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+// Copy 4-bit-per-pixel data (32 bytes, 16 brightness levels) to green screen buffer
+//------------------------------------------------------------------------------
+void Display_copy_grey_to_green_screen(const uint8_t *pix4)
+{
+  Display_stop_animation(SPRITE_GREEN);
+  Display_fill_grey_screen(green_screen, pix4);
+}
 
------------------------------------------------------------------------------------------------------*/
+//------------------------------------------------------------------------------
+// Animate symbol sym_num over a cleared screen of the given colour (0 - red, 1 - green, 2 - both):
+// it moves by deltax, deltay every period + 1 animation steps and returns to startx, starty
+// after step_num moves. A write to the same screen stops the animation
+//------------------------------------------------------------------------------
 void Set_dinamic_symbol(int32_t sym_num, int32_t period, int32_t step_num, int32_t deltax, int32_t deltay, int32_t startx, int32_t starty, int32_t color)
 {
-  T_din_symbol *pdsym1 = 0;
-  T_din_symbol *pdsym2 = 0;
-  if (color == 0)
+  static const uint8_t blank[8];
+  uint64_t             glyph;
+  uint32_t             colors;
+  uint32_t             i;
+
+  if ((Symbol_get(sym_num) == NULL) || (color < 0) || (color > 2))
   {
-    pdsym1 = &red_dsym;
+    return;
   }
-  else if (color == 1)
+  colors = (color == 2) ? (SPRITE_RED | SPRITE_GREEN) : (SPRITE_RED << color);
+  glyph  = Bit_matrix_load(Symbol_get(sym_num));
+
+  taskENTER_CRITICAL();
+  for (i = 0; i < 2; i++)
   {
-    pdsym1 = &green_dsym;
+    if (colors & (SPRITE_RED << i))
+    {
+      Display_fill_screen((i == 0) ? red_screen : green_screen, blank);
+      Sprite_place(&g_sprites[i], glyph, startx, starty, SPRITE_RED << i, SPRITE_BLEND_OR, 0);
+      Sprite_set_motion(&g_sprites[i], deltax, deltay, (period > 0) ? (uint32_t)period + 1U : 0U, (uint32_t)step_num);
+    }
   }
-  else if (color == 2)
+  g_sprite_legacy |= colors;
+  g_screen_gen++;
+  taskEXIT_CRITICAL();
+}
+
+//------------------------------------------------------------------------------
+// Put symbol code as sprite n over the screens; it moves by dx, dy every period
+// animation steps (0 - still) and wraps around the screen edges.
+// colors (SPRITE_RED, SPRITE_GREEN) = 0 or an unknown code remove the sprite
+//------------------------------------------------------------------------------
+void Display_set_sprite(uint32_t n, int32_t code, int32_t x, int32_t y, uint32_t colors, uint32_t blend, uint32_t z, int32_t dx, int32_t dy, uint32_t period)
+{
+  const uint8_t *sym   = NULL;
+  uint64_t       glyph = 0;
+
+  if (n >= SPRITE_POOL_SIZE)
   {
-    pdsym1 = &red_dsym;
-    pdsym2 = &green_dsym;
+    return;
   }
-
-  if (pdsym1 != 0)
+  if (code >= 0)
+  {
+    sym = Symbol_get(Remap_sym_code(code));
+  }
+  if (sym == NULL)
+  {
+    colors = 0;
+  }
+  else
   {
-    pdsym1->state_period = 0;
-    pdsym1->start_x      = startx;
-    pdsym1->start_y      = starty;
-    pdsym1->state_cnt    = period;
-    pdsym1->step_cnt     = step_num;
-    pdsym1->step_count   = step_num;
-    pdsym1->symbol_num   = sym_num;
-    pdsym1->x_delta      = deltax;
-    pdsym1->y_delta      = deltay;
-    pdsym1->x_pos        = pdsym1->start_x;
-    pdsym1->y_pos        = pdsym1->start_y;
-    pdsym1->state_period = period;
+    glyph = Bit_matrix_load(sym);
   }
 
-  if (pdsym2 != 0)
+  taskENTER_CRITICAL();
+  Sprite_place(&g_sprites[n], glyph, x, y, colors, blend, z);
+  Sprite_set_motion(&g_sprites[n], dx, dy, period, 0);
+  if (n < 2)
   {
-    pdsym2->state_period = 0;
-    pdsym2->start_x      = startx;
-    pdsym2->start_y      = starty;
-    pdsym2->state_cnt    = period;
-    pdsym2->step_cnt     = step_num;
-    pdsym2->step_count   = step_num;
-    pdsym2->symbol_num   = sym_num;
-    pdsym2->x_delta      = deltax;
-    pdsym2->y_delta      = deltay;
-    pdsym2->x_pos        = pdsym1->start_x;
-    pdsym2->y_pos        = pdsym1->start_y;
-    pdsym2->state_period = period;
+    g_sprite_legacy &= ~(SPRITE_RED << n);
   }
+  g_screen_gen++;
+  taskEXIT_CRITICAL();
 }
 
 //------------------------------------------------------------------------------
-// Dynamic symbol animation procedure
+// Picture generation, changes with every write to the screens
 //------------------------------------------------------------------------------
-static void Dynamyc_simbol_procedure(uint8_t *screen, T_din_symbol *pdsym)
+uint32_t Display_screen_gen(void)
 {
-  int32_t row, col, y, x;
-  uint8_t s, a;
-
-  if (pdsym->state_period == 0)
-    return;
-
-  if (g_line_cnt == 7)
-  {  // Decrease period counter; symbol animation is updated when this counter reaches zero
-
-    if (pdsym->state_cnt == 0)
-    {
-      // Clear screen
-      screen[0]        = 0;
-      screen[1]        = 0;
-      screen[2]        = 0;
-      screen[3]        = 0;
-      screen[4]        = 0;
-      screen[5]        = 0;
-      screen[6]        = 0;
-      screen[7]        = 0;
-
-      pdsym->state_cnt = pdsym->state_period;  // Reset period counter
-
-      // Draw symbol at new position
-
-      //  Rendering
-      for (row = 0; row < 8; row++)
-      {
-        y = row + pdsym->y_pos;
-        // Check if row is within display bounds vertically
-        if ((y >= 0) && (y < 8))
-        {
-          s = Symbols[pdsym->symbol_num][row];
-          for (col = 0; col < 8; col++)
-          {
-            x = col + pdsym->x_pos;
-            // Check if column is within display bounds horizontally
-            if ((x >= 0) && (x < 8))
-            {
-              // Move pixel from source position row, col to screen position x, y
-              a         = ((s >> col) & 1) << x;
-              screen[y] = screen[y] ^ a;
-            }
-          }
-        }
-      }
-
-      // Update symbol position
-      pdsym->x_pos += pdsym->x_delta;
-      pdsym->y_pos += pdsym->y_delta;
+  return g_screen_gen;
+}
 
-      if (pdsym->step_cnt != 0)
-      {
-        pdsym->step_cnt--;
-      }
-      else
-      {
-        pdsym->step_cnt = pdsym->step_count;
-        pdsym->x_pos    = pdsym->start_x;
-        pdsym->y_pos    = pdsym->start_y;
-      }
-    }
-    else
-    {
-      pdsym->state_cnt--;
-    }
+//------------------------------------------------------------------------------
+// Time the command received at rx_cyc until its picture is shown, if it changed
+// the screens since gen_before. While a command is timed, later ones are skipped
+//------------------------------------------------------------------------------
+void Display_mark_command(uint32_t gen_before, uint32_t rx_cyc)
+{
+  taskENTER_CRITICAL();
+  if ((g_screen_gen != gen_before) && !g_mark_req)
+  {
+    g_mark_req = 1;
+    g_mark_gen = g_screen_gen;
+    g_mark_cyc = rx_cyc;
   }
+  taskEXIT_CRITICAL();
 }
 
-/*-----------------------------------------------------------------------------------------------------
-
------------------------------------------------------------------------------------------------------*/
-static void Display_rotation_0(uint32_t k, uint8_t *a, uint8_t *c)
+//------------------------------------------------------------------------------
+// Show the picture written last at the moment the cycle counter reaches cyc instead of
+// at the next frame boundary. Called after the picture is written to the screens
+//------------------------------------------------------------------------------
+void Display_present_at(uint32_t cyc)
 {
-  *a = red_screen[k];
-  *c = green_screen[k];
+  taskENTER_CRITICAL();
+  g_present_req = 1;
+  g_present_gen = g_screen_gen;
+  g_present_cyc = cyc;
+  taskEXIT_CRITICAL();
 }
 
-/*-----------------------------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+// Per-plane timer values of a page for brightness level 0..255 (Display_plane_timing)
+//------------------------------------------------------------------------------
+static void Display_page_timing(uint32_t page, uint32_t level)
+{
+  Display_plane_timing(level, g_us_ticks, g_page_arr[page], g_page_ccr[page]);
+  g_brightness = level;
+}
 
------------------------------------------------------------------------------------------------------*/
-static void Display_rotation_90(uint32_t k, uint8_t *a, uint8_t *c)
+//------------------------------------------------------------------------------
+// Rebuild the slot words and timing of a page from a snapshot of the screen bit-planes
+//------------------------------------------------------------------------------
+static void Display_compile_frame(uint32_t page)
 {
-  *a = (((red_screen[0] >> k) & 1) << 7) | (((red_screen[1] >> k) & 1) << 6) | (((red_screen[2] >> k) & 1) << 5) | (((red_screen[3] >> k) & 1) << 4) | (((red_screen[4] >> k) & 1) << 3) | (((red_screen[5] >> k) & 1) << 2) | (((red_screen[6] >> k) & 1) << 1) | (((red_screen[7] >> k) & 1) << 0);
-  *c = (((green_screen[0] >> k) & 1) << 7) | (((green_screen[1] >> k) & 1) << 6) | (((green_screen[2] >> k) & 1) << 5) | (((green_screen[3] >> k) & 1) << 4) | (((green_screen[4] >> k) & 1) << 3) | (((green_screen[5] >> k) & 1) << 2) | (((green_screen[6] >> k) & 1) << 1) | (((green_screen[7] >> k) & 1) << 0);
+  uint8_t  red_planes[DISPLAY_BCM_BITS][8];
+  uint8_t  green_planes[DISPLAY_BCM_BITS][8];
+  uint32_t level;
+
+  // Writers may run in other tasks: take both colours, the brightness and the generation in one piece
+  taskENTER_CRITICAL();
+  memcpy(red_planes, red_screen, sizeof(red_planes));
+  memcpy(green_planes, green_screen, sizeof(green_planes));
+  level          = g_bright_cur >> 8;
+  g_compiled_gen = g_screen_gen;
+  // The page holding the timed picture flips at its moment, older pictures at the frame end.
+  // No flip is pending here, so the scan interrupt does not read these fields
+  g_scan.timed   = g_present_req && ((int32_t)(g_compiled_gen - g_present_gen) >= 0);
+  if (g_scan.timed)
+  {
+    g_scan.flip_cyc = g_present_cyc;
+    g_present_req   = 0;
+  }
+  g_scan.marked  = g_mark_req && ((int32_t)(g_compiled_gen - g_mark_gen) >= 0);
+  if (g_scan.marked)
+  {
+    g_scan.mark_cyc = g_mark_cyc;
+    g_mark_req      = 0;
+  }
+  taskEXIT_CRITICAL();
+  g_compiled_rot = app_vars.rotated & 3;
+
+  // Sprites are changed only by tasks, so locking the scheduler keeps them whole
+  // without masking the scan interrupt for the time of compositing
+  vTaskSuspendAll();
+  Sprite_compose(g_sprites, red_planes, green_planes, DISPLAY_BCM_BITS);
+  xTaskResumeAll();
+  g_timing.frames_compiled++;
+
+  Display_compile_words(red_planes, green_planes, g_compiled_rot, g_slot_words[page]);
+  Display_page_timing(page, level);
 }
 
-/*-----------------------------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+// Start DMA transfer of one 16-bit row word to the TLC5920 shift register
+//------------------------------------------------------------------------------
+static void Display_start_row_dma(const uint16_t *pw)
+{
+  DMA1_Channel3->CCR  &= ~DMA_CCR_EN;
+  DMA1->IFCR           = DMA_IFCR_CGIF3;
+  DMA1_Channel3->CMAR  = (uint32_t)pw;
+  DMA1_Channel3->CNDTR = 1;
+  DMA1_Channel3->CCR  |= DMA_CCR_EN;
+}
 
------------------------------------------------------------------------------------------------------*/
-static void Display_rotation_180(uint32_t k, uint8_t *a, uint8_t *c)
+//------------------------------------------------------------------------------
+// Set global brightness 0..255, reached linearly within ramp_ms milliseconds (0 - at once)
+//------------------------------------------------------------------------------
+void Display_set_brightness(uint32_t level, uint32_t ramp_ms)
 {
-  uint8_t  b;
-  uint32_t i;
+  uint32_t target;
+  uint32_t delta;
+  uint32_t ticks;
 
-  *a = red_screen[7 - k];
-  *c = green_screen[7 - k];
-  //  Reverse bits
-  b  = 0;
-  for (i = 0; i < 8; i++)
+  if (level > 255)
   {
-    b <<= 1;
-    if (*a & 1)
-      b++;
-    *a >>= 1;
+    level = 255;
   }
-  *a = b;
-  b  = 0;
-  for (i = 0; i < 8; i++)
+  target = level << 8;
+  ticks  = (ramp_ms * configTICK_RATE_HZ) / 1000U;
+  taskENTER_CRITICAL();
+  if (ticks == 0)
   {
-    b <<= 1;
-    if (*c & 1)
-      b++;
-    *c >>= 1;
+    // A step goes with the picture: the next page built gets it, as a picture written
+    // in the same critical section as this call
+    g_bright_cur  = target;
+    g_bright_step = 0;
   }
-  *c = b;
+  else
+  {
+    delta         = (target > g_bright_cur) ? (target - g_bright_cur) : (g_bright_cur - target);
+    g_bright_step = (delta + ticks - 1U) / ticks;
+  }
+  g_bright_target = target;
+  taskEXIT_CRITICAL();
 }
 
-/*-----------------------------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+// Brightness level of the last page built, shown from its flip on
+//------------------------------------------------------------------------------
+uint32_t Display_get_brightness(void)
+{
+  return g_brightness;
+}
 
------------------------------------------------------------------------------------------------------*/
-static void Display_rotation_270(uint32_t k, uint8_t *a, uint8_t *c)
+//------------------------------------------------------------------------------
+// Move the brightness one OS tick towards the requested level
+//------------------------------------------------------------------------------
+static void Display_brightness_ramp(void)
 {
-  uint8_t  b;
-  uint32_t i, j;
-  uint8_t  rr[8];
-  uint8_t  gg[8];
-  for (j = 0; j < 8; j++)
+  uint32_t cur;
+  uint32_t target;
+  uint32_t step;
+
+  // Display_set_brightness() runs in other tasks; the frame stage builds a page for every new level
+  taskENTER_CRITICAL();
+  cur    = g_bright_cur;
+  target = g_bright_target;
+  step   = g_bright_step;
+  if (cur < target)
   {
-    //  Reverse bits
-    b  = 0;
-    *a = red_screen[j];
-    for (i = 0; i < 8; i++)
-    {
-      b <<= 1;
-      if (*a & 1)
-        b++;
-      *a >>= 1;
-    }
-    rr[j] = b;
+    g_bright_cur = ((target - cur) > step) ? (cur + step) : target;
   }
+  else if (cur > target)
+  {
+    g_bright_cur = ((cur - target) > step) ? (cur - step) : target;
+  }
+  taskEXIT_CRITICAL();
+}
 
-  for (j = 0; j < 8; j++)
+//------------------------------------------------------------------------------
+// Row scan engine initialization
+// TIM2 paces the slots, SPI1 TX DMA (DMA1 channel 3) shifts the row words out,
+// TIM2 channel 4 drives BLANK (PA3) so dimming costs no CPU time per slot
+//------------------------------------------------------------------------------
+void Display_init(void)
+{
+  uint32_t           timclk;
+  GPIO_InitTypeDef   gpio_init = {0};
+  TIM_OC_InitTypeDef oc_init   = {0};
+
+  // TLC5920 takes the 16-bit row word as a single SPI frame
+  __HAL_SPI_DISABLE(&hspi1);
+  hspi1.Init.DataSize = SPI_DATASIZE_16BIT;
+  HAL_SPI_Init(&hspi1);
+  SET_BIT(hspi1.Instance->CR2, SPI_CR2_TXDMAEN);
+  __HAL_SPI_ENABLE(&hspi1);
+
+  // DMA1 channel 3: memory -> SPI1->DR, 16-bit, one item per slot
+  __HAL_RCC_DMA1_CLK_ENABLE();
+  DMA1_Channel3->CCR  = 0;
+  DMA1_Channel3->CPAR = (uint32_t)&hspi1.Instance->DR;
+  DMA1_Channel3->CCR  = DMA_CCR_DIR | DMA_CCR_PSIZE_0 | DMA_CCR_MSIZE_0 | DMA_CCR_PL_1;
+
+  // TIM2 runs at the full timer clock for fine brightness steps, update event marks the start of each slot
+  timclk              = HAL_RCC_GetPCLK1Freq();
+  if ((RCC->CFGR & RCC_CFGR_PPRE1) != RCC_HCLK_DIV1)
   {
-    //  Reverse bits
-    b  = 0;
-    *a = green_screen[j];
-    for (i = 0; i < 8; i++)
-    {
-      b <<= 1;
-      if (*a & 1)
-        b++;
-      *a >>= 1;
-    }
-    gg[j] = b;
+    timclk *= 2;
   }
+  g_us_ticks      = timclk / 1000000U;
+  Display_reset_timing();
+  g_bright_cur    = DISPLAY_BRIGHTNESS_DEFAULT << 8;
+  g_bright_target = g_bright_cur;
+
+  // Page 0 with its timing is shown first; slot 0 is preloaded so the first latch shows valid data
+  Display_compile_frame(0);
+  Display_scan_init(&g_scan);
+
+  __HAL_RCC_TIM2_CLK_ENABLE();
+  htim_scan.Instance               = TIM2;
+  htim_scan.Init.Prescaler         = 0;
+  htim_scan.Init.Period            = g_page_arr[0][0];
+  htim_scan.Init.CounterMode       = TIM_COUNTERMODE_UP;
+  htim_scan.Init.ClockDivision     = TIM_CLOCKDIVISION_DIV1;
+  htim_scan.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_ENABLE;
+  HAL_TIM_PWM_Init(&htim_scan);
+
+  // PWM2 with active-low output: BLANK is high (LEDs off) while CNT < CCR4, low for the rest of the slot
+  oc_init.OCMode     = TIM_OCMODE_PWM2;
+  oc_init.Pulse      = g_page_ccr[0][0];
+  oc_init.OCPolarity = TIM_OCPOLARITY_LOW;
+  oc_init.OCFastMode = TIM_OCFAST_DISABLE;
+  HAL_TIM_PWM_ConfigChannel(&htim_scan, &oc_init, TIM_CHANNEL_4);
+
+  // PA3 passes from GPIO control (IO_funcs.c) to TIM2_CH4
+  gpio_init.Pin   = GPIO_PIN_3;
+  gpio_init.Mode  = GPIO_MODE_AF_PP;
+  gpio_init.Speed = GPIO_SPEED_FREQ_HIGH;
+  HAL_GPIO_Init(GPIOA, &gpio_init);
+
+  Display_start_row_dma(&g_slot_words[0][0]);
+
+  // Only pended by software, the TIM3 peripheral itself stays off
+  HAL_NVIC_SetPriority(DISPLAY_EVENT_IRQn, DISPLAY_EVENT_IRQ_PRIO, 0);
+  HAL_NVIC_EnableIRQ(DISPLAY_EVENT_IRQn);
+  HAL_NVIC_SetPriority(TIM2_IRQn, DISPLAY_SCAN_IRQ_PRIO, 0);
+  HAL_NVIC_EnableIRQ(TIM2_IRQn);
+  HAL_TIM_PWM_Start(&htim_scan, TIM_CHANNEL_4);
+  HAL_TIM_Base_Start_IT(&htim_scan);
+}
 
-  // Rotate by 270 degrees
-  *a = (((rr[0] >> k) & 1) << 0) | (((rr[1] >> k) & 1) << 1) | (((rr[2] >> k) & 1) << 2) | (((rr[3] >> k) & 1) << 3) | (((rr[4] >> k) & 1) << 4) | (((rr[5] >> k) & 1) << 5) | (((rr[6] >> k) & 1) << 6) | (((rr[7] >> k) & 1) << 7);
+//------------------------------------------------------------------------------
+// Display_blank - holds BLANK high while on is nonzero
+// Flash programming and erase stall the CPU with every interrupt, the row scan too, and the
+// latched row would stay lit for the whole stall. TIM2 keeps counting, only channel 4 is
+// forced inactive and then returned to PWM2; OC4M is not preloaded and acts at once
+//------------------------------------------------------------------------------
+void Display_blank(uint32_t on)
+{
+  uint32_t ccmr = TIM2->CCMR2 & ~TIM_CCMR2_OC4M;
 
-  *c = (((gg[0] >> k) & 1) << 0) | (((gg[1] >> k) & 1) << 1) | (((gg[2] >> k) & 1) << 2) | (((gg[3] >> k) & 1) << 3) | (((gg[4] >> k) & 1) << 4) | (((gg[5] >> k) & 1) << 5) | (((gg[6] >> k) & 1) << 6) | (((gg[7] >> k) & 1) << 7);
+  if (on)
+  {
+    // Forced inactive OC4REF gives a high BLANK through the active-low output
+    ccmr |= TIM_CCMR2_OC4M_2;
+  }
+  else
+  {
+    ccmr |= TIM_CCMR2_OC4M_2 | TIM_CCMR2_OC4M_1 | TIM_CCMR2_OC4M_0;
+  }
+  TIM2->CCMR2 = ccmr;
 }
 
 //------------------------------------------------------------------------------
-// SPI send procedure called after each line data transmission via SPI1_send_word
+// Row scan interrupt handler, called from TIM2_IRQHandler at the start of each slot
+// The word for this slot was shifted during the previous one and BLANK is held
+// high by TIM2 CH4 at the slot start, so here only CSEL and latch are switched,
+// the next slot's duration and BLANK compare are preloaded and the next word
+// is queued to DMA. Runs at DISPLAY_SCAN_IRQ_PRIO: no FreeRTOS calls here
 //------------------------------------------------------------------------------
-static void Displ_SPI_send_proc(void)
+void Display_scan_isr(void)
 {
-  // Disable line output
-  TLC5920DLG4_Blank_high();
+  uint32_t slot;
+  uint32_t next;
+  uint32_t t;
+  uint32_t evt;
+
+  TIM2->SR   = ~TIM_SR_UIF;
+
+  // Advance to next slot
+  slot       = Display_scan_advance(&g_scan);
 
   // Установка сигналов выбора строки на трех пинах PB8, PB9, PB10 (CSEL0, CSEL1, CSEL2 на чипе TLC5920DLG4)
-  GPIOB->ODR = (g_line_cnt << 8);
+  GPIOB->ODR = ((slot / DISPLAY_BCM_BITS) << 8);
 
   // Даем сигнал перемещения данных строки из сдвигового регистра на выход на LED матрицу
   TLC5920DLG4_Latch_high();
   TLC5920DLG4_Latch_low();
-  // Включаем сигнал строки
-  TLC5920DLG4_Blank_low();
 
-  // Advance to next line
-  if (g_line_cnt >= 7)
+  // CNT restarted at the slot start; CCR4 still holds this slot's end of blank
+  t = TIM2->CNT;
+  if (t < g_timing.latch_min)
   {
-    g_line_cnt = 0;
+    g_timing.latch_min = t;
   }
-  else
+  if (t > g_timing.latch_max)
+  {
+    g_timing.latch_max = t;
+  }
+  if (t >= TIM2->CCR4)
+  {
+    g_timing.latch_late++;
+  }
+  g_timing.slots++;
+
+  // Next word, from the new page if a flip is due now
+  next = Display_scan_next(&g_scan, DWT->CYCCNT, &evt);
+  if (evt & DISPLAY_SCAN_MARKED)
+  {
+    g_scan_latency = DWT->CYCCNT - g_scan.mark_cyc;
+  }
+
+  // ARR and CCR4 are preloaded: the values written now take effect at the next update event.
+  // They come from the page of the word, so a brightness change flips with its picture
+  TIM2->ARR  = g_page_arr[g_scan.front][next % DISPLAY_BCM_BITS];
+  TIM2->CCR4 = g_page_ccr[g_scan.front][next % DISPLAY_BCM_BITS];
+
+  // Shift the next slot's word into the TLC5920 while this one is displayed
+  Display_start_row_dma(&g_slot_words[g_scan.front][next]);
+
+  t = TIM2->CNT;
+  if (t > g_timing.isr_max)
   {
-    g_line_cnt++;
+    g_timing.isr_max = t;
   }
 
-  // Process dynamic symbol animation after completing full frame (8 lines)
-  // Animation is updated at 8-line intervals
-  Dynamyc_simbol_procedure(&red_screen[0], &red_dsym);
-  Dynamyc_simbol_procedure(&green_screen[0], &green_dsym);
+  // The back page is free again: Display_event_isr wakes the frame stage to build the next one.
+  // Pended after the row is served so the notification does not delay the slot
+  if (evt)
+  {
+    g_scan_events |= evt;
+    NVIC_SetPendingIRQ(DISPLAY_EVENT_IRQn);
+  }
 }
 
 //------------------------------------------------------------------------------
-// Display state machine handler
+// Page flip events of the row scan, software-pended by Display_scan_isr
+// Runs at DISPLAY_EVENT_IRQ_PRIO where FreeRTOS calls from interrupts are allowed
 //------------------------------------------------------------------------------
-void Display_state_machine(void)
+void Display_event_isr(void)
 {
-  uint32_t i;
-  uint32_t k;
-  int16_t  w;
-  uint8_t  a = 0;
-  uint8_t  b = 0;
-  uint8_t  c = 0;
-  uint8_t  spi_data[2];  // Массив для передачи данных через SPI
+  uint32_t   evt;
+  uint32_t   latency;
+  BaseType_t woken = pdFALSE;
+
+  // Display_scan_isr may preempt here: take and clear the events in one piece
+  __disable_irq();
+  evt           = g_scan_events;
+  latency       = g_scan_latency;
+  g_scan_events = 0;
+  __enable_irq();
+
+  if (evt & DISPLAY_SCAN_MARKED)
+  {
+    CAN_note_display_latency(latency);
+  }
+  if (evt & DISPLAY_SCAN_FLIPPED)
+  {
+    vTaskNotifyGiveFromISR(defaultTaskHandle, &woken);
+    portYIELD_FROM_ISR(woken);
+  }
+}
 
-  // Calculate line number from 0 to 7 for next output
-  k = g_line_cnt & 7;
+//------------------------------------------------------------------------------
+// Slow display inputs, called every OS tick from Main_cycle
+//------------------------------------------------------------------------------
+void Display_tick(void)
+{
+  app_vars.rotated = ((GPIOA->IDR >> 7) & 2) | ((GPIOA->IDR >> 2) & 1);
 
-  app_vars.rotated   = ((GPIOA->IDR >> 7) & 2) | ((GPIOA->IDR >> 2) & 1);
+  Display_brightness_ramp();
+}
 
-  // If rotation is enabled, rotate display by 90 degree increments
-  switch (app_vars.rotated & 3)
+//------------------------------------------------------------------------------
+// Frame stage, called from Main_cycle every OS tick and whenever Display_scan_isr has flipped pages
+// Row output runs in Display_scan_isr; here animation, compositing and frame compilation are served,
+// so the cost of a new picture never falls on a row slot
+//------------------------------------------------------------------------------
+void Display_state_machine(void)
+{
+  static uint32_t anim_step;
+  uint32_t        step;
+  uint32_t        moved;
+  uint32_t        back;
+  uint32_t        t0;
+
+  // A newer timed picture replaces a timed flip still waiting for its moment;
+  // a command it carried is timed again with the newer picture
+  // The scan interrupt is above the FreeRTOS critical sections, so all interrupts are masked
+  if (g_scan.pending && g_scan.timed && g_present_req)
   {
-    case 0:
-      Display_rotation_0(k, &a, &c);
-      break;
-    case 1:
-      Display_rotation_90(k, &a, &c);
-      break;
-    case 2:
-      Display_rotation_180(k, &a, &c);
-      break;
-    case 3:
-      Display_rotation_270(k, &a, &c);
-      break;
+    __disable_irq();
+    if (Display_scan_withdraw(&g_scan) && g_scan.marked && !g_mark_req)
+    {
+      g_mark_req = 1;
+      g_mark_gen = g_compiled_gen;
+      g_mark_cyc = g_scan.mark_cyc;
+    }
+    __enable_irq();
   }
 
-  // Interleave red (a) and green (c) data
-  b = 0x01;
-  w = 0;
-  for (i = 0; i < 8; i++)
+  // While a flip is pending the back page belongs to the ISR, the change is taken after the flip
+  if (g_scan.pending)
   {
-    w = w << 1;
-    if (a & b)
-    {
-      w = w | 1;
-    }
-    w = w << 1;
-    if (c & b)
+    return;
+  }
+  t0   = DWT->CYCCNT;
+
+  // Animation advances once per DISPLAY_ANIMATION_TICKS ticks, the step rate of the former tick-driven scan.
+  // Steps are counted on the display clock, so synchronized boards step together
+  step = App_display_clock_us() / (DISPLAY_ANIMATION_TICKS * (1000000 / configTICK_RATE_HZ));
+  if (step != anim_step)
+  {
+    anim_step = step;
+    vTaskSuspendAll();
+    moved = Sprite_step(g_sprites);
+    xTaskResumeAll();
+    if (moved)
     {
-      w = w | 1;
+      taskENTER_CRITICAL();
+      g_screen_gen++;
+      taskEXIT_CRITICAL();
     }
-    b = b << 1;
   }
 
-  // Передача 16-битного слова через 8-битный SPI
-  // Разделяем 16-битное слово на старший и младший байты
-  spi_data[0] = (uint8_t)((w >> 8) & 0xFF);  // Старший байт
-  spi_data[1] = (uint8_t)(w & 0xFF);         // Младший байт
+  // Rotation and interleave run only when the picture or the orientation has changed
+  back = g_scan.front ^ 1;
+  if ((g_compiled_gen != g_screen_gen) || (g_compiled_rot != (app_vars.rotated & 3)))
+  {
+    Display_compile_frame(back);
+  }
+  else if ((g_bright_cur >> 8) != g_brightness)
+  {
+    // Brightness alone: the words of the front page again with the timing of the new level
+    memcpy(g_slot_words[back], g_slot_words[g_scan.front], sizeof(g_slot_words[0]));
+    g_scan.timed  = 0;
+    g_scan.marked = 0;
+    Display_page_timing(back, g_bright_cur >> 8);
+  }
+  else
+  {
+    return;
+  }
+  Display_scan_post(&g_scan);
+  t0 = (DWT->CYCCNT - t0) / (SystemCoreClock / 1000000U);
+  if (t0 > g_timing.compile_max_us)
+  {
+    g_timing.compile_max_us = t0;
+  }
+}
 
-  // Передача данных через HAL SPI
-  HAL_SPI_Transmit(&hspi1, spi_data, 2, HAL_MAX_DELAY);
-  Displ_SPI_send_proc();
+//------------------------------------------------------------------------------
+// Row scan and frame stage timing
+//------------------------------------------------------------------------------
+const T_display_timing *Display_get_timing(void)
+{
+  return &g_timing;
+}
+
+//------------------------------------------------------------------------------
+// Restart the timing measurements
+//------------------------------------------------------------------------------
+void Display_reset_timing(void)
+{
+  // Display_scan_isr updates the measurements and is not masked by taskENTER_CRITICAL
+  __disable_irq();
+  memset(&g_timing, 0, sizeof(g_timing));
+  g_timing.ticks_per_us = g_us_ticks;
+  g_timing.latch_min    = 0xFFFFFFFFU;
+  __enable_irq();
 }
@@ -1,6 +1,16 @@
 #ifndef __LED_DISPLAY_H
 #define __LED_DISPLAY_H
 
+#define DISPLAY_ANIMATION_TICKS    8    // OS ticks per dynamic symbol animation step
+#define DISPLAY_BRIGHTNESS_DEFAULT 255  // Global brightness after start, 0..255
+
+// The row scan runs above configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY, so neither the CAN
+// interrupts nor FreeRTOS critical sections delay a slot. It calls no FreeRTOS API: page flip
+// and latency events are passed to a software-pended interrupt of the otherwise unused TIM3
+// vector at a syscall-safe priority
+#define DISPLAY_SCAN_IRQ_PRIO      2
+#define DISPLAY_EVENT_IRQn         TIM3_IRQn
+#define DISPLAY_EVENT_IRQ_PRIO     6
 
 typedef struct
 {
@@ -18,12 +28,44 @@ typedef struct
 
 } T_din_symbol;
 
+// Row scan timing measured by Display_scan_isr and the frame stage, times in TIM2 ticks unless noted
+typedef struct
+{
+  uint32_t ticks_per_us;     // TIM2 ticks per microsecond
+  uint32_t slots;            // Slots scanned
+  uint32_t latch_min;        // Slot start to row latch
+  uint32_t latch_max;
+  uint32_t latch_late;       // Rows latched after BLANK went low, i.e. switched while lit
+  uint32_t isr_max;          // Slot start to the DMA start of the next row word
+  uint32_t frames_compiled;  // Back pages built by the frame stage
+  uint32_t compile_max_us;   // Animation step, compositing and compilation of one page, with preemption
+} T_display_timing;
+
+void Display_init(void);
+void Display_scan_isr(void);
+void Display_event_isr(void);
+void Display_tick(void);
 void Display_state_machine(void);
 void Display_set_symbol(int32_t code, int32_t color);
 void Display_copy_to_red_screen(uint8_t *ptr);
 void Display_copy_to_green_screen(uint8_t *ptr);
+void Display_copy_frame(const uint8_t *red, const uint8_t *green);
+int32_t Display_xor_red_screen(const uint8_t *payload);
+int32_t Display_xor_green_screen(const uint8_t *payload);
+void Display_get_screens(uint8_t *red, uint8_t *green);
+void Display_copy_grey_to_red_screen(const uint8_t *pix4);
+void Display_copy_grey_to_green_screen(const uint8_t *pix4);
+void Display_set_brightness(uint32_t level, uint32_t ramp_ms);
+void Display_blank(uint32_t on);
+uint32_t Display_get_brightness(void);
+void Display_present_at(uint32_t cyc);
+uint32_t Display_screen_gen(void);
+void Display_mark_command(uint32_t gen_before, uint32_t rx_cyc);
+const T_display_timing *Display_get_timing(void);
+void Display_reset_timing(void);
 
 void Set_dinamic_symbol(int32_t sym_num, int32_t period, int32_t step_num, int32_t deltax, int32_t deltay, int32_t startx, int32_t starty, int32_t color);
+void Display_set_sprite(uint32_t n, int32_t code, int32_t x, int32_t y, uint32_t colors, uint32_t blend, uint32_t z, int32_t dx, int32_t dy, uint32_t period);
 
 int32_t Remap_sym_code(int32_t code);
 #endif
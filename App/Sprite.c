@@ -0,0 +1,184 @@
+#include <string.h>
+#include "Bit_matrix.h"
+#include "Sprite.h"
+
+//------------------------------------------------------------------------------
+// Free all pool slots
+//------------------------------------------------------------------------------
+void Sprite_pool_init(T_sprite *pool)
+{
+  memset(pool, 0, SPRITE_POOL_SIZE * sizeof(T_sprite));
+}
+
+//------------------------------------------------------------------------------
+// Put a still sprite with glyph at x, y; colors = 0 frees the slot
+//------------------------------------------------------------------------------
+void Sprite_place(T_sprite *s, uint64_t glyph, int32_t x, int32_t y, uint32_t colors, uint32_t blend, uint32_t z)
+{
+  memset(s, 0, sizeof(*s));
+  s->glyph   = glyph;
+  s->x       = (int16_t)x;
+  s->y       = (int16_t)y;
+  s->start_x = (int16_t)x;
+  s->start_y = (int16_t)y;
+  s->colors  = (uint8_t)(colors & (SPRITE_RED | SPRITE_GREEN));
+  s->blend   = (uint8_t)((blend < SPRITE_BLEND_NUM) ? blend : SPRITE_BLEND_OR);
+  s->z       = (uint8_t)z;
+}
+
+//------------------------------------------------------------------------------
+// Move the sprite by dx, dy every period animation steps, starting from its current position
+//------------------------------------------------------------------------------
+void Sprite_set_motion(T_sprite *s, int32_t dx, int32_t dy, uint32_t period, uint32_t path_len)
+{
+  s->dx         = (int16_t)dx;
+  s->dy         = (int16_t)dy;
+  s->start_x    = s->x;
+  s->start_y    = s->y;
+  s->period     = (uint16_t)period;
+  s->period_cnt = (uint16_t)period;
+  s->path_len   = (uint16_t)path_len;
+  s->path_cnt   = (uint16_t)path_len;
+}
+
+//------------------------------------------------------------------------------
+// Keep a wrapping coordinate in SPRITE_WRAP_MIN..7: a sprite leaving one edge
+// enters from the opposite one after a single step fully off the screen
+//------------------------------------------------------------------------------
+static int16_t Sprite_wrap(int32_t v)
+{
+  while (v >= 8)
+  {
+    v -= 8 - SPRITE_WRAP_MIN;
+  }
+  while (v < SPRITE_WRAP_MIN)
+  {
+    v += 8 - SPRITE_WRAP_MIN;
+  }
+  return (int16_t)v;
+}
+
+//------------------------------------------------------------------------------
+// Advance all moving sprites by one animation step
+// Returns non-zero if any sprite moved
+//------------------------------------------------------------------------------
+uint32_t Sprite_step(T_sprite *pool)
+{
+  T_sprite *s;
+  uint32_t  i;
+  uint32_t  moved = 0;
+
+  for (i = 0; i < SPRITE_POOL_SIZE; i++)
+  {
+    s = &pool[i];
+    if ((s->colors == 0) || (s->period == 0))
+    {
+      continue;
+    }
+    if (--s->period_cnt != 0)
+    {
+      continue;
+    }
+    s->period_cnt = s->period;
+
+    if (s->path_len == 0)
+    {
+      s->x = Sprite_wrap(s->x + s->dx);
+      s->y = Sprite_wrap(s->y + s->dy);
+    }
+    else if (s->path_cnt != 0)
+    {
+      s->x += s->dx;
+      s->y += s->dy;
+      s->path_cnt--;
+    }
+    else
+    {
+      s->x        = s->start_x;
+      s->y        = s->start_y;
+      s->path_cnt = s->path_len;
+    }
+    moved = 1;
+  }
+  return moved;
+}
+
+//------------------------------------------------------------------------------
+// Blend the sprites of one colour into one plane, order and shape are sorted by z
+//------------------------------------------------------------------------------
+static void Sprite_blend_plane(const T_sprite *pool, const uint8_t *order, const uint64_t *shape, uint32_t n, uint32_t color, uint8_t *rows)
+{
+  uint64_t m = Bit_matrix_load(rows);
+  uint32_t k;
+
+  for (k = 0; k < n; k++)
+  {
+    if ((pool[order[k]].colors & color) == 0)
+    {
+      continue;
+    }
+    switch (pool[order[k]].blend)
+    {
+      case SPRITE_BLEND_XOR:
+        m ^= shape[k];
+        break;
+      case SPRITE_BLEND_MASK:
+        m &= ~shape[k];
+        break;
+      default:
+        m |= shape[k];
+        break;
+    }
+  }
+  Bit_matrix_store(m, rows);
+}
+
+//------------------------------------------------------------------------------
+// Draw the pool over planes bit-planes of both colours
+// Each sprite is shifted once; per plane the cost is one load, one store
+// and one logic operation per sprite
+//------------------------------------------------------------------------------
+void Sprite_compose(const T_sprite *pool, uint8_t (*red)[8], uint8_t (*green)[8], uint32_t planes)
+{
+  uint8_t  order[SPRITE_POOL_SIZE];
+  uint64_t shape[SPRITE_POOL_SIZE];
+  uint64_t sh;
+  uint32_t colors = 0;
+  uint32_t n      = 0;
+  uint32_t i, j, p;
+
+  // Insertion by z keeps the pool order of sprites with equal z
+  for (i = 0; i < SPRITE_POOL_SIZE; i++)
+  {
+    if (pool[i].colors == 0)
+    {
+      continue;
+    }
+    sh = Bit_matrix_shift(pool[i].glyph, pool[i].x, pool[i].y);
+    if (sh == 0)
+    {
+      continue;
+    }
+    for (j = n; (j > 0) && (pool[order[j - 1]].z > pool[i].z); j--)
+    {
+      order[j] = order[j - 1];
+      shape[j] = shape[j - 1];
+    }
+    order[j]  = (uint8_t)i;
+    shape[j]  = sh;
+    colors   |= pool[i].colors;
+    n++;
+  }
+
+  for (p = 0; p < planes; p++)
+  {
+    if (colors & SPRITE_RED)
+    {
+      Sprite_blend_plane(pool, order, shape, n, SPRITE_RED, red[p]);
+    }
+    if (colors & SPRITE_GREEN)
+    {
+      Sprite_blend_plane(pool, order, shape, n, SPRITE_GREEN, green[p]);
+    }
+  }
+}
@@ -0,0 +1,52 @@
+#ifndef __SPRITE_H
+#define __SPRITE_H
+
+#include <stdint.h>
+
+// Fixed pool of one-colour-per-plane 8x8 sprites composited over the screen bit-planes.
+// A sprite keeps its glyph as a Bit_matrix word, so moving it is a single 64-bit shift
+// and blending is one logic operation per plane. Sprites are drawn in ascending z-order,
+// equal z in pool order, on top of the picture written by the screen commands.
+// Blending applies to every brightness plane: OR lights the glyph pixels at full level,
+// XOR inverts their level, MASK clears them (cuts the glyph shape out of the layers below).
+
+#define SPRITE_POOL_SIZE 8
+
+#define SPRITE_RED   0x01u
+#define SPRITE_GREEN 0x02u
+
+#define SPRITE_WRAP_MIN (-8)  // Wrapping sprites move through x, y in SPRITE_WRAP_MIN..7
+
+typedef enum
+{
+  SPRITE_BLEND_OR = 0,
+  SPRITE_BLEND_XOR,
+  SPRITE_BLEND_MASK,
+  SPRITE_BLEND_NUM
+} T_sprite_blend;
+
+typedef struct
+{
+  uint64_t glyph;       // Bit_matrix layout, row r in byte r
+  int16_t  x;           // Current position of the top-left corner, pixels outside the screen are clipped
+  int16_t  y;
+  int16_t  dx;          // Increment per move
+  int16_t  dy;
+  int16_t  start_x;     // Position a path starts from
+  int16_t  start_y;
+  uint16_t period;      // Animation steps per move, 0 - the sprite stands still
+  uint16_t period_cnt;
+  uint16_t path_len;    // Moves before returning to the start, 0 - wrap around the screen edges
+  uint16_t path_cnt;
+  uint8_t  colors;      // SPRITE_RED | SPRITE_GREEN, 0 - pool slot free
+  uint8_t  blend;       // T_sprite_blend
+  uint8_t  z;           // Drawing order, higher is on top
+} T_sprite;
+
+void     Sprite_pool_init(T_sprite *pool);
+void     Sprite_place(T_sprite *s, uint64_t glyph, int32_t x, int32_t y, uint32_t colors, uint32_t blend, uint32_t z);
+void     Sprite_set_motion(T_sprite *s, int32_t dx, int32_t dy, uint32_t period, uint32_t path_len);
+uint32_t Sprite_step(T_sprite *pool);
+void     Sprite_compose(const T_sprite *pool, uint8_t (*red)[8], uint8_t (*green)[8], uint32_t planes);
+
+#endif
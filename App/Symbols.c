@@ -1,6 +1,7 @@
 #include "Application.h"
 
-unsigned char Symbols[][8] =
+// Built-in font, read from flash in place
+static const uint8_t Symbols[][8] =
 {
  {  // 0: SYM_0 - char '0'
   ________,
@@ -530,3 +531,139 @@ int Get_symbols_count(void)
 {
   return (sizeof(Symbols) / sizeof(Symbols[0]));
 }
+
+extern uint8_t _sglyphs[];  // STM32F103C4TX_FLASH.ld
+
+static uint32_t Symbol_flash_program(uint8_t *dst, uint16_t val);
+static uint32_t Symbol_flash_erase(uint8_t *page);
+
+static const T_glyph_flash  symbol_flash = {Symbol_flash_program, Symbol_flash_erase};
+static T_glyph_store        symbol_store;
+static T_symbol_flash_stats symbol_flash_stats;
+
+//------------------------------------------------------------------------------
+// Glyph_store access to the internal flash
+//------------------------------------------------------------------------------
+static uint32_t Symbol_flash_program(uint8_t *dst, uint16_t val)
+{
+  return HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD, (uint32_t)dst, val) != HAL_OK;
+}
+
+static uint32_t Symbol_flash_erase(uint8_t *page)
+{
+  FLASH_EraseInitTypeDef erase;
+  uint32_t               page_error;
+
+  erase.TypeErase   = FLASH_TYPEERASE_PAGES;
+  erase.Banks       = FLASH_BANK_1;
+  erase.PageAddress = (uint32_t)page;
+  erase.NbPages     = 1;
+  return HAL_FLASHEx_Erase(&erase, &page_error) != HAL_OK;
+}
+
+//------------------------------------------------------------------------------
+// Symbols_init - opens the user glyph store, formatting it on first start
+//------------------------------------------------------------------------------
+void Symbols_init(void)
+{
+  HAL_FLASH_Unlock();
+  Glyph_store_init(&symbol_store, &symbol_flash, _sglyphs, FLASH_PAGE_SIZE);
+  HAL_FLASH_Lock();
+}
+
+//------------------------------------------------------------------------------
+// Symbol_get - returns the 8 rows of a symbol, NULL if the code is not defined
+// An uploaded glyph replaces the built-in symbol with the same code
+//------------------------------------------------------------------------------
+const uint8_t *Symbol_get(int32_t code)
+{
+  const uint8_t *glyph;
+
+  if ((code < 0) || (code > 0xFF))
+  {
+    return NULL;
+  }
+  glyph = Glyph_store_get(&symbol_store, (uint32_t)code);
+  if ((glyph == NULL) && (code < Get_symbols_count()))
+  {
+    glyph = Symbols[code];
+  }
+  return glyph;
+}
+
+//------------------------------------------------------------------------------
+// Symbol_store - writes count uploaded glyphs of codes first.. to flash, they survive a reset
+// Returns GLYPH_STORE_xxx. Nothing is written if the new codes do not fit. The glyphs are
+// written in code order with the scheduler suspended, so other tasks never see a batch in
+// progress, but a flash error stops the batch and leaves the glyphs before it stored.
+// The CPU stalls while flash is programmed; a page erase, once per several dozen uploads,
+// stalls it for about 20 ms. The display is blanked for the stall, and its length and the
+// CAN frames lost in it go to the flash stats
+//------------------------------------------------------------------------------
+int32_t Symbol_store(int32_t first, const uint8_t *glyphs, uint32_t count)
+{
+  const CAN_Error_Stats_t *es    = CAN_get_error_stats();
+  int32_t                  res   = GLYPH_STORE_OK;
+  uint32_t                 added = 0;
+  uint32_t                 erases;
+  uint32_t                 overruns;
+  uint32_t                 t0;
+  uint32_t                 i;
+
+  if ((first < 0) || (first + count > 0x100))
+  {
+    return GLYPH_STORE_FULL;
+  }
+  for (i = 0; i < count; i++)
+  {
+    if (Glyph_store_get(&symbol_store, first + i) == NULL)
+    {
+      added++;
+    }
+  }
+  if (symbol_store.count + added > GLYPH_STORE_MAX)
+  {
+    return GLYPH_STORE_FULL;
+  }
+
+  vTaskSuspendAll();
+  erases   = symbol_store.erase_count;
+  overruns = es->rx_fifo_overrun_count[0] + es->rx_fifo_overrun_count[1];
+  Display_blank(1);
+  t0       = DWT->CYCCNT;
+  HAL_FLASH_Unlock();
+  for (i = 0; (i < count) && (res == GLYPH_STORE_OK); i++)
+  {
+    res = Glyph_store_write(&symbol_store, first + i, &glyphs[i * 8]);
+  }
+  HAL_FLASH_Lock();
+  t0 = (DWT->CYCCNT - t0) / (SystemCoreClock / 1000000U);
+  Display_blank(0);
+
+  // The receive interrupt held off by the stall has run by now and counted the FIFO overruns
+  symbol_flash_stats.writes++;
+  symbol_flash_stats.erases      += symbol_store.erase_count - erases;
+  symbol_flash_stats.rx_overruns += es->rx_fifo_overrun_count[0] + es->rx_fifo_overrun_count[1] - overruns;
+  if (t0 > symbol_flash_stats.stall_max_us)
+  {
+    symbol_flash_stats.stall_max_us = t0;
+  }
+  xTaskResumeAll();
+  return res;
+}
+
+//------------------------------------------------------------------------------
+// Symbol_get_flash_stats - returns the counters of Symbol_store flash accesses
+//------------------------------------------------------------------------------
+const T_symbol_flash_stats *Symbol_get_flash_stats(void)
+{
+  return &symbol_flash_stats;
+}
+
+//------------------------------------------------------------------------------
+// Symbol_reset_stall_max - clears the longest stall together with the other maxima of PDISPLx_READ_STATS
+//------------------------------------------------------------------------------
+void Symbol_reset_stall_max(void)
+{
+  symbol_flash_stats.stall_max_us = 0;
+}
@@ -60,9 +60,23 @@
 #define SYM_EG          50  // Double symbol 'EG'
 #define SYM_OG          51  // Double symbol 'OG'
 
-/* Объявление массива символов для LED дисплея */
-extern unsigned char Symbols[][8];
+#define SYMBOL_STORE_PAGES 2  // Flash pages of user glyphs, reserved in STM32F103C4TX_FLASH.ld
 
-extern int Get_symbols_count(void);
+// Flash accesses of Symbol_store. The CPU stalls during them with every interrupt, so CAN
+// frames arriving meanwhile pile up in the 3-deep receive FIFOs and may be lost
+typedef struct
+{
+  uint32_t writes;        // Symbol_store calls that programmed flash
+  uint32_t erases;        // Page erases, about 20 ms of stall each
+  uint32_t stall_max_us;  // Longest flash access of one Symbol_store call
+  uint32_t rx_overruns;   // CAN receive FIFO overruns found right after a flash access
+} T_symbol_flash_stats;
+
+extern int            Get_symbols_count(void);
+extern void           Symbols_init(void);
+extern const uint8_t *Symbol_get(int32_t code);
+extern int32_t        Symbol_store(int32_t first, const uint8_t *glyphs, uint32_t count);
+extern const T_symbol_flash_stats *Symbol_get_flash_stats(void);
+extern void           Symbol_reset_stall_max(void);
 
 #endif
@@ -0,0 +1,66 @@
+#include <string.h>
+#include "Time_sync.h"
+
+//------------------------------------------------------------------------------
+// Start free running: display time equals local time until the first beacon
+//------------------------------------------------------------------------------
+void Time_sync_init(T_time_sync *ts)
+{
+  memset(ts, 0, sizeof(*ts));
+}
+
+//------------------------------------------------------------------------------
+// Display time at a local time
+//------------------------------------------------------------------------------
+uint32_t Time_sync_display_time(const T_time_sync *ts, uint32_t local_us)
+{
+  int32_t dt = (int32_t)(local_us - ts->base_local);
+
+  return ts->base_disp + (uint32_t)dt + (uint32_t)(int32_t)(((int64_t)dt * ts->rate) >> 24);
+}
+
+//------------------------------------------------------------------------------
+// Local time at which the display clock reaches disp_us (inverse of Time_sync_display_time)
+//------------------------------------------------------------------------------
+uint32_t Time_sync_local_time(const T_time_sync *ts, uint32_t disp_us)
+{
+  int32_t dd = (int32_t)(disp_us - ts->base_disp);
+
+  return ts->base_local + (uint32_t)dd - (uint32_t)(int32_t)(((int64_t)dd * ts->rate) >> 24);
+}
+
+//------------------------------------------------------------------------------
+// Correct the display clock by a beacon: master_us was sent when local_us was read here
+// Returns the phase error before the correction, us
+//------------------------------------------------------------------------------
+int32_t Time_sync_beacon(T_time_sync *ts, uint32_t master_us, uint32_t local_us)
+{
+  uint32_t pred     = Time_sync_display_time(ts, local_us);
+  int32_t  err      = (int32_t)(master_us - pred);
+  int32_t  interval = (int32_t)(local_us - ts->base_local);
+  int64_t  rate;
+
+  if (ts->beacon_cnt == 0 || err > TIME_SYNC_STEP_US || err < -TIME_SYNC_STEP_US || interval <= 0)
+  {
+    ts->base_disp = master_us;
+    ts->step_cnt++;
+  }
+  else
+  {
+    rate = ts->rate + (((int64_t)err * (1 << 24)) / interval) / 4;
+    if (rate > TIME_SYNC_RATE_MAX)
+    {
+      rate = TIME_SYNC_RATE_MAX;
+    }
+    if (rate < -TIME_SYNC_RATE_MAX)
+    {
+      rate = -TIME_SYNC_RATE_MAX;
+    }
+    ts->rate      = (int32_t)rate;
+    ts->base_disp = pred + err / 2;
+  }
+  ts->base_local = local_us;
+  ts->last_err   = err;
+  ts->beacon_cnt++;
+  return err;
+}
@@ -0,0 +1,33 @@
+#ifndef __TIME_SYNC_H
+#define __TIME_SYNC_H
+
+#include <stdint.h>
+
+// Display clock disciplined to the master's time beacons.
+// Times are microseconds in free-running 32-bit counters; differences are taken modulo 2^32,
+// so beacons must come more often than every 35 minutes.
+// Display time = base_disp + dt + dt * rate / 2^24, where dt = local time - base_local.
+// Every beacon pairs the master time of a beacon's transmission with the local time of its
+// reception. Half of the phase error is corrected at once, a quarter of the frequency error
+// (phase error over the beacon interval) goes into rate. Errors above TIME_SYNC_STEP_US
+// step the clock instead.
+
+#define TIME_SYNC_STEP_US  1000  // Larger phase errors step the clock
+#define TIME_SYNC_RATE_MAX 8389  // Rate limit, 2^-24 units: +-500 ppm
+
+typedef struct
+{
+  uint32_t base_local;  // Local time of the last correction
+  uint32_t base_disp;   // Display time at base_local
+  int32_t  rate;        // Frequency correction, 2^-24 units
+  int32_t  last_err;    // Phase error at the last beacon, us
+  uint32_t beacon_cnt;  // Beacons used, 0 - display clock runs free on the local clock
+  uint32_t step_cnt;    // Corrections done by a step
+} T_time_sync;
+
+void     Time_sync_init(T_time_sync *ts);
+uint32_t Time_sync_display_time(const T_time_sync *ts, uint32_t local_us);
+uint32_t Time_sync_local_time(const T_time_sync *ts, uint32_t disp_us);
+int32_t  Time_sync_beacon(T_time_sync *ts, uint32_t master_us, uint32_t local_us);
+
+#endif
@@ -93,6 +93,7 @@ to exclude the API function. */
 #define INCLUDE_vTaskDelay                   1
 #define INCLUDE_xTaskGetSchedulerState       1
 #define INCLUDE_xTaskResumeFromISR           0
+#define INCLUDE_uxTaskGetStackHighWaterMark  1
 
 /* Cortex-M specific definitions. */
 #ifdef __NVIC_PRIO_BITS
@@ -139,7 +140,12 @@ standard names. */
 /* Section where parameter definitions can be added (for instance, to override default ones in FreeRTOS.h) */
 
 /* Additional configuration for static allocation support */
+/* Debug builds check the task stacks at every context switch, vApplicationStackOverflowHook in freertos.c */
+#ifdef DEBUG
+#define configCHECK_FOR_STACK_OVERFLOW           2
+#else
 #define configCHECK_FOR_STACK_OVERFLOW           0
+#endif
 #define configUSE_MALLOC_FAILED_HOOK             0
 #define configSUPPORT_DYNAMIC_ALLOCATION         0    /* Ensure dynamic allocation is disabled */
 #define configSUPPORT_STATIC_ALLOCATION          1    /* Ensure static allocation is enabled */
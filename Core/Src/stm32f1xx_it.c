@@ -22,6 +22,7 @@
 #include "stm32f1xx_it.h"
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include "LED_display.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -232,4 +233,20 @@ void TIM1_UP_IRQHandler(void)
 
 /* USER CODE BEGIN 1 */
 
+/**
+  * @brief This function handles TIM2 global interrupt (LED matrix row scan).
+  */
+void TIM2_IRQHandler(void)
+{
+  Display_scan_isr();
+}
+
+/**
+  * @brief This function handles TIM3 global interrupt, pended by software only (LED matrix scan events).
+  */
+void TIM3_IRQHandler(void)
+{
+  Display_event_isr();
+}
+
 /* USER CODE END 1 */
@@ -0,0 +1,274 @@
+#include <stdlib.h>
+#include <string.h>
+#include "Anim_script.h"
+#include "host_test.h"
+
+// Anim_script_run() suite: a scripted timeline of every instruction, LOOP/NEXT nesting for all
+// small pass counts and with a forever outer loop, catching up after late calls, the instruction
+// budget of loops without WAIT, and the malformed scripts that must stop with ANIM_ERROR -
+// every operand truncated by the script end, unknown opcodes, NEXT without LOOP, nesting past
+// ANIM_LOOP_DEPTH and running off the end. Random byte scripts are then run from heap buffers
+// of their exact size, so with the address sanitizer any read past the script fails the test.
+
+#define FUZZ_SCRIPTS 200000
+#define FUZZ_CALLS   64
+
+//------------------------------------------------------------------------------
+// Every instruction once, called at and around its moments
+//------------------------------------------------------------------------------
+static void Check_timeline(void)
+{
+  static const uint8_t s[] = {ANIM_GLYPH(5), ANIM_COLOR(0x06), ANIM_POS(-2, 1), ANIM_LOOP(3), ANIM_MOVE(1, 0),
+                              ANIM_WAIT(100), ANIM_NEXT(), ANIM_FADE(64, 500), ANIM_BLINK(2, 50), ANIM_END()};
+  T_anim_player        pl;
+  uint32_t             evt;
+
+  Anim_script_start(&pl, 1000);
+  CHECK_EQ(pl.glyph, 0xFF);
+  evt = Anim_script_run(&pl, s, sizeof(s), 999);
+  CHECK_EQ(evt, 0);  // Not started yet
+  evt = Anim_script_run(&pl, s, sizeof(s), 1000);
+  CHECK_EQ(evt, ANIM_EVT_SPRITE);
+  CHECK_EQ(pl.glyph, 5);
+  CHECK_EQ(pl.colors, 0x02);  // Only the colour bits are kept
+  CHECK_EQ(pl.x, -1);
+  CHECK_EQ(pl.y, 1);
+  CHECK_EQ(pl.wake_ms, 1100);
+  CHECK_EQ(Anim_script_run(&pl, s, sizeof(s), 1099), 0);
+  CHECK_EQ(Anim_script_run(&pl, s, sizeof(s), 1100), ANIM_EVT_SPRITE);
+  CHECK_EQ(pl.x, 0);
+  Anim_script_run(&pl, s, sizeof(s), 1200);
+  CHECK_EQ(pl.x, 1);
+  CHECK_EQ(pl.wake_ms, 1300);
+
+  // Loop done: the fade is reported and the first blink toggle happens at once
+  evt = Anim_script_run(&pl, s, sizeof(s), 1300);
+  CHECK_EQ(evt, ANIM_EVT_FADE | ANIM_EVT_SPRITE);
+  CHECK_EQ(pl.fade_level, 64);
+  CHECK_EQ(pl.fade_ms, 500);
+  CHECK_EQ(pl.visible, 0);
+  CHECK_EQ(pl.wake_ms, 1350);
+  CHECK_EQ(pl.sp, 0);
+  Anim_script_run(&pl, s, sizeof(s), 1350);
+  CHECK_EQ(pl.visible, 1);
+  Anim_script_run(&pl, s, sizeof(s), 1400);
+  CHECK_EQ(pl.visible, 0);
+  evt = Anim_script_run(&pl, s, sizeof(s), 1450);
+  CHECK_EQ(evt, ANIM_EVT_SPRITE);
+  CHECK_EQ(pl.visible, 1);
+  CHECK_EQ(pl.state, ANIM_RUNNING);  // The last half period still runs before END
+  evt = Anim_script_run(&pl, s, sizeof(s), 1500);
+  CHECK_EQ(evt, ANIM_EVT_END);
+  CHECK_EQ(pl.state, ANIM_IDLE);
+  CHECK_EQ(Anim_script_run(&pl, s, sizeof(s), 5000), 0);  // Finished players stay put
+  CHECK_EQ(pl.x, 1);
+}
+
+//------------------------------------------------------------------------------
+// Counted loops nested two deep: the inner body runs outer * inner times
+//------------------------------------------------------------------------------
+static void Check_nesting(void)
+{
+  uint8_t       s[16];
+  T_anim_player pl;
+  uint32_t      outer, inner;
+  uint32_t      len;
+  uint32_t      calls;
+
+  for (outer = 1; outer <= 5; outer++)
+  {
+    for (inner = 1; inner <= 5; inner++)
+    {
+      len = 0;
+      s[len++] = ANIM_OP_LOOP;
+      s[len++] = (uint8_t)outer;
+      s[len++] = ANIM_OP_LOOP;
+      s[len++] = (uint8_t)inner;
+      s[len++] = ANIM_OP_MOVE;
+      s[len++] = 1;
+      s[len++] = 0;
+      s[len++] = ANIM_OP_WAIT;
+      s[len++] = 1;
+      s[len++] = 0;
+      s[len++] = ANIM_OP_NEXT;
+      s[len++] = ANIM_OP_MOVE;
+      s[len++] = 0;
+      s[len++] = 1;
+      s[len++] = ANIM_OP_NEXT;
+      s[len++] = ANIM_OP_END;
+
+      Anim_script_start(&pl, 0);
+      for (calls = 0; (pl.state == ANIM_RUNNING) && (calls < 100); calls++)
+      {
+        Anim_script_run(&pl, s, len, calls);
+        CHECK(pl.sp <= ANIM_LOOP_DEPTH);
+      }
+      CHECK_EQ(pl.state, ANIM_IDLE);
+      CHECK_EQ(pl.x, outer * inner);
+      CHECK_EQ(pl.y, outer);
+      CHECK_EQ(pl.sp, 0);
+      CHECK_EQ(calls, outer * inner + 1);  // One call per wait plus the one reaching END
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+// Forever outer loop around a counted inner one, 10 ms per step; late calls catch up
+// to exactly the state of calls every millisecond
+//------------------------------------------------------------------------------
+static void Check_catch_up(void)
+{
+  static const uint8_t s[] = {ANIM_LOOP(0), ANIM_LOOP(3), ANIM_MOVE(1, 0), ANIM_WAIT(10), ANIM_NEXT(),
+                              ANIM_MOVE(-3, 1), ANIM_NEXT()};
+  T_anim_player        every;
+  T_anim_player        late;
+  uint32_t             t;
+  uint32_t             next_late = 0;
+
+  Anim_script_start(&every, 0);
+  Anim_script_start(&late, 0);
+  for (t = 0; t <= 3000; t++)
+  {
+    Anim_script_run(&every, s, sizeof(s), t);
+    if (t == next_late)
+    {
+      Anim_script_run(&late, s, sizeof(s), t);
+      CHECK_EQ(late.x, every.x);
+      CHECK_EQ(late.y, every.y);
+      CHECK_EQ(late.wake_ms, every.wake_ms);
+      next_late += 1 + (uint32_t)(Host_test_rnd() % 29);  // A few passes per call, well inside the budget
+    }
+  }
+  CHECK_EQ(every.state, ANIM_RUNNING);
+  // 100 outer passes of 30 ms done, the first move of the next one is due at 3000 ms
+  CHECK_EQ(every.x, 1);
+  CHECK_EQ(every.y, 100);
+}
+
+//------------------------------------------------------------------------------
+// A loop without WAIT returns after ANIM_RUN_BUDGET instructions and goes on next call
+//------------------------------------------------------------------------------
+static void Check_budget(void)
+{
+  static const uint8_t s[] = {ANIM_LOOP(0), ANIM_MOVE(1, 0), ANIM_NEXT()};
+  T_anim_player        pl;
+  uint32_t             evt;
+  uint32_t             i;
+
+  Anim_script_start(&pl, 0);
+  for (i = 0; i < 10; i++)
+  {
+    evt = Anim_script_run(&pl, s, sizeof(s), 0);
+    CHECK_EQ(evt, ANIM_EVT_SPRITE);
+    CHECK_EQ(pl.state, ANIM_RUNNING);
+  }
+  // LOOP once, then NEXT and MOVE alternate: every second instruction moves
+  CHECK_EQ((uint8_t)pl.x, (uint8_t)(10 * ANIM_RUN_BUDGET / 2));
+}
+
+//------------------------------------------------------------------------------
+// Script must stop with ANIM_ERROR and the END flag, keeping what ran before
+//------------------------------------------------------------------------------
+static void Check_error(const uint8_t *s, uint32_t size)
+{
+  T_anim_player pl;
+  uint8_t      *copy = malloc(size ? size : 1);
+  uint32_t      evt  = 0;
+  uint32_t      i;
+
+  memcpy(copy, s, size);
+  Anim_script_start(&pl, 0);
+  for (i = 0; (i < 10) && (pl.state == ANIM_RUNNING); i++)
+  {
+    evt = Anim_script_run(&pl, copy, size, 1000 * i);
+  }
+  CHECK_EQ(pl.state, ANIM_ERROR);
+  CHECK(evt & ANIM_EVT_END);
+  CHECK(pl.pc <= size);
+  free(copy);
+}
+
+static void Check_malformed(void)
+{
+  static const uint8_t with_operands[] = {ANIM_OP_GLYPH, ANIM_OP_COLOR, ANIM_OP_POS, ANIM_OP_MOVE,
+                                          ANIM_OP_WAIT,  ANIM_OP_LOOP,  ANIM_OP_FADE, ANIM_OP_BLINK};
+  static const uint8_t operands[]      = {1, 1, 2, 2, 2, 1, 3, 3};
+  static const uint8_t next_alone[]    = {ANIM_GLYPH(1), ANIM_NEXT()};
+  static const uint8_t too_deep[]      = {ANIM_LOOP(2), ANIM_LOOP(2), ANIM_LOOP(2), ANIM_NEXT(), ANIM_NEXT(), ANIM_NEXT(), ANIM_END()};
+  static const uint8_t extra_next[]    = {ANIM_LOOP(2), ANIM_NEXT(), ANIM_NEXT(), ANIM_END()};
+  static const uint8_t no_end[]        = {ANIM_GLYPH(1), ANIM_WAIT(5)};
+  uint8_t              s[8];
+  uint32_t             i, k, cut;
+
+  for (i = 0; i < sizeof(with_operands); i++)
+  {
+    // Opcode after a valid instruction, cut anywhere inside its operands
+    for (cut = 0; cut < operands[i]; cut++)
+    {
+      s[0] = ANIM_OP_GLYPH;
+      s[1] = 7;
+      s[2] = with_operands[i];
+      for (k = 0; k < cut; k++)
+      {
+        s[3 + k] = 1;
+      }
+      Check_error(s, 3 + cut);
+    }
+  }
+  for (i = ANIM_OP_BLINK + 1; i <= 0xFF; i++)
+  {
+    s[0] = (uint8_t)i;
+    Check_error(s, 1);
+  }
+  Check_error(next_alone, sizeof(next_alone));
+  Check_error(too_deep, sizeof(too_deep));
+  Check_error(extra_next, sizeof(extra_next));
+  Check_error(no_end, sizeof(no_end));
+  Check_error(s, 0);
+}
+
+//------------------------------------------------------------------------------
+// Random scripts: no read outside the script, state always consistent
+//------------------------------------------------------------------------------
+static void Check_fuzz(void)
+{
+  T_anim_player pl;
+  uint8_t      *s;
+  uint32_t      size, n, i, now;
+  uint32_t      ended = 0;
+
+  for (n = 0; n < FUZZ_SCRIPTS; n++)
+  {
+    size = 1 + (uint32_t)(Host_test_rnd() % 40);
+    s    = malloc(size);
+    for (i = 0; i < size; i++)
+    {
+      // Mostly valid opcodes so scripts get past the first bytes
+      s[i] = (Host_test_rnd() & 3) ? (uint8_t)(Host_test_rnd() % (ANIM_OP_BLINK + 1)) : (uint8_t)Host_test_rnd();
+    }
+    Anim_script_start(&pl, 0);
+    now = 0;
+    for (i = 0; (i < FUZZ_CALLS) && (pl.state == ANIM_RUNNING); i++)
+    {
+      Anim_script_run(&pl, s, size, now);
+      CHECK(pl.pc <= size);
+      CHECK(pl.sp <= ANIM_LOOP_DEPTH);
+      now += (uint32_t)(Host_test_rnd() % 70000);
+    }
+    ended += (pl.state != ANIM_RUNNING);
+    free(s);
+  }
+  printf("random scripts: %u of %u ended within %u calls\n", (unsigned)ended, (unsigned)FUZZ_SCRIPTS, (unsigned)FUZZ_CALLS);
+  CHECK(ended > FUZZ_SCRIPTS / 2);
+}
+
+int main(void)
+{
+  Check_timeline();
+  Check_nesting();
+  Check_catch_up();
+  Check_budget();
+  Check_malformed();
+  Check_fuzz();
+  return Host_test_done("Anim_script_test");
+}
@@ -0,0 +1,137 @@
+#include <string.h>
+#include "Bit_matrix.h"
+#include "host_test.h"
+
+// Bit_matrix_rotate() against the per-line rotation it replaced in Display_scan.c.
+// Both are bit permutations of the plane, so agreeing on all 64 one-pixel planes proves
+// them equal for every input; random planes check the assembly of whole planes on top.
+
+#define RANDOM_PLANES 200000
+
+static uint8_t Old_reverse(uint8_t a)
+{
+  uint8_t  b = 0;
+  uint32_t i;
+
+  for (i = 0; i < 8; i++)
+  {
+    b <<= 1;
+    if (a & 1)
+      b++;
+    a >>= 1;
+  }
+  return b;
+}
+
+//------------------------------------------------------------------------------
+// Line k of the rotated screen as Display_rotation_0/90/180/270 built it
+//------------------------------------------------------------------------------
+static uint8_t Old_rotation_line(const uint8_t *scr, uint32_t rot, uint32_t k)
+{
+  uint8_t  a = 0;
+  uint32_t i;
+
+  switch (rot)
+  {
+    case 0:
+      a = scr[k];
+      break;
+    case 1:
+      for (i = 0; i < 8; i++)
+      {
+        a |= ((scr[i] >> k) & 1) << (7 - i);
+      }
+      break;
+    case 2:
+      a = Old_reverse(scr[7 - k]);
+      break;
+    case 3:
+      for (i = 0; i < 8; i++)
+      {
+        a |= ((Old_reverse(scr[i]) >> k) & 1) << i;
+      }
+      break;
+  }
+  return a;
+}
+
+static void Check_rotation(const uint8_t *scr)
+{
+  uint8_t  out[8];
+  uint32_t rot;
+  uint32_t k;
+
+  for (rot = 0; rot < 4; rot++)
+  {
+    Bit_matrix_store(Bit_matrix_rotate(Bit_matrix_load(scr), rot), out);
+    for (k = 0; k < 8; k++)
+    {
+      CHECK_EQ(out[k], Old_rotation_line(scr, rot, k));
+    }
+    // Only the two low bits of the turn count are used
+    CHECK(Bit_matrix_rotate(Bit_matrix_load(scr), rot + 4) == Bit_matrix_rotate(Bit_matrix_load(scr), rot));
+  }
+}
+
+//------------------------------------------------------------------------------
+// Pixel (r, c) of a plane, out of range reads as 0
+//------------------------------------------------------------------------------
+static uint32_t Px(uint64_t m, int32_t r, int32_t c)
+{
+  if ((r < 0) || (r > 7) || (c < 0) || (c > 7))
+  {
+    return 0;
+  }
+  return (uint32_t)(m >> (r * 8 + c)) & 1;
+}
+
+//------------------------------------------------------------------------------
+// The other transforms against their per-pixel definitions in Bit_matrix.h
+//------------------------------------------------------------------------------
+static void Check_transforms(uint64_t m)
+{
+  uint64_t t  = Bit_matrix_transpose(m);
+  uint64_t fh = Bit_matrix_flip_h(m);
+  uint64_t fv = Bit_matrix_flip_v(m);
+  int32_t  dx = (int32_t)(Host_test_rnd() % 19) - 9;
+  int32_t  dy = (int32_t)(Host_test_rnd() % 19) - 9;
+  uint64_t sh = Bit_matrix_shift(m, dx, dy);
+  uint32_t bad = 0;
+  int32_t  r, c;
+
+  for (r = 0; r < 8; r++)
+  {
+    for (c = 0; c < 8; c++)
+    {
+      bad += Px(t, r, c) != Px(m, c, r);
+      bad += Px(fh, r, c) != Px(m, r, 7 - c);
+      bad += Px(fv, r, c) != Px(m, 7 - r, c);
+      bad += Px(sh, r, c) != Px(m, r - dy, c - dx);
+    }
+  }
+  CHECK_EQ(bad, 0);
+}
+
+int main(void)
+{
+  uint8_t  scr[8];
+  uint64_t m;
+  uint32_t i;
+
+  memset(scr, 0, sizeof(scr));
+  Check_rotation(scr);
+  for (i = 0; i < 64; i++)
+  {
+    Bit_matrix_store(1ULL << i, scr);
+    Check_rotation(scr);
+    Check_transforms(1ULL << i);
+  }
+  for (i = 0; i < RANDOM_PLANES; i++)
+  {
+    m = Host_test_rnd();
+    Bit_matrix_store(m, scr);
+    Check_rotation(scr);
+    Check_transforms(m);
+  }
+  return Host_test_done("Bit_matrix_test");
+}
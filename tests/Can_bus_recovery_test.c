@@ -0,0 +1,365 @@
+#include <string.h>
+#include "Can_bus_recovery.h"
+#include "host_test.h"
+
+// Fault-sequence simulation of Can_bus_recovery_step() against a model of the bxCAN fault
+// confinement: TEC +8 per failed and -1 per good transmission, REC +1 per receive error,
+// error passive above 127, bus-off above 255. Leaving bus-off takes 128 x 11 recessive bits
+// (2.5 ms at 562.5 kbit/s) after the controller is restarted - by software through
+// initialization mode, or by the hardware itself with automatic bus-off management.
+// The driver is modelled as CAN_bus_supervise(): it runs the state machine on the status
+// interrupts (entering error passive or bus-off only) and on Can_bus_recovery_timeout(),
+// and executes the returned actions. Scripted and random fault sequences are run with and
+// without automatic bus-off management, checking after every call:
+//  - transmission is held exactly while the state machine is in bus-off or recovering;
+//  - a software restart comes no earlier than the holdoff after the bus-off, and the holdoff
+//    stays within its limits, doubling for a node that falls off again soon;
+//  - a recovery, a return to error active and the recovery timeout of a stuck bus are seen
+//    within their poll periods;
+//  - once the faults stop, the node is back on the bus, transmitting, in bounded time.
+
+#define RECOVER_BITS_MS 3     // 128 x 11 bits at 562.5 kbit/s take 2.5 ms
+#define RANDOM_MS       2000000
+#define SETTLE_MS       (CAN_BUS_HOLDOFF_MAX_MS + CAN_BUS_RECOVER_TIMEOUT_MS + 2 * RECOVER_BITS_MS + 10)
+
+typedef enum
+{
+  BUS_OK = 0,       // Frames go through
+  BUS_NO_ACK,       // Alone on the bus or cable cut: every transmission fails, bus recessive
+  BUS_NOISE,        // Every other transmission and some receptions fail
+  BUS_RX_ERRORS,    // Receive errors only
+  BUS_STUCK,        // Bus held dominant: transmissions fail, no recessive bits
+  BUS_FAULT_NUM
+} T_bus_fault;
+
+typedef struct
+{
+  uint32_t tec;
+  uint32_t rec;
+  uint32_t boff;
+  uint32_t restarted;    // Counting recessive bits after a restart
+  uint32_t recessive_ms;
+} T_ctrl;
+
+typedef struct
+{
+  T_can_bus_recovery r;
+  T_ctrl             c;
+  uint32_t           tx_held;
+  uint32_t           wake_armed;      // A timeout run is due at next_wake
+  uint32_t           next_wake;
+  uint32_t           prev_status;
+  uint32_t           stale_since;     // State machine lags behind the controller since then
+  uint32_t           max_stale_ms[CAN_BUS_STATE_NUM];
+  uint32_t           bus_offs;        // Bus-off events of the controller
+  uint32_t           recoveries;      // BOFF cleared by the controller
+  uint32_t           restarts;
+  uint32_t           last_restart_ok; // Bus-off was long enough before the last restart
+} T_node;
+
+static uint32_t Status(const T_ctrl *c)
+{
+  uint32_t s = 0;
+
+  if (c->boff)
+  {
+    s |= CAN_BUS_IN_BOFF;
+  }
+  else if ((c->tec > 127) || (c->rec > 127))
+  {
+    s |= CAN_BUS_IN_EPV;
+  }
+  return s;
+}
+
+//------------------------------------------------------------------------------
+// One millisecond of the controller under a fault
+//------------------------------------------------------------------------------
+static void Ctrl_ms(T_node *n, T_bus_fault fault, uint32_t now)
+{
+  T_ctrl  *c  = &n->c;
+  uint32_t tx = !n->tx_held;  // A frame is always waiting unless transmission is held
+
+  if (c->boff)
+  {
+    if (n->r.auto_bus_off)
+    {
+      c->restarted = 1;
+    }
+    if (c->restarted && (fault != BUS_STUCK))
+    {
+      if (++c->recessive_ms >= RECOVER_BITS_MS)
+      {
+        c->boff = 0;
+        c->tec  = 0;
+        c->rec  = 0;
+        n->recoveries++;
+      }
+    }
+    return;
+  }
+
+  switch (fault)
+  {
+    case BUS_OK:
+      if (tx && (c->tec > 0))
+      {
+        c->tec--;
+      }
+      if (c->rec > 0)
+      {
+        c->rec--;
+      }
+      break;
+    case BUS_NO_ACK:
+    case BUS_STUCK:
+      if (tx)
+      {
+        c->tec += 8;
+      }
+      break;
+    case BUS_NOISE:
+      if (tx)
+      {
+        c->tec = (now & 1) ? c->tec + 8 : (c->tec > 0 ? c->tec - 1 : 0);
+      }
+      c->rec += (now % 3 == 0) ? 1 : 0;
+      break;
+    default:
+      c->rec += 1;
+      break;
+  }
+  if (c->rec > 200)
+  {
+    c->rec = 200;  // REC stops counting up in error passive
+  }
+  if (c->tec > 255)
+  {
+    c->boff         = 1;
+    c->restarted    = 0;
+    c->recessive_ms = 0;
+    n->bus_offs++;
+  }
+}
+
+//------------------------------------------------------------------------------
+// CAN_bus_supervise(): state machine run and actions
+//------------------------------------------------------------------------------
+static void Supervise(T_node *n, uint32_t status, uint32_t now)
+{
+  uint32_t act;
+  uint32_t t_off   = n->r.t_enter;
+  uint32_t holdoff = n->r.holdoff_ms;
+  uint32_t before  = n->r.state;
+
+  act = Can_bus_recovery_step(&n->r, status, now);
+  if (act & CAN_BUS_ACT_HOLD_TX)
+  {
+    n->tx_held = 1;
+  }
+  if (act & CAN_BUS_ACT_RESTART)
+  {
+    CHECK(!n->r.auto_bus_off);
+    CHECK_EQ(before, CAN_BUS_OFF);
+    CHECK(now - t_off >= holdoff);  // Holdoff respected
+    n->c.restarted    = 1;
+    n->c.recessive_ms = 0;
+    n->restarts++;
+  }
+  if (act & CAN_BUS_ACT_RESUME_TX)
+  {
+    n->tx_held = 0;
+  }
+
+  CHECK((n->r.holdoff_ms >= CAN_BUS_HOLDOFF_MIN_MS) && (n->r.holdoff_ms <= CAN_BUS_HOLDOFF_MAX_MS));
+  CHECK_EQ(n->tx_held, (n->r.state == CAN_BUS_OFF) || (n->r.state == CAN_BUS_RECOVERING));
+  if (status & CAN_BUS_IN_BOFF)
+  {
+    CHECK(n->tx_held);
+  }
+  if (n->r.auto_bus_off)
+  {
+    CHECK(n->r.state != CAN_BUS_RECOVERING);
+  }
+  n->next_wake  = Can_bus_recovery_timeout(&n->r, now);
+  n->wake_armed = (n->next_wake != CAN_BUS_NO_TIMEOUT);
+  n->next_wake += now;
+}
+
+//------------------------------------------------------------------------------
+// State the state machine should reach for the controller status
+//------------------------------------------------------------------------------
+static uint32_t Settled(const T_node *n, uint32_t status)
+{
+  if (status & CAN_BUS_IN_BOFF)
+  {
+    return (n->r.state == CAN_BUS_OFF) || (n->r.state == CAN_BUS_RECOVERING);
+  }
+  if ((n->r.state == CAN_BUS_OFF) && !n->r.auto_bus_off)
+  {
+    // Only after a timed-out attempt: the controller finished the sequence on its own,
+    // the next attempt at the end of the holdoff picks that up
+    return 1;
+  }
+  return n->r.state == ((status & CAN_BUS_IN_EPV) ? CAN_BUS_ERROR_PASSIVE : CAN_BUS_ERROR_ACTIVE);
+}
+
+static void Node_init(T_node *n, uint32_t auto_bus_off)
+{
+  memset(n, 0, sizeof(*n));
+  Can_bus_recovery_init(&n->r, auto_bus_off, 0);
+}
+
+//------------------------------------------------------------------------------
+// Run ms milliseconds under one fault, starting at *now
+//------------------------------------------------------------------------------
+static void Run(T_node *n, T_bus_fault fault, uint32_t ms, uint32_t *now)
+{
+  uint32_t status;
+  uint32_t st;
+  uint32_t end = *now + ms;
+
+  for (; *now != end; (*now)++)
+  {
+    Ctrl_ms(n, fault, *now);
+    status = Status(&n->c);
+    // The SCE interrupt comes on entering error passive or bus-off, leaving them is polled
+    if (((status & ~n->prev_status) != 0) || (n->wake_armed && ((int32_t)(*now - n->next_wake) >= 0)))
+    {
+      Supervise(n, status, *now);
+    }
+    n->prev_status = status;
+
+    // How long the state machine lags behind the controller
+    if (Settled(n, status))
+    {
+      n->stale_since = *now + 1;
+    }
+    else
+    {
+      st = n->r.state;
+      if (*now - n->stale_since > n->max_stale_ms[st])
+      {
+        n->max_stale_ms[st] = *now - n->stale_since;
+      }
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+// Back on the bus and transmitting after the faults stop
+//------------------------------------------------------------------------------
+static void Check_settles(T_node *n, uint32_t *now)
+{
+  Run(n, BUS_OK, SETTLE_MS, now);
+  CHECK_EQ(n->r.state, CAN_BUS_ERROR_ACTIVE);
+  CHECK_EQ(n->tx_held, 0);
+  CHECK_EQ(n->c.boff, 0);
+  CHECK_EQ(n->r.recover_count, n->recoveries);
+}
+
+static void Check_lag(const T_node *n)
+{
+  // Polls: error passive exit every CAN_BUS_PASSIVE_POLL_MS, BOFF clear every CAN_BUS_POLL_MS
+  CHECK(n->max_stale_ms[CAN_BUS_ERROR_PASSIVE] <= CAN_BUS_PASSIVE_POLL_MS);
+  CHECK(n->max_stale_ms[CAN_BUS_RECOVERING] <= CAN_BUS_POLL_MS);
+  if (n->r.auto_bus_off)
+  {
+    CHECK(n->max_stale_ms[CAN_BUS_OFF] <= CAN_BUS_POLL_MS);
+  }
+  CHECK_EQ(n->max_stale_ms[CAN_BUS_ERROR_ACTIVE], 0);
+}
+
+static void Scripted(uint32_t auto_bus_off)
+{
+  T_node   n;
+  uint32_t now = 1000;
+
+  // Short burst of failed frames: error passive and back, no bus-off
+  Node_init(&n, auto_bus_off);
+  Run(&n, BUS_OK, 100, &now);
+  Run(&n, BUS_NO_ACK, 20, &now);
+  CHECK_EQ(n.r.state, CAN_BUS_ERROR_PASSIVE);
+  CHECK_EQ(n.bus_offs, 0);
+  Check_settles(&n, &now);
+  CHECK_EQ(n.r.enter_count[CAN_BUS_OFF], 0);
+
+  // One bus-off: recovery after the minimum holdoff plus the recessive bits
+  Node_init(&n, auto_bus_off);
+  Run(&n, BUS_NO_ACK, 34, &now);  // TEC passes 255 after 32 failed frames
+  CHECK_EQ(n.bus_offs, 1);
+  CHECK_EQ(n.r.state, CAN_BUS_OFF);
+  Check_settles(&n, &now);
+  CHECK_EQ(n.r.recover_count, 1);
+  CHECK(n.r.recover_last_ms <= (auto_bus_off ? 0 : CAN_BUS_HOLDOFF_MIN_MS) + RECOVER_BITS_MS + CAN_BUS_POLL_MS);
+
+  // Cable cut for 20 s: every recovery ends in another bus-off, the holdoff climbs to the limit
+  Node_init(&n, auto_bus_off);
+  Run(&n, BUS_NO_ACK, 20000, &now);
+  if (!auto_bus_off)
+  {
+    CHECK_EQ(n.r.holdoff_ms, CAN_BUS_HOLDOFF_MAX_MS);
+    CHECK(n.restarts < 20000 / CAN_BUS_HOLDOFF_MAX_MS + 6);  // Backoff keeps the restarts rare
+    CHECK(n.restarts >= 20000 / (CAN_BUS_HOLDOFF_MAX_MS + RECOVER_BITS_MS + 40) - 1);
+  }
+  Check_settles(&n, &now);
+  // The first bus-off after a stable period starts again from the minimum holdoff
+  Run(&n, BUS_OK, CAN_BUS_STABLE_MS, &now);
+  Run(&n, BUS_NO_ACK, 34, &now);
+  CHECK_EQ(n.r.holdoff_ms, CAN_BUS_HOLDOFF_MIN_MS);
+  Check_settles(&n, &now);
+
+  // Bus stuck dominant while recovering: the attempt times out and is retried later
+  Node_init(&n, auto_bus_off);
+  Run(&n, BUS_STUCK, 2000, &now);
+  CHECK(n.c.boff);
+  CHECK(n.tx_held);
+  if (!auto_bus_off)
+  {
+    CHECK(n.r.recover_fail_count > 0);
+    CHECK_EQ(n.r.recover_count, 0);
+  }
+  Check_settles(&n, &now);
+  CHECK_EQ(n.r.recover_count, 1);
+
+  // Receive errors alone never take the node off the bus
+  Node_init(&n, auto_bus_off);
+  Run(&n, BUS_RX_ERRORS, 500, &now);
+  CHECK_EQ(n.r.state, CAN_BUS_ERROR_PASSIVE);
+  CHECK_EQ(n.tx_held, 0);
+  Check_settles(&n, &now);
+  CHECK_EQ(n.r.enter_count[CAN_BUS_OFF], 0);
+  Check_lag(&n);
+}
+
+static void Random(uint32_t auto_bus_off)
+{
+  T_node   n;
+  uint32_t now = 0xFFFFFFFFu - 100000;  // The millisecond tick wraps during the run
+  uint32_t done;
+  uint32_t ms;
+
+  Node_init(&n, auto_bus_off);
+  n.r.t_enter     = now;
+  n.r.t_recovered = now - CAN_BUS_STABLE_MS;
+  for (done = 0; done < RANDOM_MS; done += ms)
+  {
+    ms = 1 + (uint32_t)(Host_test_rnd() % 3000);
+    Run(&n, (T_bus_fault)(Host_test_rnd() % BUS_FAULT_NUM), ms, &now);
+  }
+  Check_settles(&n, &now);
+  Check_lag(&n);
+  printf("%s bus-off management: %u bus-offs, %u restarts, %u recoveries, %u failed, max %u ms\n",
+         auto_bus_off ? "automatic" : "software", (unsigned)n.bus_offs, (unsigned)n.restarts,
+         (unsigned)n.r.recover_count, (unsigned)n.r.recover_fail_count, (unsigned)n.r.recover_max_ms);
+  CHECK(n.bus_offs > 100);
+}
+
+int main(void)
+{
+  Scripted(0);
+  Scripted(1);
+  Random(0);
+  Random(1);
+  return Host_test_done("Can_bus_recovery_test");
+}
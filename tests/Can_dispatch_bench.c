@@ -0,0 +1,433 @@
+#include <string.h>
+#include "CAN_IDs.h"
+#include "Can_dispatch.h"
+#include "Can_pool.h"
+#include "Can_rx_ring.h"
+#include "Frame_delta.h"
+#include "host_test.h"
+
+// Frames per second through the receive path and Can_dispatch_msg(). Random display protocol
+// traffic is presented as FIFO output mailbox registers in bursts of 1..3 frames (the FIFO
+// depth), as the RX interrupt sees it, and handled by stub command handlers that read the data.
+// Two receive paths are timed:
+//  - in place: the interrupt decodes into the ring slot, the task dispatches from the slot;
+//  - copying: the frame is decoded into a pool block, the block pointer is queued by value,
+//    the task copies the frame to its stack and frees the block before dispatching.
+// Every frame must reach the handler its ID and sub-command select, PDISPLx_SET_GROUPS
+// only when sent to the own address of the board, XOR deltas only when the frame
+// carries as many row bytes as their mask announces, and glyph chunks only in 8-byte frames.
+
+#define NODE_ADDR  3
+#define TRAFFIC    65536  // Frames prepared, replayed PASSES times
+#define PASSES     32
+#define FRAMES     (TRAFFIC * PASSES)
+#define QUEUE_SIZE CAN_NO_RECV_OBJECTS
+
+typedef enum
+{
+  H_SET_SYMBOL = 0,
+  H_PTRN1,
+  H_PTRN2,
+  H_DIN1,
+  H_DIN2,
+  H_DIN3,
+  H_DIN4,
+  H_RED,
+  H_GREEN,
+  H_BRIGHTNESS,
+  H_FRAME_BEGIN,
+  H_FRAME_COMMIT,
+  H_XOR_RED,
+  H_XOR_GREEN,
+  H_SET_GROUPS,
+  H_TIME_SYNC,
+  H_READ_STATS,
+  H_SPRITE,
+  H_SCRIPT_LOAD,
+  H_SCRIPT_RUN,
+  H_GLYPH_BEGIN,
+  H_GLYPH_DATA,
+  H_GLYPH_COMMIT,
+  H_NONE,  // Ignored by the dispatcher
+  H_NUM
+} T_handler;
+
+typedef struct
+{
+  uint32_t  base_id;
+  uint8_t   sub;      // data[0] for PDISPLx_REQ
+  T_handler handler;
+  uint32_t  weight;   // Share in the traffic
+} T_cmd;
+
+static const T_cmd cmds[] = {
+  {PDISPLx_SET_RED_SYMB,   0,                        H_RED,          12},
+  {PDISPLx_SET_GREEN_SYMB, 0,                        H_GREEN,        12},
+  {PDISPLx_REQ,            PDISPLx_XOR_RED,          H_XOR_RED,      10},
+  {PDISPLx_REQ,            PDISPLx_XOR_GREEN,        H_XOR_GREEN,    10},
+  {PDISPLx_REQ,            PDISPLx_SET_SPRITE,       H_SPRITE,       6},
+  {PDISPLx_REQ,            PDISPLx_TIME_SYNC,        H_TIME_SYNC,    2},
+  {PDISPLx_REQ,            PDISPLx_FRAME_BEGIN,      H_FRAME_BEGIN,  6},
+  {PDISPLx_REQ,            PDISPLx_FRAME_COMMIT,     H_FRAME_COMMIT, 6},
+  {PDISPLx_REQ,            PDISPLx_SET_SYMBOL,       H_SET_SYMBOL,   2},
+  {PDISPLx_REQ,            PDISPLx_SET_SYMBOL_PTRN1, H_PTRN1,        1},
+  {PDISPLx_REQ,            PDISPLx_SET_SYMBOL_PTRN2, H_PTRN2,        1},
+  {PDISPLx_REQ,            PDISPLx_DIN_SYMBOL_SET1,  H_DIN1,         1},
+  {PDISPLx_REQ,            PDISPLx_DIN_SYMBOL_SET2,  H_DIN2,         1},
+  {PDISPLx_REQ,            PDISPLx_DIN_SYMBOL_SET3,  H_DIN3,         1},
+  {PDISPLx_REQ,            PDISPLx_DIN_SYMBOL_SET4,  H_DIN4,         1},
+  {PDISPLx_REQ,            PDISPLx_SET_BRIGHTNESS,   H_BRIGHTNESS,   1},
+  {PDISPLx_REQ,            PDISPLx_SET_GROUPS,       H_SET_GROUPS,   1},
+  {PDISPLx_REQ,            PDISPLx_READ_STATS,       H_READ_STATS,   1},
+  {PDISPLx_REQ,            PDISPLx_SCRIPT_LOAD,      H_SCRIPT_LOAD,  1},
+  {PDISPLx_REQ,            PDISPLx_SCRIPT_RUN,       H_SCRIPT_RUN,   1},
+  {PDISPLx_REQ,            PDISPLx_GLYPH_BEGIN,      H_GLYPH_BEGIN,  1},
+  {PDISPLx_REQ,            PDISPLx_GLYPH_DATA,       H_GLYPH_DATA,   4},
+  {PDISPLx_REQ,            PDISPLx_GLYPH_COMMIT,     H_GLYPH_COMMIT, 1},
+  {PDISPLx_REQ,            0xFF,                     H_NONE,         1},
+  {PDISPLx_ANS,            0,                        H_NONE,         1},
+};
+
+#define CMDS_NUM (sizeof(cmds) / sizeof(cmds[0]))
+
+static uint32_t calls[H_NUM];
+static uint32_t expected[H_NUM];
+static uint32_t sink;        // Handlers read the data so the frame is really accessed
+static uint32_t stamped;     // Reception times are frame numbers and checked by the handler
+static uint32_t bad_stamps;
+
+// Traffic prepared before timing: FIFO registers RIR, RDTR, RDLR, RDHR of every frame
+static uint32_t traffic[TRAFFIC][4];
+static uint32_t total_weight;
+
+static void Touch(T_handler h, const uint8_t *data)
+{
+  uint32_t w;
+
+  memcpy(&w, data, 4);
+  sink += w;
+  calls[h]++;
+}
+
+void Handle_CAN_SetSymbol(const uint8_t *data) { Touch(H_SET_SYMBOL, data); }
+void Handle_CAN_SetSymbolPattern1(const uint8_t *data) { Touch(H_PTRN1, data); }
+void Handle_CAN_SetSymbolPattern2(const uint8_t *data) { Touch(H_PTRN2, data); }
+void Handle_CAN_DynamicSymbolSet1(const uint8_t *data) { Touch(H_DIN1, data); }
+void Handle_CAN_DynamicSymbolSet2(const uint8_t *data) { Touch(H_DIN2, data); }
+void Handle_CAN_DynamicSymbolSet3(const uint8_t *data) { Touch(H_DIN3, data); }
+void Handle_CAN_DynamicSymbolSet4(const uint8_t *data) { Touch(H_DIN4, data); }
+void Handle_CAN_SetRedScreen(const uint8_t *data) { Touch(H_RED, data); }
+void Handle_CAN_SetGreenScreen(const uint8_t *data) { Touch(H_GREEN, data); }
+void Handle_CAN_SetBrightness(const uint8_t *data) { Touch(H_BRIGHTNESS, data); }
+void Handle_CAN_FrameBegin(const uint8_t *data) { Touch(H_FRAME_BEGIN, data); }
+void Handle_CAN_FrameCommit(const uint8_t *data) { Touch(H_FRAME_COMMIT, data); }
+void Handle_CAN_XorRedScreen(const uint8_t *data) { Touch(H_XOR_RED, data); }
+void Handle_CAN_XorGreenScreen(const uint8_t *data) { Touch(H_XOR_GREEN, data); }
+void Handle_CAN_SetGroups(const uint8_t *data) { Touch(H_SET_GROUPS, data); }
+void Handle_CAN_ReadStats(const uint8_t *data) { Touch(H_READ_STATS, data); }
+void Handle_CAN_SetSprite(const uint8_t *data) { Touch(H_SPRITE, data); }
+void Handle_CAN_ScriptLoad(const uint8_t *data) { Touch(H_SCRIPT_LOAD, data); }
+void Handle_CAN_ScriptRun(const uint8_t *data) { Touch(H_SCRIPT_RUN, data); }
+void Handle_CAN_GlyphBegin(const uint8_t *data) { Touch(H_GLYPH_BEGIN, data); }
+void Handle_CAN_GlyphData(const uint8_t *data) { Touch(H_GLYPH_DATA, data); }
+void Handle_CAN_GlyphCommit(const uint8_t *data) { Touch(H_GLYPH_COMMIT, data); }
+
+void Handle_CAN_TimeSync(const uint8_t *data, uint32_t rx_cyc)
+{
+  uint32_t w;
+
+  Touch(H_TIME_SYNC, data);
+  memcpy(&w, data, 4);
+  if (stamped && (w != traffic[rx_cyc % TRAFFIC][2]))
+  {
+    bad_stamps++;  // The stamp belongs to another frame
+  }
+}
+
+static uint32_t Popcount8(uint32_t v)
+{
+  uint32_t n = 0;
+
+  for (; v != 0; v >>= 1)
+  {
+    n += v & 1;
+  }
+  return n;
+}
+
+//------------------------------------------------------------------------------
+// Random frame for the own, a group or the broadcast address; counts the handler it must reach
+//------------------------------------------------------------------------------
+static void Make_frame(uint32_t *regs)
+{
+  static const uint32_t addrs[] = {NODE_ADDR, NODE_ADDR, NODE_ADDR, PDISPLx_ADDR_GROUP0 + 2, PDISPLx_ADDR_BROADCAST};
+  const T_cmd          *cmd;
+  uint32_t              w    = (uint32_t)(Host_test_rnd() % total_weight);
+  uint32_t              addr = addrs[Host_test_rnd() % (sizeof(addrs) / sizeof(addrs[0]))];
+  uint32_t              i;
+
+  for (i = 0; w >= cmds[i].weight; i++)
+  {
+    w -= cmds[i].weight;
+  }
+  cmd     = &cmds[i];
+  regs[0] = ((cmd->base_id | (addr << 20)) << 3) | 0x04;  // EXID and IDE
+  regs[1] = 8;
+  regs[2] = (uint32_t)Host_test_rnd() & 0xFFFFFF00u;
+  regs[3] = (uint32_t)Host_test_rnd();
+  if (cmd->base_id == PDISPLx_REQ)
+  {
+    regs[2] |= cmd->sub;
+  }
+  if ((cmd->handler == H_SET_GROUPS) && (addr != NODE_ADDR))
+  {
+    expected[H_NONE] += PASSES;
+  }
+  else if (((cmd->handler == H_XOR_RED) || (cmd->handler == H_XOR_GREEN)) && (Popcount8((regs[2] >> 8) & 0xFF) > FRAME_DELTA_MAX_ROWS))
+  {
+    expected[H_NONE] += PASSES;  // The row mask does not fit an 8-byte frame
+  }
+  else
+  {
+    expected[cmd->handler] += PASSES;
+  }
+}
+
+//------------------------------------------------------------------------------
+// In place: burst stored from the registers and published, then dispatched from the slots
+//------------------------------------------------------------------------------
+static uint32_t Run_in_place(void)
+{
+  static T_can_rx_ring ring;
+  T_can_msg           *msg;
+  uint32_t             n = 0;
+  uint32_t             head;
+  uint32_t             burst;
+  uint32_t             lost = 0;
+
+  memset(&ring, 0, sizeof(ring));
+  while (n < FRAMES)
+  {
+    burst = 1 + (n * 7 + (n >> 3)) % 3;
+    head  = ring.head;
+    for (; (burst > 0) && (n < FRAMES); burst--, n++)
+    {
+      if (Can_rx_ring_store(&ring, head, traffic[n % TRAFFIC], n))
+      {
+        head++;
+      }
+      else
+      {
+        lost++;
+      }
+    }
+    ring.head = head;
+    while ((msg = Can_rx_ring_front(&ring)) != NULL)
+    {
+      Can_dispatch_msg(msg, NODE_ADDR, Can_rx_ring_front_stamp(&ring));
+      Can_rx_ring_release(&ring);
+    }
+  }
+  return lost;
+}
+
+//------------------------------------------------------------------------------
+// Decode of the registers into a message, as HAL_CAN_GetRxMessage() and the copy after it did
+//------------------------------------------------------------------------------
+static void Decode(const uint32_t *regs, T_can_msg *msg)
+{
+  msg->format = (regs[0] & 0x04) ? EXTENDED_FORMAT : STANDARD_FORMAT;
+  msg->id     = (regs[0] & 0x04) ? (regs[0] >> 3) : (regs[0] >> 21);
+  msg->type   = (regs[0] & 0x02) ? REMOTE_FRAME : DATA_FRAME;
+  msg->len    = (uint8_t)(regs[1] & 0x0F);
+  memcpy(&msg->data[0], &regs[2], 4);
+  memcpy(&msg->data[4], &regs[3], 4);
+}
+
+//------------------------------------------------------------------------------
+// Copying: pool block, pointer queue, stack copy
+//------------------------------------------------------------------------------
+static uint32_t Run_copying(void)
+{
+  static T_can_msg pool_mem[QUEUE_SIZE];
+  T_can_pool       pool;
+  T_can_msg       *queue[QUEUE_SIZE];
+  T_can_msg       *blk;
+  T_can_msg        msg_rcv;
+  uint32_t         q_head = 0;
+  uint32_t         q_tail = 0;
+  uint32_t         n      = 0;
+  uint32_t         burst;
+  uint32_t         lost   = 0;
+
+  memset(&pool, 0, sizeof(pool));
+  Can_pool_init(&pool, pool_mem, sizeof(pool_mem[0]), QUEUE_SIZE);
+  while (n < FRAMES)
+  {
+    burst = 1 + (n * 7 + (n >> 3)) % 3;
+    for (; (burst > 0) && (n < FRAMES); burst--, n++)
+    {
+      blk = (T_can_msg *)Can_pool_take(&pool, 0);
+      if (blk == NULL)
+      {
+        lost++;
+        continue;
+      }
+      Decode(traffic[n % TRAFFIC], blk);
+      memcpy(&queue[q_head++ % QUEUE_SIZE], &blk, sizeof(blk));  // xQueueSendFromISR copies the item
+    }
+    while (q_tail != q_head)
+    {
+      memcpy(&blk, &queue[q_tail++ % QUEUE_SIZE], sizeof(blk));
+      msg_rcv = *blk;
+      Can_pool_give(&pool, blk);
+      Can_dispatch_msg(&msg_rcv, NODE_ADDR, 0);
+    }
+  }
+  return lost;
+}
+
+//------------------------------------------------------------------------------
+// Ring overflow: frames beyond the ring size are dropped, the stored ones stay in order
+//------------------------------------------------------------------------------
+static void Check_overflow(void)
+{
+  static T_can_rx_ring ring;
+  T_can_msg           *msg;
+  uint32_t             regs[4];
+  uint32_t             head;
+  uint32_t             i;
+
+  memset(&ring, 0, sizeof(ring));
+  ring.head = ring.tail = 0xFFFFFFFEu;  // Indexes wrap inside the burst
+  head      = ring.head;
+  for (i = 0; i < CAN_RX_RING_SIZE + 3; i++)
+  {
+    regs[0] = (0x123u << 21) | ((i & 1) ? 0x02 : 0);  // Standard ID, every other one remote
+    regs[1] = i & 7;
+    regs[2] = i;
+    regs[3] = ~i;
+    CHECK_EQ(Can_rx_ring_store(&ring, head, regs, 1000 + i), i < CAN_RX_RING_SIZE);
+    if (i < CAN_RX_RING_SIZE)
+    {
+      head++;
+    }
+  }
+  ring.head = head;
+  for (i = 0; (msg = Can_rx_ring_front(&ring)) != NULL; i++)
+  {
+    CHECK_EQ(msg->id, 0x123);
+    CHECK_EQ(msg->format, STANDARD_FORMAT);
+    CHECK_EQ(msg->type, (i & 1) ? REMOTE_FRAME : DATA_FRAME);
+    CHECK_EQ(msg->len, i & 7);
+    CHECK_EQ(msg->data[0], i);
+    CHECK_EQ(msg->data[4], (uint8_t)~i);
+    CHECK_EQ(Can_rx_ring_front_stamp(&ring), 1000 + i);
+    Can_rx_ring_release(&ring);
+  }
+  CHECK_EQ(i, CAN_RX_RING_SIZE);
+}
+
+//------------------------------------------------------------------------------
+// XOR deltas of every mask and frame length: dispatched only when the frame holds the
+// sub-command, the mask and one byte per changed row
+//------------------------------------------------------------------------------
+static void Check_delta_length(void)
+{
+  static const uint32_t subs[2] = {PDISPLx_XOR_RED, PDISPLx_XOR_GREEN};
+  static const uint32_t hs[2]   = {H_XOR_RED, H_XOR_GREEN};
+  T_can_msg             msg;
+  uint32_t              c, mask, len;
+  uint32_t              before;
+  uint32_t              ok;
+
+  memset(&msg, 0, sizeof(msg));
+  msg.format = EXTENDED_FORMAT;
+  msg.type   = DATA_FRAME;
+  msg.id     = PDISPLx_REQ | (NODE_ADDR << 20);
+  for (c = 0; c < 2; c++)
+  {
+    for (mask = 0; mask < 256; mask++)
+    {
+      for (len = 0; len <= 8; len++)
+      {
+        msg.data[0] = (uint8_t)subs[c];
+        msg.data[1] = (uint8_t)mask;
+        msg.len     = (uint8_t)len;
+        before      = calls[hs[c]];
+        Can_dispatch_msg(&msg, NODE_ADDR, 0);
+        ok          = (Popcount8(mask) <= FRAME_DELTA_MAX_ROWS) && (len >= 2 + Popcount8(mask));
+        CHECK_EQ(calls[hs[c]] - before, ok);
+      }
+    }
+  }
+  memset(calls, 0, sizeof(calls));
+}
+
+//------------------------------------------------------------------------------
+// Glyph upload chunks of every frame length: dispatched only when all 6 data bytes came
+//------------------------------------------------------------------------------
+static void Check_glyph_data_length(void)
+{
+  T_can_msg msg;
+  uint32_t  len;
+  uint32_t  before;
+
+  memset(&msg, 0, sizeof(msg));
+  msg.format  = EXTENDED_FORMAT;
+  msg.type    = DATA_FRAME;
+  msg.id      = PDISPLx_REQ | (NODE_ADDR << 20);
+  msg.data[0] = PDISPLx_GLYPH_DATA;
+  for (len = 0; len <= 8; len++)
+  {
+    msg.len = (uint8_t)len;
+    before  = calls[H_GLYPH_DATA];
+    Can_dispatch_msg(&msg, NODE_ADDR, 0);
+    CHECK_EQ(calls[H_GLYPH_DATA] - before, len == 8);
+  }
+  memset(calls, 0, sizeof(calls));
+}
+
+int main(void)
+{
+  uint64_t t0, t1, t2, t3;
+  uint32_t i;
+
+  for (i = 0; i < CMDS_NUM; i++)
+  {
+    total_weight += cmds[i].weight;
+  }
+  for (i = 0; i < TRAFFIC; i++)
+  {
+    Make_frame(traffic[i]);
+  }
+  Check_overflow();
+  Check_delta_length();
+  Check_glyph_data_length();
+
+  stamped = 1;
+  t0      = Host_test_ns();
+  CHECK_EQ(Run_in_place(), 0);
+  t1      = Host_test_ns();
+  for (i = 0; i < H_NUM; i++)
+  {
+    CHECK_EQ(calls[i], expected[i] * (i != H_NONE));
+  }
+  CHECK_EQ(bad_stamps, 0);
+
+  memset(calls, 0, sizeof(calls));
+  stamped = 0;
+  t2      = Host_test_ns();
+  CHECK_EQ(Run_copying(), 0);
+  t3      = Host_test_ns();
+  for (i = 0; i < H_NUM; i++)
+  {
+    CHECK_EQ(calls[i], expected[i] * (i != H_NONE));
+  }
+
+  printf("in place: %.1f Mframes/s (%.1f ns/frame)\n", FRAMES * 1e3 / (double)(t1 - t0), (double)(t1 - t0) / FRAMES);
+  printf("copying:  %.1f Mframes/s (%.1f ns/frame)\n", FRAMES * 1e3 / (double)(t3 - t2), (double)(t3 - t2) / FRAMES);
+  printf("ring %u slots, %u bytes; handler checksum %08x\n", (unsigned)CAN_RX_RING_SIZE,
+         (unsigned)sizeof(T_can_rx_ring), (unsigned)sink);
+  return Host_test_done("Can_dispatch_bench");
+}
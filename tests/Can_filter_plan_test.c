@@ -0,0 +1,188 @@
+#include <string.h>
+#include "CAN_IDs.h"
+#include "Can_filter_plan.h"
+#include "host_test.h"
+
+// Filter plans for every node address and every group mask. Each bank is expanded into all
+// 32-bit register images it accepts (list banks: both entries, mask banks: every combination of
+// the bits the mask leaves free, bit 0 excluded as RIR bit 0 always reads 0). Every image must
+// have IDE set and RTR clear, its ID must be in the accept set and go to the FIFO of that ID,
+// and every ID of the set must be accepted. Can_filter_plan_match() must agree with the
+// expansion for the set and for every ID one bit away from it.
+
+#define NODE_ADDR_NUM 8    // Board numbers 0..7
+#define GROUP_MASKS   (1u << PDISPLx_GROUPS_NUM)
+#define MAX_FREE_BITS 5    // A cube of more than 32 IDs cannot come from the accept set
+
+#define REG_RTR 0x02u
+#define REG_IDE 0x04u
+
+static uint32_t Popcount(uint32_t v)
+{
+  uint32_t n = 0;
+
+  for (; v != 0; v &= v - 1)
+  {
+    n++;
+  }
+  return n;
+}
+
+//------------------------------------------------------------------------------
+// Index of id in the accept set or -1
+//------------------------------------------------------------------------------
+static int32_t Find_id(const T_can_accept_id *ids, uint32_t n, uint32_t id)
+{
+  uint32_t i;
+
+  for (i = 0; i < n; i++)
+  {
+    if (ids[i].id == id)
+    {
+      return (int32_t)i;
+    }
+  }
+  return -1;
+}
+
+//------------------------------------------------------------------------------
+// One register image accepted by a bank of the given FIFO
+//------------------------------------------------------------------------------
+static void Check_image(const T_can_accept_id *ids, uint32_t n, uint32_t img, uint32_t fifo, uint32_t *covered)
+{
+  int32_t k;
+
+  CHECK(img & REG_IDE);         // Standard frames never pass
+  CHECK((img & REG_RTR) == 0);  // Nor do remote frames
+  k = Find_id(ids, n, img >> 3);
+  CHECK(k >= 0);
+  if (k >= 0)
+  {
+    CHECK_EQ(ids[k].fifo, fifo);
+    covered[k]++;
+  }
+}
+
+//------------------------------------------------------------------------------
+// Expand every bank and compare with the accept set
+// Returns number of banks
+//------------------------------------------------------------------------------
+static uint32_t Check_plan(uint32_t node_addr, uint32_t groups)
+{
+  T_can_accept_id   ids[CAN_FILTER_PLAN_MAX_IDS];
+  T_can_filter_bank banks[CAN_FILTER_PLAN_MAX_BANKS];
+  T_can_filter_bank node_banks[CAN_FILTER_PLAN_MAX_BANKS];
+  uint32_t          covered[CAN_FILTER_PLAN_MAX_IDS];
+  uint32_t          n, i, b;
+  uint32_t          free_bits, sub;
+  uint32_t          bit;
+  int32_t           nb;
+
+  n = Can_filter_plan_ids(node_addr, groups, ids);
+  // 4 IDs of the own address only, 3 picture IDs at own, broadcast and group addresses
+  CHECK_EQ(n, 4 + 3 * (2 + Popcount(groups)));
+  for (i = 0; i < n; i++)
+  {
+    CHECK_EQ(Find_id(ids, n, ids[i].id), (int32_t)i);  // No duplicates
+    CHECK(ids[i].fifo <= 1);
+  }
+
+  nb = Can_filter_plan_build(ids, n, banks, CAN_FILTER_PLAN_MAX_BANKS);
+  CHECK((nb > 0) && (nb <= CAN_FILTER_PLAN_MAX_BANKS));
+  if (nb <= 0)
+  {
+    return 0;
+  }
+  // The firmware plans without the ID list and must get the same banks
+  memset(node_banks, 0, sizeof(node_banks));
+  CHECK_EQ(Can_filter_plan_node(node_addr, groups, node_banks, CAN_FILTER_PLAN_MAX_BANKS), nb);
+  for (b = 0; b < (uint32_t)nb; b++)
+  {
+    CHECK_EQ(node_banks[b].kind, banks[b].kind);
+    CHECK_EQ(node_banks[b].fifo, banks[b].fifo);
+    CHECK_EQ(node_banks[b].r1, banks[b].r1);
+    CHECK_EQ(node_banks[b].r2, banks[b].r2);
+  }
+
+  memset(covered, 0, sizeof(covered));
+  for (b = 0; b < (uint32_t)nb; b++)
+  {
+    CHECK(banks[b].fifo <= 1);
+    if (banks[b].kind == CAN_FILTER_LIST32)
+    {
+      CHECK_EQ(banks[b].r1 & 1, 0);
+      CHECK_EQ(banks[b].r2 & 1, 0);
+      Check_image(ids, n, banks[b].r1, banks[b].fifo, covered);
+      if (banks[b].r2 != banks[b].r1)
+      {
+        Check_image(ids, n, banks[b].r2, banks[b].fifo, covered);
+      }
+      continue;
+    }
+    CHECK_EQ(banks[b].kind, CAN_FILTER_MASK32);
+    CHECK_EQ(banks[b].r1 & ~banks[b].r2, 0);  // Id bits outside the mask are left clear
+    free_bits = ~banks[b].r2 & ~1u;
+    CHECK(Popcount(free_bits) <= MAX_FREE_BITS);
+    if (Popcount(free_bits) > MAX_FREE_BITS)
+    {
+      continue;
+    }
+    // Every subset of the free bits
+    sub = 0;
+    do
+    {
+      Check_image(ids, n, banks[b].r1 | sub, banks[b].fifo, covered);
+      sub = (sub - free_bits) & free_bits;
+    } while (sub != 0);
+  }
+
+  for (i = 0; i < n; i++)
+  {
+    CHECK_EQ(covered[i], 1);  // Accepted, and by one bank only
+    CHECK_EQ(Can_filter_plan_match(banks, (uint32_t)nb, ids[i].id), (int32_t)ids[i].fifo);
+    // IDs one bit away are foreign unless they are in the set themselves
+    for (bit = 1; bit < (1u << 29); bit <<= 1)
+    {
+      if (Find_id(ids, n, ids[i].id ^ bit) < 0)
+      {
+        CHECK_EQ(Can_filter_plan_match(banks, (uint32_t)nb, ids[i].id ^ bit), -1);
+      }
+    }
+  }
+  return (uint32_t)nb;
+}
+
+int main(void)
+{
+  uint32_t hist[CAN_FILTER_PLAN_MAX_BANKS + 1];
+  uint32_t addr, groups;
+  uint32_t nb;
+  uint32_t max_nb = 0;
+
+  memset(hist, 0, sizeof(hist));
+  for (addr = 0; addr < NODE_ADDR_NUM; addr++)
+  {
+    for (groups = 0; groups < GROUP_MASKS; groups++)
+    {
+      nb = Check_plan(addr, groups);
+      hist[nb]++;
+      if (nb > max_nb)
+      {
+        max_nb = nb;
+      }
+    }
+  }
+  // CAN_setup_all_filters() keeps room for CAN_FILTER_PLAN_NODE_BANKS banks only
+  CHECK_EQ(max_nb, CAN_FILTER_PLAN_NODE_BANKS);
+
+  printf("banks used over %u addresses x %u group masks:", (unsigned)NODE_ADDR_NUM, (unsigned)GROUP_MASKS);
+  for (nb = 0; nb <= CAN_FILTER_PLAN_MAX_BANKS; nb++)
+  {
+    if (hist[nb] != 0)
+    {
+      printf(" %u banks: %u", (unsigned)nb, (unsigned)hist[nb]);
+    }
+  }
+  printf("\n");
+  return Host_test_done("Can_filter_plan_test");
+}
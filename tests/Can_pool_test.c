@@ -0,0 +1,168 @@
+#include <string.h>
+#include "Can_pool.h"
+#include "host_test.h"
+
+// Stress test of the CAN message pool free-list. Random sequences of takes with and without the
+// HIGH reserve, frees in random order, double frees, frees of pointers outside the pool and into
+// the middle of a block are replayed against a shadow model of the owned blocks. After every step
+// the pool must agree with the model: used equals the number of owned blocks and the bits of
+// used_map, the free-list holds exactly the other blocks once each, a take fails only when no
+// more than reserve blocks are free, and rejected frees change nothing but bad_free_count.
+
+#define BLK_SIZE   40  // sizeof(T_can_tx_item) on the target
+#define STEPS      2000000
+#define RESERVE    1   // CAN_TX_HIGH_RESERVE
+
+static const uint32_t pool_sizes[] = {1, 2, 8, CAN_POOL_MAX_BLOCKS};
+
+static uint8_t  mem[BLK_SIZE * (CAN_POOL_MAX_BLOCKS + 1)];
+static uint8_t *owned[CAN_POOL_MAX_BLOCKS];  // Blocks taken and not given back
+static uint32_t owned_num;
+
+//------------------------------------------------------------------------------
+// Pool state against the model
+//------------------------------------------------------------------------------
+static void Check_pool(const T_can_pool *pool, uint32_t high_water)
+{
+  uint32_t seen = 0;
+  uint32_t map  = 0;
+  uint32_t n    = 0;
+  uint32_t i, k;
+  uint8_t *p;
+
+  CHECK_EQ(pool->stats.used, owned_num);
+  CHECK_EQ(pool->stats.high_water, high_water);
+  for (i = 0; i < owned_num; i++)
+  {
+    k    = (uint32_t)(owned[i] - mem) / BLK_SIZE;
+    map |= 1UL << k;
+  }
+  CHECK_EQ(pool->used_map, map);
+
+  // Walk the free-list: every block not owned, each once, and nothing else
+  p = (uint8_t *)pool->free_head;
+  while ((p != NULL) && (n <= pool->num))
+  {
+    CHECK((p >= mem) && (p < mem + pool->num * BLK_SIZE));
+    CHECK_EQ((uint32_t)(p - mem) % BLK_SIZE, 0);
+    k = (uint32_t)(p - mem) / BLK_SIZE;
+    CHECK_EQ((seen >> k) & 1, 0);
+    CHECK_EQ((map >> k) & 1, 0);
+    seen |= 1UL << k;
+    n++;
+    memcpy(&p, p, sizeof(p));
+  }
+  CHECK_EQ(n, pool->num - owned_num);
+}
+
+static void Run(uint32_t num)
+{
+  T_can_pool pool;
+  uint32_t   high_water = 0;
+  uint32_t   fails      = 0;
+  uint32_t   bad        = 0;
+  uint32_t   step, i, r;
+  uint32_t   reserve;
+  uint8_t   *p;
+
+  memset(&pool, 0, sizeof(pool));
+  owned_num = 0;
+  Can_pool_init(&pool, mem, BLK_SIZE, num);
+  Check_pool(&pool, 0);
+
+  for (step = 0; step < STEPS; step++)
+  {
+    r = (uint32_t)(Host_test_rnd() % 100);
+    if (r < 50)
+    {
+      // Take; HIGH senders ignore the reserve
+      reserve = (Host_test_rnd() & 1) ? RESERVE : 0;
+      p       = (uint8_t *)Can_pool_take(&pool, reserve);
+      if (owned_num + reserve < num)
+      {
+        CHECK(p != NULL);
+        if (p == NULL)
+        {
+          return;
+        }
+        // Payload written by the owner must not disturb the pool
+        memset(p, 0xA5, BLK_SIZE);
+        owned[owned_num++] = p;
+        if (owned_num > high_water)
+        {
+          high_water = owned_num;
+        }
+      }
+      else
+      {
+        CHECK(p == NULL);
+        fails++;
+      }
+    }
+    else if (r < 94)
+    {
+      // Give back one of the owned blocks in random order
+      if (owned_num == 0)
+      {
+        continue;
+      }
+      i        = (uint32_t)(Host_test_rnd() % owned_num);
+      p        = owned[i];
+      owned[i] = owned[--owned_num];
+      CHECK_EQ(Can_pool_give(&pool, p), 0);
+    }
+    else
+    {
+      // Bad frees: a free block, the block past the end, the middle of a block, a stack pointer
+      switch (Host_test_rnd() % 4)
+      {
+        case 0:
+          if (owned_num == num)
+          {
+            continue;
+          }
+          p = (uint8_t *)pool.free_head;
+          break;
+        case 1:
+          p = mem + num * BLK_SIZE;
+          break;
+        case 2:
+          p = mem + (Host_test_rnd() % num) * BLK_SIZE + 1 + Host_test_rnd() % (BLK_SIZE - 1);
+          break;
+        default:
+          p = (uint8_t *)&pool;
+          break;
+      }
+      CHECK_EQ(Can_pool_give(&pool, p), 1);
+      bad++;
+    }
+    CHECK_EQ(pool.stats.bad_free_count, bad);
+    Check_pool(&pool, high_water);
+  }
+
+  // Everything given back: the whole pool is free again
+  while (owned_num > 0)
+  {
+    CHECK_EQ(Can_pool_give(&pool, owned[--owned_num]), 0);
+  }
+  Check_pool(&pool, high_water);
+  CHECK_EQ(high_water, num);
+
+  // Reinit keeps the statistics but the used count
+  Can_pool_init(&pool, mem, BLK_SIZE, num);
+  CHECK_EQ(pool.stats.bad_free_count, bad);
+  CHECK_EQ(pool.stats.high_water, high_water);
+  Check_pool(&pool, high_water);
+  printf("pool of %2u blocks: %u refused takes, %u rejected frees\n", (unsigned)num, (unsigned)fails, (unsigned)bad);
+}
+
+int main(void)
+{
+  uint32_t t;
+
+  for (t = 0; t < sizeof(pool_sizes) / sizeof(pool_sizes[0]); t++)
+  {
+    Run(pool_sizes[t]);
+  }
+  return Host_test_done("Can_pool_test");
+}
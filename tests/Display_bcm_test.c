@@ -0,0 +1,141 @@
+#include <string.h>
+#include "Display_scan.h"
+#include "host_test.h"
+
+// BCM duty-ratio simulator. Grey pictures are split into bit-planes as Display_fill_grey_screen()
+// does, compiled into slot words and scanned for one frame with the timer values of
+// Display_plane_timing(): a slot lasts ARR + 1 ticks and its row is lit from CCR4 to the end.
+// The lit time of every pixel must be its grey level times the lit time of the lowest plane,
+// and the frame period must not depend on the picture or the brightness.
+
+#define PICTURES 300
+
+static const uint32_t timer_mhz[] = {8, 36, 72};
+static const uint32_t levels[]    = {0, 1, 2, 64, 127, 128, 200, 254, 255};
+
+//------------------------------------------------------------------------------
+// Grey level 0..15 of every pixel into bit-planes, the most significant bits kept
+//------------------------------------------------------------------------------
+static void Split_planes(const uint8_t grey[8][8], uint8_t (*planes)[8])
+{
+  uint32_t p, r, c;
+  uint32_t level;
+
+  memset(planes, 0, DISPLAY_BCM_BITS * 8);
+  for (r = 0; r < 8; r++)
+  {
+    for (c = 0; c < 8; c++)
+    {
+      level = grey[r][c] >> (4 - DISPLAY_BCM_BITS);
+      for (p = 0; p < DISPLAY_BCM_BITS; p++)
+      {
+        planes[p][r] |= ((level >> p) & 1) << c;
+      }
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+// Scan one frame; lit[colour][row][column] collects the ticks the LED is on
+// Returns the frame period in ticks
+//------------------------------------------------------------------------------
+static uint64_t Scan_frame(const uint16_t *words, const uint32_t *arr, const uint32_t *ccr, uint64_t lit[2][8][8])
+{
+  uint64_t frame = 0;
+  uint32_t s, k, p, c;
+  uint32_t on;
+
+  memset(lit, 0, 2 * 8 * 8 * sizeof(uint64_t));
+  for (s = 0; s < DISPLAY_SLOTS_NUM; s++)
+  {
+    k      = s / DISPLAY_BCM_BITS;
+    p      = s % DISPLAY_BCM_BITS;
+    on     = arr[p] + 1 - ccr[p];
+    frame += arr[p] + 1;
+    for (c = 0; c < 8; c++)
+    {
+      // The word layout is taken from the encoder itself: bit of column c for each colour
+      if (words[s] & Display_interleave_row((uint8_t)(1u << c), 0))
+      {
+        lit[0][k][c] += on;
+      }
+      if (words[s] & Display_interleave_row(0, (uint8_t)(1u << c)))
+      {
+        lit[1][k][c] += on;
+      }
+    }
+  }
+  return frame;
+}
+
+int main(void)
+{
+  uint8_t  grey[2][8][8];
+  uint8_t  red[DISPLAY_BCM_BITS][8];
+  uint8_t  green[DISPLAY_BCM_BITS][8];
+  uint16_t words[DISPLAY_SLOTS_NUM];
+  uint32_t arr[DISPLAY_BCM_BITS];
+  uint32_t ccr[DISPLAY_BCM_BITS];
+  uint64_t lit[2][8][8];
+  uint64_t frame;
+  uint64_t unit_on;
+  uint32_t t, l, n, col, r, c, p;
+  uint32_t level;
+
+  for (t = 0; t < sizeof(timer_mhz) / sizeof(timer_mhz[0]); t++)
+  {
+    for (l = 0; l < sizeof(levels) / sizeof(levels[0]); l++)
+    {
+      Display_plane_timing(levels[l], timer_mhz[t], arr, ccr);
+      unit_on = arr[0] + 1 - ccr[0];
+      for (p = 0; p < DISPLAY_BCM_BITS; p++)
+      {
+        // Row switching and latch always fall into the forced blank
+        CHECK(ccr[p] >= DISPLAY_BLANK_LEAD_US * timer_mhz[t]);
+        CHECK(ccr[p] <= arr[p] + 1);
+      }
+      for (n = 0; n < PICTURES; n++)
+      {
+        for (col = 0; col < 2; col++)
+        {
+          for (r = 0; r < 8; r++)
+          {
+            for (c = 0; c < 8; c++)
+            {
+              grey[col][r][c] = (uint8_t)(Host_test_rnd() & 0x0F);
+            }
+          }
+        }
+        Split_planes(grey[0], red);
+        Split_planes(grey[1], green);
+        Display_compile_words(red, green, 0, words);
+        frame = Scan_frame(words, arr, ccr, lit);
+
+        CHECK_EQ(frame, 8ULL * DISPLAY_BCM_UNIT_US * timer_mhz[t] * ((1u << DISPLAY_BCM_BITS) - 1));
+        for (col = 0; col < 2; col++)
+        {
+          for (r = 0; r < 8; r++)
+          {
+            for (c = 0; c < 8; c++)
+            {
+              level = grey[col][r][c] >> (4 - DISPLAY_BCM_BITS);
+              CHECK_EQ(lit[col][r][c], level * unit_on);
+            }
+          }
+        }
+      }
+    }
+  }
+
+  // Duty of each grey level at full brightness and a 72 MHz timer
+  Display_plane_timing(255, 72, arr, ccr);
+  unit_on = arr[0] + 1 - ccr[0];
+  frame   = 8ULL * DISPLAY_BCM_UNIT_US * 72 * ((1u << DISPLAY_BCM_BITS) - 1);
+  printf("duty per grey level at brightness 255:");
+  for (level = 0; level < (1u << DISPLAY_BCM_BITS); level++)
+  {
+    printf(" %u:%.2f%%", (unsigned)level, 100.0 * (double)(level * unit_on) / (double)frame);
+  }
+  printf("\n");
+  return Host_test_done("Display_bcm_test");
+}
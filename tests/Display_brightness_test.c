@@ -0,0 +1,59 @@
+#include "Display_scan.h"
+#include "host_test.h"
+
+// On-time against brightness level for Display_plane_timing(): the lit window of the lowest
+// plane is the unit minus the blank lead, scaled linearly by the level and truncated to whole
+// timer ticks, every higher plane is exactly twice the one below, and the slot periods do not
+// change with the level. With a slow timer several levels share one tick count, so the number
+// of distinct steps is checked too.
+
+static const uint32_t timer_mhz[] = {1, 8, 36, 72};
+
+int main(void)
+{
+  uint32_t arr[DISPLAY_BCM_BITS];
+  uint32_t ccr[DISPLAY_BCM_BITS];
+  uint32_t arr_full[DISPLAY_BCM_BITS];
+  uint32_t ccr_full[DISPLAY_BCM_BITS];
+  uint32_t window;
+  uint32_t on;
+  uint32_t prev;
+  uint32_t steps;
+  uint32_t t, level, p;
+
+  for (t = 0; t < sizeof(timer_mhz) / sizeof(timer_mhz[0]); t++)
+  {
+    window = (DISPLAY_BCM_UNIT_US - DISPLAY_BLANK_LEAD_US) * timer_mhz[t];
+    Display_plane_timing(255, timer_mhz[t], arr_full, ccr_full);
+    prev  = 0;
+    steps = 0;
+    for (level = 0; level <= 255; level++)
+    {
+      Display_plane_timing(level, timer_mhz[t], arr, ccr);
+      on = arr[0] + 1 - ccr[0];
+
+      // Linear model truncated to ticks: level * window / 255 - 1 < on <= level * window / 255
+      CHECK(on * 255 <= level * window);
+      CHECK((on + 1) * 255 > level * window);
+      CHECK(on >= prev);
+      if ((level == 0) || (on != prev))
+      {
+        steps++;
+      }
+      prev = on;
+
+      for (p = 0; p < DISPLAY_BCM_BITS; p++)
+      {
+        CHECK_EQ(arr[p], arr_full[p]);
+        CHECK_EQ(arr[p] + 1, (DISPLAY_BCM_UNIT_US * timer_mhz[t]) << p);
+        CHECK_EQ(arr[p] + 1 - ccr[p], on << p);
+      }
+    }
+    CHECK_EQ(arr_full[0] + 1 - ccr_full[0], window);
+    CHECK_EQ(steps, (window + 1 < 256) ? window + 1 : 256);
+    printf("timer %2u MHz: lit window %u ticks, %u distinct brightness steps, level 128 -> %.3f us\n",
+           (unsigned)timer_mhz[t], (unsigned)window, (unsigned)steps,
+           (double)((window * 128) / 255) / timer_mhz[t]);
+  }
+  return Host_test_done("Display_brightness_test");
+}
@@ -0,0 +1,136 @@
+#include <string.h>
+#include "Display_scan.h"
+#include "host_test.h"
+
+// Cost per row slot of the compiled frame against building every row word in the scan
+// interrupt, as the scan did before the words were cached. The cached scan only looks a
+// word up; the compile cost is paid once per picture change and is shown per slot of one frame.
+// Host times do not transfer to the Cortex-M3, only the ratios do; the cycles of the
+// interrupt on the board are in T_display_timing.isr_max.
+// The compiled words are also checked against the per-row build for every rotation.
+
+#define BENCH_FRAMES  20000
+#define CHECK_SCREENS 2000
+
+static volatile uint32_t sink;
+
+//------------------------------------------------------------------------------
+// Line k of a rotated plane, built per line like the former Display_rotation_N()
+//------------------------------------------------------------------------------
+static uint8_t Row_rotated(const uint8_t *scr, uint32_t rot, uint32_t k)
+{
+  uint8_t  a = 0;
+  uint32_t i;
+
+  for (i = 0; i < 8; i++)
+  {
+    switch (rot)
+    {
+      case 0:
+        a |= ((scr[k] >> i) & 1) << i;
+        break;
+      case 1:
+        a |= ((scr[i] >> k) & 1) << (7 - i);
+        break;
+      case 2:
+        a |= ((scr[7 - k] >> (7 - i)) & 1) << i;
+        break;
+      default:
+        a |= ((scr[i] >> (7 - k)) & 1) << i;
+        break;
+    }
+  }
+  return a;
+}
+
+//------------------------------------------------------------------------------
+// Word of one slot built on demand
+//------------------------------------------------------------------------------
+static uint16_t Row_word(uint8_t (*red)[8], uint8_t (*green)[8], uint32_t rot, uint32_t slot)
+{
+  uint32_t k = slot / DISPLAY_BCM_BITS;
+  uint32_t p = slot % DISPLAY_BCM_BITS;
+
+  return Display_interleave_row(Row_rotated(red[p], rot, k), Row_rotated(green[p], rot, k));
+}
+
+static void Random_planes(uint8_t (*planes)[8])
+{
+  uint32_t p;
+  uint64_t m;
+
+  for (p = 0; p < DISPLAY_BCM_BITS; p++)
+  {
+    m = Host_test_rnd();
+    memcpy(planes[p], &m, 8);
+  }
+}
+
+int main(void)
+{
+  uint8_t  red[DISPLAY_BCM_BITS][8];
+  uint8_t  green[DISPLAY_BCM_BITS][8];
+  uint16_t words[DISPLAY_SLOTS_NUM];
+  uint32_t i, s, rot;
+  uint32_t acc;
+  uint64_t t0;
+  double   ns_build;
+  double   ns_cached;
+  double   ns_compile;
+
+  for (i = 0; i < CHECK_SCREENS; i++)
+  {
+    Random_planes(red);
+    Random_planes(green);
+    for (rot = 0; rot < 4; rot++)
+    {
+      Display_compile_words(red, green, rot, words);
+      for (s = 0; s < DISPLAY_SLOTS_NUM; s++)
+      {
+        CHECK_EQ(words[s], Row_word(red, green, rot, s));
+      }
+    }
+  }
+
+  Random_planes(red);
+  Random_planes(green);
+  rot = 1;
+
+  acc = 0;
+  t0  = Host_test_ns();
+  for (i = 0; i < BENCH_FRAMES; i++)
+  {
+    for (s = 0; s < DISPLAY_SLOTS_NUM; s++)
+    {
+      acc += Row_word(red, green, rot, s);
+    }
+  }
+  ns_build = (double)(Host_test_ns() - t0) / ((double)BENCH_FRAMES * DISPLAY_SLOTS_NUM);
+  sink     = acc;
+
+  Display_compile_words(red, green, rot, words);
+  acc = 0;
+  t0  = Host_test_ns();
+  for (i = 0; i < BENCH_FRAMES; i++)
+  {
+    for (s = 0; s < DISPLAY_SLOTS_NUM; s++)
+    {
+      acc += ((volatile uint16_t *)words)[s];
+    }
+  }
+  ns_cached = (double)(Host_test_ns() - t0) / ((double)BENCH_FRAMES * DISPLAY_SLOTS_NUM);
+  sink      = acc;
+
+  t0 = Host_test_ns();
+  for (i = 0; i < BENCH_FRAMES; i++)
+  {
+    red[0][i & 7] ^= 1;  // A new picture every frame, the worst case for the cache
+    Display_compile_words(red, green, rot, words);
+    sink += words[i % DISPLAY_SLOTS_NUM];
+  }
+  ns_compile = (double)(Host_test_ns() - t0) / ((double)BENCH_FRAMES * DISPLAY_SLOTS_NUM);
+
+  printf("per row slot, rotation 90: build in scan %.2f ns, cached lookup %.2f ns, compile %.2f ns (once per picture)\n",
+         ns_build, ns_cached, ns_compile);
+  return Host_test_done("Display_compile_bench");
+}
@@ -0,0 +1,174 @@
+#include <string.h>
+#include "Display_scan.h"
+#include "host_test.h"
+
+// Writer/scanner interleave of the double-buffered frames. The frame stage is modelled word by
+// word: while no flip is pending it writes a new frame into the back page and posts it, and the
+// scan interrupt may run between any two of its stores. Every word carries the number of the
+// frame it belongs to, so a scanned frame (the words queued from slot 0 to the next flip or
+// wrap) made of words of two frames is torn. Untimed and timed flips are mixed, and a newer
+// frame may withdraw a timed flip still waiting for its moment and take over the back page.
+// Writers that break the protocol must produce torn frames, which shows the check can fail.
+
+#define STEPS 2000000
+
+typedef enum
+{
+  WRITER_PROTOCOL = 0,  // Waits for the pending flip, writes the back page
+  WRITER_NO_WAIT,       // Writes the back page while its flip is pending
+  WRITER_FRONT          // Writes the page being scanned
+} T_writer;
+
+static uint16_t       pages[2][DISPLAY_SLOTS_NUM];
+static T_display_scan sc;
+static uint32_t       withdrawn;
+
+typedef struct
+{
+  uint32_t frame_id;   // Frame being written
+  uint32_t pos;        // Next word to write, DISPLAY_SLOTS_NUM - frame complete
+  uint32_t page;
+} T_writer_state;
+
+typedef struct
+{
+  uint32_t cur_id;     // Frame of the first word of the scanned frame
+  uint32_t started;
+  uint32_t frames;
+  uint32_t torn;
+  uint32_t backwards;  // A frame older than one already shown
+  uint32_t flips;
+} T_scanner_state;
+
+//------------------------------------------------------------------------------
+// One store of the frame stage
+//------------------------------------------------------------------------------
+static void Writer_step(T_writer_state *w, T_writer mode, uint32_t now)
+{
+  if (w->pos == 0)
+  {
+    if ((mode == WRITER_PROTOCOL) && sc.pending && (Host_test_rnd() & 1))
+    {
+      withdrawn += Display_scan_withdraw(&sc);  // A newer timed frame replaces the waiting one
+    }
+    if ((mode == WRITER_PROTOCOL) && sc.pending)
+    {
+      return;
+    }
+    w->page = (mode == WRITER_FRONT) ? sc.front : sc.front ^ 1;
+  }
+  pages[w->page][w->pos] = (uint16_t)(w->frame_id << 6 | w->pos);
+  if (++w->pos < DISPLAY_SLOTS_NUM)
+  {
+    return;
+  }
+  w->pos = 0;
+  w->frame_id++;
+  if (sc.pending)
+  {
+    return;  // Broken writers only: the pending flip stays as it was
+  }
+  sc.timed  = (Host_test_rnd() & 3) == 0;
+  sc.marked = 0;
+  if (sc.timed)
+  {
+    sc.flip_cyc = now + (uint32_t)(Host_test_rnd() % 200);
+  }
+  Display_scan_post(&sc);
+}
+
+//------------------------------------------------------------------------------
+// One slot of the scan interrupt; the queued word is checked against its frame
+//------------------------------------------------------------------------------
+static void Scanner_step(T_scanner_state *s, uint32_t now)
+{
+  uint32_t next;
+  uint32_t evt;
+  uint32_t word;
+  uint32_t id;
+
+  Display_scan_advance(&sc);
+  next = Display_scan_next(&sc, now, &evt);
+  word = pages[sc.front][next];
+  id   = word >> 6;
+  if (evt & DISPLAY_SCAN_FLIPPED)
+  {
+    s->flips++;
+  }
+  if ((word & 0x3F) != next)
+  {
+    s->torn++;  // Word of another slot: the page was half written
+  }
+  if (next == 0)
+  {
+    // Frame numbers wrap in the 10 bits of the word
+    if (s->started && (((id - s->cur_id) & 0x3FF) >= 0x200))
+    {
+      s->backwards++;
+    }
+    s->cur_id  = id;
+    s->started = 1;
+    s->frames++;
+  }
+  else if (id != s->cur_id)
+  {
+    s->torn++;
+  }
+}
+
+static T_scanner_state Run(T_writer mode)
+{
+  T_writer_state  w;
+  T_scanner_state s;
+  uint32_t        now;
+  uint32_t        r;
+
+  memset(&w, 0, sizeof(w));
+  memset(&s, 0, sizeof(s));
+  for (r = 0; r < DISPLAY_SLOTS_NUM; r++)
+  {
+    pages[0][r] = (uint16_t)r;  // Frame 0, compiled by Display_init()
+    pages[1][r] = (uint16_t)r;
+  }
+  Display_scan_init(&sc);
+  withdrawn  = 0;
+  w.frame_id = 1;
+
+  for (now = 0; now < STEPS; now++)
+  {
+    // Bursts of both sides: the writer is preempted anywhere, and sometimes it stalls for frames
+    r = (uint32_t)(Host_test_rnd() % 16);
+    if (r < 7)
+    {
+      Scanner_step(&s, now);
+    }
+    else if ((r < 15) || (Host_test_rnd() % 8 == 0))
+    {
+      Writer_step(&w, mode, now);
+    }
+  }
+  return s;
+}
+
+int main(void)
+{
+  T_scanner_state s;
+
+  s = Run(WRITER_PROTOCOL);
+  printf("protocol writer: %u frames scanned, %u flips, %u timed flips withdrawn, %u torn\n", (unsigned)s.frames,
+         (unsigned)s.flips, (unsigned)withdrawn, (unsigned)s.torn);
+  CHECK_EQ(s.torn, 0);
+  CHECK_EQ(s.backwards, 0);
+  CHECK(s.flips > 1000);
+  CHECK(withdrawn > 100);
+
+  s = Run(WRITER_NO_WAIT);
+  printf("writer ignoring the pending flip: %u torn\n", (unsigned)s.torn);
+  CHECK(s.torn > 0);
+
+  s = Run(WRITER_FRONT);
+  printf("writer of the front page: %u torn\n", (unsigned)s.torn);
+  CHECK(s.torn > 0);
+
+  return Host_test_done("Display_flip_test");
+}
@@ -0,0 +1,72 @@
+#include "Display_scan.h"
+#include "host_test.h"
+
+// Display_interleave_row() for all 65536 pairs of red and green lines against the
+// bit-by-bit loop it replaced. The loop built the default layout (column 0 in bits 15:14,
+// red on the odd bit); the board variants are derived from it the way the macros define them.
+
+//------------------------------------------------------------------------------
+// Former loop of Display_interleave_row(): column i of a to bit 15 - 2i, of c to bit 14 - 2i
+//------------------------------------------------------------------------------
+static uint16_t Old_interleave(uint8_t a, uint8_t c)
+{
+  uint8_t  b = 0x01;
+  uint16_t w = 0;
+  uint32_t i;
+
+  for (i = 0; i < 8; i++)
+  {
+    w = w << 1;
+    if (a & b)
+    {
+      w = w | 1;
+    }
+    w = w << 1;
+    if (c & b)
+    {
+      w = w | 1;
+    }
+    b = b << 1;
+  }
+  return w;
+}
+
+static uint8_t Reverse(uint8_t x)
+{
+  uint8_t  r = 0;
+  uint32_t i;
+
+  for (i = 0; i < 8; i++)
+  {
+    r |= ((x >> i) & 1) << (7 - i);
+  }
+  return r;
+}
+
+static uint16_t Reference(uint8_t red, uint8_t green)
+{
+  uint8_t a = DISPLAY_SWAP_COLORS ? green : red;
+  uint8_t c = DISPLAY_SWAP_COLORS ? red : green;
+
+  if (DISPLAY_REVERSE_COLUMNS)
+  {
+    a = Reverse(a);
+    c = Reverse(c);
+  }
+  return Old_interleave(a, c);
+}
+
+int main(void)
+{
+  uint32_t red;
+  uint32_t green;
+
+  for (red = 0; red < 256; red++)
+  {
+    for (green = 0; green < 256; green++)
+    {
+      CHECK_EQ(Display_interleave_row((uint8_t)red, (uint8_t)green), Reference((uint8_t)red, (uint8_t)green));
+    }
+  }
+  return Host_test_done("Display_interleave_test");
+}
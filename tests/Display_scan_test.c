@@ -0,0 +1,221 @@
+#include <string.h>
+#include "Display_scan.h"
+#include "host_test.h"
+
+// Host simulation of the row scan: Display_scan_isr() is replayed with the same calls in the
+// same order against a model of TIM2 (preloaded ARR/CCR4, BLANK high while CNT < CCR4),
+// the CSEL pins, the TLC5920 shift register and output latch, and the SPI DMA.
+// For every slot it checks that row select and latch happen inside the forced blank,
+// that the latched word is the one queued in the previous slot and completely shifted,
+// and that the lit time belongs to the plane of the slot shown. Page flips at the frame end
+// and timed flips are checked for the slot they take effect at.
+
+#define TIMER_MHZ     72
+#define SPI_TICKS     (16 * 8)     // 16 bits at PCLK2 / 8 = 9 MHz, in 72 MHz timer ticks
+#define FRAMES        50
+#define LATENCY_STEPS 16
+
+typedef struct
+{
+  uint32_t arr;         // Active registers, loaded from the preload ones at the update event
+  uint32_t ccr;
+  uint32_t arr_pre;
+  uint32_t ccr_pre;
+  uint32_t csel;        // Row select pins
+  uint16_t shift;       // TLC5920 shift register
+  uint16_t out;         // TLC5920 output latch
+  uint64_t shift_done;  // Time the DMA transfer into the shift register completes
+  uint64_t now;         // Time of the current update event, ticks
+  uint32_t late;        // Rows selected or latched while lit
+  uint32_t torn;        // Latches of a word still being shifted
+} T_hw;
+
+static uint16_t       pages[2][DISPLAY_SLOTS_NUM];
+static uint32_t       plane_arr[DISPLAY_BCM_BITS];
+static uint32_t       plane_ccr[DISPLAY_BCM_BITS];
+static T_display_scan sc;
+static T_hw           hw;
+
+//------------------------------------------------------------------------------
+// Distinct word per page and slot so every latch tells where its word came from
+//------------------------------------------------------------------------------
+static void Fill_page(uint32_t page, uint32_t frame_id)
+{
+  uint32_t s;
+
+  for (s = 0; s < DISPLAY_SLOTS_NUM; s++)
+  {
+    pages[page][s] = (uint16_t)((frame_id << 6) | s);
+  }
+}
+
+//------------------------------------------------------------------------------
+// Display_scan_isr() entered latency ticks after the update event
+// Returns the events of Display_scan_next()
+//------------------------------------------------------------------------------
+static uint32_t Isr(uint32_t latency)
+{
+  uint32_t slot;
+  uint32_t next;
+  uint32_t evt;
+
+  slot    = Display_scan_advance(&sc);
+  hw.csel = slot / DISPLAY_BCM_BITS;
+  if (hw.now + latency < hw.shift_done)
+  {
+    hw.torn++;
+  }
+  hw.out = hw.shift;
+  if (latency >= hw.ccr)
+  {
+    hw.late++;
+  }
+
+  next          = Display_scan_next(&sc, (uint32_t)(hw.now + latency), &evt);
+  hw.arr_pre    = plane_arr[next % DISPLAY_BCM_BITS];
+  hw.ccr_pre    = plane_ccr[next % DISPLAY_BCM_BITS];
+  hw.shift      = pages[sc.front][next];
+  hw.shift_done = hw.now + latency + SPI_TICKS;
+  return evt;
+}
+
+//------------------------------------------------------------------------------
+// Update event, the interrupt and the rest of the slot; returns the word shown lit
+// and its lit time and row through the pointers
+//------------------------------------------------------------------------------
+static uint32_t Run_slot(uint32_t latency, uint16_t *word, uint32_t *lit, uint32_t *row)
+{
+  uint32_t evt;
+
+  hw.arr = hw.arr_pre;
+  hw.ccr = hw.ccr_pre;
+  evt    = Isr(latency);
+  *word  = hw.out;
+  *row   = hw.csel;
+  *lit   = hw.arr + 1 - hw.ccr;
+  hw.now += hw.arr + 1;
+  return evt;
+}
+
+//------------------------------------------------------------------------------
+// Start as Display_init() does: page 0 compiled, slot 0 word queued, timer at plane 0
+//------------------------------------------------------------------------------
+static void Start(uint32_t level)
+{
+  memset(&hw, 0, sizeof(hw));
+  Display_plane_timing(level, TIMER_MHZ, plane_arr, plane_ccr);
+  Fill_page(0, 0);
+  Display_scan_init(&sc);
+  hw.arr_pre = plane_arr[0];
+  hw.ccr_pre = plane_ccr[0];
+  hw.shift   = pages[0][0];
+}
+
+//------------------------------------------------------------------------------
+// Every slot shows its own row and word for the dwell of its plane
+//------------------------------------------------------------------------------
+static void Check_sequence(uint32_t level, uint32_t latency)
+{
+  uint16_t word;
+  uint32_t lit, row;
+  uint32_t n, s;
+
+  Start(level);
+  for (n = 0; n < FRAMES * DISPLAY_SLOTS_NUM; n++)
+  {
+    s = n % DISPLAY_SLOTS_NUM;
+    Run_slot(latency, &word, &lit, &row);
+    CHECK_EQ(sc.slot, s);
+    CHECK_EQ(row, s / DISPLAY_BCM_BITS);
+    CHECK_EQ(word, pages[0][s]);
+    CHECK_EQ(lit, plane_arr[s % DISPLAY_BCM_BITS] + 1 - plane_ccr[s % DISPLAY_BCM_BITS]);
+  }
+  CHECK_EQ(hw.torn, 0);
+}
+
+//------------------------------------------------------------------------------
+// A page posted in mid-frame is shown from slot 0 of the next frame, a timed one
+// from the first slot start after its moment
+//------------------------------------------------------------------------------
+static void Check_flips(uint32_t latency)
+{
+  uint16_t word;
+  uint32_t lit, row;
+  uint32_t n;
+  uint32_t evt;
+  uint32_t page;
+  uint64_t due;
+  uint64_t max_slot = (uint64_t)DISPLAY_BCM_UNIT_US * TIMER_MHZ << (DISPLAY_BCM_BITS - 1);
+
+  Start(255);
+  for (n = 0; n < 10; n++)
+  {
+    Run_slot(latency, &word, &lit, &row);
+  }
+  page = sc.front ^ 1;
+  Fill_page(page, 1);
+  sc.timed = 0;
+  Display_scan_post(&sc);
+  do
+  {
+    evt = Run_slot(latency, &word, &lit, &row);
+    CHECK_EQ(word >> 6, 0);  // The old frame is finished from the old page
+  } while (!(evt & DISPLAY_SCAN_FLIPPED));
+  CHECK_EQ(sc.slot, DISPLAY_SLOTS_NUM - 1);
+  Run_slot(latency, &word, &lit, &row);
+  CHECK_EQ(word, pages[page][0]);
+
+  // Timed flip in the middle of a frame
+  for (n = 0; n < 5; n++)
+  {
+    Run_slot(latency, &word, &lit, &row);
+  }
+  page        = sc.front ^ 1;
+  Fill_page(page, 2);
+  due         = hw.now + 3 * max_slot + 17;
+  sc.timed    = 1;
+  sc.flip_cyc = (uint32_t)due;
+  sc.marked   = 1;
+  Display_scan_post(&sc);
+  do
+  {
+    evt = Run_slot(latency, &word, &lit, &row);
+    CHECK_EQ(word >> 6, 1);
+  } while (!(evt & DISPLAY_SCAN_FLIPPED));
+  CHECK(evt & DISPLAY_SCAN_MARKED);
+  // Shown at the next slot start: within one slot of the interrupt that saw the moment
+  CHECK(hw.now >= due);
+  CHECK(hw.now <= due + max_slot + latency);
+  Run_slot(latency, &word, &lit, &row);
+  CHECK_EQ(word, pages[page][0]);
+  CHECK_EQ(row, 0);
+  CHECK_EQ(hw.torn, 0);
+}
+
+int main(void)
+{
+  uint32_t lead = DISPLAY_BLANK_LEAD_US * TIMER_MHZ;
+  uint32_t latency;
+  uint32_t i;
+
+  // Any entry latency inside the blank lead is safe at any brightness
+  for (i = 0; i < LATENCY_STEPS; i++)
+  {
+    latency = (lead - 1) * i / (LATENCY_STEPS - 1);
+    Check_sequence(255, latency);
+    CHECK_EQ(hw.late, 0);
+    Check_sequence(1, latency);
+    CHECK_EQ(hw.late, 0);
+    Check_flips(latency);
+    CHECK_EQ(hw.late, 0);
+  }
+
+  // The blank before the lit window doubles with the plane like the window itself, so at full
+  // brightness a latch just past the lead is switched while lit in the plane 0 slots only
+  Check_sequence(255, lead);
+  CHECK_EQ(hw.late, FRAMES * 8);
+
+  printf("row select and latch must follow the slot start within %u timer ticks (%u us)\n",
+         (unsigned)(lead - 1), (unsigned)DISPLAY_BLANK_LEAD_US);
+  return Host_test_done("Display_scan_test");
+}
@@ -0,0 +1,132 @@
+#include <string.h>
+#include "Bit_matrix.h"
+#include "Frame_delta.h"
+#include "host_test.h"
+
+// Bytes per frame and bus load of the XOR delta updates against sending both colours in full,
+// for 4 boards addressed one by one at 60 frames/s on the 562.5 kbit/s bus.
+// A colour goes as PDISPLx_REQ with PDISPLx_XOR_RED/GREEN (sub-command, mask, changed rows)
+// when Frame_delta_encode() fits it, else as PDISPLx_SET_RED/GREEN_SYMB with 8 bytes; an
+// unchanged colour is not sent. Frames are extended; bits as in CAN_frame_bits() plus the
+// worst-case 20% of stuffing. Every delta is also applied and must rebuild the new picture.
+
+#define NODES       4
+#define FPS         60
+#define BITRATE     562500
+#define FRAMES      6000
+#define STUFF_NUM   6  // Worst-case stuffing: one bit per 5, i.e. x 6 / 5
+#define STUFF_DEN   5
+
+typedef enum
+{
+  LOAD_STATIC = 0,  // Picture does not change
+  LOAD_CURSOR,      // One pixel walks over the screen
+  LOAD_SPRITE,      // An 8x8 glyph moves by one pixel
+  LOAD_BLINK,       // Two rows toggle
+  LOAD_NOISE_2,     // Two random pixels flip per colour
+  LOAD_SCROLL,      // Whole picture scrolls by one column
+  LOAD_NUM
+} T_load;
+
+static const char *load_names[LOAD_NUM] = {"static", "cursor", "sprite", "blink", "noise 2px", "scroll"};
+
+static uint32_t Frame_bits(uint32_t len)
+{
+  return ((67U + 8U * len) * STUFF_NUM) / STUFF_DEN;
+}
+
+//------------------------------------------------------------------------------
+// Next picture of colour col for frame n of a load
+//------------------------------------------------------------------------------
+static uint64_t Next_picture(T_load load, uint64_t prev, uint32_t n, uint32_t col)
+{
+  static const uint8_t glyph[8] = {0x3C, 0x42, 0xA5, 0x81, 0xA5, 0x99, 0x42, 0x3C};
+  uint32_t             i;
+
+  switch (load)
+  {
+    case LOAD_CURSOR:
+      return 1ULL << ((n + col * 17) % 64);
+    case LOAD_SPRITE:
+      return Bit_matrix_shift(Bit_matrix_load(glyph), (int32_t)(n % 8) - 4, (int32_t)((n / 8) % 8) - 4);
+    case LOAD_BLINK:
+      return prev ^ (0xFFULL << (8 * (1 + col))) ^ (0xFFULL << (8 * (5 + col)));
+    case LOAD_NOISE_2:
+      for (i = 0; i < 2; i++)
+      {
+        prev ^= 1ULL << (Host_test_rnd() % 64);
+      }
+      return prev;
+    case LOAD_SCROLL:
+      // Columns rotate by one, the column shifted out comes back on the other side
+      return ((prev << 1) & 0xFEFEFEFEFEFEFEFEULL) | ((prev >> 7) & 0x0101010101010101ULL);
+    default:
+      return prev;
+  }
+}
+
+int main(void)
+{
+  uint8_t  prev[2][8];
+  uint8_t  next[2][8];
+  uint8_t  rows[8];
+  uint8_t  payload[8];
+  uint64_t pic[2];
+  uint64_t bytes_delta;
+  uint64_t bits_delta;
+  uint64_t bits_full;
+  uint32_t load, n, col;
+  int32_t  len;
+  double   load_delta;
+  double   load_full;
+
+  printf("%-10s %14s %14s %12s %12s\n", "load", "delta B/frame", "full B/frame", "delta bus %", "full bus %");
+  for (load = 0; load < LOAD_NUM; load++)
+  {
+    pic[0]      = 0x0000183C3C180000ULL;
+    pic[1]      = 0x8142241818244281ULL;
+    bytes_delta = 0;
+    bits_delta  = 0;
+    bits_full   = 0;
+    for (n = 0; n < FRAMES; n++)
+    {
+      for (col = 0; col < 2; col++)
+      {
+        Bit_matrix_store(pic[col], prev[col]);
+        pic[col] = Next_picture((T_load)load, pic[col], n, col);
+        Bit_matrix_store(pic[col], next[col]);
+
+        // Full update: both colours every frame, 8 data bytes each
+        bits_full += Frame_bits(8);
+
+        len = Frame_delta_encode(prev[col], next[col], payload);
+        if (len == FRAME_DELTA_FULL)
+        {
+          bytes_delta += 8;
+          bits_delta  += Frame_bits(8);
+          continue;
+        }
+        if (len == 0)
+        {
+          CHECK(memcmp(prev[col], next[col], 8) == 0);
+          continue;
+        }
+        CHECK(len <= 1 + FRAME_DELTA_MAX_ROWS);
+        CHECK_EQ(Frame_delta_size(payload), len);  // The length the receiver checks the DLC against
+        bytes_delta += 1 + (uint32_t)len;
+        bits_delta  += Frame_bits(1 + (uint32_t)len);
+
+        memcpy(rows, prev[col], 8);
+        CHECK_EQ(Frame_delta_apply(rows, payload), len);
+        CHECK(memcmp(rows, next[col], 8) == 0);
+      }
+    }
+    load_delta = 100.0 * (double)bits_delta * NODES * FPS / ((double)FRAMES * BITRATE);
+    load_full  = 100.0 * (double)bits_full * NODES * FPS / ((double)FRAMES * BITRATE);
+    printf("%-10s %14.2f %14.2f %12.2f %12.2f\n", load_names[load], (double)bytes_delta / FRAMES, 16.0,
+           load_delta, load_full);
+    CHECK(bits_delta <= bits_full);
+    CHECK(load_full < 100.0);
+  }
+  return Host_test_done("Frame_delta_bench");
+}
@@ -0,0 +1,369 @@
+#include <string.h>
+#include "Glyph_store.h"
+#include "host_test.h"
+
+// Power-cut test of the user glyph store on a simulated flash of two 1 KB pages. The simulation
+// keeps the rules of the STM32F1 flash: a halfword is programmed only when erased, or with 0 over
+// any value, and programming only clears bits. Random glyphs of more codes than the store holds
+// are written until the power is cut at a random flash operation:
+//  - a torn program clears only part of the bits it should;
+//  - an interrupted erase leaves every byte of the page either erased or as it was;
+//  - after the cut no flash operation has any effect.
+// The store is then opened again and must hold the last glyph written before the cut for every
+// code, and for the interrupted code either that glyph or the new one. The pages start at a
+// generation close to 0xFFFF, so the cuts also hit compactions across the generation wrap.
+// Two valid pages of consecutive generations and torn records are also checked on images
+// built by hand.
+
+#define PAGE_SIZE  1024
+#define CODES      24    // Codes written, more than GLYPH_STORE_MAX so the store also gets full
+#define POWER_CUTS 1000
+#define MAX_OPS    700   // Flash operations before a cut, about one compaction apart
+#define START_GEN  0xFFF0u
+
+typedef enum
+{
+  TAG_NONE = 0,  // Power lost after the rows, before the tag
+  TAG_OK,
+  TAG_TORN       // Tag programmed in part: code byte with a bit still set
+} T_tag;
+
+static uint8_t       flash[2 * PAGE_SIZE];
+static T_glyph_store st;
+static uint32_t      ops_left;     // Flash operations until the cut, 0 - no cut armed
+static uint32_t      erase_cut;    // Cut the next erase instead, erases are rare among the operations
+static uint32_t      power_off;
+static uint32_t      bad_program;  // Programs the flash would refuse
+static uint32_t      cut_erase, cut_copy, cut_header, cut_tag;
+
+static uint8_t model[CODES][8];
+static uint8_t model_set[CODES];
+
+//------------------------------------------------------------------------------
+// Code of index k, spread over the whole byte
+//------------------------------------------------------------------------------
+static uint32_t Code(uint32_t k)
+{
+  return 255 - k * 11;
+}
+
+//------------------------------------------------------------------------------
+// Count down to the cut; non-zero when this operation is the one cut
+//------------------------------------------------------------------------------
+static uint32_t Sim_cut_now(void)
+{
+  if ((ops_left != 0) && (--ops_left == 0))
+  {
+    power_off = 1;
+    return 1;
+  }
+  return 0;
+}
+
+static uint32_t Sim_program(uint8_t *dst, uint16_t val)
+{
+  uint32_t offs = (uint32_t)(dst - flash);
+  uint16_t cur  = (uint16_t)(dst[0] | (dst[1] << 8));
+
+  CHECK((offs < sizeof(flash)) && ((offs & 1) == 0));
+  if (power_off)
+  {
+    return 1;
+  }
+  if ((val != 0) && (cur != 0xFFFF))
+  {
+    bad_program++;
+    return 1;
+  }
+  if (Sim_cut_now())
+  {
+    val |= (uint16_t)Host_test_rnd();
+    if (offs / PAGE_SIZE != st.active)
+    {
+      cut_copy++;
+    }
+    if (offs % PAGE_SIZE < GLYPH_STORE_HDR_SIZE)
+    {
+      cut_header++;
+    }
+    else if ((offs % PAGE_SIZE - GLYPH_STORE_HDR_SIZE) % GLYPH_STORE_REC_SIZE == 8)
+    {
+      cut_tag++;
+    }
+  }
+  cur    &= val;
+  dst[0]  = (uint8_t)cur;
+  dst[1]  = (uint8_t)(cur >> 8);
+  return power_off;
+}
+
+static uint32_t Sim_erase(uint8_t *page)
+{
+  uint32_t i;
+
+  CHECK((page == flash) || (page == flash + PAGE_SIZE));
+  if (power_off)
+  {
+    return 1;
+  }
+  if (erase_cut || Sim_cut_now())
+  {
+    power_off = 1;
+    for (i = 0; i < PAGE_SIZE; i++)
+    {
+      if (Host_test_rnd() & 1)
+      {
+        page[i] = 0xFF;
+      }
+    }
+    cut_erase++;
+    return 1;
+  }
+  memset(page, 0xFF, PAGE_SIZE);
+  return 0;
+}
+
+static const T_glyph_flash sim = {Sim_program, Sim_erase};
+
+//------------------------------------------------------------------------------
+// Erased page with a valid header of generation gen
+//------------------------------------------------------------------------------
+static void Put_page(uint32_t page, uint16_t gen)
+{
+  uint8_t *p = flash + page * PAGE_SIZE;
+
+  memset(p, 0xFF, PAGE_SIZE);
+  p[0] = (uint8_t)gen;
+  p[1] = (uint8_t)(gen >> 8);
+  p[2] = (uint8_t)GLYPH_STORE_PAGE_MAGIC;
+  p[3] = (uint8_t)(GLYPH_STORE_PAGE_MAGIC >> 8);
+}
+
+//------------------------------------------------------------------------------
+// Record of code with every row set to fill in the given slot of a page
+//------------------------------------------------------------------------------
+static void Put_rec(uint32_t page, uint32_t slot, uint32_t code, uint8_t fill, T_tag tag)
+{
+  uint8_t *rec = flash + page * PAGE_SIZE + GLYPH_STORE_HDR_SIZE + slot * GLYPH_STORE_REC_SIZE;
+
+  memset(rec, fill, 8);
+  if (tag == TAG_OK)
+  {
+    rec[8] = (uint8_t)code;
+    rec[9] = (uint8_t)~code;
+  }
+  else if (tag == TAG_TORN)
+  {
+    rec[8] = (uint8_t)(code | 0x04);
+    rec[9] = (uint8_t)~code;
+  }
+}
+
+//------------------------------------------------------------------------------
+// Non-zero if the glyph of code has all rows equal to fill
+//------------------------------------------------------------------------------
+static uint32_t Rows_are(uint32_t code, uint8_t fill)
+{
+  const uint8_t *g = Glyph_store_get(&st, code);
+  uint32_t       i;
+
+  if (g == NULL)
+  {
+    return 0;
+  }
+  for (i = 0; i < 8; i++)
+  {
+    if (g[i] != fill)
+    {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+//------------------------------------------------------------------------------
+// Of two valid pages the newer generation wins, in either page and across the wrap
+//------------------------------------------------------------------------------
+static void Check_two_pages(void)
+{
+  static const uint16_t gens[] = {0, 1, 0x7FFF, 0xFFFE, 0xFFFF};
+  uint32_t              i;
+  uint32_t              newer;
+
+  for (i = 0; i < sizeof(gens) / sizeof(gens[0]); i++)
+  {
+    for (newer = 0; newer < 2; newer++)
+    {
+      Put_page(newer ^ 1, gens[i]);
+      Put_rec(newer ^ 1, 0, 7, 0x11, TAG_OK);
+      Put_rec(newer ^ 1, 1, 8, 0x12, TAG_OK);
+      Put_page(newer, (uint16_t)(gens[i] + 1));
+      Put_rec(newer, 0, 7, 0x22, TAG_OK);
+      CHECK_EQ(Glyph_store_init(&st, &sim, flash, PAGE_SIZE), GLYPH_STORE_OK);
+      CHECK_EQ(st.active, newer);
+      CHECK_EQ(st.gen, (uint16_t)(gens[i] + 1));
+      CHECK(Rows_are(7, 0x22));
+      CHECK(Glyph_store_get(&st, 8) == NULL);  // Only in the older page
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+// Torn records are ignored but keep their slots, the next write goes after them
+//------------------------------------------------------------------------------
+static void Check_torn_records(void)
+{
+  static const uint8_t glyph[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+  const uint8_t       *g;
+
+  memset(flash, 0xFF, sizeof(flash));
+  Put_page(1, 5);
+  Put_rec(1, 0, 3, 0x33, TAG_OK);
+  Put_rec(1, 1, 4, 0x44, TAG_NONE);
+  Put_rec(1, 2, 3, 0x55, TAG_TORN);  // Would read as code 7 with a fixed mark
+  CHECK_EQ(Glyph_store_init(&st, &sim, flash, PAGE_SIZE), GLYPH_STORE_OK);
+  CHECK_EQ(st.active, 1);
+  CHECK_EQ(st.count, 1);
+  CHECK(Rows_are(3, 0x33));
+  CHECK(Glyph_store_get(&st, 4) == NULL);
+  CHECK(Glyph_store_get(&st, 7) == NULL);
+  CHECK_EQ(st.free_offs, GLYPH_STORE_HDR_SIZE + 3 * GLYPH_STORE_REC_SIZE);
+
+  CHECK_EQ(Glyph_store_write(&st, 9, glyph), GLYPH_STORE_OK);
+  g = Glyph_store_get(&st, 9);
+  CHECK(g == flash + PAGE_SIZE + GLYPH_STORE_HDR_SIZE + 3 * GLYPH_STORE_REC_SIZE);
+  CHECK_EQ(bad_program, 0);
+}
+
+//------------------------------------------------------------------------------
+// Random glyph, some rows left 0xFF so their halfwords are not programmed
+//------------------------------------------------------------------------------
+static void Random_glyph(uint8_t *g)
+{
+  uint32_t i;
+
+  for (i = 0; i < 8; i++)
+  {
+    g[i] = (Host_test_rnd() & 3) ? (uint8_t)Host_test_rnd() : 0xFF;
+  }
+}
+
+static uint32_t Model_count(void)
+{
+  uint32_t n = 0;
+  uint32_t k;
+
+  for (k = 0; k < CODES; k++)
+  {
+    n += model_set[k];
+  }
+  return n;
+}
+
+//------------------------------------------------------------------------------
+// Store opened after a cut against the model; the interrupted write of code index torn_k
+// may have completed, then its glyph becomes part of the model
+//------------------------------------------------------------------------------
+static void Check_store(uint32_t torn_k, const uint8_t *torn_glyph)
+{
+  const uint8_t *g;
+  uint32_t       k;
+
+  for (k = 0; k < CODES; k++)
+  {
+    g = Glyph_store_get(&st, Code(k));
+    if ((k == torn_k) && (g != NULL) && (memcmp(g, torn_glyph, 8) == 0))
+    {
+      memcpy(model[k], torn_glyph, 8);
+      model_set[k] = 1;
+      continue;
+    }
+    if (model_set[k])
+    {
+      CHECK((g != NULL) && (memcmp(g, model[k], 8) == 0));
+    }
+    else
+    {
+      CHECK(g == NULL);
+    }
+  }
+  CHECK_EQ(st.count, Model_count());
+}
+
+//------------------------------------------------------------------------------
+// Writes cut by power loss at random flash operations, each followed by a restart
+//------------------------------------------------------------------------------
+static void Check_power_cuts(void)
+{
+  uint8_t  glyph[8];
+  uint32_t cut;
+  uint32_t k = 0;
+  uint32_t writes = 0;
+  uint32_t wraps  = 0;
+  uint16_t gen;
+  int32_t  res;
+
+  memset(flash, 0xFF, sizeof(flash));
+  Put_page(0, START_GEN);
+  CHECK_EQ(Glyph_store_init(&st, &sim, flash, PAGE_SIZE), GLYPH_STORE_OK);
+  gen = st.gen;
+
+  for (cut = 0; cut < POWER_CUTS; cut++)
+  {
+    erase_cut = (Host_test_rnd() % 8) == 0;
+    ops_left  = erase_cut ? 0 : 1 + (uint32_t)(Host_test_rnd() % MAX_OPS);
+    power_off = 0;
+    while (!power_off)
+    {
+      k = (uint32_t)(Host_test_rnd() % CODES);
+      Random_glyph(glyph);
+      res = Glyph_store_write(&st, Code(k), glyph);
+      if (power_off)
+      {
+        break;
+      }
+      if (res == GLYPH_STORE_OK)
+      {
+        memcpy(model[k], glyph, 8);
+        model_set[k] = 1;
+      }
+      else
+      {
+        CHECK_EQ(res, GLYPH_STORE_FULL);
+        CHECK(!model_set[k] && (Model_count() == GLYPH_STORE_MAX));
+      }
+      wraps += (st.gen < gen);
+      gen    = st.gen;
+      writes++;
+    }
+
+    // Restart
+    erase_cut = 0;
+    ops_left  = 0;
+    power_off = 0;
+    CHECK_EQ(Glyph_store_init(&st, &sim, flash, PAGE_SIZE), GLYPH_STORE_OK);
+    Check_store(k, glyph);
+    wraps += (st.gen < gen);
+    gen    = st.gen;
+  }
+
+  printf("%u power cuts in %u writes: %u in erases, %u in page copies, %u in headers, %u in tags; "
+         "%u generation wraps\n",
+         (unsigned)POWER_CUTS, (unsigned)writes, (unsigned)cut_erase, (unsigned)cut_copy, (unsigned)cut_header,
+         (unsigned)cut_tag, (unsigned)wraps);
+  CHECK(cut_erase > 0);
+  CHECK(cut_copy > 0);
+  CHECK(cut_header > 0);
+  CHECK(cut_tag > 0);
+  CHECK(wraps > 0);
+  CHECK_EQ(Model_count(), GLYPH_STORE_MAX);
+  CHECK_EQ(bad_program, 0);
+}
+
+int main(void)
+{
+  Check_two_pages();
+  Check_torn_records();
+  Check_power_cuts();
+  return Host_test_done("Glyph_store_test");
+}
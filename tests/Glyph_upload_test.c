@@ -0,0 +1,192 @@
+#include <string.h>
+#include "Glyph_upload.h"
+#include "host_test.h"
+
+// Test of the glyph upload transaction. The CRC is checked against the CRC-16/CCITT-FALSE check
+// value, then batches of every size are sent with their chunks shuffled, repeated and sometimes
+// dropped: a batch commits only when every chunk came and the CRC matches, and then holds exactly
+// the sent rows. Wrong transaction numbers, bad lengths, chunks outside the batch and commands
+// arriving while a committed batch waits for flash are answered with their error codes.
+
+#define RANDOM_BATCHES 20000
+#define MAX_CHUNKS     ((GLYPH_UPLOAD_MAX * 8 + GLYPH_UPLOAD_CHUNK - 1) / GLYPH_UPLOAD_CHUNK)
+
+static T_glyph_upload u;
+static uint8_t        rows[GLYPH_UPLOAD_MAX * 8];
+
+//------------------------------------------------------------------------------
+// Send chunk n of rows as a DATA frame would carry it, 6 bytes even past the batch end
+//------------------------------------------------------------------------------
+static uint32_t Send_chunk(uint32_t n)
+{
+  uint8_t  bytes[GLYPH_UPLOAD_CHUNK];
+  uint32_t i;
+
+  for (i = 0; i < GLYPH_UPLOAD_CHUNK; i++)
+  {
+    bytes[i] = (n * GLYPH_UPLOAD_CHUNK + i < sizeof(rows)) ? rows[n * GLYPH_UPLOAD_CHUNK + i] : 0xEE;
+  }
+  return Glyph_upload_data(&u, n, bytes);
+}
+
+static uint32_t Chunks(uint32_t count)
+{
+  return (count * 8 + GLYPH_UPLOAD_CHUNK - 1) / GLYPH_UPLOAD_CHUNK;
+}
+
+//------------------------------------------------------------------------------
+// CRC-16/CCITT-FALSE check value
+//------------------------------------------------------------------------------
+static void Check_crc(void)
+{
+  CHECK_EQ(Glyph_upload_crc16((const uint8_t *)"123456789", 9), 0x29B1);
+  CHECK_EQ(Glyph_upload_crc16(NULL, 0), 0xFFFF);
+}
+
+//------------------------------------------------------------------------------
+// Begin, data and commit errors and the state they leave
+//------------------------------------------------------------------------------
+static void Check_errors(void)
+{
+  uint32_t i;
+  uint16_t crc;
+
+  memset(&u, 0, sizeof(u));
+  for (i = 0; i < sizeof(rows); i++)
+  {
+    rows[i] = (uint8_t)(i * 7 + 1);
+  }
+
+  // Nothing open
+  CHECK_EQ(Send_chunk(0), GLYPH_UPLOAD_NO_TRANSACTION);
+  CHECK_EQ(Glyph_upload_commit(&u, 0, 0), GLYPH_UPLOAD_NO_TRANSACTION);
+
+  // Bad length drops the open batch
+  CHECK_EQ(Glyph_upload_begin(&u, 1, 10, 2), GLYPH_UPLOAD_OK);
+  CHECK_EQ(Glyph_upload_begin(&u, 1, 10, 0), GLYPH_UPLOAD_BAD_LENGTH);
+  CHECK_EQ(u.state, GLYPH_UPLOAD_IDLE);
+  CHECK_EQ(Glyph_upload_begin(&u, 1, 10, GLYPH_UPLOAD_MAX + 1), GLYPH_UPLOAD_BAD_LENGTH);
+  CHECK_EQ(Glyph_upload_begin(&u, 1, 250, 7), GLYPH_UPLOAD_BAD_LENGTH);
+  CHECK_EQ(Glyph_upload_begin(&u, 1, 249, 7), GLYPH_UPLOAD_OK);  // Up to code 255
+  CHECK_EQ(Glyph_upload_begin(&u, 1, 0, GLYPH_UPLOAD_MAX), GLYPH_UPLOAD_OK);
+
+  // Wrong transaction number
+  CHECK_EQ(Glyph_upload_begin(&u, 5, 20, 1), GLYPH_UPLOAD_OK);
+  CHECK_EQ(Send_chunk(0), GLYPH_UPLOAD_OK);
+  CHECK_EQ(Send_chunk(1), GLYPH_UPLOAD_OK);
+  crc = Glyph_upload_crc16(rows, 8);
+  CHECK_EQ(Glyph_upload_commit(&u, 6, crc), GLYPH_UPLOAD_BAD_ID);
+  CHECK_EQ(u.state, GLYPH_UPLOAD_IDLE);
+  CHECK_EQ(Glyph_upload_commit(&u, 5, crc), GLYPH_UPLOAD_NO_TRANSACTION);
+
+  // Chunk outside the batch is reported by the commit even when all chunks came
+  CHECK_EQ(Glyph_upload_begin(&u, 5, 20, 1), GLYPH_UPLOAD_OK);
+  CHECK_EQ(Send_chunk(0), GLYPH_UPLOAD_OK);
+  CHECK_EQ(Send_chunk(1), GLYPH_UPLOAD_OK);
+  CHECK_EQ(Send_chunk(2), GLYPH_UPLOAD_BAD_CHUNK);
+  CHECK_EQ(Glyph_upload_commit(&u, 5, crc), GLYPH_UPLOAD_BAD_CHUNK);
+
+  // Missing chunk
+  CHECK_EQ(Glyph_upload_begin(&u, 5, 20, 1), GLYPH_UPLOAD_OK);
+  CHECK_EQ(Send_chunk(1), GLYPH_UPLOAD_OK);
+  CHECK_EQ(Glyph_upload_commit(&u, 5, crc), GLYPH_UPLOAD_INCOMPLETE);
+
+  // Bad CRC
+  CHECK_EQ(Glyph_upload_begin(&u, 5, 20, 1), GLYPH_UPLOAD_OK);
+  CHECK_EQ(Send_chunk(0), GLYPH_UPLOAD_OK);
+  CHECK_EQ(Send_chunk(1), GLYPH_UPLOAD_OK);
+  CHECK_EQ(Glyph_upload_commit(&u, 5, (uint16_t)(crc ^ 1)), GLYPH_UPLOAD_BAD_CRC);
+
+  // Committed batch waits for flash: everything is busy until the driver is done
+  CHECK_EQ(Glyph_upload_begin(&u, 5, 20, 1), GLYPH_UPLOAD_OK);
+  CHECK_EQ(Send_chunk(1), GLYPH_UPLOAD_OK);
+  CHECK_EQ(Send_chunk(0), GLYPH_UPLOAD_OK);
+  CHECK_EQ(Glyph_upload_commit(&u, 5, crc), GLYPH_UPLOAD_OK);
+  CHECK_EQ(u.state, GLYPH_UPLOAD_COMMITTED);
+  CHECK_EQ(u.rows[8], 0);  // Last chunk cut to the batch
+  CHECK_EQ(Glyph_upload_begin(&u, 6, 30, 1), GLYPH_UPLOAD_BUSY);
+  CHECK_EQ(Glyph_upload_commit(&u, 5, crc), GLYPH_UPLOAD_BUSY);
+  CHECK_EQ(Send_chunk(0), GLYPH_UPLOAD_NO_TRANSACTION);
+  CHECK_EQ(u.first, 20);
+  CHECK_EQ(memcmp(u.rows, rows, 8), 0);
+  Glyph_upload_done(&u);
+  CHECK_EQ(u.state, GLYPH_UPLOAD_IDLE);
+  CHECK_EQ(Glyph_upload_begin(&u, 6, 30, 1), GLYPH_UPLOAD_OK);
+}
+
+//------------------------------------------------------------------------------
+// Random batches: chunks reordered and repeated, now and then one dropped
+//------------------------------------------------------------------------------
+static void Check_random_batches(void)
+{
+  uint8_t  order[MAX_CHUNKS * 2];
+  uint32_t committed = 0;
+  uint32_t b, i, j, t;
+  uint32_t count, first, n, sent;
+  uint32_t drop;
+  uint32_t res;
+  uint16_t crc;
+
+  for (b = 0; b < RANDOM_BATCHES; b++)
+  {
+    count = 1 + (uint32_t)(Host_test_rnd() % GLYPH_UPLOAD_MAX);
+    first = (uint32_t)(Host_test_rnd() % (257 - count));
+    n     = Chunks(count);
+    for (i = 0; i < count * 8; i++)
+    {
+      rows[i] = (uint8_t)Host_test_rnd();
+    }
+    crc = Glyph_upload_crc16(rows, count * 8);
+
+    // Every chunk once, a few of them again, shuffled
+    sent = n + (uint32_t)(Host_test_rnd() % (n + 1));
+    for (i = 0; i < sent; i++)
+    {
+      order[i] = (uint8_t)((i < n) ? i : Host_test_rnd() % n);
+    }
+    for (i = sent - 1; i > 0; i--)
+    {
+      j        = (uint32_t)(Host_test_rnd() % (i + 1));
+      t        = order[i];
+      order[i] = order[j];
+      order[j] = (uint8_t)t;
+    }
+    drop = (Host_test_rnd() % 4 == 0) ? (uint32_t)(Host_test_rnd() % n) : n;
+
+    CHECK_EQ(Glyph_upload_begin(&u, b & 0xFF, first, count), GLYPH_UPLOAD_OK);
+    for (i = 0; i < sent; i++)
+    {
+      if (order[i] != drop)
+      {
+        CHECK_EQ(Send_chunk(order[i]), GLYPH_UPLOAD_OK);
+      }
+    }
+    res = Glyph_upload_commit(&u, b & 0xFF, crc);
+    if (drop < n)
+    {
+      CHECK_EQ(res, GLYPH_UPLOAD_INCOMPLETE);
+      CHECK_EQ(u.state, GLYPH_UPLOAD_IDLE);
+      continue;
+    }
+    CHECK_EQ(res, GLYPH_UPLOAD_OK);
+    CHECK_EQ(u.first, first);
+    CHECK_EQ(u.count, count);
+    CHECK_EQ(memcmp(u.rows, rows, count * 8), 0);
+    for (i = count * 8; i < sizeof(u.rows); i++)
+    {
+      CHECK_EQ(u.rows[i], 0);  // Bytes of the last chunk past the batch are not stored
+    }
+    Glyph_upload_done(&u);
+    committed++;
+  }
+  printf("%u random batches, %u committed\n", (unsigned)RANDOM_BATCHES, (unsigned)committed);
+  CHECK(committed > RANDOM_BATCHES / 2);
+}
+
+int main(void)
+{
+  Check_crc();
+  Check_errors();
+  Check_random_batches();
+  return Host_test_done("Glyph_upload_test");
+}
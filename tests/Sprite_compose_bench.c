@@ -0,0 +1,167 @@
+#include <string.h>
+#include "Display_scan.h"
+#include "Sprite.h"
+#include "host_test.h"
+
+// Compositing cost per frame of Sprite_compose() for 1 to 8 sprites over the bit-planes of
+// both colours, as the frame compile stage runs it, against compositing pixel by pixel.
+// Sprites get random glyphs, positions (partly off the screen), colours, blend modes and
+// z-orders with ties, and move with Sprite_step() between frames. Every composited frame is
+// checked against the pixel reference: sprites in ascending z, equal z in pool order.
+// Host times do not transfer to the Cortex-M3, only the growth with the sprite count does.
+
+#define FRAMES       100000
+#define CHECK_FRAMES 20000
+#define Z_LEVELS     3  // z-orders used, few enough for ties
+
+static volatile uint32_t sink;
+
+//------------------------------------------------------------------------------
+// Pool with n random sprites in random slots
+//------------------------------------------------------------------------------
+static void Random_pool(T_sprite *pool, uint32_t n)
+{
+  uint32_t i, k;
+
+  Sprite_pool_init(pool);
+  for (k = 0; k < n; k++)
+  {
+    do
+    {
+      i = (uint32_t)(Host_test_rnd() % SPRITE_POOL_SIZE);
+    } while (pool[i].colors != 0);
+    Sprite_place(&pool[i], Host_test_rnd(), (int32_t)(Host_test_rnd() % 15) - 7, (int32_t)(Host_test_rnd() % 15) - 7, 1 + (uint32_t)(Host_test_rnd() % 3),
+                 (uint32_t)(Host_test_rnd() % SPRITE_BLEND_NUM), (uint32_t)(Host_test_rnd() % Z_LEVELS));
+    Sprite_set_motion(&pool[i], (int32_t)(Host_test_rnd() % 3) - 1, (int32_t)(Host_test_rnd() % 3) - 1, 1 + (uint32_t)(Host_test_rnd() % 3), 0);
+  }
+}
+
+static void Random_planes(uint8_t (*planes)[8])
+{
+  uint32_t p;
+  uint64_t m;
+
+  for (p = 0; p < DISPLAY_BCM_BITS; p++)
+  {
+    m = Host_test_rnd();
+    memcpy(planes[p], &m, 8);
+  }
+}
+
+//------------------------------------------------------------------------------
+// Pixel by pixel compositing of one colour
+//------------------------------------------------------------------------------
+static void Compose_pixels(const T_sprite *pool, uint32_t color, uint8_t (*planes)[8])
+{
+  uint32_t z, i, p;
+  int32_t  r, c, x, y;
+  uint8_t  bit;
+
+  for (z = 0; z < Z_LEVELS; z++)
+  {
+    for (i = 0; i < SPRITE_POOL_SIZE; i++)
+    {
+      if ((pool[i].z != z) || ((pool[i].colors & color) == 0))
+      {
+        continue;
+      }
+      for (r = 0; r < 8; r++)
+      {
+        for (c = 0; c < 8; c++)
+        {
+          x = c + pool[i].x;
+          y = r + pool[i].y;
+          if (((pool[i].glyph >> (8 * r + c)) & 1) == 0 || (x < 0) || (x > 7) || (y < 0) || (y > 7))
+          {
+            continue;
+          }
+          bit = (uint8_t)(1u << x);
+          for (p = 0; p < DISPLAY_BCM_BITS; p++)
+          {
+            switch (pool[i].blend)
+            {
+              case SPRITE_BLEND_XOR:
+                planes[p][y] ^= bit;
+                break;
+              case SPRITE_BLEND_MASK:
+                planes[p][y] &= (uint8_t)~bit;
+                break;
+              default:
+                planes[p][y] |= bit;
+                break;
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+int main(void)
+{
+  T_sprite pool[SPRITE_POOL_SIZE];
+  uint8_t  red[DISPLAY_BCM_BITS][8];
+  uint8_t  green[DISPLAY_BCM_BITS][8];
+  uint8_t  ref_red[DISPLAY_BCM_BITS][8];
+  uint8_t  ref_green[DISPLAY_BCM_BITS][8];
+  uint32_t n, i;
+  uint64_t t0;
+  double   ns_compose;
+  double   ns_pixels;
+  double   ns_one = 0;
+
+  for (n = 1; n <= SPRITE_POOL_SIZE; n++)
+  {
+    Random_pool(pool, n);
+    for (i = 0; i < CHECK_FRAMES; i++)
+    {
+      Random_planes(red);
+      Random_planes(green);
+      memcpy(ref_red, red, sizeof(red));
+      memcpy(ref_green, green, sizeof(green));
+      Sprite_compose(pool, red, green, DISPLAY_BCM_BITS);
+      Compose_pixels(pool, SPRITE_RED, ref_red);
+      Compose_pixels(pool, SPRITE_GREEN, ref_green);
+      CHECK(memcmp(red, ref_red, sizeof(red)) == 0);
+      CHECK(memcmp(green, ref_green, sizeof(green)) == 0);
+      Sprite_step(pool);
+    }
+  }
+
+  printf("%-8s %16s %16s %8s\n", "sprites", "compose ns/frame", "pixels ns/frame", "ratio");
+  for (n = 1; n <= SPRITE_POOL_SIZE; n++)
+  {
+    Random_pool(pool, n);
+    Random_planes(red);
+    Random_planes(green);
+
+    t0 = Host_test_ns();
+    for (i = 0; i < FRAMES; i++)
+    {
+      red[0][i & 7] ^= 1;  // Keep the compiler from hoisting the work out of the loop
+      Sprite_compose(pool, red, green, DISPLAY_BCM_BITS);
+      Sprite_step(pool);
+    }
+    ns_compose = (double)(Host_test_ns() - t0) / FRAMES;
+    sink += red[1][3] + green[0][5];
+
+    t0 = Host_test_ns();
+    for (i = 0; i < FRAMES; i++)
+    {
+      red[0][i & 7] ^= 1;
+      Compose_pixels(pool, SPRITE_RED, red);
+      Compose_pixels(pool, SPRITE_GREEN, green);
+      Sprite_step(pool);
+    }
+    ns_pixels = (double)(Host_test_ns() - t0) / FRAMES;
+    sink += red[1][3] + green[0][5];
+
+    if (n == 1)
+    {
+      ns_one = ns_compose;
+    }
+    printf("%-8u %16.1f %16.1f %8.1f\n", (unsigned)n, ns_compose, ns_pixels, ns_pixels / ns_compose);
+  }
+  printf("compose cost of 8 sprites is %.1f times that of 1\n", ns_compose / ns_one);
+  return Host_test_done("Sprite_compose_bench");
+}
@@ -0,0 +1,166 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Time_sync.h"
+#include "host_test.h"
+
+// Clock-skew simulation of several boards disciplined by Time_sync_beacon(). Every board has a
+// crystal error and a random phase of its 32-bit microsecond counter (one starts just before the
+// wrap). The master sends a beacon every 100 ms after a random queueing delay and reports its
+// transmission time with the next beacon; each board stamps the reception with a few
+// microseconds of interrupt latency and may miss beacons. After the lock-in the display clocks
+// are sampled at random moments between beacons against the master clock. Every board must
+// take the phase with one step and then only slew, and step once more after a master clock jump.
+
+#define BOARDS        8
+#define PERIOD_US     100000.0  // TIME_SYNC_PERIOD_MS
+#define BEACONS       6000      // 10 minutes
+#define LOCK_BEACONS  50        // Allowed for the lock-in
+#define SKEW_PPM      200.0     // Crystal error range, +-
+#define JITTER_US     5.0       // Transmission and reception stamp latency, 0..JITTER_US
+#define MAX_ERR_US    25        // Display clock error allowed after the lock-in
+#define MAX_RATE_PPM  40.0      // Frequency error allowed after the lock-in: stamp jitter alone
+                                // looks like 50 ppm over one period, a quarter goes into rate
+#define SAMPLES       4         // Checks between two beacons
+
+typedef struct
+{
+  double      skew;       // Relative frequency error
+  double      offset;     // Counter value at true time 0, us
+  double      loss;       // Probability to miss a beacon
+  T_time_sync ts;
+  uint32_t    rx_us;      // Local stamp of the last received beacon
+  uint32_t    rx_valid;   // The last beacon was received
+} T_board;
+
+static T_board  boards[BOARDS];
+static T_board  master;
+static double   max_rate;  // Largest frequency error after the lock-in, ppm
+
+static double Rnd_unit(void)
+{
+  return (double)(Host_test_rnd() >> 11) / 9007199254740992.0;
+}
+
+//------------------------------------------------------------------------------
+// Microsecond counter of a board at a true time
+//------------------------------------------------------------------------------
+static uint32_t Counter(const T_board *b, double t_us)
+{
+  return (uint32_t)(uint64_t)floor(fmod(b->offset + t_us * (1.0 + b->skew), 4294967296.0));
+}
+
+//------------------------------------------------------------------------------
+// Run the network; jump_at - beacon at which the master clock jumps by jump_us, 0 - never
+// Returns the largest display clock error after the lock-in, us
+//------------------------------------------------------------------------------
+static int32_t Run(uint32_t jump_at, double jump_us, uint32_t *steps)
+{
+  double   t = 0;
+  double   t_tx;
+  uint32_t master_tx_us = 0;
+  uint32_t k, i, s;
+  uint32_t disp;
+  int32_t  err;
+  int32_t  max_err = 0;
+  double   rate_err;
+
+  max_rate = 0;
+  for (i = 0; i < BOARDS; i++)
+  {
+    Time_sync_init(&boards[i].ts);
+    boards[i].rx_valid = 0;
+  }
+  for (k = 1; k <= BEACONS; k++)
+  {
+    if (k == jump_at)
+    {
+      master.offset += jump_us;  // Master restarted or its clock was set
+    }
+    // Transmission completes after the queue and the other frames on the bus
+    t_tx = t + Rnd_unit() * 2000.0;
+    for (i = 0; i < BOARDS; i++)
+    {
+      T_board *b = &boards[i];
+
+      // The beacon carries the transmission time of the previous one, paired with its stamp
+      if (b->rx_valid && (k > 1))
+      {
+        Time_sync_beacon(&b->ts, master_tx_us, b->rx_us);
+      }
+      b->rx_valid = Rnd_unit() >= b->loss;
+      b->rx_us    = Counter(b, t_tx + Rnd_unit() * JITTER_US);
+    }
+    master_tx_us = Counter(&master, t_tx + Rnd_unit() * JITTER_US);
+
+    // Display clocks against the master clock until the next beacon
+    for (s = 0; (k > LOCK_BEACONS) && ((k < jump_at) || (k > jump_at + LOCK_BEACONS)) && (s < SAMPLES); s++)
+    {
+      double ts = t + Rnd_unit() * PERIOD_US;
+
+      for (i = 0; i < BOARDS; i++)
+      {
+        disp = Time_sync_display_time(&boards[i].ts, Counter(&boards[i], ts));
+        err  = (int32_t)(disp - Counter(&master, ts));
+        err  = (err < 0) ? -err : err;
+        if (err > max_err)
+        {
+          max_err = err;
+        }
+        // The inverse gives back the local moment of a display time
+        CHECK(abs((int32_t)(Time_sync_local_time(&boards[i].ts, disp) - Counter(&boards[i], ts))) <= 1);
+        rate_err = (1.0 + boards[i].skew) * (1.0 + boards[i].ts.rate / 16777216.0) / (1.0 + master.skew) - 1.0;
+        CHECK(fabs(rate_err) * 1e6 <= MAX_RATE_PPM);
+        if (fabs(rate_err) * 1e6 > max_rate)
+        {
+          max_rate = fabs(rate_err) * 1e6;
+        }
+      }
+    }
+    t += PERIOD_US;
+  }
+  for (i = 0; i < BOARDS; i++)
+  {
+    steps[i] = boards[i].ts.step_cnt;
+  }
+  return max_err;
+}
+
+int main(void)
+{
+  uint32_t steps[BOARDS];
+  int32_t  max_err;
+  uint32_t i;
+
+  master.skew   = (Rnd_unit() * 2.0 - 1.0) * SKEW_PPM * 1e-6;
+  master.offset = (double)(uint32_t)Host_test_rnd();
+  for (i = 0; i < BOARDS; i++)
+  {
+    boards[i].skew   = (Rnd_unit() * 2.0 - 1.0) * SKEW_PPM * 1e-6;
+    boards[i].offset = (double)(uint32_t)Host_test_rnd();
+    boards[i].loss   = (i % 4 == 3) ? 0.1 : 0.0;  // Some boards miss every tenth beacon
+  }
+  boards[0].skew   = SKEW_PPM * 1e-6;   // Extremes of the crystal range
+  boards[1].skew   = -SKEW_PPM * 1e-6;
+  boards[2].offset = 4294967296.0 - 60e6;  // Local counter wraps a minute into the run
+
+  // Steady network: one step to take the phase, then only slewing
+  max_err = Run(0, 0, steps);
+  printf("%u boards, +-%.0f ppm: display clock error after lock-in %d us, frequency error %.1f ppm\n",
+         (unsigned)BOARDS, SKEW_PPM, (int)max_err, max_rate);
+  CHECK(max_err <= MAX_ERR_US);
+  for (i = 0; i < BOARDS; i++)
+  {
+    CHECK_EQ(steps[i], 1);
+  }
+
+  // Master clock jumps by 5 ms: every board steps once more and locks again
+  max_err = Run(BEACONS / 2, 5000.0, steps);
+  printf("after a 5 ms master jump: error %d us, frequency error %.1f ppm\n", (int)max_err, max_rate);
+  CHECK(max_err <= MAX_ERR_US);
+  for (i = 0; i < BOARDS; i++)
+  {
+    CHECK_EQ(steps[i], 2);
+  }
+  return Host_test_done("Time_sync_test");
+}
@@ -0,0 +1,82 @@
+#ifndef __HOST_TEST_H
+#define __HOST_TEST_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+// Minimal harness of the host tests: every test is one executable registered with add_test().
+// CHECK macros count failures and print the first ones, Host_test_done() prints the summary and
+// gives the exit code of main(), so ctest reports a test as failed when any check failed.
+
+#define HOST_TEST_REPORT_MAX 20  // Failed checks printed per test, the rest are only counted
+
+static uint32_t host_test_checks;
+static uint32_t host_test_failures;
+static uint64_t host_test_rnd_state = 0x9E3779B97F4A7C15ULL;
+
+//------------------------------------------------------------------------------
+// Count a check, print it while failures are few
+//------------------------------------------------------------------------------
+static inline int Host_test_check(int ok, const char *file, int line, const char *expr)
+{
+  host_test_checks++;
+  if (!ok)
+  {
+    if (host_test_failures < HOST_TEST_REPORT_MAX)
+    {
+      printf("%s:%d: check failed: %s\n", file, line, expr);
+    }
+    host_test_failures++;
+  }
+  return ok;
+}
+
+#define CHECK(cond) Host_test_check((cond) ? 1 : 0, __FILE__, __LINE__, #cond)
+
+#define CHECK_EQ(a, b)                                                                        \
+  do                                                                                          \
+  {                                                                                           \
+    long long host_a_ = (long long)(a);                                                       \
+    long long host_b_ = (long long)(b);                                                       \
+    if (!Host_test_check(host_a_ == host_b_, __FILE__, __LINE__, #a " == " #b))               \
+    {                                                                                         \
+      if (host_test_failures <= HOST_TEST_REPORT_MAX)                                         \
+      {                                                                                       \
+        printf("    %lld (0x%llx) != %lld (0x%llx)\n", host_a_, host_a_, host_b_, host_b_); \
+      }                                                                                       \
+    }                                                                                         \
+  } while (0)
+
+//------------------------------------------------------------------------------
+// Monotonic time in nanoseconds for the benchmarks
+//------------------------------------------------------------------------------
+static inline uint64_t Host_test_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+//------------------------------------------------------------------------------
+// xorshift64 shared by the tests, fixed seed so a failure is reproducible
+//------------------------------------------------------------------------------
+static inline uint64_t Host_test_rnd(void)
+{
+  host_test_rnd_state ^= host_test_rnd_state << 13;
+  host_test_rnd_state ^= host_test_rnd_state >> 7;
+  host_test_rnd_state ^= host_test_rnd_state << 17;
+  return host_test_rnd_state;
+}
+
+//------------------------------------------------------------------------------
+// Summary line and exit code of the test
+//------------------------------------------------------------------------------
+static inline int Host_test_done(const char *name)
+{
+  printf("%s: %u checks, %u failed\n", name, (unsigned)host_test_checks, (unsigned)host_test_failures);
+  return (host_test_failures == 0) ? 0 : 1;
+}
+
+#endif